@@ -88,7 +88,23 @@
           '<!(node -p "require(\'node-addon-api\').include_dir")'
         ],
         'sources': [
-          'src/unix/pty.cc'
+          'src/unix/pty.cc',
+          'src/unix/poller.cc',
+          'src/unix/hub.cc',
+          'src/unix/uring.cc',
+          'src/unix/scrollback.cc',
+          'src/unix/search.cc',
+          'src/unix/compress.cc',
+          'src/unix/budget.cc',
+          'src/unix/vt.cc',
+          'src/unix/screen.cc',
+          'src/unix/width.cc',
+          'src/unix/width_table.cc',
+          'src/unix/events.cc',
+          'src/unix/plain.cc',
+          'src/unix/lines.cc',
+          'src/unix/expect.cc',
+          'src/unix/links.cc'
         ],
         'libraries': [
           '-lutil'
@@ -0,0 +1,95 @@
+/**
+ * Compares counting the columns of text with the native kernel against a
+ * naive loop over its code points with a wcwidth in JS, as consumers do.
+ *
+ * Usage: node examples/benchmark/columns.js [file] [MB]
+ *
+ * The text is the file when given, else a mix of ASCII, CJK, combining marks
+ * and emoji. Both strings and Buffers are measured, strings are converted to
+ * UTF-8 by the native call.
+ */
+
+var fs = require('fs');
+var pty = require('../..');
+
+var FILE = process.argv[2];
+var MB = parseFloat(process.argv[3]) || 64;
+
+// The usual wcwidth port: a binary search of the combining ranges, then the
+// wide ranges.
+var COMBINING = [
+  [0x0300, 0x036F], [0x0483, 0x0489], [0x0591, 0x05BD], [0x0610, 0x061A],
+  [0x064B, 0x065F], [0x0900, 0x0903], [0x093A, 0x094F], [0x1AB0, 0x1AFF],
+  [0x1DC0, 0x1DFF], [0x200B, 0x200F], [0x20D0, 0x20FF], [0xFE00, 0xFE0F],
+  [0xFE20, 0xFE2F], [0xE0100, 0xE01EF]
+];
+
+function combining(c) {
+  var lo = 0;
+  var hi = COMBINING.length - 1;
+  while (lo <= hi) {
+    var mid = (lo + hi) >> 1;
+    if (c > COMBINING[mid][1]) {
+      lo = mid + 1;
+    } else if (c < COMBINING[mid][0]) {
+      hi = mid - 1;
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+function wcwidth(c) {
+  if (c < 32 || (c >= 0x7F && c < 0xA0)) {
+    return 0;
+  }
+  if (combining(c)) {
+    return 0;
+  }
+  return c >= 0x1100 &&
+    (c <= 0x115F || (c >= 0x2E80 && c <= 0xA4CF && c !== 0x303F) ||
+     (c >= 0xAC00 && c <= 0xD7A3) || (c >= 0xF900 && c <= 0xFAFF) ||
+     (c >= 0xFE30 && c <= 0xFE6F) || (c >= 0xFF00 && c <= 0xFF60) ||
+     (c >= 0xFFE0 && c <= 0xFFE6) || (c >= 0x1F300 && c <= 0x1F64F) ||
+     (c >= 0x1F900 && c <= 0x1F9FF) || (c >= 0x20000 && c <= 0x3FFFD)) ? 2 : 1;
+}
+
+function naive(text) {
+  var columns = 0;
+  for (var i = 0; i < text.length; i++) {
+    var c = text.charCodeAt(i);
+    if (c >= 0xD800 && c <= 0xDBFF && i + 1 < text.length) {
+      c = (c - 0xD800) * 0x400 + text.charCodeAt(++i) - 0xDC00 + 0x10000;
+    }
+    columns += wcwidth(c);
+  }
+  return columns;
+}
+
+function measure(name, fn, data, bytes) {
+  var rounds = Math.max(1, Math.ceil(MB * 1024 * 1024 / bytes));
+  var columns = 0;
+  var start = process.hrtime();
+  for (var i = 0; i < rounds; i++) {
+    columns = fn(data);
+  }
+  var elapsed = process.hrtime(start);
+  var seconds = elapsed[0] + elapsed[1] / 1e9;
+  console.log(name + ': ' + (rounds * bytes / 1024 / 1024 / seconds).toFixed(1) + ' MB/s (' + columns + ' columns)');
+}
+
+var text;
+if (FILE) {
+  text = fs.readFileSync(FILE, 'utf8');
+} else {
+  var sample = 'plain ASCII output of a build log, line 42: ok\n' +
+    '中文输出和日本語のテキスト\n' + 'combining é ä and emoji 😀 🚀 ✅\n';
+  text = new Array(1000).join(sample);
+}
+var buffer = Buffer.from(text, 'utf8');
+
+console.log('Unicode ' + pty.unicodeVersion + ', ' + (buffer.length / 1024).toFixed(0) + ' KB of text');
+measure('naive JS loop', naive, text, buffer.length);
+measure('native, string', pty.columns, text, buffer.length);
+measure('native, Buffer', pty.columns, buffer, buffer.length);
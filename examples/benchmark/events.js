@@ -0,0 +1,69 @@
+/**
+ * Compares picking titles and bells out of terminal output with the native
+ * scanner against the regular expressions consumers run over onData.
+ *
+ * Usage: node examples/benchmark/events.js [recording] [MB]
+ *
+ * The recording defaults to plain text with a title set now and then, see
+ * screen.js for recording a session. It is scanned in 4KB chunks.
+ */
+
+var fs = require('fs');
+var native = require('../../lib/unixTerminal').pty;
+
+var FILE = process.argv[2];
+var MB = parseFloat(process.argv[3]) || 256;
+var CHUNK = 4096;
+
+var TITLE = /\x1b\][02];([^\x07\x1b]*)(?:\x07|\x1b\\)/g;
+var BEL = /\x07/g;
+
+function regex(chunk) {
+  var events = 0;
+  var text = chunk.toString('utf8');
+  TITLE.lastIndex = 0;
+  while (TITLE.exec(text)) {
+    events++;
+  }
+  // bells that do not end a title
+  var bells = text.replace(TITLE, '').match(BEL);
+  return events + (bells ? bells.length : 0);
+}
+
+function scanner() {
+  var s = new native.EventScanner();
+  return function (chunk) { return s.scan(chunk).length; };
+}
+
+function measure(name, fn, chunks, bytes) {
+  var rounds = Math.max(1, Math.ceil(MB * 1024 * 1024 / bytes));
+  var events = 0;
+  var start = process.hrtime();
+  for (var r = 0; r < rounds; r++) {
+    for (var i = 0; i < chunks.length; i++) {
+      events += fn(chunks[i]);
+    }
+  }
+  var elapsed = process.hrtime(start);
+  var seconds = elapsed[0] + elapsed[1] / 1e9;
+  console.log(name + ': ' + (rounds * bytes / 1024 / 1024 / seconds).toFixed(1) + ' MB/s (' + events / rounds + ' events per round)');
+}
+
+var data;
+if (FILE) {
+  data = fs.readFileSync(FILE);
+} else {
+  var lines = [];
+  for (var i = 0; i < 20000; i++) {
+    lines.push(i % 1000 === 0 ? '\x1b]0;build step ' + i + '\x07' : 'compiling src/module' + i + '.cc ... ok');
+  }
+  data = Buffer.from(lines.join('\r\n'));
+}
+var chunks = [];
+for (var j = 0; j < data.length; j += CHUNK) {
+  chunks.push(data.slice(j, j + CHUNK));
+}
+
+console.log((data.length / 1024).toFixed(0) + ' KB of output in ' + chunks.length + ' chunks');
+measure('regex over strings', regex, chunks, data.length);
+measure('native scanner', scanner(), chunks, data.length);
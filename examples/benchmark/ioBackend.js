@@ -0,0 +1,96 @@
+/**
+ * Compares reading pty output through a socket per terminal with the pty hub
+ * backends: system calls per MB and CPU time per session.
+ *
+ * Usage: node examples/benchmark/ioBackend.js [sessions] [MB per session]
+ *
+ * System calls of the socket path are the read(2)/write(2) calls counted in
+ * /proc/self/io (Linux only), which leaves out the epoll_wait(2) calls of
+ * libuv, so its figure is a lower bound. The hub counts its own calls.
+ */
+
+var fs = require('fs');
+var pty = require('../..');
+
+var SESSIONS = parseInt(process.argv[2], 10) || 50;
+var MB = parseFloat(process.argv[3]) || 4;
+var BYTES = Math.floor(MB * 1024 * 1024);
+
+var COMMAND = ['-c', 'head -c ' + BYTES + ' /dev/zero | tr "\\0" x'];
+var OPTIONS = { encoding: null, termios: 'raw', cols: 80, rows: 24 };
+
+function procSyscalls() {
+  try {
+    var io = fs.readFileSync('/proc/self/io', 'utf8');
+    return parseInt(/syscr: (\d+)/.exec(io)[1], 10) + parseInt(/syscw: (\d+)/.exec(io)[1], 10);
+  } catch (e) {
+    return NaN;
+  }
+}
+
+function run(name, spawn, done) {
+  var received = 0;
+  var exited = 0;
+  var start = Date.now();
+  var cpu = process.cpuUsage();
+  var syscalls = procSyscalls();
+
+  for (var i = 0; i < SESSIONS; i++) {
+    var term = spawn();
+    term.onData(function (data) { received += data.length; });
+    term.onExit(function () {
+      if (++exited < SESSIONS) {
+        return;
+      }
+      var elapsed = (Date.now() - start) / 1000;
+      var used = process.cpuUsage(cpu);
+      done({
+        name: name,
+        mb: received / 1024 / 1024,
+        seconds: elapsed,
+        cpuMsPerSession: (used.user + used.system) / 1000 / SESSIONS,
+        procSyscalls: procSyscalls() - syscalls
+      });
+    });
+  }
+}
+
+function report(result, hubSyscalls) {
+  var line = result.name + ': ' + result.mb.toFixed(1) + ' MB in ' + result.seconds.toFixed(2) + 's (' +
+    (result.mb / result.seconds).toFixed(1) + ' MB/s), ' +
+    result.cpuMsPerSession.toFixed(2) + ' ms CPU/session, ' +
+    (result.procSyscalls / result.mb).toFixed(0) + ' read/write syscalls/MB';
+  if (hubSyscalls !== undefined) {
+    line += ', ' + (hubSyscalls / result.mb).toFixed(0) + ' hub syscalls/MB';
+  }
+  console.log(line);
+}
+
+var backends = ['poll', 'io_uring'];
+
+function next() {
+  var backend = backends.shift();
+  if (!backend) {
+    process.exit(0);
+  }
+  var hub = pty.createPtyHub({ backend: backend });
+  var label = 'hub (' + hub.stats.backend + ')';
+  if (backend === 'io_uring' && hub.stats.backend !== 'io_uring') {
+    console.log('hub (io_uring): unavailable, fell back to ' + hub.stats.backend);
+    hub.close();
+    next();
+    return;
+  }
+  var before = hub.stats.syscalls;
+  run(label, function () { return hub.spawn('/bin/sh', COMMAND, OPTIONS); }, function (result) {
+    report(result, hub.stats.syscalls - before);
+    hub.close();
+    next();
+  });
+}
+
+console.log(SESSIONS + ' sessions, ' + MB + ' MB each');
+run('socket', function () { return pty.spawn('/bin/sh', COMMAND, OPTIONS); }, function (result) {
+  report(result);
+  next();
+});
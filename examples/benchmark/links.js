@@ -0,0 +1,70 @@
+/**
+ * Compares finding URLs and file paths in terminal output natively against
+ * the regular expression pass UIs run over each chunk of onData.
+ *
+ * Usage: node examples/benchmark/links.js [recording] [MB]
+ *
+ * Without a recording, colored compiler output with locations and URLs is
+ * generated, see screen.js for recording a session. It is scanned in 4KB
+ * chunks. The regular expression misses links split across chunks or
+ * colored within, the native detector does not.
+ */
+
+var fs = require('fs');
+var native = require('../../lib/unixTerminal').pty;
+
+var FILE = process.argv[2];
+var MB = parseFloat(process.argv[3]) || 256;
+var CHUNK = 4096;
+
+var LINK = /[a-zA-Z][\w+.-]+:\/\/[^\s<>"{}|\\^`]+|(?:[\w.~-]*\/)*[\w.-]+\.\w+(?::\d+(?::\d+)?)?/g;
+
+function regex(chunk) {
+  var text = chunk.toString('utf8');
+  var found = 0;
+  LINK.lastIndex = 0;
+  while (LINK.exec(text)) {
+    found++;
+  }
+  return found;
+}
+
+function detector() {
+  // urls and paths
+  var links = new native.LinkDetector(3, 0);
+  return function (chunk) { return links.write(chunk); };
+}
+
+function measure(name, fn, chunks, bytes) {
+  var rounds = Math.max(1, Math.ceil(MB * 1024 * 1024 / bytes));
+  var start = process.hrtime();
+  for (var r = 0; r < rounds; r++) {
+    for (var i = 0; i < chunks.length; i++) {
+      fn(chunks[i]);
+    }
+  }
+  var elapsed = process.hrtime(start);
+  var seconds = elapsed[0] + elapsed[1] / 1e9;
+  console.log(name + ': ' + (rounds * bytes / 1024 / 1024 / seconds).toFixed(1) + ' MB/s');
+}
+
+var data;
+if (FILE) {
+  data = fs.readFileSync(FILE);
+} else {
+  var lines = [];
+  for (var i = 0; i < 20000; i++) {
+    lines.push(i % 50 === 0 ?
+      '\x1b[1msrc/module' + i + '.cc:' + (i % 300) + ':7:\x1b[0m \x1b[31merror:\x1b[0m see https://example.com/errors/' + i + '\r\n' :
+      '\x1b[32m✔\x1b[0m compiled module ' + i + ' in ' + (i % 97) + 'ms, 0 warnings\r\n');
+  }
+  data = Buffer.from(lines.join(''));
+}
+var chunks = [];
+for (var j = 0; j < data.length; j += CHUNK) {
+  chunks.push(data.slice(j, j + CHUNK));
+}
+
+console.log((data.length / 1024).toFixed(0) + ' KB of output in ' + chunks.length + ' chunks');
+measure('regex over strings', regex, chunks, data.length);
+measure('native detector', detector(), chunks, data.length);
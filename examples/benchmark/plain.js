@@ -0,0 +1,64 @@
+/**
+ * Compares stripping terminal output to plain text natively against the
+ * regular expressions consumers run over onData.
+ *
+ * Usage: node examples/benchmark/plain.js [recording] [MB]
+ *
+ * Without a recording, colored build output with a progress line is
+ * generated, see screen.js for recording a session. It is stripped in 4KB
+ * chunks. The regular expressions do not handle sequences split across
+ * chunks nor overwrites, the native stripper does.
+ */
+
+var fs = require('fs');
+var native = require('../../lib/unixTerminal').pty;
+
+var FILE = process.argv[2];
+var MB = parseFloat(process.argv[3]) || 256;
+var CHUNK = 4096;
+
+// as in the strip-ansi package
+var ANSI = /[\u001B\u009B][[\]()#;?]*(?:(?:(?:[a-zA-Z\d]*(?:;[-a-zA-Z\d\/#&.:=?%@~_]*)*)?\u0007)|(?:(?:\d{1,4}(?:;\d{0,4})*)?[\dA-PR-TZcf-ntqry=><~]))/g;
+
+function regex(chunk) {
+  return chunk.toString('utf8').replace(ANSI, '').length;
+}
+
+function stripper() {
+  var plainText = new native.PlainText();
+  return function (chunk) { return plainText.write(chunk).length; };
+}
+
+function measure(name, fn, chunks, bytes) {
+  var rounds = Math.max(1, Math.ceil(MB * 1024 * 1024 / bytes));
+  var start = process.hrtime();
+  for (var r = 0; r < rounds; r++) {
+    for (var i = 0; i < chunks.length; i++) {
+      fn(chunks[i]);
+    }
+  }
+  var elapsed = process.hrtime(start);
+  var seconds = elapsed[0] + elapsed[1] / 1e9;
+  console.log(name + ': ' + (rounds * bytes / 1024 / 1024 / seconds).toFixed(1) + ' MB/s');
+}
+
+var data;
+if (FILE) {
+  data = fs.readFileSync(FILE);
+} else {
+  var lines = [];
+  for (var i = 0; i < 20000; i++) {
+    lines.push(i % 100 === 0 ?
+      '\r\x1b[K\x1b[36mprogress\x1b[0m [' + new Array(i % 40 + 1).join('=') + '>] ' + i :
+      '\x1b[32m✔\x1b[0m compiled \x1b[1msrc/module' + i + '.cc\x1b[0m in ' + (i % 97) + 'ms\r\n');
+  }
+  data = Buffer.from(lines.join(''));
+}
+var chunks = [];
+for (var j = 0; j < data.length; j += CHUNK) {
+  chunks.push(data.slice(j, j + CHUNK));
+}
+
+console.log((data.length / 1024).toFixed(0) + ' KB of output in ' + chunks.length + ' chunks');
+measure('regex over strings', regex, chunks, data.length);
+measure('native stripper', stripper(), chunks, data.length);
@@ -0,0 +1,74 @@
+/**
+ * Measures how fast the native screen model parses real terminal output.
+ *
+ * Usage: node examples/benchmark/screen.js [recording] [MB]
+ *
+ * Without a recording, the output of a few colored commands is recorded
+ * through a pty first. A session recorded with script(1) can be passed
+ * instead, e.g. `script -q -c vim session.txt`. The recording is replayed in
+ * 4KB chunks, as the hub reads it, until MB megabytes were parsed, with and
+ * without scrollback.
+ */
+
+var fs = require('fs');
+var pty = require('../..');
+var Screen = require('../../lib/screen').Screen;
+
+var FILE = process.argv[2];
+var MB = parseFloat(process.argv[3]) || 256;
+var COLS = 120;
+var ROWS = 40;
+var CHUNK = 4096;
+
+var COMMANDS = [
+  'ls -la --color=always /usr/bin /usr/lib',
+  'git --no-pager log --color=always --stat -n 500',
+  'git --no-pager log --color=always -p -n 50',
+  'grep -rn --color=always include src'
+];
+
+function record(done) {
+  var chunks = [];
+  var term = pty.spawn('/bin/sh', ['-c', COMMANDS.join('; ')], {
+    encoding: null, cols: COLS, rows: ROWS, cwd: __dirname + '/../..', env: { TERM: 'xterm-256color', PATH: process.env.PATH }
+  });
+  term.onData(function (data) { chunks.push(data); });
+  term.onExit(function () { done(Buffer.concat(chunks)); });
+}
+
+function replay(data, scrollback) {
+  var screen = new Screen(COLS, ROWS, { scrollback: scrollback });
+  var chunks = [];
+  for (var i = 0; i < data.length; i += CHUNK) {
+    chunks.push(data.slice(i, i + CHUNK));
+  }
+  var rounds = Math.max(1, Math.ceil(MB * 1024 * 1024 / data.length));
+  var cpu = process.cpuUsage();
+  var start = process.hrtime();
+  for (var r = 0; r < rounds; r++) {
+    for (var j = 0; j < chunks.length; j++) {
+      screen.native.write(chunks[j]);
+    }
+  }
+  var elapsed = process.hrtime(start);
+  var used = process.cpuUsage(cpu);
+  var mb = rounds * data.length / 1024 / 1024;
+  var seconds = elapsed[0] + elapsed[1] / 1e9;
+  var cpuSeconds = (used.user + used.system) / 1e6;
+  console.log('scrollback ' + scrollback + ': ' + mb.toFixed(1) + ' MB in ' + seconds.toFixed(2) + 's (' +
+    (mb / seconds).toFixed(1) + ' MB/s, ' + (mb / cpuSeconds).toFixed(1) + ' MB/s of CPU)');
+}
+
+function run(data) {
+  console.log('recording of ' + (data.length / 1024).toFixed(0) + ' KB at ' + COLS + 'x' + ROWS);
+  replay(data, 0);
+  replay(data, 1000);
+  replay(data, 10000);
+  process.exit(0);
+}
+
+if (FILE) {
+  run(fs.readFileSync(FILE));
+} else {
+  record(run);
+}
@@ -0,0 +1,71 @@
+/**
+ * Compares searching the scrollback through its trigram index against
+ * reading the output back and searching it in JS.
+ *
+ * Usage: node examples/benchmark/search.js [MB]
+ *
+ * Generated build output is appended to a scrollback which holds 64MB in
+ * memory and spills the rest to the temporary directory. A line with a rare
+ * needle sits in the middle.
+ */
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var native = require('../../lib/unixTerminal').pty;
+
+var MB = parseFloat(process.argv[2]) || 256;
+var ROUNDS = 10;
+
+var words = ['compiling', 'src/module', '.cc', 'warning:', '\x1b[32mok\x1b[0m', 'test', 'passed', 'in', 'ms', 'linking'];
+var directory = fs.mkdtempSync(path.join(os.tmpdir(), 'node-pty-search-'));
+var scrollback = new native.Scrollback({ limit: 64 * 1024 * 1024, compress: true, directory: directory });
+
+var written = 0;
+var seed = 1;
+function random(n) {
+  seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+  return seed % n;
+}
+while (written < MB * 1024 * 1024) {
+  var lines = [];
+  for (var i = 0; i < 1000; i++) {
+    var line = [];
+    for (var j = 4 + random(8); j > 0; j--) {
+      line.push(words[random(words.length)] + random(1000));
+    }
+    lines.push(line.join(' '));
+  }
+  if (written < MB * 512 * 1024 && written + 80000 >= MB * 512 * 1024) {
+    lines.push('needle-in-haystack 0xdeadbeef');
+  }
+  var chunk = Buffer.from(lines.join('\r\n') + '\r\n');
+  scrollback.write(chunk);
+  written += chunk.length;
+}
+
+function measure(name, fn) {
+  var start = process.hrtime();
+  var found;
+  for (var r = 0; r < ROUNDS; r++) {
+    found = fn();
+  }
+  var elapsed = process.hrtime(start);
+  console.log(name + ': ' + ((elapsed[0] * 1e3 + elapsed[1] / 1e6) / ROUNDS).toFixed(3) + ' ms, ' + found + ' found');
+}
+
+// segments are indexed in the background
+setTimeout(function () {
+  var stats = scrollback.stats();
+  console.log((written / 1024 / 1024).toFixed(0) + ' MB of output, ' + (stats.memory / 1024 / 1024).toFixed(1) + ' MB in memory, ' +
+    (stats.disk / 1024 / 1024).toFixed(1) + ' MB spilled, ' + (stats.index / 1024 / 1024).toFixed(1) + ' MB of index');
+  measure('indexed literal', function () { return scrollback.search('needle-in-haystack', false, false, 1000).length; });
+  measure('indexed literal ignoring case', function () { return scrollback.search('NEEDLE-IN', false, true, 1000).length; });
+  measure('indexed regex', function () { return scrollback.search('needle-[\\w-]+ 0x[0-9a-f]+', true, false, 1000).length; });
+  measure('read back and indexOf', function () {
+    var text = scrollback.read(0).data.toString('latin1');
+    return text.indexOf('needle-in-haystack') === -1 ? 0 : 1;
+  });
+  scrollback.destroy();
+  fs.rmdirSync(directory);
+}, 2000);
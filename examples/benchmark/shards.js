@@ -0,0 +1,60 @@
+/**
+ * Measures the aggregate throughput of the pty hub against its number of I/O
+ * threads (shards).
+ *
+ * Usage: node examples/benchmark/shards.js [sessions] [MB per session] [backend]
+ */
+
+var os = require('os');
+var pty = require('../..');
+
+var SESSIONS = parseInt(process.argv[2], 10) || 64;
+var MB = parseFloat(process.argv[3]) || 8;
+var BACKEND = process.argv[4] || 'poll';
+var BYTES = Math.floor(MB * 1024 * 1024);
+
+var COMMAND = ['-c', 'head -c ' + BYTES + ' /dev/zero | tr "\\0" x'];
+var OPTIONS = { termios: 'raw', cols: 80, rows: 24 };
+
+var counts = [1];
+for (var n = 2; n <= os.cpus().length; n *= 2) {
+  counts.push(n);
+}
+
+function run(threads, done) {
+  var hub = pty.createPtyHub({ backend: BACKEND, threads: threads });
+  var received = 0;
+  var exited = 0;
+  var start = Date.now();
+  var cpu = process.cpuUsage();
+
+  for (var i = 0; i < SESSIONS; i++) {
+    var term = hub.spawn('/bin/sh', COMMAND, OPTIONS);
+    // strings, so that decoding on the JS thread is part of the measure
+    term.onData(function (data) { received += data.length; });
+    term.onExit(function () {
+      if (++exited < SESSIONS) {
+        return;
+      }
+      var seconds = (Date.now() - start) / 1000;
+      var used = process.cpuUsage(cpu);
+      var mb = received / 1024 / 1024;
+      console.log(threads + ' shard(s), ' + hub.stats.backend + ': ' + (mb / seconds).toFixed(1) + ' MB/s, ' +
+        ((used.user + used.system) / 1000 / seconds / 10).toFixed(0) + '% CPU, ' +
+        hub.stats.batches + ' batches');
+      hub.close();
+      done();
+    });
+  }
+}
+
+function next() {
+  var threads = counts.shift();
+  if (threads === undefined) {
+    process.exit(0);
+  }
+  run(threads, next);
+}
+
+console.log(SESSIONS + ' sessions, ' + MB + ' MB each, ' + os.cpus().length + ' cpus');
+next();
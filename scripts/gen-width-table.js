@@ -0,0 +1,155 @@
+'use strict'
+
+// Generates src/unix/width_table.cc, the columns of every code point for the
+// pinned Unicode version, from the Unicode character database:
+//   0 for combining and enclosing marks, format characters, controls and
+//     the medial and final Hangul jamo,
+//   2 for East Asian Wide and Fullwidth characters and emoji presented as
+//     such (Emoji_Presentation),
+//   1 for everything else, East Asian Ambiguous characters included.
+//
+// Usage: node scripts/gen-width-table.js [ucd directory]
+//
+// Without a directory the files are downloaded from unicode.org. Bump
+// UNICODE_VERSION and rerun to update the table.
+
+const fs = require('fs');
+const https = require('https');
+const path = require('path');
+
+const UNICODE_VERSION = '15.1.0';
+const FILES = {
+  eaw: 'EastAsianWidth.txt',
+  category: 'extracted/DerivedGeneralCategory.txt',
+  emoji: 'emoji/emoji-data.txt'
+};
+const OUTPUT = path.join(__dirname, '..', 'src', 'unix', 'width_table.cc');
+const MAX = 0x110000;
+const BLOCK = 256;
+
+function fetch(file) {
+  const url = `https://www.unicode.org/Public/${UNICODE_VERSION}/ucd/${file}`;
+  return new Promise((resolve, reject) => {
+    https.get(url, res => {
+      if (res.statusCode !== 200) {
+        reject(new Error(`${url}: ${res.statusCode}`));
+        return;
+      }
+      let data = '';
+      res.setEncoding('utf8');
+      res.on('data', chunk => data += chunk);
+      res.on('end', () => resolve(data));
+    }).on('error', reject);
+  });
+}
+
+function read(dir, file) {
+  return dir ? Promise.resolve(fs.readFileSync(path.join(dir, file), 'utf8')) : fetch(file);
+}
+
+// Calls fn(first, last, value) for every "XXXX..YYYY ; value" line, and for
+// the "# @missing:" defaults when missing is set.
+function parse(text, fn, missing) {
+  const re = /^([0-9A-F]+)(?:\.\.([0-9A-F]+))?\s*;\s*([\w]+)/;
+  for (let line of text.split('\n')) {
+    if (line.startsWith('# @missing:')) {
+      if (!missing) {
+        continue;
+      }
+      line = line.slice('# @missing:'.length).trim();
+    }
+    const match = re.exec(line);
+    if (match) {
+      const first = parseInt(match[1], 16);
+      fn(first, match[2] ? parseInt(match[2], 16) : first, match[3]);
+    }
+  }
+}
+
+function hex(bytes, indent) {
+  const lines = [];
+  for (let i = 0; i < bytes.length; i += 16) {
+    lines.push(indent + Array.from(bytes.slice(i, i + 16), b => `0x${b.toString(16).padStart(2, '0')}`).join(', '));
+  }
+  return lines.join(',\n');
+}
+
+async function main() {
+  const dir = process.argv[2];
+  const eaw = await read(dir, FILES.eaw);
+  const category = await read(dir, FILES.category);
+  const emoji = await read(dir, FILES.emoji);
+
+  const widths = new Uint8Array(MAX).fill(1);
+  // @missing defaults first, the listed code points override them
+  parse(eaw, (first, last, value) => {
+    widths.fill(value === 'W' || value === 'F' ? 2 : 1, first, last + 1);
+  }, true);
+  parse(emoji, (first, last, value) => {
+    if (value === 'Emoji_Presentation') {
+      widths.fill(2, first, last + 1);
+    }
+  }, false);
+  parse(category, (first, last, value) => {
+    if (value === 'Mn' || value === 'Me' || value === 'Cf' || value === 'Cc') {
+      widths.fill(0, first, last + 1);
+    }
+  }, false);
+  // the soft hyphen is shown, the jamo join the syllable before them
+  widths[0xAD] = 1;
+  widths.fill(0, 0x1160, 0x1200);
+  widths.fill(0, 0xD7B0, 0xD800);
+
+  // stage 1 maps the high bits of a code point to a block of stage 2, which
+  // holds 4 widths of 2 bits per byte
+  const stage1 = new Uint8Array(MAX / BLOCK);
+  const blocks = [];
+  const index = new Map();
+  for (let b = 0; b < MAX / BLOCK; b++) {
+    const packed = new Uint8Array(BLOCK / 4);
+    for (let i = 0; i < BLOCK; i++) {
+      packed[i >> 2] |= widths[b * BLOCK + i] << ((i & 3) * 2);
+    }
+    const key = packed.join(',');
+    if (!index.has(key)) {
+      index.set(key, blocks.length);
+      blocks.push(packed);
+    }
+    stage1[b] = index.get(key);
+  }
+  if (blocks.length > 256) {
+    throw new Error(`${blocks.length} blocks do not fit stage 1`);
+  }
+
+  const out = `/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * width_table.cc:
+ *   Generated by scripts/gen-width-table.js from the Unicode ${UNICODE_VERSION}
+ *   character database, do not edit.
+ */
+
+#include "width.h"
+
+namespace width {
+
+const uint32_t kUnicodeVersion[3] = { ${UNICODE_VERSION.split('.').join(', ')} };
+
+const uint8_t kStage1[${stage1.length}] = {
+${hex(stage1, '  ')}
+};
+
+const uint8_t kStage2[${blocks.length}][${BLOCK / 4}] = {
+${blocks.map(block => `  {\n${hex(block, '    ')}\n  }`).join(',\n')}
+};
+
+}  // namespace width
+`;
+  fs.writeFileSync(OUTPUT, out);
+  console.log(`${OUTPUT}: ${blocks.length} blocks, ${stage1.length + blocks.length * BLOCK / 4} bytes`);
+}
+
+main().catch(err => {
+  console.error(err);
+  process.exit(1);
+});
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+
+if (process.platform !== 'win32') {
+  // required lazily, the native matcher is not built on Windows
+  const ExpectMatcher = require('./expectMatcher').ExpectMatcher;
+  const UnixTerminal = require('./unixTerminal').UnixTerminal;
+
+  describe('ExpectMatcher', () => {
+    it('should match the pattern that ends first across writes', async () => {
+      const matcher = new ExpectMatcher(0);
+      const matched = matcher.expect(['Password:', 'login:', { literal: 'Downloaded ', regex: /\d+ files/ }]);
+      matcher.write('Downloaded 12 fi');
+      matcher.write('les\r\nhost log');
+      matcher.write('in: ');
+      assert.deepEqual(await matched, { index: 2, text: 'Downloaded 12 files', start: 0, end: 19 });
+      // the output after the match is kept for the next call
+      assert.deepEqual(await matcher.expect(['password:', 'LOGIN:'], { caseInsensitive: true }), { index: 1, text: 'login:', start: 26, end: 32 });
+    });
+
+    it('should reject when nothing matched in time or the terminal closed', async () => {
+      const matcher = new ExpectMatcher(0);
+      const errors: string[] = [];
+      await matcher.expect(['never'], { timeout: 20 }).catch((e: Error) => errors.push(e.message));
+      await matcher.expect([{ literal: 'x', regex: new RegExp('x', 'm') }]).catch((e: Error) => errors.push(e.message));
+      const matched = matcher.expect(['never']);
+      matcher.close();
+      await matched.catch((e: Error) => errors.push(e.message));
+      assert.deepEqual(errors, [
+        'No pattern matched within 20 ms',
+        'the regex of pattern 0 may only have the i flag',
+        'The terminal closed before a pattern matched'
+      ]);
+    });
+
+    it('should only take regexes that run in linear time', async () => {
+      const matcher = new ExpectMatcher(0);
+      const error = await matcher.expect([{ literal: 'x', regex: /(a)\1/ }]).catch((e: Error) => e.message);
+      assert.equal(error, 'Invalid regex of pattern 0: backreferences are not supported');
+      // would backtrack for ages
+      const matched = matcher.expect([{ literal: 'x', regex: /(a+)+b/ }, 'done']);
+      matcher.write('x' + 'a'.repeat(1000) + 'done');
+      assert.equal((await matched).index, 1);
+    });
+
+    it('should automate an interactive program', async () => {
+      const term = new UnixTerminal('/bin/sh', ['-c', 'printf "login: "; read name; echo "hello $name"; sleep 1']);
+      const login = await term.expect(['Password:', 'login: '], { timeout: 5000 });
+      assert.equal(login.index, 1);
+      term.write('bob\n');
+      const hello = await term.expect([{ literal: 'hello ', regex: /\w+\r\n/ }], { timeout: 5000 });
+      assert.equal(hello.text, 'hello bob\r\n');
+      term.kill();
+    });
+  });
+}
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { ExpectPattern, IExpectOptions, IExpectMatch } from './interfaces';
+
+interface IWaiting {
+  token: number;
+  resolve: (match: IExpectMatch) => void;
+  reject: (err: Error) => void;
+  timer: NodeJS.Timer | null;
+}
+
+function toNative(pattern: ExpectPattern, i: number): { literal: string, regex?: string, ignoreCase?: boolean } {
+  if (typeof pattern === 'string') {
+    return { literal: pattern };
+  }
+  if (!pattern || typeof pattern.literal !== 'string') {
+    throw new Error(`pattern ${i} must be a string or have a literal`);
+  }
+  if (pattern.regex === undefined) {
+    return { literal: pattern.literal };
+  }
+  if (!(pattern.regex instanceof RegExp)) {
+    throw new Error(`the regex of pattern ${i} must be a RegExp`);
+  }
+  // matched natively in ECMAScript syntax, without these
+  if (pattern.regex.multiline || (pattern.regex as any).dotAll || (pattern.regex as any).unicode) {
+    throw new Error(`the regex of pattern ${i} may only have the i flag`);
+  }
+  return { literal: pattern.literal, regex: pattern.regex.source, ignoreCase: pattern.regex.ignoreCase };
+}
+
+function toMatch(match: IUnixExpectMatch): IExpectMatch {
+  return { index: match.index, text: match.text, start: match.start, end: match.end };
+}
+
+/**
+ * Waits for one of many patterns in the output of a terminal. The literals
+ * of the patterns are found natively by an Aho-Corasick automaton as the
+ * output is read, across reads, and a pattern may go on with a regex matched
+ * right after its literal. The output since the last match is kept (a few
+ * KB), so text that arrived before expect() was called still matches.
+ */
+export class ExpectMatcher {
+  public readonly native: IUnixExpectMatcher;
+  private _waiting: IWaiting | null = null;
+  private _closed: boolean = false;
+
+  constructor(offset: number) {
+    // required lazily, unixTerminal uses this module
+    const pty: IUnixNative = require('./unixTerminal').pty;
+    this.native = new pty.ExpectMatcher(offset);
+  }
+
+  public expect(patterns: ExpectPattern[], opt?: IExpectOptions): Promise<IExpectMatch> {
+    const timeout = opt && opt.timeout;
+    let armed: { token: number, match: IUnixExpectMatch | null };
+    try {
+      if (!Array.isArray(patterns) || patterns.length === 0) {
+        throw new Error('patterns must be a non-empty array');
+      }
+      if (timeout !== undefined && (typeof timeout !== 'number' || !(timeout > 0))) {
+        throw new Error('timeout must be a positive number of milliseconds');
+      }
+      if (this._closed) {
+        throw new Error('The terminal is closed');
+      }
+      if (this._waiting) {
+        throw new Error('expect is already waiting for a match');
+      }
+      armed = this.native.arm(patterns.map(toNative), !!(opt && opt.caseInsensitive));
+    } catch (e) {
+      return Promise.reject(e);
+    }
+    if (armed.match) {
+      return Promise.resolve(toMatch(armed.match));
+    }
+    return new Promise<IExpectMatch>((resolve, reject) => {
+      const waiting: IWaiting = this._waiting = { token: armed.token, resolve, reject, timer: null };
+      if (timeout !== undefined) {
+        waiting.timer = setTimeout(() => {
+          this.native.cancel(waiting.token);
+          this._waiting = null;
+          reject(new Error(`No pattern matched within ${timeout} ms`));
+        }, timeout);
+      }
+    });
+  }
+
+  public write(data: string | Buffer): void {
+    this.deliver(this.native.write(data));
+  }
+
+  /**
+   * Resolves the expectation a native match ends, the hub matches as it
+   * reads.
+   */
+  public deliver(match: IUnixExpectMatch | null): void {
+    const waiting = this._waiting;
+    // a match of an expectation that timed out is dropped
+    if (!match || !waiting || match.token !== waiting.token) {
+      return;
+    }
+    this._waiting = null;
+    if (waiting.timer) {
+      clearTimeout(waiting.timer);
+    }
+    waiting.resolve(toMatch(match));
+  }
+
+  /**
+   * Rejects the expectation waiting, no more output comes.
+   */
+  public close(): void {
+    this._closed = true;
+    const waiting = this._waiting;
+    if (waiting) {
+      this._waiting = null;
+      if (waiting.timer) {
+        clearTimeout(waiting.timer);
+      }
+      waiting.reject(new Error('The terminal closed before a pattern matched'));
+    }
+  }
+}
@@ -4,8 +4,10 @@
  * Copyright (c) 2018, Microsoft Corporation (MIT License).
  */
 
-import { ITerminal, IPtyOpenOptions, IPtyForkOptions, IWindowsPtyForkOptions } from './interfaces';
+import { ITerminal, IPtyOpenOptions, IPtyForkOptions, IWindowsPtyForkOptions, IPtyPoolOptions, IPtyPoolStats, IShellPoolOptions, IPtyHubOptions, IMemoryBudgetOptions, IMemoryBudgetStats, IScreenSnapshot } from './interfaces';
 import { ArgvOrCommandLine } from './types';
+import { ShellPool } from './shellPool';
+import { PtyHub } from './ptyHub';
 
 let terminalCtor: any;
 if (process.platform === 'win32') {
@@ -21,7 +23,9 @@ if (process.platform === 'win32') {
  * CommandLine format (string). Note that the CommandLine option is only
  * available on Windows and is expected to be escaped properly.
  * @param options The options of the terminal.
- * @throws When the file passed to spawn with does not exists.
+ * @throws When the file passed to spawn with does not exists. On Unix the error
+ * carries `code`, `errno` and `syscall` (`chdir`, `setgid`, `setuid` or `execvp`)
+ * of the setup stage that failed in the child.
  * @see CommandLineToArgvW https://msdn.microsoft.com/en-us/library/windows/desktop/bb776391(v=vs.85).aspx
  * @see Parsing C++ Comamnd-Line Arguments https://msdn.microsoft.com/en-us/library/17w5ykft.aspx
  * @see GetCommandLine https://msdn.microsoft.com/en-us/library/windows/desktop/ms683156.aspx
@@ -44,8 +48,111 @@ export function open(options: IPtyOpenOptions): ITerminal {
   return terminalCtor.open(options);
 }
 
+/**
+ * Creates a pool that keeps shells spawned and initialized per spawn
+ * configuration, so that claiming one skips shell startup.
+ * @param options The options of the pool.
+ */
+export function createShellPool(options?: IShellPoolOptions): ShellPool {
+  return new ShellPool((file, args, opt) => new terminalCtor(file, args, opt), options);
+}
+
+/**
+ * Keeps a number of ptys opened ahead of time so that spawn only has to fork
+ * and exec. The pool is refilled in the background. This does nothing on
+ * Windows.
+ * @param options The pool size (0 disables the pool) and the default size of
+ * the pooled ptys.
+ */
+export function configurePtyPool(options: IPtyPoolOptions): void {
+  if (process.platform !== 'win32') {
+    terminalCtor.configurePool(options);
+  }
+}
+
+/**
+ * Gets the pty pool size, the number of ready ptys and how many spawns were
+ * served from the pool (hits) or had to open a pty (misses).
+ */
+export function getPtyPoolStats(): IPtyPoolStats {
+  if (process.platform === 'win32') {
+    return { size: 0, available: 0, hits: 0, misses: 0 };
+  }
+  return terminalCtor.poolStats;
+}
+
+/**
+ * Caps the output all terminals buffer natively: scrollback, input not yet
+ * accepted by the ptys and output not yet delivered to JS. Over the limit the
+ * scrollback of the least recently viewed terminals is compressed and then
+ * evicted, and hub terminals stop being read while that does not suffice.
+ * This does nothing on Windows.
+ * @param options The limit in bytes, 0 removes it.
+ */
+export function configureMemoryBudget(options: IMemoryBudgetOptions): void {
+  if (process.platform !== 'win32') {
+    terminalCtor.configureMemoryBudget(options);
+  }
+}
+
+/**
+ * Gets what all terminals buffer natively against the memory budget.
+ */
+export function getMemoryBudgetStats(): IMemoryBudgetStats {
+  if (process.platform === 'win32') {
+    return { limit: 0, used: 0, scrollback: 0, writes: 0, output: 0, sessions: 0, reclaims: 0, reclaimed: 0, backpressure: false };
+  }
+  return terminalCtor.memoryBudgetStats;
+}
+
+/**
+ * Creates a hub that reads the ptys of the terminals it spawns on a native I/O
+ * thread, delivering their output in batches instead of through a socket per
+ * terminal. Not supported on Windows.
+ * @param options The options of the hub.
+ */
+export function createPtyHub(options?: IPtyHubOptions): PtyHub {
+  if (process.platform === 'win32') {
+    throw new Error('The pty hub is not supported on Windows.');
+  }
+  return new (require('./ptyHub').PtyHub)(options);
+}
+
+/**
+ * Decodes a snapshot of a terminal screen, see IScreen.snapshot. This needs
+ * nothing native and works on any platform.
+ * @param data The snapshot.
+ */
+export function decodeScreenSnapshot(data: Uint8Array): IScreenSnapshot {
+  return require('./screen').decodeScreenSnapshot(data);
+}
+
 /**
  * Expose the native API when not Windows, note that this is not public API and
  * could be removed at any time.
  */
 export const native = (process.platform !== 'win32' ? require(`../bin/${process.platform}-${process.arch}/pty.node`) : null);
+
+/**
+ * The termios flag values of the platform, to compose the `iflag`, `oflag`,
+ * `cflag` and `lflag` fields of the `termios` option. Empty on Windows.
+ */
+export const termiosFlags: { [name: string]: number } = (native ? native.termios : {});
+
+/**
+ * The Unicode version the column widths follow, '' on Windows.
+ */
+export const unicodeVersion: string = (native ? native.unicodeVersion : '');
+
+/**
+ * The columns text takes in a terminal: wide characters and emoji take 2,
+ * combining marks, format characters and controls none. Escape sequences are
+ * not skipped. Not supported on Windows.
+ * @param data The text, a Buffer is taken as UTF-8.
+ */
+export function columns(data: string | Buffer): number {
+  if (!native) {
+    throw new Error('columns is not supported on Windows.');
+  }
+  return native.columns(data);
+}
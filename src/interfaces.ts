@@ -106,13 +106,248 @@ interface IBasePtyForkOptions {
   handleFlowControl?: boolean;
   flowControlPause?: string;
   flowControlResume?: string;
+  throttle?: IThrottleOptions;
+}
+
+export interface IThrottleOptions {
+  bytesPerSecond?: number;
+  eventsPerSecond?: number;
+  pause?: boolean;
+  halfLife?: number;
+}
+
+export interface IThrottleEvent {
+  throttled: boolean;
+  bytesPerSecond: number;
+  eventsPerSecond: number;
 }
 
 export interface IPtyForkOptions extends IBasePtyForkOptions {
   uid?: number;
   gid?: number;
+  termios?: TermiosOption;
+  scrollback?: IScrollbackOptions;
+  screen?: IScreenOptions;
+  plainText?: IPlainTextOptions;
+  mode?: 'data' | 'lines';
+  lines?: ILinesOptions;
+  links?: ILinkOptions;
+}
+
+export interface IScrollbackOptions {
+  limit?: number;
+  segmentSize?: number;
+  compress?: boolean;
+  directory?: string;
+  diskLimit?: number;
+}
+
+export interface IScrollbackChunk {
+  offset: number;
+  data: string | Buffer;
+}
+
+export interface IOutputSince extends IScrollbackChunk {
+  tooOld: boolean;
+  end: number;
+}
+
+export interface ICwdChangeEvent {
+  path: string;
+  host: string;
+}
+
+export interface IClipboardEvent {
+  selection: string;
+  data: string | null;
+}
+
+export interface ICommandEvent {
+  promptStart: number;
+  commandStart: number;
+  outputStart: number;
+  outputEnd: number;
+  exitCode: number | null;
+  duration: number;
+}
+
+export interface IScrollbackLines extends IScrollbackChunk {
+  line: number;
+}
+
+export interface ISearchOptions {
+  regex?: boolean;
+  caseInsensitive?: boolean;
+  limit?: number;
+}
+
+export interface ISearchMatch {
+  offset: number;
+  length: number;
+  line: number;
+}
+
+export interface IScrollbackStats {
+  start: number;
+  end: number;
+  startLine: number;
+  endLine: number;
+  memory: number;
+  index: number;
+  disk: number;
+  segments: number;
+  compressed: number;
+  spilled: number;
+  files: number;
+  spillErrors: number;
+}
+
+export interface IScreenOptions {
+  scrollback?: number;
+}
+
+export interface IPlainTextOptions {
+  file?: string;
+}
+
+export interface IPlainTextStats {
+  lines: number;
+  bytes: number;
+  pending: number;
+  error: string | null;
+}
+
+export interface ILinesOptions {
+  maxLength?: number;
+  idleMs?: number;
+}
+
+export interface ILine {
+  text: string;
+  time: number;
+  partial: boolean;
+}
+
+export interface ILinkOptions {
+  urls?: boolean;
+  paths?: boolean;
+}
+
+export interface ILink {
+  type: 'url' | 'path';
+  text: string;
+  start: number;
+  end: number;
+  line?: number;
+  column?: number;
+}
+
+export interface IExpectPattern {
+  literal: string;
+  regex?: RegExp;
+}
+
+export type ExpectPattern = string | IExpectPattern;
+
+export interface IExpectOptions {
+  timeout?: number;
+  caseInsensitive?: boolean;
+}
+
+export interface IExpectMatch {
+  index: number;
+  text: string;
+  start: number;
+  end: number;
+}
+
+export interface IScreenState {
+  cols: number;
+  rows: number;
+  cursorX: number;
+  cursorY: number;
+  cursorVisible: boolean;
+  alternate: boolean;
+  applicationCursor: boolean;
+  bracketedPaste: boolean;
+  scrollback: number;
+  saved: number;
+  version: number;
+  title: string;
+}
+
+export interface IScreenChanges extends IScreenState {
+  since: number;
+  lines: IScreenLineChange[];
+  rect: { left: number, top: number, right: number, bottom: number } | null;
+}
+
+export interface IScreenLineChange {
+  y: number;
+  left: number;
+  right: number;
+  wrapped: boolean;
+  chars: string[];
+  runs: { start: number, end: number, fg: number, bg: number, flags: number }[];
+}
+
+export interface IScreenLine {
+  wrapped: boolean;
+  chars: string[];
+  runs: { start: number, end: number, fg: number, bg: number, flags: number }[];
+}
+
+export interface IScreenSnapshot {
+  cols: number;
+  rows: number;
+  cursorX: number;
+  cursorY: number;
+  cursorVisible: boolean;
+  alternate: boolean;
+  applicationCursor: boolean;
+  bracketedPaste: boolean;
+  autowrap: boolean;
+  origin: boolean;
+  insert: boolean;
+  newline: boolean;
+  wrapPending: boolean;
+  scrollTop: number;
+  scrollBottom: number;
+  attributes: { fg: number, bg: number, flags: number };
+  version: number;
+  saved: number;
+  title: string;
+  scrollback: IScreenLine[];
+  lines: IScreenLine[];
 }
 
+export interface IScreenCell {
+  chars: string;
+  width: number;
+  fg: number;
+  bg: number;
+  bold: boolean;
+  dim: boolean;
+  italic: boolean;
+  underline: boolean;
+  blink: boolean;
+  inverse: boolean;
+  hidden: boolean;
+  strikethrough: boolean;
+}
+
+export interface ITermios {
+  iflag?: number;
+  oflag?: number;
+  cflag?: number;
+  lflag?: number;
+  ispeed?: number;
+  ospeed?: number;
+  cc?: { [name: string]: number };
+}
+
+export type TermiosOption = 'default' | 'raw' | ITermios;
+
 export interface IWindowsPtyForkOptions extends IBasePtyForkOptions {
   useConpty?: boolean;
   conptyInheritCursor?: boolean;
@@ -122,4 +357,103 @@ export interface IPtyOpenOptions {
   cols?: number;
   rows?: number;
   encoding?: string;
+  termios?: TermiosOption;
+}
+
+export interface IPtyPoolOptions {
+  size?: number;
+  cols?: number;
+  rows?: number;
+}
+
+export interface IShellPoolOptions {
+  size?: number;
+  promptPattern?: RegExp;
+  settleTime?: number;
+  idleTimeout?: number;
+}
+
+export interface IShellPoolStats {
+  idle: number;
+  ready: number;
+  hits: number;
+  misses: number;
+}
+
+export interface IPtyPoolStats {
+  size: number;
+  available: number;
+  hits: number;
+  misses: number;
+}
+
+export interface IMemoryBudgetOptions {
+  limit?: number;
+}
+
+export interface IMemoryBudgetStats {
+  limit: number;
+  used: number;
+  scrollback: number;
+  writes: number;
+  output: number;
+  floor: number;
+  sessions: number;
+  reclaims: number;
+  reclaimed: number;
+  backpressure: boolean;
+}
+
+export interface IMemoryUsage {
+  scrollback: number;
+  writes: number;
+  output: number;
+  total: number;
+  idleMs: number;
+}
+
+export interface IPtyHubOptions {
+  backend?: 'poll' | 'io_uring';
+  threads?: number;
+  assign?: ShardAssignment;
+  scheduler?: 'round-robin' | 'drr';
+  quantum?: number;
+  coalesce?: { [priority in HubPriority]?: number };
+}
+
+export type HubPriority = 'interactive' | 'normal' | 'batch';
+
+export interface IHubPtyForkOptions extends IPtyForkOptions {
+  priority?: HubPriority;
+}
+
+export type ShardAssignment = 'round-robin' | 'least-loaded' | ((file: string, args: string[], opt: IPtyForkOptions) => number);
+
+export interface IPtyHubShardStats {
+  sessions: number;
+  bytesRead: number;
+  batches: number;
+}
+
+export interface IPtyHubStats {
+  backend: string;
+  sessions: number;
+  syscalls: number;
+  reads: number;
+  bytesRead: number;
+  writes: number;
+  bytesWritten: number;
+  wakeups: number;
+  batches: number;
+  deferred: number;
+  throttled: number;
+  shards: IPtyHubShardStats[];
+}
+
+export interface IHubFairness {
+  bytesRead: number;
+  turns: number;
+  deferred: number;
+  waitUs: number;
+  maxWaitUs: number;
 }
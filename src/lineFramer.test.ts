@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+
+if (process.platform !== 'win32') {
+  // required lazily, the native framer is not built on Windows
+  const LineFramer = require('./lineFramer').LineFramer;
+  const UnixTerminal = require('./unixTerminal').UnixTerminal;
+
+  describe('LineFramer', () => {
+    it('should frame lines across writes and keep what was written last', () => {
+      const framer = new LineFramer({ idleMs: 0 });
+      const lines: any[] = [];
+      framer.onLines((l: any[]) => lines.push(...l));
+      framer.write('\x1b[32mok\x1b[0m\r\npar');
+      framer.write('tial\r');
+      framer.write('\r\n10%\r50%\r100%\r\r\nlast');
+      assert.deepEqual(lines.map(l => l.text), ['\x1b[32mok\x1b[0m', 'partial', '100%']);
+      assert.ok(lines.every(l => !l.partial && l.time > 0));
+      // the line that did not end is delivered on close
+      framer.close();
+      assert.deepEqual(lines[3], { text: 'last', time: lines[3].time, partial: true });
+    });
+
+    it('should cut long lines at character boundaries', () => {
+      const framer = new LineFramer({ maxLength: 4, idleMs: 0 });
+      const lines: string[] = [];
+      framer.onLines((l: any[]) => l.forEach(line => lines.push(line.text)));
+      framer.write('abcdefg\nab€\n');
+      assert.deepEqual(lines, ['abcd', 'efg', 'ab', '€']);
+    });
+
+    it('should stop the idle timer when the spawn fails', () => {
+      const close = LineFramer.prototype.close;
+      let closed = 0;
+      LineFramer.prototype.close = function (): void {
+        closed++;
+        close.call(this);
+      };
+      try {
+        assert.throws(() => new UnixTerminal('/nonexistent/file', [], { mode: 'lines', lines: { idleMs: 50 } }), /execvp/);
+      } finally {
+        LineFramer.prototype.close = close;
+      }
+      assert.equal(closed, 1);
+    });
+
+    it('should deliver a line that does not end once the terminal is idle', (done) => {
+      const term = new UnixTerminal('/bin/sh', ['-c', 'printf "a\\nprompt: "; sleep 0.5; printf "b\\n"'], { mode: 'lines', lines: { idleMs: 50 } });
+      const lines: any[] = [];
+      let data = '';
+      term.onLines((l: any[]) => lines.push(...l));
+      term.onData((d: string) => data += d);
+      term.on('data', (d: string) => data += d);
+      term.onExit(() => {
+        assert.deepEqual(lines.map(l => [l.text, l.partial]), [['a', false], ['prompt: ', true], ['b', false]]);
+        assert.equal(data, '');
+        done();
+      });
+    });
+  });
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { EventEmitter2, IEvent } from './eventEmitter2';
+import { IPtyForkOptions, ILinesOptions, ILine } from './interfaces';
+
+const DEFAULT_MAX_LENGTH = 16384;
+const DEFAULT_IDLE_MS = 1000;
+
+/**
+ * Whether the options ask for lines instead of data.
+ */
+export function linesMode(opt: IPtyForkOptions | undefined): boolean {
+  const mode = opt && opt.mode || 'data';
+  if (mode !== 'data' && mode !== 'lines') {
+    throw new Error('mode must be one of data, lines');
+  }
+  return mode === 'lines';
+}
+
+/**
+ * Frames the output of a terminal into complete lines natively, for log
+ * capture. A line written over after a carriage return keeps what was
+ * written last, escape sequences are kept. A line that does not end is
+ * delivered once the output was idle for a while, and long lines are cut.
+ */
+export class LineFramer {
+  public readonly native: IUnixLineFramer;
+  private _timer: NodeJS.Timer | null = null;
+
+  private _onLines = new EventEmitter2<ILine[]>();
+  public get onLines(): IEvent<ILine[]> { return this._onLines.event; }
+
+  constructor(opt: ILinesOptions | undefined) {
+    const maxLength = opt && opt.maxLength !== undefined ? opt.maxLength : DEFAULT_MAX_LENGTH;
+    const idleMs = opt && opt.idleMs !== undefined ? opt.idleMs : DEFAULT_IDLE_MS;
+    if (typeof maxLength !== 'number' || !(maxLength >= 1) || maxLength !== Math.floor(maxLength)) {
+      throw new Error('lines.maxLength must be a positive integer');
+    }
+    if (typeof idleMs !== 'number' || !(idleMs >= 0) || idleMs === Infinity) {
+      throw new Error('lines.idleMs must be a number of milliseconds, 0 to wait for lines to end');
+    }
+    // required lazily, unixTerminal uses this module
+    const pty: IUnixNative = require('./unixTerminal').pty;
+    this.native = new pty.LineFramer(maxLength);
+    if (idleMs > 0) {
+      // a line idle for idleMs waits up to twice as long for the next check
+      this._timer = setInterval(() => this.deliver(this.native.flush(idleMs)), idleMs);
+      this._timer.unref();
+    }
+  }
+
+  public write(data: string | Buffer): void {
+    this.deliver(this.native.write(data));
+  }
+
+  /**
+   * Fires the lines framed natively, the hub frames them as it reads.
+   */
+  public deliver(framed: IUnixLines | null): void {
+    if (!framed) {
+      return;
+    }
+    const texts = framed.lines.split('\n');
+    const partial = !!framed.partial;
+    this._onLines.fire(texts.map((text, i) => ({ text, time: framed.time, partial: partial && i === texts.length - 1 })));
+  }
+
+  /**
+   * Delivers the line that did not end, if any, and stops the idle timer.
+   */
+  public close(): void {
+    if (this._timer) {
+      clearInterval(this._timer);
+      this._timer = null;
+    }
+    this.deliver(this.native.flush(0));
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+
+if (process.platform !== 'win32') {
+  // required lazily, the native detector is not built on Windows
+  const LinkDetector = require('./linkDetector').LinkDetector;
+  const UnixTerminal = require('./unixTerminal').UnixTerminal;
+
+  function detect(chunks: string[], opt: any = {}): any[] {
+    const detector = new LinkDetector(opt, 0);
+    const links: any[] = [];
+    detector.onLinks((l: any[]) => links.push(...l));
+    chunks.forEach(chunk => detector.write(chunk));
+    detector.close();
+    return links;
+  }
+
+  describe('LinkDetector', () => {
+    it('should find URLs and paths with their offsets', () => {
+      assert.deepEqual(detect(['see (https://en.wikipedia.org/wiki/Foo_(bar)). src/a.cc:12:5: error, ~/notes and/or 1/2\r\n']), [
+        { type: 'url', text: 'https://en.wikipedia.org/wiki/Foo_(bar)', start: 5, end: 44 },
+        { type: 'path', text: 'src/a.cc:12:5', start: 47, end: 60, line: 12, column: 5 },
+        { type: 'path', text: '~/notes', start: 69, end: 76 }
+      ]);
+    });
+
+    it('should put links split across writes together', () => {
+      const output = 'fetching http://example.com/a.tar.gz ok\r\n';
+      const whole = detect([output]);
+      assert.equal(whole.length, 1);
+      for (let i = 1; i < output.length; i++) {
+        assert.deepEqual(detect([output.slice(0, i), output.slice(i)]), whole, String(i));
+      }
+    });
+
+    it('should skip colors within a link', () => {
+      // as grep --color=always -n prints a match
+      const output = '\x1b[35m\x1b[Ksrc/a.c\x1b[m\x1b[K:\x1b[32m\x1b[K7\x1b[m\x1b[K:x \x1b[1mhttp://a.io\x1b[2K.de\r\n';
+      assert.deepEqual(detect([output]), [
+        { type: 'path', text: 'src/a.c:7', start: 8, end: 31, line: 7 },
+        { type: 'url', text: 'http://a.io', start: 44, end: 55 }
+      ]);
+    });
+
+    it('should deliver the link at the end of the output on close', () => {
+      assert.deepEqual(detect(['open ./build/out.log']).map(l => l.text), ['./build/out.log']);
+    });
+
+    it('should only look for the kinds of links asked for', () => {
+      assert.deepEqual(detect(['http://a.io /etc/hosts\n'], { paths: false }).map(l => l.text), ['http://a.io']);
+      assert.deepEqual(detect(['http://a.io /etc/hosts\n'], { urls: false }).map(l => l.text), ['/etc/hosts']);
+      assert.throws(() => new LinkDetector({ urls: false, paths: false }, 0), /urls or paths/);
+    });
+
+    it('should find the links in the output of a terminal', (done) => {
+      const term = new UnixTerminal('/bin/sh', ['-c', 'printf "docs: https://exa"; sleep 0.1; printf "mple.com\\n"'], { links: {}, scrollback: {} });
+      const links: any[] = [];
+      term.onLinks((l: any[]) => links.push(...l));
+      term.onExit(() => {
+        assert.equal(links.length, 1);
+        assert.equal(links[0].text, 'https://example.com');
+        assert.equal(term.scrollback.read(links[0].start, links[0].end - links[0].start).data, 'https://example.com');
+        done();
+      });
+    });
+  });
+}
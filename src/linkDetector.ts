@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { EventEmitter2, IEvent } from './eventEmitter2';
+import { ILinkOptions, ILink } from './interfaces';
+
+// the kinds of links as the native side numbers them
+const KIND_URL = 1;
+const KIND_PATH = 2;
+
+function toLink(record: string): ILink {
+  // links hold no spaces
+  const fields = record.split(' ');
+  const link: ILink = { type: fields[0] === 'u' ? 'url' : 'path', text: fields[5], start: +fields[1], end: +fields[2] };
+  if (fields[3] !== '0') {
+    link.line = +fields[3];
+  }
+  if (fields[4] !== '0') {
+    link.column = +fields[4];
+  }
+  return link;
+}
+
+/**
+ * Finds URLs and file paths (with a :line:column) in the output of a
+ * terminal natively, for the UI to highlight. Only the words around a ':' or
+ * '/' are looked at, colors within a word are skipped over. A link is
+ * delivered once its word ends, the offsets of links are sequence numbers.
+ */
+export class LinkDetector {
+  public readonly native: IUnixLinkDetector;
+
+  private _onLinks = new EventEmitter2<ILink[]>();
+  public get onLinks(): IEvent<ILink[]> { return this._onLinks.event; }
+
+  constructor(opt: ILinkOptions, offset: number) {
+    if (opt.urls !== undefined && typeof opt.urls !== 'boolean') {
+      throw new Error('links.urls must be a boolean');
+    }
+    if (opt.paths !== undefined && typeof opt.paths !== 'boolean') {
+      throw new Error('links.paths must be a boolean');
+    }
+    const kinds = (opt.urls === false ? 0 : KIND_URL) | (opt.paths === false ? 0 : KIND_PATH);
+    if (!kinds) {
+      throw new Error('links must look for urls or paths');
+    }
+    // required lazily, unixTerminal uses this module
+    const pty: IUnixNative = require('./unixTerminal').pty;
+    this.native = new pty.LinkDetector(kinds, offset);
+  }
+
+  public write(data: string | Buffer): void {
+    this.deliver(this.native.write(data));
+  }
+
+  /**
+   * Fires the links found natively, the hub finds them as it reads.
+   */
+  public deliver(found: IUnixLinks | null): void {
+    if (found) {
+      this._onLinks.fire(found.links.split('\n').map(toLink));
+    }
+  }
+
+  /**
+   * Delivers the links in the last word of the output.
+   */
+  public close(): void {
+    this.deliver(this.native.flush());
+  }
+}
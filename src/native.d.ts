@@ -18,10 +18,131 @@ interface IWinptyNative {
 }
 
 interface IUnixNative {
-  fork(file: string, args: string[], parsedEnv: string[], cwd: string, cols: number, rows: number, uid: number, gid: number, useUtf8: boolean, onExitCallback: (code: number, signal: number) => void): IUnixProcess;
-  open(cols: number, rows: number): IUnixOpenProcess;
+  fork(file: string, args: string[], parsedEnv: string[], cwd: string, cols: number, rows: number, uid: number, gid: number, useUtf8: boolean, termios: string | object | undefined, onExitCallback: (code: number, signal: number) => void): IUnixProcess;
+  open(cols: number, rows: number, termios: string | object | undefined): IUnixOpenProcess;
   process(fd: number, pty: string): string;
   resize(fd: number, cols: number, rows: number): void;
+  setPoolOptions(size: number, cols: number, rows: number): void;
+  getPoolStats(): IUnixPoolStats;
+  setMemoryBudget(limit: number): void;
+  getMemoryBudget(): { limit: number, used: number, scrollback: number, writes: number, output: number, floor: number, sessions: number, reclaims: number, reclaimed: number, backpressure: boolean };
+  getAttr(fd: number): any;
+  setAttr(fd: number, termios: string | object): void;
+  termios: { [name: string]: number };
+  columns(data: string | Buffer): number;
+  unicodeVersion: string;
+  Scrollback: new (options: { limit: number, segmentSize?: number, compress: boolean, directory?: string, diskLimit?: number }) => IUnixScrollback;
+  Screen: new (options: { cols: number, rows: number, scrollback: number }) => IUnixScreen;
+  EventScanner: new (offset?: number) => IUnixEventScanner;
+  PlainText: new (file?: string) => IUnixPlainText;
+  LineFramer: new (maxLength: number) => IUnixLineFramer;
+  ExpectMatcher: new (offset?: number) => IUnixExpectMatcher;
+  LinkDetector: new (kinds: number, offset?: number) => IUnixLinkDetector;
+  PtyHub: new (onBatch: (ids: Uint32Array, ends: Uint32Array, data: Buffer, events: IUnixHubEvent[]) => void, options: { backend?: string, threads?: number, scheduler?: string, quantum?: number, coalesce?: { [priority: string]: number | undefined } }) => IUnixPtyHub;
+}
+
+interface IUnixPtyHub {
+  add(fd: number, shard: number, utf8: boolean, priority: number, scrollback?: IUnixScrollback, screen?: IUnixScreen, events?: IUnixEventScanner, plainText?: IUnixPlainText, lines?: IUnixLineFramer, expect?: IUnixExpectMatcher, links?: IUnixLinkDetector): number;
+  remove(id: number): void;
+  write(id: number, data: string | Buffer): void;
+  observe(id: number, events?: IUnixEventScanner, expect?: IUnixExpectMatcher): void;
+  pause(id: number): void;
+  resume(id: number): void;
+  stats(): IUnixPtyHubStats;
+  fairness(id: number): IUnixHubFairness | undefined;
+  usage(id: number): { scrollback: number, writes: number, output: number, total: number, idleMs: number } | undefined;
+  markViewed(id: number): void;
+  close(): void;
+}
+
+interface IUnixScrollback {
+  write(data: string | Buffer): void;
+  read(offset: number, length?: number): { offset: number, data: Buffer };
+  tail(bytes: number): { offset: number, data: Buffer };
+  tailLines(lines: number): { offset: number, data: Buffer };
+  readLines(line: number, count?: number): { offset: number, line: number, data: Buffer };
+  search(query: string, regex: boolean, caseInsensitive: boolean, limit?: number): { offset: number, length: number, line: number }[];
+  clear(): void;
+  destroy(): void;
+  markViewed(): void;
+  stats(): { start: number, end: number, startLine: number, endLine: number, memory: number, index: number, disk: number, segments: number, compressed: number, spilled: number, files: number, spillErrors: number };
+}
+
+interface IUnixScreen {
+  write(data: string | Buffer): void;
+  resize(cols: number, rows: number): void;
+  reset(): void;
+  state(): { cols: number, rows: number, cursorX: number, cursorY: number, cursorVisible: boolean, alternate: boolean, applicationCursor: boolean, bracketedPaste: boolean, scrollback: number, saved: number, version: number, title: string };
+  lines(start: number, end: number): string[];
+  cell(x: number, y: number): { chars: string, width: number, fg: number, bg: number, bold: boolean, dim: boolean, italic: boolean, underline: boolean, blink: boolean, inverse: boolean, hidden: boolean, strikethrough: boolean } | null;
+  changes(since: number): any;
+  snapshot(scrollback: number): Buffer;
+}
+
+interface IUnixEventScanner {
+  scan(data: string | Buffer): IUnixEvent[];
+  reset(): void;
+}
+
+interface IUnixPlainText {
+  write(data: string | Buffer): string;
+  flush(): string;
+  close(): string;
+  stats(): { lines: number, bytes: number, pending: number, error: string | null };
+}
+
+interface IUnixLineFramer {
+  write(data: string | Buffer): IUnixLines | null;
+  flush(idleMs?: number): IUnixLines | null;
+}
+
+// lines joined by newlines, partial is a number in hub events
+interface IUnixLines {
+  lines: string;
+  time: number;
+  seq: number;
+  partial: boolean | number;
+}
+
+interface IUnixExpectMatcher {
+  arm(patterns: { literal: string, regex?: string, ignoreCase?: boolean }[], caseInsensitive: boolean): { token: number, match: IUnixExpectMatch | null };
+  cancel(token: number): void;
+  write(data: string | Buffer): IUnixExpectMatch | null;
+}
+
+interface IUnixExpectMatch {
+  token: number;
+  index: number;
+  start: number;
+  end: number;
+  text: string;
+}
+
+interface IUnixLinkDetector {
+  write(data: string | Buffer): IUnixLinks | null;
+  flush(): IUnixLinks | null;
+}
+
+// "kind start end line column text" of each link, joined by newlines
+interface IUnixLinks {
+  links: string;
+}
+
+interface IUnixHubFairness {
+  bytesRead: number;
+  turns: number;
+  deferred: number;
+  waitUs: number;
+  maxWaitUs: number;
+}
+
+interface IUnixEvent {
+  type: string;
+  [field: string]: any;
+}
+
+interface IUnixHubEvent extends IUnixEvent {
+  id: number;
 }
 
 interface IConptyProcess {
@@ -52,3 +173,25 @@ interface IUnixOpenProcess {
   slave: number;
   pty: string;
 }
+
+interface IUnixPoolStats {
+  size: number;
+  available: number;
+  hits: number;
+  misses: number;
+}
+
+interface IUnixPtyHubStats {
+  backend: string;
+  sessions: number;
+  syscalls: number;
+  reads: number;
+  bytesRead: number;
+  writes: number;
+  bytesWritten: number;
+  wakeups: number;
+  batches: number;
+  deferred: number;
+  throttled: number;
+  shards: { sessions: number, bytesRead: number, batches: number }[];
+}
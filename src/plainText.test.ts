@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+import * as fs from 'fs';
+import * as os from 'os';
+import * as path from 'path';
+
+if (process.platform !== 'win32') {
+  // required lazily, the native stripper is not built on Windows
+  const PlainText = require('./plainText').PlainText;
+  const UnixTerminal = require('./unixTerminal').UnixTerminal;
+
+  describe('PlainText', () => {
+    it('should remove escape sequences and keep what was written last', () => {
+      const plainText = new PlainText({});
+      const text = plainText.native.write('\x1b[1;31mred\x1b[m \x1b]0;title\x07plain\r\n10%\r50%\r\x1b[K100%\r\nb\bbo\bold\n\x1bP1$r0m\x1b\\x');
+      assert.equal(text, 'red plain\n100%\nbold\n');
+      // the last line waits for its end
+      assert.equal(plainText.native.flush(), 'x\n');
+      assert.deepEqual(plainText.stats, { lines: 4, bytes: 22, pending: 0, error: null });
+    });
+
+    it('should keep the cursor within the longest line', () => {
+      const plainText = new PlainText({});
+      assert.equal(plainText.native.write('a\x1b[999999999Cb\n'), 'a' + ' '.repeat(65535) + 'b\n');
+    });
+
+    it('should put sequences split across writes together', () => {
+      const plainText = new PlainText({});
+      const input = '\x1b[38;2;1;2;3mcolor\x1b[0m\x1b]8;;http://example.com\x1b\\link\x1b]8;;\x1b\\ 中文\r\n';
+      let text = '';
+      for (let i = 0; i < input.length; i++) {
+        text += plainText.native.write(input[i]);
+      }
+      assert.equal(text, 'colorlink 中文\n');
+    });
+
+    it('should append the text of a terminal to a file', (done) => {
+      const file = path.join(os.tmpdir(), `node-pty-plain-${process.pid}.log`);
+      const term = new UnixTerminal('/bin/sh', ['-c', 'printf "\\033[32mok\\033[0m\\nnext: 1\\rnext: 2"'], { plainText: { file } });
+      term.onExit(() => {
+        // the file is written off the I/O thread
+        const written = () => {
+          if (term.plainText.stats.pending) {
+            setTimeout(written, 10);
+            return;
+          }
+          assert.equal(fs.readFileSync(file, 'utf8'), 'ok\nnext: 2\n');
+          assert.equal(term.plainText.stats.lines, 2);
+          fs.unlinkSync(file);
+          done();
+        };
+        written();
+      });
+    });
+  });
+}
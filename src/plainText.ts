@@ -0,0 +1,28 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { IPlainTextOptions, IPlainTextStats } from './interfaces';
+
+/**
+ * The plain text of the output of a terminal, for logs: escape sequences are
+ * removed natively as the output is read, and lines overwritten after a
+ * carriage return or backspace keep what was written last. Lines are
+ * delivered once they end, or appended to a file.
+ */
+export class PlainText {
+  public readonly native: IUnixPlainText;
+  public readonly file: string | undefined;
+
+  constructor(opt: IPlainTextOptions) {
+    if (opt.file !== undefined && typeof opt.file !== 'string') {
+      throw new Error('plainText.file must be a string');
+    }
+    // required lazily, unixTerminal uses this module
+    const pty: IUnixNative = require('./unixTerminal').pty;
+    this.native = new pty.PlainText(opt.file);
+    this.file = opt.file;
+  }
+
+  public get stats(): IPlainTextStats { return this.native.stats(); }
+}
@@ -0,0 +1,292 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+import { pollUntil } from './testUtils.test';
+
+if (process.platform !== 'win32') {
+  // required lazily, the hub is not built on Windows
+  const PtyHub = require('./ptyHub').PtyHub;
+
+  ['poll', 'io_uring'].forEach(backend => describe(`PtyHub (${backend})`, () => {
+    let hub: any;
+
+    beforeEach(() => hub = new PtyHub({ backend }));
+    afterEach(() => hub.close());
+
+    it('should report the backend in use', () => {
+      // io_uring falls back to the poller when the kernel does not allow it
+      const backends = backend === 'io_uring' ? ['io_uring', 'epoll'] : ['epoll', 'kqueue', 'poll'];
+      if (process.platform !== 'linux') {
+        backends.push('kqueue', 'poll');
+      }
+      assert.ok(backends.indexOf(hub.stats.backend) !== -1, hub.stats.backend);
+    });
+
+    it('should deliver the output and exit of each terminal', (done) => {
+      const outputs = ['', '', ''];
+      let exited = 0;
+      outputs.forEach((_, i) => {
+        const term = hub.spawn('/bin/sh', ['-c', `echo terminal${i}`], {});
+        term.onData((data: string) => outputs[i] += data);
+        term.onExit((e: { exitCode: number }) => {
+          assert.equal(e.exitCode, 0);
+          assert.ok(outputs[i].indexOf(`terminal${i}`) !== -1, outputs[i]);
+          if (++exited === outputs.length) {
+            assert.equal(hub.stats.sessions, 0);
+            assert.ok(hub.stats.batches <= hub.stats.reads);
+            done();
+          }
+        });
+      });
+    });
+
+    it('should write to the terminal', (done) => {
+      const term = hub.spawn('/bin/cat', [], {});
+      let output = '';
+      term.onData((data: string) => {
+        output += data;
+        if (output.indexOf('hello hub') !== -1) {
+          term.kill();
+          done();
+        }
+      });
+      term.write('hello hub\n');
+    });
+
+    it('should not read a paused terminal', async () => {
+      const term = hub.spawn('/bin/sh', ['-c', 'sleep 0.2; echo resumed; sleep 1'], {});
+      let output = '';
+      term.onData((data: string) => output += data);
+      term.pause();
+      await new Promise(r => setTimeout(r, 500));
+      assert.equal(output.indexOf('resumed'), -1);
+      term.resume();
+      await pollUntil(() => output.indexOf('resumed') !== -1, 1000, 10);
+      term.kill();
+    });
+
+    it('should append the output to the scrollback natively', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'echo first; echo second'], { scrollback: {} });
+      term.onExit(() => {
+        assert.equal(term.scrollback.tailLines(1).replace(/\r/g, ''), 'second\n');
+        assert.equal(term.scrollback.read(0).offset, 0);
+        // everything was delivered, the sequence number is the end of the output
+        assert.equal(term.seq, term.scrollback.end);
+        assert.equal(term.readSince(0).data.replace(/\r/g, ''), 'first\nsecond\n');
+        done();
+      });
+    });
+
+    it('should parse the output into the screen natively', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "one\\ntwo\\033[1;1Hzero"'], { cols: 20, rows: 4, screen: {} });
+      term.onExit(() => {
+        assert.deepEqual(term.screen.lines(0, 2), ['zero', 'two']);
+        assert.deepEqual([term.screen.state.cursorX, term.screen.state.cursorY], [4, 0]);
+        done();
+      });
+    });
+
+    it('should scan the output for events across reads', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "\\033]2;sp"; sleep 0.1; printf "lit\\033\\\\\\\\\\007"'], {});
+      const seen: string[] = [];
+      term.onTitleChange((title: string) => seen.push(`title ${title}`));
+      term.onBell(() => seen.push('bell'));
+      term.onExit(() => {
+        assert.deepEqual(seen, ['title split', 'bell']);
+        done();
+      });
+    });
+
+    it('should scan for events from the first subscription on', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "\\033]2;one\\007"; sleep 0.5; printf "\\033]2;two\\007"'], {});
+      const seen: string[] = [];
+      setTimeout(() => term.onTitleChange((title: string) => seen.push(title)), 250);
+      term.onExit(() => {
+        assert.deepEqual(seen, ['two']);
+        done();
+      });
+    });
+
+    it('should report the commands of a shell with shell integration', (done) => {
+      const script = 'printf "\\033]133;A\\007$ \\033]133;B\\007ls\\n\\033]133;C\\007"; sleep 0.1; printf "out\\n\\033]133;D;3\\007"';
+      const term = hub.spawn('/bin/sh', ['-c', script], { scrollback: {} });
+      const commands: any[] = [];
+      term.onCommand((e: any) => commands.push(e));
+      term.onExit(() => {
+        assert.equal(commands.length, 1);
+        const command = commands[0];
+        assert.deepEqual([command.promptStart, command.exitCode], [0, 3]);
+        assert.equal(term.scrollback.read(command.commandStart, command.outputStart - command.commandStart).data, 'ls\r\n\x1b]133;C\x07');
+        assert.equal(term.scrollback.read(command.outputStart, command.outputEnd - command.outputStart).data, 'out\r\n');
+        assert.ok(command.duration >= 50, String(command.duration));
+        done();
+      });
+    });
+
+    it('should strip the output to plain text natively', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "\\033[1mbold\\033[0m\\n0%%\\r"; sleep 0.1; printf "100%%"'], { plainText: {} });
+      let text = '';
+      term.onPlainText((t: string) => text += t);
+      term.onExit(() => {
+        assert.equal(text, 'bold\n100%\n');
+        done();
+      });
+    });
+
+    it('should deliver complete lines instead of data in lines mode', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "one\\n0%%\\r"; sleep 0.1; printf "100%%\\ntwo"'], { mode: 'lines', lines: { idleMs: 0 } });
+      const lines: any[] = [];
+      let data = '';
+      term.onLines((l: any[]) => lines.push(...l));
+      term.onData((d: string) => data += d);
+      term.onExit(() => {
+        assert.deepEqual(lines.map(l => [l.text, l.partial]), [['one', false], ['100%', false], ['two', true]]);
+        assert.equal(data, '');
+        assert.equal(term.seq, 'one\r\n0%\r100%\r\ntwo'.length);
+        done();
+      });
+    });
+
+    it('should match expected patterns as the shard reads', async () => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "login: "; read name; printf "hello %s\\n$ " "$name"; sleep 1'], { scrollback: {} });
+      const login = await term.expect(['Password:', 'login: '], { timeout: 5000 });
+      assert.deepEqual([login.index, login.start], [1, 0]);
+      term.write('bob\n');
+      const hello = await term.expect([{ literal: 'hello ', regex: /\w+/ }, '$ '], { timeout: 5000 });
+      assert.equal(hello.text, 'hello bob');
+      assert.equal(term.scrollback.read(hello.start, hello.end - hello.start).data, 'hello bob');
+      term.kill();
+    });
+
+    it('should find links split across reads natively', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "see src/main.c:4"; sleep 0.1; printf "2 and https://a.io\\n"'], { links: {}, scrollback: {} });
+      const links: any[] = [];
+      term.onLinks((l: any[]) => links.push(...l));
+      term.onExit(() => {
+        assert.deepEqual(links.map(l => [l.type, l.text, l.line]), [['path', 'src/main.c:42', 42], ['url', 'https://a.io', undefined]]);
+        assert.equal(term.scrollback.read(links[0].start, links[0].end - links[0].start).data, 'src/main.c:42');
+        done();
+      });
+    });
+
+    it('should charge the scrollback to the memory budget', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'echo budget'], { scrollback: {} });
+      term.onExit(() => {
+        const usage = term.memoryUsage;
+        assert.ok(usage.scrollback > 0, JSON.stringify(usage));
+        assert.equal(usage.total, usage.scrollback + usage.writes + usage.output);
+        term.markViewed();
+        assert.ok(term.memoryUsage.idleMs < 1000);
+        done();
+      });
+    });
+
+    it('should keep reading a terminal whose input is over the memory budget', (done) => {
+      const UnixTerminal = require('./unixTerminal').UnixTerminal;
+      UnixTerminal.configureMemoryBudget({ limit: 64 * 1024 });
+      // echoes the paste back, which must be read for the paste to go in
+      const term = hub.spawn('/bin/sh', ['-c', 'stty raw -echo; echo ready; head -c 300000; echo'], {});
+      let output = '';
+      term.onData((data: string) => {
+        if (!output && data.indexOf('ready') !== -1) {
+          term.write(Buffer.alloc(300000, 'x'));
+        }
+        output += data;
+      });
+      term.onExit(() => {
+        UnixTerminal.configureMemoryBudget({ limit: 0 });
+        assert.equal(output.split('x').length - 1, 300000);
+        done();
+      });
+    });
+
+    it('should keep split multi-byte characters intact', (done) => {
+      const term = hub.spawn('/bin/sh', ['-c', 'printf "\\342\\202"; sleep 0.1; printf "\\254\\n"'], {});
+      let output = '';
+      term.onData((data: string) => output += data);
+      term.onExit(() => {
+        assert.ok(output.indexOf('€') !== -1, output);
+        done();
+      });
+    });
+  }));
+
+  describe('PtyHub shards', () => {
+    it('should spread terminals round-robin', (done) => {
+      const hub = new PtyHub({ threads: 2 });
+      const outputs = ['', '', '', ''];
+      let exited = 0;
+      outputs.forEach((_, i) => {
+        const term = hub.spawn('/bin/sh', ['-c', `echo shard${i}`], {});
+        term.onData((data: string) => outputs[i] += data);
+        term.onExit(() => {
+          assert.ok(outputs[i].indexOf(`shard${i}`) !== -1, outputs[i]);
+          if (++exited === outputs.length) {
+            const shards = hub.stats.shards;
+            assert.equal(shards.length, 2);
+            assert.ok(shards[0].bytesRead > 0 && shards[1].bytesRead > 0);
+            hub.close();
+            done();
+          }
+        });
+      });
+      assert.deepEqual(hub.stats.shards.map((s: any) => s.sessions), [2, 2]);
+    });
+
+    it('should assign terminals with a function', () => {
+      const hub = new PtyHub({ threads: 3, assign: (file: string, args: string[]) => args.length });
+      const terms = [hub.spawn('/bin/cat', [], {}), hub.spawn('/bin/cat', ['-u'], {})];
+      assert.deepEqual(hub.stats.shards.map((s: any) => s.sessions), [1, 1, 0]);
+      assert.throws(() => hub.spawn('/bin/cat', ['-u', '-', '-', '-'], {}));
+      terms.forEach(t => t.destroy());
+      hub.close();
+    });
+  });
+
+  ['round-robin', 'drr'].forEach(scheduler => describe(`PtyHub scheduler (${scheduler})`, () => {
+    it('should keep serving a terminal next to a flooding one', async () => {
+      const hub = new PtyHub({ scheduler, quantum: 4096 });
+      const flood = hub.spawn('/bin/sh', ['-c', 'yes'], { termios: 'raw' });
+      const echo = hub.spawn('/bin/cat', [], {});
+      let output = '';
+      echo.onData((data: string) => output += data);
+      await new Promise(r => setTimeout(r, 100));
+      echo.write('ping\n');
+      await pollUntil(() => output.indexOf('ping') !== -1, 2000, 10);
+      assert.ok(flood.fairness.deferred > 0);
+      assert.ok(echo.fairness.turns > 0);
+      assert.ok(hub.stats.deferred >= flood.fairness.deferred);
+      flood.destroy();
+      echo.destroy();
+      hub.close();
+    });
+  }));
+  describe('PtyHub priorities', () => {
+    it('should deliver the output of every priority', (done) => {
+      const hub = new PtyHub({ coalesce: { batch: 20 } });
+      const priorities = ['interactive', 'normal', 'batch'];
+      let exited = 0;
+      priorities.forEach(priority => {
+        const term = hub.spawn('/bin/sh', ['-c', `echo ${priority}`], { priority });
+        let output = '';
+        term.onData((data: string) => output += data);
+        term.onExit(() => {
+          assert.ok(output.indexOf(priority) !== -1, output);
+          if (++exited === priorities.length) {
+            hub.close();
+            done();
+          }
+        });
+      });
+    });
+
+    it('should reject an unknown priority', () => {
+      const hub = new PtyHub();
+      assert.throws(() => hub.spawn('/bin/cat', [], { priority: 'urgent' }), /priority must be one of/);
+      assert.equal(hub.stats.sessions, 0);
+      hub.close();
+    });
+  });
+}
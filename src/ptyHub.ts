@@ -0,0 +1,499 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as fs from 'fs';
+import { StringDecoder } from 'string_decoder';
+import { EventEmitter2, IEvent } from './eventEmitter2';
+import { IPtyForkOptions, IPtyHubOptions, IPtyHubStats, IHubFairness, IMemoryUsage, IHubPtyForkOptions, HubPriority, IThrottleEvent, ITermios, TermiosOption, ShardAssignment, IOutputSince, ICwdChangeEvent, IClipboardEvent, ICommandEvent, ILine, ILink, ExpectPattern, IExpectOptions, IExpectMatch, ISearchOptions, ISearchMatch } from './interfaces';
+import { ArgvOrCommandLine, IExitEvent } from './types';
+import { pty, forkPty, DESTROY_SOCKET_TIMEOUT_MS } from './unixTerminal';
+import { Throttle } from './throttle';
+import { Scrollback } from './scrollback';
+import { Screen } from './screen';
+import { PlainText } from './plainText';
+import { LineFramer, linesMode } from './lineFramer';
+import { ExpectMatcher } from './expectMatcher';
+import { LinkDetector } from './linkDetector';
+import { TerminalEvents } from './terminalEvents';
+
+// in the order the native side numbers them
+const PRIORITIES: HubPriority[] = ['interactive', 'normal', 'batch'];
+
+interface IHubSink {
+  data(chunk: Buffer): void;
+  event(e: IUnixHubEvent): void;
+}
+
+/**
+ * Reads the ptys of many terminals on native I/O threads (shards) and delivers
+ * their output in batches, one JS callback per batch for all terminals of a
+ * shard. Terminals of a hub have no socket of their own.
+ */
+export class PtyHub {
+  private _native: IUnixPtyHub;
+  private _sinks: { [id: number]: IHubSink } = {};
+  private _closed: boolean = false;
+  private _threads: number;
+  private _assign: ShardAssignment;
+  private _nextShard: number = 0;
+
+  constructor(opt?: IPtyHubOptions) {
+    opt = opt || {};
+    this._threads = opt.threads || 1;
+    this._assign = opt.assign || 'round-robin';
+    this._native = new pty.PtyHub((ids, ends, data, events) => this._onBatch(ids, ends, data, events), {
+      backend: opt.backend || 'poll',
+      threads: this._threads,
+      scheduler: opt.scheduler || 'round-robin',
+      quantum: opt.quantum,
+      coalesce: opt.coalesce
+    });
+  }
+
+  public get stats(): IPtyHubStats {
+    return this._native.stats();
+  }
+
+  /**
+   * Forks a process on a new pty that is read by the hub.
+   */
+  public spawn(file?: string, args?: ArgvOrCommandLine, opt?: IHubPtyForkOptions): HubTerminal {
+    if (this._closed) {
+      throw new Error('The pty hub is closed');
+    }
+    return new HubTerminal(this._native, this._sinks, this._pickShard(file, args, opt), file, args, opt);
+  }
+
+  /**
+   * Stops the I/O thread, terminals of the hub stop receiving data.
+   */
+  public close(): void {
+    this._closed = true;
+    this._native.close();
+  }
+
+  private _pickShard(file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions): number {
+    if (typeof this._assign === 'function') {
+      const shard = this._assign(file, <string[]>args || [], opt || {});
+      if (shard !== (shard | 0) || shard < 0 || shard >= this._threads) {
+        throw new Error(`assign must return a shard between 0 and ${this._threads - 1} (not ${shard})`);
+      }
+      return shard;
+    }
+    if (this._assign === 'least-loaded') {
+      const shards = this._native.stats().shards;
+      let best = 0;
+      for (let i = 1; i < shards.length; i++) {
+        if (shards[i].sessions < shards[best].sessions) {
+          best = i;
+        }
+      }
+      return best;
+    }
+    const shard = this._nextShard;
+    this._nextShard = (this._nextShard + 1) % this._threads;
+    return shard;
+  }
+
+  private _onBatch(ids: Uint32Array, ends: Uint32Array, data: Buffer, events: IUnixHubEvent[]): void {
+    let start = 0;
+    for (let i = 0; i < ids.length; i++) {
+      const sink = this._sinks[ids[i]];
+      if (sink) {
+        sink.data(data.slice(start, ends[i]));
+      }
+      start = ends[i];
+    }
+    // events follow the data of the same turn, a close is seen after the last
+    // output
+    for (let i = 0; i < events.length; i++) {
+      const sink = this._sinks[events[i].id];
+      if (sink) {
+        sink.event(events[i]);
+      }
+    }
+  }
+}
+
+export class HubTerminal {
+  private _id: number;
+  private _pid: number;
+  private _fd: number;
+  private _pty: string;
+  private _file: string;
+  private _cols: number;
+  private _rows: number;
+  private _utf8: boolean;
+  private _decoder: StringDecoder | null = null;
+  private _closed: boolean = false;
+  private _exit: IExitEvent | null = null;
+  private _exitTimer: NodeJS.Timer | null = null;
+  private _throttle: Throttle | null = null;
+  private _paused: boolean = false;
+  private _scrollback: Scrollback | undefined;
+  private _screen: Screen | undefined;
+  private _plainText: PlainText | undefined;
+  private _lines: LineFramer | undefined;
+  private _expect: ExpectMatcher | undefined;
+  private _links: LinkDetector | undefined;
+  private _seq: number = 0;
+  private _events: TerminalEvents | undefined;
+
+  private _onData = new EventEmitter2<string | Buffer>();
+  public get onData(): IEvent<string | Buffer> { return this._onData.event; }
+  private _onExit = new EventEmitter2<IExitEvent>();
+  public get onExit(): IEvent<IExitEvent> { return this._onExit.event; }
+  private _onThrottle = new EventEmitter2<IThrottleEvent>();
+  public get onThrottle(): IEvent<IThrottleEvent> { return this._onThrottle.event; }
+  public get onTitleChange(): IEvent<string> { return this._scanEvents().onTitleChange; }
+  public get onBell(): IEvent<void> { return this._scanEvents().onBell; }
+  public get onCwdChange(): IEvent<ICwdChangeEvent> { return this._scanEvents().onCwdChange; }
+  public get onClipboard(): IEvent<IClipboardEvent> { return this._scanEvents().onClipboard; }
+  public get onCommand(): IEvent<ICommandEvent> { return this._scanEvents().onCommand; }
+  private _onPlainText = new EventEmitter2<string>();
+  public get onPlainText(): IEvent<string> { return this._onPlainText.event; }
+  private _onLines = new EventEmitter2<ILine[]>();
+  public get onLines(): IEvent<ILine[]> { return this._onLines.event; }
+  private _onLinks = new EventEmitter2<ILink[]>();
+  public get onLinks(): IEvent<ILink[]> { return this._onLinks.event; }
+
+  public get pid(): number { return this._pid; }
+  public get cols(): number { return this._cols; }
+  public get rows(): number { return this._rows; }
+  public get scrollback(): Scrollback | undefined { return this._scrollback; }
+  public get screen(): Screen | undefined { return this._screen; }
+  public get plainText(): PlainText | undefined { return this._plainText; }
+
+  /**
+   * The bytes of output delivered so far, within a data listener including
+   * that data. The shard may have stored more in the scrollback already. In
+   * lines mode, the bytes framed into the lines delivered so far.
+   */
+  public get seq(): number { return this._seq; }
+
+  /**
+   * The output delivered from sequence number seq on, from the scrollback.
+   */
+  public readSince(seq: number): IOutputSince {
+    if (!this._scrollback) {
+      throw new Error('readSince needs the scrollback option');
+    }
+    return this._scrollback.readSince(seq, this._seq);
+  }
+
+  /**
+   * The matches of query in the output held by the scrollback.
+   */
+  public search(query: string, opt?: ISearchOptions): ISearchMatch[] {
+    if (!this._scrollback) {
+      throw new Error('search needs the scrollback option');
+    }
+    return this._scrollback.search(query, opt);
+  }
+
+  /**
+   * What the hub's read scheduler gave this terminal so far, zeros once it
+   * was closed.
+   */
+  public get fairness(): IHubFairness {
+    return this._hub.fairness(this._id) || { bytesRead: 0, turns: 0, deferred: 0, waitUs: 0, maxWaitUs: 0 };
+  }
+
+  /**
+   * What this terminal holds against the memory budget, zeros once it was
+   * closed.
+   */
+  public get memoryUsage(): IMemoryUsage {
+    return this._hub.usage(this._id) || { scrollback: 0, writes: 0, output: 0, total: 0, idleMs: 0 };
+  }
+
+  /**
+   * Marks the terminal as looked at, the memory budget reclaims from the
+   * least recently viewed terminals first. Writing to it marks it too.
+   */
+  public markViewed(): void {
+    if (!this._closed) {
+      this._hub.markViewed(this._id);
+    }
+  }
+
+  constructor(
+    private _hub: IUnixPtyHub,
+    private _sinks: { [id: number]: IHubSink },
+    shard: number,
+    file?: string,
+    args?: ArgvOrCommandLine,
+    opt?: IHubPtyForkOptions
+  ) {
+    const priority = PRIORITIES.indexOf(opt && opt.priority || 'normal');
+    if (priority === -1) {
+      throw new Error(`priority must be one of ${PRIORITIES.join(', ')}`);
+    }
+
+    if (opt && opt.throttle) {
+      // the shard stops reading the pty while throttled
+      this._throttle = new Throttle(opt.throttle, e => this._onThrottle.fire(e), paused => {
+        if (paused) {
+          this._hub.pause(this._id);
+        } else if (!this._paused) {
+          this._hub.resume(this._id);
+        }
+      });
+    }
+
+    const onexit = (code: number, signal: number): void => {
+      this._exit = { exitCode: code, signal };
+      if (this._closed) {
+        this._onExit.fire(this._exit);
+        return;
+      }
+      // The output may not be drained yet, wait for the hub to see the pty
+      // close but not forever (see UnixTerminal).
+      this._exitTimer = setTimeout(() => this._close(), DESTROY_SOCKET_TIMEOUT_MS);
+    };
+
+    try {
+      if (opt && opt.scrollback) {
+        this._scrollback = new Scrollback(opt.scrollback);
+      }
+      if (linesMode(opt)) {
+        this._lines = new LineFramer(opt && opt.lines);
+        this._lines.onLines(lines => this._onLines.fire(lines));
+      }
+      if (opt && opt.links) {
+        this._links = new LinkDetector(opt.links, 0);
+        this._links.onLinks(links => this._onLinks.fire(links));
+      }
+
+      const forked = forkPty(file, args, opt, onexit);
+      this._pid = forked.process.pid;
+      this._fd = forked.process.fd;
+      this._pty = forked.process.pty;
+      this._file = forked.file;
+      this._cols = forked.cols;
+      this._rows = forked.rows;
+      // UTF-8 output is cut at character boundaries by the shard
+      this._utf8 = forked.encoding === 'utf8';
+      if (forked.encoding !== null && !this._utf8) {
+        this._decoder = new StringDecoder(forked.encoding);
+      }
+
+      if (this._scrollback) {
+        this._scrollback.encoding = forked.encoding;
+      }
+      if (opt && opt.screen) {
+        this._screen = new Screen(this._cols, this._rows, opt.screen);
+      }
+      if (opt && opt.plainText) {
+        this._plainText = new PlainText(opt.plainText);
+      }
+      // the shard appends the output to the scrollback, parses it into the
+      // screen, strips it to plain text, frames it into lines and finds
+      // links as it reads it, events and expect() are added on first use
+      this._id = this._hub.add(this._fd, shard, this._utf8, priority, this._scrollback && this._scrollback.native, this._screen && this._screen.native,
+        undefined, this._plainText && this._plainText.native, this._lines && this._lines.native, undefined, this._links && this._links.native);
+    } catch (e) {
+      // nothing else would end what was set up, the hub does not own the pty
+      this._closed = true;
+      if (this._fd !== undefined) {
+        this.kill('SIGHUP');
+        fs.closeSync(this._fd);
+      }
+      if (this._lines) {
+        this._lines.close();
+      }
+      if (this._links) {
+        this._links.close();
+      }
+      if (this._plainText) {
+        this._plainText.native.close();
+      }
+      if (this._scrollback) {
+        this._scrollback.destroy();
+      }
+      if (this._throttle) {
+        this._throttle.dispose();
+      }
+      throw e;
+    }
+    this._sinks[this._id] = {
+      data: chunk => {
+        if (this._throttle) {
+          this._throttle.record(chunk.length);
+        }
+        this._seq += chunk.length;
+        this._onData.fire(this._utf8 ? chunk.toString('utf8') : this._decoder ? this._decoder.write(chunk) : chunk);
+      },
+      event: e => {
+        if (e.type === 'close') {
+          this._close();
+        } else if (e.type === 'text') {
+          this._onPlainText.fire(e.text);
+        } else if (e.type === 'lines' && this._lines) {
+          // no data is delivered in lines mode, the lines count the output
+          if (this._throttle) {
+            this._throttle.record(e.seq - this._seq);
+          }
+          this._seq = e.seq;
+          this._lines.deliver(e as IUnixLines);
+        } else if (e.type === 'expect' && this._expect) {
+          this._expect.deliver(e as IUnixExpectMatch);
+        } else if (e.type === 'links' && this._links) {
+          this._links.deliver(e as IUnixLinks);
+        } else if (this._events) {
+          this._events.fire(e);
+        }
+      }
+    };
+  }
+
+  /**
+   * Gets the name of the process.
+   */
+  public get process(): string {
+    return pty.process(this._fd, this._pty) || this._file;
+  }
+
+  public on(event: 'data', listener: (data: string | Buffer) => void): void;
+  public on(event: 'exit', listener: (exitCode: number, signal?: number) => void): void;
+  public on(event: string, listener: (...args: any[]) => void): void {
+    if (event === 'data') {
+      this.onData(listener);
+    } else if (event === 'exit') {
+      this.onExit(e => listener(e.exitCode, e.signal));
+    }
+  }
+
+  public write(data: string | Buffer): void {
+    if (!this._closed) {
+      this._hub.write(this._id, data);
+    }
+  }
+
+  /**
+   * Waits for one of the patterns in the output, matched by the shard as it
+   * reads. Resolves with the first match. Matching starts with the first
+   * call, from then on the output since the last match is kept for the next
+   * call (see UnixTerminal).
+   */
+  public expect(patterns: ExpectPattern[], opt?: IExpectOptions): Promise<IExpectMatch> {
+    if (!this._expect) {
+      this._expect = new ExpectMatcher(0);
+      if (this._closed) {
+        this._expect.close();
+      } else {
+        // offsets count from the output the shard read so far
+        this._hub.observe(this._id, undefined, this._expect.native);
+      }
+    }
+    return this._expect.expect(patterns, opt);
+  }
+
+  public resize(cols: number, rows: number): void {
+    if (cols <= 0 || rows <= 0 || isNaN(cols) || isNaN(rows) || cols === Infinity || rows === Infinity) {
+      throw new Error('resizing must be done using positive cols and rows');
+    }
+    pty.resize(this._fd, cols, rows);
+    if (this._screen) {
+      this._screen.native.resize(cols, rows);
+    }
+    this._cols = cols;
+    this._rows = rows;
+  }
+
+  public getTermios(): ITermios {
+    return pty.getAttr(this._fd);
+  }
+
+  public setTermios(termios: TermiosOption): void {
+    pty.setAttr(this._fd, termios);
+  }
+
+  /**
+   * Stops reading the pty, the program blocks once the pty buffer is full.
+   */
+  public pause(): void {
+    this._paused = true;
+    this._hub.pause(this._id);
+  }
+
+  /**
+   * Reads the pty again, unless it is throttled.
+   */
+  public resume(): void {
+    this._paused = false;
+    if (!this._throttle || !this._throttle.pausing) {
+      this._hub.resume(this._id);
+    }
+  }
+
+  public kill(signal?: string): void {
+    try {
+      process.kill(this._pid, signal || 'SIGHUP');
+    } catch (e) { /* swallow */ }
+  }
+
+  public destroy(): void {
+    this._close();
+    if (this._scrollback) {
+      // removes its spill files
+      this._scrollback.destroy();
+    }
+    this.kill('SIGHUP');
+  }
+
+  // The shard scans the output for events from the first subscription to
+  // one on (see UnixTerminal).
+  private _scanEvents(): TerminalEvents {
+    if (!this._events) {
+      this._events = new TerminalEvents();
+      if (!this._closed) {
+        this._hub.observe(this._id, new pty.EventScanner());
+      }
+    }
+    return this._events;
+  }
+
+  private _close(): void {
+    if (this._closed) {
+      return;
+    }
+    this._closed = true;
+    // closes the master fd
+    this._hub.remove(this._id);
+    delete this._sinks[this._id];
+    if (this._decoder) {
+      const rest = this._decoder.end();
+      if (rest) {
+        this._onData.fire(rest);
+      }
+    }
+    if (this._plainText) {
+      // the shard ended the last line already unless the pty is still open
+      const text = this._plainText.native.close();
+      if (text) {
+        this._onPlainText.fire(text);
+      }
+    }
+    if (this._lines) {
+      this._lines.close();
+    }
+    if (this._expect) {
+      this._expect.close();
+    }
+    if (this._links) {
+      this._links.close();
+    }
+    if (this._exitTimer) {
+      clearTimeout(this._exitTimer);
+      this._exitTimer = null;
+    }
+    if (this._throttle) {
+      this._throttle.dispose();
+    }
+    if (this._exit) {
+      this._onExit.fire(this._exit);
+    }
+  }
+}
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+
+if (process.platform !== 'win32') {
+  // required lazily, the native screen is not built on Windows
+  const Screen = require('./screen').Screen;
+  const decodeScreenSnapshot = require('./screen').decodeScreenSnapshot;
+  const columns = require('./index').columns;
+  const UnixTerminal = require('./unixTerminal').UnixTerminal;
+
+  describe('Screen', () => {
+    it('should track the text, cursor and attributes', () => {
+      const screen = new Screen(10, 3, {});
+      screen.native.write('hello\r\n\x1b[1;31mred\x1b[0m \x1b[38;2;1;2;3mrgb\x1b[m\r\n0123456789ab');
+      // the last line wrapped and scrolled the first one off
+      assert.deepEqual(screen.lines(), ['red rgb', '0123456789', 'ab']);
+      assert.equal(screen.line(-1), 'hello');
+      const state = screen.state;
+      assert.deepEqual([state.cursorX, state.cursorY, state.scrollback], [2, 2, 1]);
+      const red = screen.cell(0, 0);
+      assert.equal(red.chars, 'r');
+      assert.equal(red.fg, 1);
+      assert.ok(red.bold);
+      assert.equal(screen.cell(4, 0).fg, 0x1010203);
+      assert.equal(screen.cell(3, 0).fg, -1);
+    });
+
+    it('should handle wide and combining characters', () => {
+      const screen = new Screen(10, 2, {});
+      screen.native.write('a中b é');
+      assert.equal(screen.line(0), 'a中b é');
+      assert.equal(screen.cell(1, 0).width, 2);
+      assert.equal(screen.cell(2, 0).width, 0);
+      assert.equal(screen.cell(5, 0).chars, 'é');
+      assert.equal(screen.state.cursorX, 6);
+    });
+
+    it('should bound the combining marks kept', () => {
+      const screen = new Screen(10, 2, {});
+      // marks beyond 16 on a character are dropped
+      screen.native.write('b' + '\u0301'.repeat(1000));
+      assert.equal(screen.cell(0, 0).chars, 'b' + '\u0301'.repeat(16));
+      // the clusters of characters written over are reused
+      for (let i = 0; i < 70; i++) {
+        screen.native.write('\x1b[H' + 'e\u0301'.repeat(1000));
+      }
+      screen.native.write('\x1b[2J\x1b[Ha\u0301');
+      assert.equal(screen.cell(0, 0).chars, 'a\u0301');
+    });
+
+    it('should edit lines and keep the alternate screen apart', () => {
+      const screen = new Screen(10, 4, {});
+      screen.native.write('\x1b]2;title\x07abcdef\x1b[3D\x1b[2P\x1b[1@\r\n\x1b(0lqk\x1b(B');
+      assert.deepEqual(screen.lines(0, 2), ['abc f', '┌─┐']);
+      screen.native.write('\x1b[?1049h\x1b[Hfull screen');
+      assert.ok(screen.state.alternate);
+      assert.equal(screen.line(0), 'full screen'.slice(0, 10));
+      screen.native.write('\x1b[?1049l');
+      assert.deepEqual(screen.lines(0, 2), ['abc f', '┌─┐']);
+      assert.equal(screen.state.title, 'title');
+    });
+
+    it('should keep the lines on the screen when resized', () => {
+      const screen = new Screen(10, 4, {});
+      screen.native.write('1\r\n2\r\n3\r\n4');
+      screen.native.resize(5, 2);
+      assert.deepEqual(screen.lines(-2), ['1', '2', '3', '4']);
+      assert.equal(screen.state.cursorY, 1);
+      screen.native.resize(5, 4);
+      assert.deepEqual(screen.lines(), ['1', '2', '3', '4']);
+    });
+
+    it('should give the rows changed since a version', () => {
+      const screen = new Screen(10, 3, {});
+      screen.native.write('hello\r\nworld');
+      const first = screen.changes(0);
+      assert.deepEqual(first.lines.map((l: any) => l.y), [0, 1, 2]);
+      screen.native.write('\x1b[1;2H\x1b[1mA');
+      const changes = screen.changes(first.version);
+      assert.equal(changes.since, first.version);
+      assert.equal(changes.lines.length, 1);
+      const line = changes.lines[0];
+      assert.deepEqual([line.y, line.left, line.right], [0, 0, 3]);
+      assert.deepEqual(line.chars, ['h', 'A', 'l']);
+      assert.deepEqual(line.runs.map((r: any) => [r.start, r.end, r.flags]), [[0, 1, 0], [1, 2, 1], [2, 3, 0]]);
+      assert.deepEqual(changes.rect, { left: 0, top: 0, right: 3, bottom: 1 });
+      // nothing changed since
+      assert.equal(screen.changes(changes.version).lines.length, 0);
+      // older versions get whole rows
+      assert.equal(screen.changes(first.version - 1).lines[0].right, 10);
+    });
+
+    it('should restore the screen from a snapshot', () => {
+      const screen = new Screen(20, 3, {});
+      screen.native.write('\x1b]2;title\x07one\r\ntwo \x1b[1;31mred\x1b[m\r\n中中e\u0301xxxx\x1b[44m  \x1b[m\r\nfour\x1b[?2004h');
+      const snapshot = decodeScreenSnapshot(screen.snapshot());
+      const text = (line: any) => line.chars.join('');
+      assert.deepEqual(snapshot.scrollback.map(text), ['one']);
+      assert.deepEqual(snapshot.lines.map(text), ['two red', '中中e\u0301xxxx  ', 'four']);
+      assert.deepEqual(snapshot.lines[0].runs.map((r: any) => [r.start, r.end, r.fg, r.flags]), [[0, 4, -1, 0], [4, 7, 1, 1]]);
+      assert.deepEqual(snapshot.lines[1].chars.slice(0, 3), ['中', '', '中']);
+      assert.equal(snapshot.lines[1].runs[1].bg, 4);
+      assert.deepEqual([snapshot.cursorX, snapshot.cursorY, snapshot.title], [4, 2, 'title']);
+      assert.ok(snapshot.bracketedPaste);
+      assert.equal(snapshot.version, screen.state.version);
+      assert.equal(decodeScreenSnapshot(screen.snapshot(0)).scrollback.length, 0);
+      assert.throws(() => decodeScreenSnapshot(Buffer.from('nope')));
+    });
+
+    it('should reject snapshots with cells past their line', () => {
+      const varint = (value: number): number[] => {
+        const bytes: number[] = [];
+        for (; value >= 0x80; value = Math.floor(value / 128)) {
+          bytes.push(value % 128 | 0x80);
+        }
+        return bytes.concat([value]);
+      };
+      // one row of the given columns holding one run of tokens
+      const snapshot = (columns: number, tokens: number[]) => Buffer.from(
+        [0x4E, 0x50, 0x53, 0x53, 1, 0, columns, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, columns * 2, columns, 0, 0, 0]
+          .concat(...tokens.map(varint)));
+      assert.deepEqual(decodeScreenSnapshot(snapshot(3, [0x61 * 4, 2 * 4 + 2])).lines[0].chars, ['a', 'a', 'a']);
+      assert.throws(() => decodeScreenSnapshot(snapshot(3, [0x61 * 4, 1e9 * 4 + 2])), /Invalid/);
+      assert.throws(() => decodeScreenSnapshot(snapshot(1, [0x110000 * 4])), /Invalid/);
+      assert.throws(() => decodeScreenSnapshot(snapshot(1, [0x61 * 4, 0x110000 * 4 + 3])), /Invalid/);
+    });
+
+    it('should follow the output of a terminal', (done) => {
+      const term = new UnixTerminal('/bin/sh', ['-c', 'printf "\\033]0;job\\007one\\ntwo"'], { cols: 20, rows: 5, screen: {} });
+      term.onExit(() => {
+        assert.deepEqual(term.screen.lines(0, 3), ['one', 'two', '']);
+        assert.equal(term.screen.state.title, 'job');
+        done();
+      });
+    });
+  });
+
+  describe('columns', () => {
+    it('should count the columns of text', () => {
+      assert.equal(columns('hello'), 5);
+      assert.equal(columns('a中b'), 4);
+      assert.equal(columns('e\u0301'), 1);
+      assert.equal(columns('😀\u200b'), 2);
+      assert.equal(columns('tab\there\r\n'), 7);
+      assert.equal(columns(Buffer.from([0x61, 0xff, 0x62])), 3);
+      assert.equal(columns('x'.repeat(1000) + '中'), 1002);
+    });
+
+    it('should agree with the screen', () => {
+      const text = 'ｆｕｌｌ ✔ ⌚ 🇩🇪 한국어';
+      const screen = new Screen(80, 2, {});
+      screen.native.write(text);
+      assert.equal(screen.state.cursorX, columns(text));
+    });
+  });
+}
@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { IScreenOptions, IScreenState, IScreenCell, IScreenChanges, IScreenLine, IScreenSnapshot } from './interfaces';
+
+const DEFAULT_SCROLLBACK = 1000;
+const DEFAULT_SNAPSHOT_SCROLLBACK = 100;
+
+// See kSnapshotFormat in src/unix/screen.h.
+const SNAPSHOT_MAGIC = 'NPSS';
+const SNAPSHOT_FORMAT = 1;
+const TOKEN_CHAR = 0;
+const TOKEN_WIDE = 1;
+const TOKEN_REPEAT = 2;
+const TOKEN_COMBINE = 3;
+// See kMaxSize in src/unix/screen.cc, no line is wider.
+const MAX_SIZE = 4096;
+
+// Global in browsers and in Node 11 on, exported by util before.
+declare const TextDecoder: { new (label: string): { decode(input: Uint8Array): string } } | undefined;
+let utf8Decoder: { decode(input: Uint8Array): string } | undefined;
+
+/**
+ * The native screen model of a terminal: output is parsed as it is read, by
+ * the hub shard or as the socket delivers it, and what the terminal shows can
+ * be queried at any time. Rows count from the top of the screen, the lines of
+ * the scrollback have negative rows.
+ */
+export class Screen {
+  public readonly native: IUnixScreen;
+
+  constructor(cols: number, rows: number, opt: IScreenOptions) {
+    const scrollback = opt.scrollback === undefined ? DEFAULT_SCROLLBACK : opt.scrollback;
+    if (typeof scrollback !== 'number' || !(scrollback >= 0)) {
+      throw new Error('screen.scrollback must be a non-negative number');
+    }
+    // required lazily, unixTerminal uses this module
+    const pty: IUnixNative = require('./unixTerminal').pty;
+    this.native = new pty.Screen({ cols, rows, scrollback });
+  }
+
+  public get state(): IScreenState { return this.native.state(); }
+
+  /**
+   * The text of rows [start, end), without trailing blanks. Defaults to the
+   * rows of the screen.
+   */
+  public lines(start?: number, end?: number): string[] {
+    if (start === undefined) {
+      start = 0;
+    }
+    if (end === undefined) {
+      end = this.native.state().rows;
+    }
+    return this.native.lines(start, end);
+  }
+
+  /**
+   * The text of a row, '' for rows that are not there.
+   */
+  public line(row: number): string {
+    const lines = this.native.lines(row, row + 1);
+    return lines.length ? lines[0] : '';
+  }
+
+  /**
+   * The rows of the screen joined by newlines.
+   */
+  public get text(): string {
+    return this.lines().join('\n');
+  }
+
+  public cell(x: number, y: number): IScreenCell | null {
+    return this.native.cell(x, y);
+  }
+
+  /**
+   * The rows changed after version since, with the columns that changed when
+   * they are known.
+   */
+  public changes(since: number): IScreenChanges {
+    if (typeof since !== 'number' || !(since >= 0)) {
+      throw new Error('since must be a non-negative version');
+    }
+    return this.native.changes(since);
+  }
+
+  /**
+   * A compact binary snapshot of the screen shown, its modes and up to
+   * scrollback lines of the scrollback, see decodeScreenSnapshot.
+   */
+  public snapshot(scrollback: number = DEFAULT_SNAPSHOT_SCROLLBACK): Buffer {
+    if (typeof scrollback !== 'number' || !(scrollback >= 0)) {
+      throw new Error('scrollback must be a non-negative number');
+    }
+    return this.native.snapshot(scrollback);
+  }
+
+  public reset(): void {
+    this.native.reset();
+  }
+}
+
+// Colors as in the screen model: 0 is the default, 1 << 24 | index a palette
+// color and 2 << 24 | 0xRRGGBB a direct color.
+function jsColor(color: number): number {
+  if (color === 0) {
+    return -1;
+  }
+  if (color < 0x2000000) {
+    return color & 0xFF;
+  }
+  return 0x1000000 + (color & 0xFFFFFF);
+}
+
+function decodeUtf8(bytes: Uint8Array): string {
+  if (!utf8Decoder) {
+    utf8Decoder = new (typeof TextDecoder !== 'undefined' ? TextDecoder : require('util').TextDecoder)('utf-8');
+  }
+  return utf8Decoder!.decode(bytes);
+}
+
+function fromCodePoint(value: number): string {
+  // String.fromCodePoint throws a RangeError past the last code point
+  if (value > 0x10FFFF) {
+    throw new Error('Invalid screen snapshot');
+  }
+  return String.fromCodePoint(value);
+}
+
+class SnapshotReader {
+  private _data: Uint8Array;
+  private _offset: number = 0;
+
+  constructor(data: Uint8Array) {
+    this._data = data;
+  }
+
+  public varint(): number {
+    let value = 0;
+    let scale = 1;
+    for (;;) {
+      if (this._offset >= this._data.length) {
+        throw new Error('Truncated screen snapshot');
+      }
+      const byte = this._data[this._offset++];
+      // multiplies rather than shifts, versions may not fit 32 bits
+      value += (byte & 0x7F) * scale;
+      if (byte < 0x80) {
+        return value;
+      }
+      scale *= 128;
+    }
+  }
+
+  public bytes(length: number): Uint8Array {
+    if (this._offset + length > this._data.length) {
+      throw new Error('Truncated screen snapshot');
+    }
+    const bytes = this._data.subarray(this._offset, this._offset + length);
+    this._offset += length;
+    return bytes;
+  }
+
+  public line(): IScreenLine {
+    const header = this.varint();
+    const columns = Math.floor(header / 2);
+    if (columns > MAX_SIZE) {
+      throw new Error('Invalid screen snapshot');
+    }
+    const line: IScreenLine = { wrapped: (header & 1) === 1, chars: [], runs: [] };
+    while (line.chars.length < columns) {
+      const start = line.chars.length;
+      const end = start + this.varint();
+      if (end > columns) {
+        throw new Error('Invalid screen snapshot');
+      }
+      line.runs.push({ start, end, fg: jsColor(this.varint()), bg: jsColor(this.varint()), flags: this.varint() });
+      let last = -1;
+      while (line.chars.length < end) {
+        const token = this.varint();
+        const kind = token & 3;
+        const value = Math.floor(token / 4);
+        if (kind === TOKEN_COMBINE && last >= 0) {
+          line.chars[last] += fromCodePoint(value);
+        } else if (kind === TOKEN_REPEAT && last >= 0) {
+          const wide = line.chars.length - last === 2;
+          if (value * (wide ? 2 : 1) > end - line.chars.length) {
+            throw new Error('Invalid screen snapshot');
+          }
+          for (let i = 0; i < value; i++) {
+            line.chars.push(line.chars[last]);
+            if (wide) {
+              line.chars.push('');
+            }
+          }
+          last = line.chars.length - (wide ? 2 : 1);
+        } else if (kind === TOKEN_CHAR || kind === TOKEN_WIDE) {
+          last = line.chars.length;
+          line.chars.push(value === 0 ? ' ' : fromCodePoint(value));
+          if (kind === TOKEN_WIDE) {
+            line.chars.push('');
+          }
+        } else {
+          throw new Error('Invalid screen snapshot');
+        }
+      }
+      if (line.chars.length > end) {
+        throw new Error('Invalid screen snapshot');
+      }
+    }
+    return line;
+  }
+}
+
+/**
+ * Decodes a snapshot of Screen.snapshot. It needs nothing native, so that the
+ * client a snapshot is sent to can decode it as well. Lines are cut after
+ * their last character.
+ */
+export function decodeScreenSnapshot(data: Uint8Array): IScreenSnapshot {
+  const reader = new SnapshotReader(data);
+  if (String.fromCharCode.apply(null, reader.bytes(4)) !== SNAPSHOT_MAGIC) {
+    throw new Error('Not a screen snapshot');
+  }
+  const format = reader.varint();
+  if (format !== SNAPSHOT_FORMAT) {
+    throw new Error(`Unsupported screen snapshot format ${format}`);
+  }
+  const modes = reader.varint();
+  const snapshot: IScreenSnapshot = {
+    cursorVisible: (modes & 1) !== 0,
+    alternate: (modes & 2) !== 0,
+    applicationCursor: (modes & 4) !== 0,
+    bracketedPaste: (modes & 8) !== 0,
+    autowrap: (modes & 16) !== 0,
+    origin: (modes & 32) !== 0,
+    insert: (modes & 64) !== 0,
+    newline: (modes & 128) !== 0,
+    wrapPending: (modes & 256) !== 0,
+    cols: reader.varint(),
+    rows: reader.varint(),
+    cursorX: reader.varint(),
+    cursorY: reader.varint(),
+    scrollTop: reader.varint(),
+    scrollBottom: reader.varint(),
+    attributes: { fg: jsColor(reader.varint()), bg: jsColor(reader.varint()), flags: reader.varint() },
+    version: reader.varint(),
+    saved: reader.varint(),
+    title: decodeUtf8(reader.bytes(reader.varint())),
+    scrollback: [],
+    lines: []
+  };
+  for (let i = reader.varint(); i > 0; i--) {
+    snapshot.scrollback.push(reader.line());
+  }
+  if (snapshot.rows > MAX_SIZE) {
+    throw new Error('Invalid screen snapshot');
+  }
+  for (let y = 0; y < snapshot.rows; y++) {
+    snapshot.lines.push(reader.line());
+  }
+  return snapshot;
+}
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+import * as fs from 'fs';
+import * as os from 'os';
+import * as path from 'path';
+import { pollUntil } from './testUtils.test';
+
+if (process.platform !== 'win32') {
+  // required lazily, the native store is not built on Windows
+  const Scrollback = require('./scrollback').Scrollback;
+  const UnixTerminal = require('./unixTerminal').UnixTerminal;
+
+  describe('Scrollback', () => {
+    it('should return the last bytes and lines', () => {
+      const scrollback = new Scrollback({ limit: 1024 * 1024 });
+      scrollback.native.write('one\ntwo\nthree\n');
+      scrollback.native.write(Buffer.from('four'));
+      assert.equal(scrollback.tail(6), 'e\nfour');
+      assert.equal(scrollback.tailLines(2), 'three\nfour');
+      assert.equal(scrollback.tailLines(10), 'one\ntwo\nthree\nfour');
+      scrollback.native.write('\n');
+      assert.equal(scrollback.tailLines(1), 'four\n');
+    });
+
+    it('should replay from an offset', () => {
+      const scrollback = new Scrollback({ limit: 1024 * 1024 });
+      scrollback.native.write('hello world');
+      assert.deepEqual(scrollback.read(6), { offset: 6, data: 'world' });
+      assert.deepEqual(scrollback.read(0, 5), { offset: 0, data: 'hello' });
+      assert.deepEqual(scrollback.read(100), { offset: 11, data: '' });
+    });
+
+    it('should not cut characters apart', () => {
+      const scrollback = new Scrollback({ limit: 1024 * 1024 });
+      scrollback.native.write('a€b');
+      // the euro sign is 3 bytes from offset 1
+      assert.deepEqual(scrollback.read(2), { offset: 4, data: 'b' });
+      assert.deepEqual(scrollback.read(0, 3), { offset: 0, data: 'a' });
+    });
+
+    it('should drop the oldest output beyond the limit', async () => {
+      const scrollback = new Scrollback({ limit: 64 * 1024, segmentSize: 4096 });
+      let line = '';
+      for (let i = 0; i < 20000; i++) {
+        line = `line ${i} of the output\n`;
+        scrollback.native.write(line);
+      }
+      // compression runs in the background
+      await pollUntil(() => scrollback.stats.compressed > 0, 1000, 10);
+      const stats = scrollback.stats;
+      assert.ok(stats.start > 0);
+      assert.ok(stats.memory <= 64 * 1024, String(stats.memory));
+      // more output is held than memory used
+      assert.ok(stats.end - stats.start > stats.memory, JSON.stringify(stats));
+      assert.equal(scrollback.tailLines(1), line);
+      const replay = scrollback.read(0);
+      assert.equal(replay.offset, stats.start);
+      assert.equal(replay.data.length, stats.end - stats.start);
+    });
+
+    it('should read lines by number', () => {
+      const scrollback = new Scrollback({ limit: 1024 * 1024 });
+      scrollback.native.write('zero\none\ntwo\nthree');
+      assert.deepEqual(scrollback.readLines(1, 2), { offset: 5, line: 1, data: 'one\ntwo\n' });
+      assert.deepEqual(scrollback.readLines(3), { offset: 13, line: 3, data: 'three' });
+      assert.deepEqual(scrollback.readLines(10), { offset: 18, line: 3, data: '' });
+    });
+
+    it('should search the output held', async () => {
+      const scrollback = new Scrollback({ limit: 1024 * 1024, segmentSize: 4096 });
+      let all = '';
+      for (let i = 0; i < 20000; i++) {
+        const line = `line ${i} of the output\r\n`;
+        scrollback.native.write(line);
+        all += line;
+      }
+      // segments are indexed in the background
+      await pollUntil(() => scrollback.stats.index > 0, 1000, 10);
+      assert.deepEqual(scrollback.search('line 12345 '), [{ offset: all.indexOf('line 12345 '), length: 11, line: 12345 }]);
+      assert.deepEqual(scrollback.search('LINE 7 OF', { caseInsensitive: true }).map((m: any) => m.line), [7]);
+      const matches = scrollback.search('^line 1999\\d of the output$', { regex: true });
+      assert.deepEqual(matches.map((m: any) => m.line), [19990, 19991, 19992, 19993, 19994, 19995, 19996, 19997, 19998, 19999]);
+      assert.equal(scrollback.read(matches[0].offset, matches[0].length).data, 'line 19990 of the output');
+      // the digits of an escape are no literal the output must hold
+      assert.deepEqual(scrollback.search('\\x6Cine 12345 ', { regex: true }).map((m: any) => m.line), [12345]);
+      assert.equal(scrollback.search('output', { limit: 3 }).length, 3);
+      assert.deepEqual(scrollback.search('line 20000'), []);
+      assert.throws(() => scrollback.search('(', { regex: true }), /Invalid regex/);
+    });
+
+    it('should search a long line with a regex', () => {
+      const scrollback = new Scrollback({ limit: 4 * 1024 * 1024 });
+      // as minified JSON, a backtracking matcher would run out of stack
+      scrollback.native.write('a'.repeat(150000) + 'y' + 'a'.repeat(150000) + '\n');
+      assert.deepEqual(scrollback.search('a.*y', { regex: true }), [{ offset: 0, length: 150001, line: 0 }]);
+      assert.deepEqual(scrollback.search('(a|b)*y', { regex: true }), [{ offset: 0, length: 150001, line: 0 }]);
+    });
+
+    it('should spill old output to files until destroyed', () => {
+      const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'node-pty-'));
+      const scrollback = new Scrollback({ limit: 64 * 1024, segmentSize: 4096, directory });
+      let all = '';
+      for (let i = 0; i < 20000; i++) {
+        const line = `line ${i} of the output\n`;
+        scrollback.native.write(line);
+        all += line;
+      }
+      const stats = scrollback.stats;
+      assert.equal(stats.start, 0);
+      assert.ok(stats.memory <= 64 * 1024, String(stats.memory));
+      assert.ok(stats.spilled > 0 && stats.disk > 0, JSON.stringify(stats));
+      assert.equal(stats.endLine, 20000);
+      assert.equal(scrollback.read(0).data, all);
+      assert.equal(scrollback.readLines(12345, 2).data, 'line 12345 of the output\nline 12346 of the output\n');
+      assert.ok(fs.readdirSync(directory).length > 0);
+      scrollback.destroy();
+      assert.deepEqual(fs.readdirSync(directory), []);
+      fs.rmdirSync(directory);
+    });
+
+    describe('memory budget', () => {
+      afterEach(() => UnixTerminal.configureMemoryBudget({ limit: 0 }));
+
+      it('should evict the least recently viewed scrollback first', async () => {
+        const stale = new Scrollback({ limit: 1024 * 1024, segmentSize: 4096, compress: false });
+        const viewed = new Scrollback({ limit: 1024 * 1024, segmentSize: 4096, compress: false });
+        for (let i = 0; i < 10000; i++) {
+          stale.native.write(`line ${i} of the output\n`);
+          viewed.native.write(`line ${i} of the output\n`);
+        }
+        await new Promise(r => setTimeout(r, 20));
+        viewed.markViewed();
+        UnixTerminal.configureMemoryBudget({ limit: 400 * 1024 });
+        await pollUntil(() => UnixTerminal.memoryBudgetStats.reclaims > 0 && !UnixTerminal.memoryBudgetStats.backpressure, 1000, 10);
+        assert.ok(stale.stats.start > 0, JSON.stringify(stale.stats));
+        assert.ok(stale.stats.start > viewed.stats.start, JSON.stringify(viewed.stats));
+        assert.equal(viewed.tailLines(1), 'line 9999 of the output\n');
+      });
+
+      it('should not hold back reads for what reclaiming cannot free', () => {
+        // each holds less than a segment, which is never reclaimed
+        const scrollbacks: Scrollback[] = [];
+        for (let i = 0; i < 8; i++) {
+          const scrollback = new Scrollback({ limit: 1024 * 1024, segmentSize: 64 * 1024 });
+          scrollback.native.write('x'.repeat(60 * 1024));
+          scrollbacks.push(scrollback);
+        }
+        UnixTerminal.configureMemoryBudget({ limit: 128 * 1024 });
+        const stats = UnixTerminal.memoryBudgetStats;
+        assert.ok(stats.floor >= 8 * 60 * 1024, JSON.stringify(stats));
+        assert.ok(!stats.backpressure, JSON.stringify(stats));
+        scrollbacks.forEach(scrollback => scrollback.destroy());
+      });
+    });
+
+    it('should read what was missed since a sequence number', () => {
+      const scrollback = new Scrollback({ limit: 4096, segmentSize: 1024, compress: false });
+      scrollback.native.write('hello world');
+      assert.deepEqual(scrollback.readSince(6, 11), { tooOld: false, offset: 6, end: 11, data: 'world' });
+      // up to what was delivered only
+      assert.deepEqual(scrollback.readSince(0, 5), { tooOld: false, offset: 0, end: 5, data: 'hello' });
+      assert.throws(() => scrollback.readSince(12, 11));
+      for (let i = 0; i < 100; i++) {
+        scrollback.native.write('x'.repeat(100));
+      }
+      const since = scrollback.readSince(0, scrollback.end);
+      assert.ok(since.tooOld);
+      assert.equal(since.offset, scrollback.start);
+      assert.equal(since.data, '');
+    });
+
+    it('should give the sequence number of the output of a terminal', (done) => {
+      const term = new UnixTerminal('/bin/sh', ['-c', 'printf one; sleep 0.1; printf two€'], { scrollback: {} });
+      const seqs: number[] = [];
+      term.onData(() => seqs.push(term.seq));
+      term.onExit(() => {
+        assert.equal(term.seq, 9);
+        assert.equal(seqs[seqs.length - 1], 9);
+        assert.deepEqual(term.readSince(3), { tooOld: false, offset: 3, end: 9, data: 'two€' });
+        assert.equal(term.readSince(9).data, '');
+        done();
+      });
+    });
+
+    it('should keep the output of a terminal', (done) => {
+      const term = new UnixTerminal('/bin/sh', ['-c', 'for i in 1 2 3; do echo line$i; done'], { scrollback: {} });
+      term.onExit(() => {
+        assert.equal(term.scrollback.tailLines(2).replace(/\r/g, ''), 'line2\nline3\n');
+        done();
+      });
+    });
+  });
+}
@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { IScrollbackOptions, IScrollbackChunk, IScrollbackLines, IScrollbackStats, IOutputSince, ISearchOptions, ISearchMatch } from './interfaces';
+
+const DEFAULT_LIMIT = 8 * 1024 * 1024;
+const DEFAULT_SEARCH_LIMIT = 1000;
+
+// The length of data without a UTF-8 sequence cut off at its end (see
+// utf8_boundary in hub.cc).
+function utf8Boundary(data: Buffer): number {
+  let i = data.length;
+  while (i > 0 && data.length - i < 3 && (data[i - 1] & 0xC0) === 0x80) {
+    i--;
+  }
+  if (i === 0) {
+    return data.length;
+  }
+  const lead = data[i - 1];
+  const need = lead >= 0xF8 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+  return data.length - (i - 1) < need ? i - 1 : data.length;
+}
+
+/**
+ * The native scrollback of a terminal. Offsets count bytes of output since
+ * the terminal started, reads from output that was dropped already start at
+ * the oldest output held. With a directory, output beyond the limit is
+ * spilled to files there until the store is destroyed.
+ */
+export class Scrollback {
+  public readonly native: IUnixScrollback;
+  /** How output is returned, a Buffer when null. */
+  public encoding: string | null = 'utf8';
+
+  constructor(opt: IScrollbackOptions) {
+    const limit = opt.limit === undefined ? DEFAULT_LIMIT : opt.limit;
+    if (typeof limit !== 'number' || !(limit > 0)) {
+      throw new Error('scrollback.limit must be a positive number');
+    }
+    if (opt.directory !== undefined && typeof opt.directory !== 'string') {
+      throw new Error('scrollback.directory must be a string');
+    }
+    if (opt.diskLimit !== undefined && (typeof opt.diskLimit !== 'number' || !(opt.diskLimit > 0))) {
+      throw new Error('scrollback.diskLimit must be a positive number');
+    }
+    // required lazily, unixTerminal uses this module
+    const pty: IUnixNative = require('./unixTerminal').pty;
+    this.native = new pty.Scrollback({
+      limit,
+      segmentSize: opt.segmentSize,
+      compress: opt.compress !== false,
+      directory: opt.directory,
+      diskLimit: opt.diskLimit
+    });
+  }
+
+  public get start(): number { return this.native.stats().start; }
+  public get end(): number { return this.native.stats().end; }
+  public get stats(): IScrollbackStats { return this.native.stats(); }
+
+  /**
+   * The last output, up to the given number of bytes.
+   */
+  public tail(bytes: number): string | Buffer {
+    return this._decode(this.native.tail(bytes), false).data;
+  }
+
+  /**
+   * The last lines of output, including the unterminated last line.
+   */
+  public tailLines(lines: number): string | Buffer {
+    return this._decode(this.native.tailLines(lines), false).data;
+  }
+
+  /**
+   * The output from offset on, at most length bytes.
+   */
+  public read(offset: number, length?: number): IScrollbackChunk {
+    return this._decode(this.native.read(offset, length), length !== undefined);
+  }
+
+  /**
+   * The output from offset seq to end, which the terminal delivered already.
+   * When the output from seq on is not held anymore it is too old and the
+   * data is empty.
+   */
+  public readSince(seq: number, end: number): IOutputSince {
+    if (typeof seq !== 'number' || !(seq >= 0) || seq !== Math.floor(seq)) {
+      throw new Error('seq must be a non-negative integer');
+    }
+    if (seq > end) {
+      throw new Error(`seq ${seq} is ahead of the output (${end})`);
+    }
+    const chunk = this.native.read(seq, end - seq);
+    if (chunk.offset !== seq) {
+      return { tooOld: true, offset: chunk.offset, end, data: this.encoding === null ? Buffer.alloc(0) : '' };
+    }
+    if (chunk.data.length < end - seq) {
+      // a spilled or compressed segment could not be read back
+      throw new Error(`The output from ${seq + chunk.data.length} on could not be read`);
+    }
+    // seq and end are both where output was delivered, at character
+    // boundaries
+    const decoded = this._decode(chunk, false);
+    return { tooOld: false, offset: seq, end, data: decoded.data };
+  }
+
+  /**
+   * The output from the start of line on, at most count lines.
+   */
+  public readLines(line: number, count?: number): IScrollbackLines {
+    const chunk = this.native.readLines(line, count);
+    const decoded = this._decode(chunk, false);
+    return { offset: decoded.offset, line: chunk.line, data: decoded.data };
+  }
+
+  /**
+   * The matches of query in the output held, oldest first. Segments are
+   * indexed by their trigrams, so only the ones that may hold the query (or
+   * the literal a regex cannot match without) are read. Regexes match within
+   * lines, in ECMAScript syntax.
+   */
+  public search(query: string, opt?: ISearchOptions): ISearchMatch[] {
+    const limit = opt && opt.limit !== undefined ? opt.limit : DEFAULT_SEARCH_LIMIT;
+    if (typeof query !== 'string' || query.length === 0) {
+      throw new Error('query must be a non-empty string');
+    }
+    if (typeof limit !== 'number' || !(limit >= 0) || limit !== Math.floor(limit)) {
+      throw new Error('limit must be a non-negative integer');
+    }
+    return this.native.search(query, !!(opt && opt.regex), !!(opt && opt.caseInsensitive), limit);
+  }
+
+  public clear(): void {
+    this.native.clear();
+  }
+
+  /**
+   * Marks the output as looked at, like reading it does. The memory budget
+   * reclaims from the least recently viewed scrollback first.
+   */
+  public markViewed(): void {
+    this.native.markViewed();
+  }
+
+  /**
+   * Drops all output and removes the spill files, later output is ignored.
+   */
+  public destroy(): void {
+    this.native.destroy();
+  }
+
+  private _decode(chunk: { offset: number, data: Buffer }, cut: boolean): IScrollbackChunk {
+    if (this.encoding === null) {
+      return chunk;
+    }
+    let data = chunk.data;
+    let offset = chunk.offset;
+    if (this.encoding === 'utf8') {
+      // reads may start or (with a length) end within a character
+      let skip = 0;
+      while (skip < 3 && skip < data.length && (data[skip] & 0xC0) === 0x80) {
+        skip++;
+      }
+      data = data.slice(skip, cut ? utf8Boundary(data) : data.length);
+      offset += skip;
+    }
+    return { offset, data: data.toString(this.encoding) };
+  }
+}
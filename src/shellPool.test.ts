@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+import { WindowsTerminal } from './windowsTerminal';
+import { UnixTerminal } from './unixTerminal';
+import { ShellPool } from './shellPool';
+import { pollUntil } from './testUtils.test';
+
+const terminalConstructor = (process.platform === 'win32') ? WindowsTerminal : UnixTerminal;
+const SHELL = (process.platform === 'win32') ? 'cmd.exe' : '/bin/bash';
+const PROMPT_ARGS = (process.platform === 'win32') ? ['/k', 'echo ready'] : ['-c', 'echo ready; exec cat'];
+
+describe('ShellPool', () => {
+  let pool: ShellPool;
+
+  beforeEach(() => {
+    pool = new ShellPool((file, args, opt) => new terminalConstructor(file, args, opt), { size: 1, promptPattern: /ready/ });
+  });
+
+  afterEach(() => pool.dispose());
+
+  it('should keep an initialized shell per configuration', async () => {
+    pool.warm(SHELL, PROMPT_ARGS, {});
+    await pollUntil(() => pool.stats.ready === 1, 5000, 10);
+    assert.equal(pool.stats.idle, 1);
+  });
+
+  it('should replay the buffered prompt to the claimant', (done) => {
+    pool.warm(SHELL, PROMPT_ARGS, {});
+    pollUntil(() => pool.stats.ready === 1, 5000, 10).then(() => {
+      const term = pool.claim(SHELL, PROMPT_ARGS, { cols: 100, rows: 30 });
+      assert.equal(pool.stats.hits, 1);
+      assert.equal(term.cols, 100);
+      assert.equal(term.rows, 30);
+      term.onData(data => {
+        assert.ok(data.indexOf('ready') !== -1);
+        term.kill();
+        done();
+      });
+    });
+  });
+
+  if (process.platform !== 'win32') {
+    it('should replay the prompt to listeners only, not to the scrollback or screen', (done) => {
+      const opt: any = { scrollback: {}, screen: {} };
+      pool.warm(SHELL, PROMPT_ARGS, opt);
+      pollUntil(() => pool.stats.ready === 1, 5000, 10).then(() => {
+        const term: any = pool.claim(SHELL, PROMPT_ARGS, opt);
+        let data = '';
+        term.on('data', (d: string) => data += d);
+        setTimeout(() => {
+          assert.equal(data, 'ready\r\n');
+          assert.equal(term.scrollback.read(0).data.toString(), 'ready\r\n');
+          assert.deepEqual(term.screen.lines(0, 2), ['ready', '']);
+          term.kill();
+          done();
+        }, 200);
+      });
+    });
+  }
+
+  it('should spawn on a miss and refill in the background', async () => {
+    const term = pool.claim(SHELL, PROMPT_ARGS, {});
+    assert.equal(pool.stats.misses, 1);
+    await pollUntil(() => pool.stats.idle === 1, 5000, 10);
+    term.kill();
+  });
+
+  it('should not replace the shells of a configuration nobody claims', async function (): Promise<void> {
+    this.timeout(10000);
+    pool.dispose();
+    pool = new ShellPool((file, args, opt) => new terminalConstructor(file, args, opt), { size: 1, promptPattern: /ready/, idleTimeout: 500 });
+    pool.warm(SHELL, PROMPT_ARGS, {});
+    await pollUntil(() => pool.stats.ready === 1, 5000, 10);
+    await pollUntil(() => pool.stats.idle === 0, 5000, 100);
+    await new Promise(resolve => setTimeout(resolve, 1500));
+    assert.equal(pool.stats.idle, 0);
+  });
+});
@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { Terminal } from './terminal';
+import { IPtyForkOptions, IWindowsPtyForkOptions, IShellPoolOptions, IShellPoolStats } from './interfaces';
+import { ArgvOrCommandLine } from './types';
+
+const DEFAULT_POOL_SIZE = 1;
+const DEFAULT_SETTLE_TIME_MS = 100;
+const DEFAULT_IDLE_TIMEOUT_MS = 5 * 60 * 1000;
+
+type SpawnFunction = (file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions | IWindowsPtyForkOptions) => Terminal;
+
+interface IIdleShell {
+  term: Terminal;
+  ready: boolean;
+  // since when it waits unclaimed, from spawn until it is ready
+  idleSince: number;
+  output: any[];
+  onData: (data: any) => void;
+  onExit: () => void;
+  settleTimer: NodeJS.Timer | null;
+}
+
+interface IShellConfig {
+  file?: string;
+  args?: ArgvOrCommandLine;
+  opt: IPtyForkOptions | IWindowsPtyForkOptions;
+  shells: IIdleShell[];
+  lastUsed: number;
+}
+
+/**
+ * Keeps shells spawned and initialized ahead of time per spawn configuration
+ * so that claiming one skips shell startup (rc files, prompt init). Output
+ * produced while idle (the first prompt) is buffered and replayed to the
+ * claimant.
+ */
+export class ShellPool {
+  private _configs: { [key: string]: IShellConfig } = {};
+  private _size: number;
+  private _promptPattern: RegExp | undefined;
+  private _settleTime: number;
+  private _idleTimeout: number;
+  private _retireTimer: NodeJS.Timer;
+  private _hits: number = 0;
+  private _misses: number = 0;
+  private _disposed: boolean = false;
+
+  constructor(
+    private _spawn: SpawnFunction,
+    opt?: IShellPoolOptions
+  ) {
+    opt = opt || {};
+    this._size = opt.size === undefined ? DEFAULT_POOL_SIZE : opt.size;
+    this._promptPattern = opt.promptPattern;
+    this._settleTime = opt.settleTime || DEFAULT_SETTLE_TIME_MS;
+    this._idleTimeout = opt.idleTimeout || DEFAULT_IDLE_TIMEOUT_MS;
+    this._retireTimer = setInterval(() => this._retire(), Math.max(this._idleTimeout / 4, 1000));
+    this._retireTimer.unref();
+  }
+
+  public get stats(): IShellPoolStats {
+    let idle = 0;
+    let ready = 0;
+    Object.keys(this._configs).forEach(key => {
+      this._configs[key].shells.forEach(shell => {
+        idle++;
+        if (shell.ready) {
+          ready++;
+        }
+      });
+    });
+    return { idle, ready, hits: this._hits, misses: this._misses };
+  }
+
+  /**
+   * Starts keeping shells for a spawn configuration without claiming one.
+   */
+  public warm(file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions | IWindowsPtyForkOptions): void {
+    const config = this._getConfig(file, args, opt);
+    config.lastUsed = Date.now();
+    this._refill(config);
+  }
+
+  /**
+   * Hands out an idle shell for the spawn configuration, preferring one that
+   * already printed its prompt, or spawns a new one when none is idle. The
+   * pool is refilled in the background.
+   */
+  public claim(file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions | IWindowsPtyForkOptions): Terminal {
+    if (this._disposed) {
+      throw new Error('The shell pool is disposed');
+    }
+    const config = this._getConfig(file, args, opt);
+    config.lastUsed = Date.now();
+
+    let index = -1;
+    for (let i = 0; i < config.shells.length; i++) {
+      if (config.shells[i].ready) {
+        index = i;
+        break;
+      }
+    }
+    if (index === -1 && config.shells.length > 0) {
+      index = 0;
+    }
+
+    if (index === -1) {
+      this._misses++;
+      setImmediate(() => this._refill(config));
+      return this._spawn(file, args, opt);
+    }
+
+    this._hits++;
+    const shell = config.shells.splice(index, 1)[0];
+    this._release(shell);
+
+    const term = shell.term;
+    opt = opt || {};
+    const cols = opt.cols || term.cols;
+    const rows = opt.rows || term.rows;
+    if (cols !== term.cols || rows !== term.rows) {
+      term.resize(cols, rows);
+    }
+
+    // Replay once the claimant had a chance to attach its listeners, no pty
+    // data can be emitted before the next tick.
+    if (shell.output.length > 0) {
+      const output = typeof shell.output[0] === 'string' ? shell.output.join('') : Buffer.concat(shell.output);
+      process.nextTick(() => term.replay(output));
+    }
+
+    setImmediate(() => this._refill(config));
+    return term;
+  }
+
+  /**
+   * Kills all idle shells, claimed shells are not affected.
+   */
+  public dispose(): void {
+    this._disposed = true;
+    clearInterval(this._retireTimer);
+    Object.keys(this._configs).forEach(key => {
+      const shells = this._configs[key].shells;
+      this._configs[key].shells = [];
+      shells.forEach(shell => {
+        this._release(shell);
+        shell.term.kill();
+      });
+    });
+    this._configs = {};
+  }
+
+  private _getConfig(file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions | IWindowsPtyForkOptions): IShellConfig {
+    opt = opt || {};
+    // The size is applied on claim, it does not make a different shell.
+    const keyOpt: any = {};
+    Object.keys(opt).sort().forEach(k => {
+      if (k !== 'cols' && k !== 'rows') {
+        keyOpt[k] = (<any>opt)[k];
+      }
+    });
+    const key = JSON.stringify([file, args, keyOpt]);
+    let config = this._configs[key];
+    if (!config) {
+      config = this._configs[key] = { file, args, opt, shells: [], lastUsed: 0 };
+    }
+    return config;
+  }
+
+  private _refill(config: IShellConfig): void {
+    while (!this._disposed && config.shells.length < this._size) {
+      config.shells.push(this._spawnIdle(config));
+    }
+  }
+
+  private _spawnIdle(config: IShellConfig): IIdleShell {
+    const term = this._spawn(config.file, config.args, config.opt);
+    const shell: IIdleShell = {
+      term,
+      ready: false,
+      idleSince: Date.now(),
+      output: [],
+      onData: null,
+      onExit: null,
+      settleTimer: null
+    };
+    shell.onData = (data: any) => {
+      shell.output.push(data);
+      if (shell.ready) {
+        return;
+      }
+      if (this._promptPattern) {
+        const text = typeof data === 'string' ? shell.output.join('') : Buffer.concat(shell.output).toString();
+        if (this._promptPattern.test(text)) {
+          shell.ready = true;
+          shell.idleSince = Date.now();
+        }
+        return;
+      }
+      // Without a pattern the prompt is the output before the shell settles.
+      if (shell.settleTimer) {
+        clearTimeout(shell.settleTimer);
+      }
+      shell.settleTimer = setTimeout(() => {
+        shell.settleTimer = null;
+        shell.ready = true;
+        shell.idleSince = Date.now();
+      }, this._settleTime);
+    };
+    shell.onExit = () => {
+      const index = config.shells.indexOf(shell);
+      if (index !== -1) {
+        config.shells.splice(index, 1);
+        this._release(shell);
+      }
+    };
+    term.on('data', shell.onData);
+    term.on('exit', shell.onExit);
+    return shell;
+  }
+
+  private _release(shell: IIdleShell): void {
+    if (shell.settleTimer) {
+      clearTimeout(shell.settleTimer);
+      shell.settleTimer = null;
+    }
+    shell.term.removeListener('data', shell.onData);
+    shell.term.removeListener('exit', shell.onExit);
+  }
+
+  private _retire(): void {
+    const now = Date.now();
+    Object.keys(this._configs).forEach(key => {
+      const config = this._configs[key];
+      // A shell is idle since the configuration was last claimed, or since
+      // it became ready if that was later.
+      const retired = config.shells.filter(shell => now - Math.max(config.lastUsed, shell.idleSince) > this._idleTimeout);
+      config.shells = config.shells.filter(shell => retired.indexOf(shell) === -1);
+      retired.forEach(shell => {
+        this._release(shell);
+        shell.term.kill();
+      });
+      if (now - config.lastUsed <= this._idleTimeout) {
+        // replaces shells that exited meanwhile
+        this._refill(config);
+      } else if (config.shells.length === 0) {
+        // Nobody claimed this configuration lately, stop keeping shells for it.
+        delete this._configs[key];
+      }
+    });
+  }
+}
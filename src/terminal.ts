@@ -6,9 +6,10 @@
 
 import { Socket } from 'net';
 import { EventEmitter } from 'events';
-import { ITerminal, IPtyForkOptions } from './interfaces';
+import { ITerminal, IPtyForkOptions, IThrottleEvent } from './interfaces';
 import { EventEmitter2, IEvent } from './eventEmitter2';
 import { IExitEvent } from './types';
+import { Throttle } from './throttle';
 
 export const DEFAULT_COLS: number = 80;
 export const DEFAULT_ROWS: number = 24;
@@ -40,10 +41,21 @@ export abstract class Terminal implements ITerminal {
   private _flowControlResume: string;
   public handleFlowControl: boolean;
 
+  private _throttle: Throttle | null = null;
+  // output framed into lines is not delivered as data, to onData or to
+  // 'data' listeners
+  protected _deliverData: boolean = true;
+  // how the output is decoded, the throttle counts the bytes before that
+  protected _encoding: string | null = 'utf8';
+  // paused by the user, a throttle that ends does not resume reading then
+  private _paused: boolean = false;
+
   private _onData = new EventEmitter2<string>();
   public get onData(): IEvent<string> { return this._onData.event; }
   private _onExit = new EventEmitter2<IExitEvent>();
   public get onExit(): IEvent<IExitEvent> { return this._onExit.event; }
+  private _onThrottle = new EventEmitter2<IThrottleEvent>();
+  public get onThrottle(): IEvent<IThrottleEvent> { return this._onThrottle.event; }
 
   public get pid(): number { return this._pid; }
   public get cols(): number { return this._cols; }
@@ -72,6 +84,16 @@ export abstract class Terminal implements ITerminal {
     this.handleFlowControl = !!(opt.handleFlowControl);
     this._flowControlPause = opt.flowControlPause || FLOW_CONTROL_PAUSE;
     this._flowControlResume = opt.flowControlResume || FLOW_CONTROL_RESUME;
+
+    if (opt.throttle) {
+      this._throttle = new Throttle(opt.throttle, e => this._onThrottle.fire(e), paused => {
+        if (paused) {
+          this._socket.pause();
+        } else if (!this._paused) {
+          this._socket.resume();
+        }
+      });
+    }
   }
 
   protected abstract _write(data: string): void;
@@ -93,7 +115,15 @@ export abstract class Terminal implements ITerminal {
   }
 
   protected _forwardEvents(): void {
-    this.on('data', e => this._onData.fire(e));
+    this._socket.on('data', e => {
+      if (this._throttle) {
+        this._throttle.record(typeof e === 'string' ? Buffer.byteLength(e, this._encoding || 'utf8') : e.length);
+      }
+      if (this._deliverData) {
+        this._onData.fire(e);
+        this._internalee.emit('data', e);
+      }
+    });
     this.on('exit', (exitCode, signal) => this._onExit.fire({ exitCode, signal }));
   }
 
@@ -128,16 +158,22 @@ export abstract class Terminal implements ITerminal {
 
   /** See net.Socket.pause */
   public pause(): Socket {
+    this._paused = true;
     return this._socket.pause();
   }
 
-  /** See net.Socket.resume */
+  /** See net.Socket.resume, stays paused while throttled */
   public resume(): Socket {
+    this._paused = false;
+    if (this._throttle && this._throttle.pausing) {
+      return this._socket;
+    }
     return this._socket.resume();
   }
 
   /** See net.Socket.setEncoding */
   public setEncoding(encoding: string | null): void {
+    this._encoding = encoding;
     if ((this._socket as any)._decoder) {
       delete (this._socket as any)._decoder;
     }
@@ -148,11 +184,10 @@ export abstract class Terminal implements ITerminal {
 
   public addListener(eventName: string, listener: (...args: any[]) => any): void { this.on(eventName, listener); }
   public on(eventName: string, listener: (...args: any[]) => any): void {
-    if (eventName === 'close') {
-      this._internalee.on('close', listener);
+    if (eventName === 'data' && !this._deliverData) {
       return;
     }
-    this._socket.on(eventName, listener);
+    this._emitterOf(eventName).on(eventName, listener);
   }
 
   public emit(eventName: string, ...args: any[]): any {
@@ -163,19 +198,40 @@ export abstract class Terminal implements ITerminal {
   }
 
   public listeners(eventName: string): Function[] {
-    return this._socket.listeners(eventName);
+    return this._emitterOf(eventName).listeners(eventName);
   }
 
   public removeListener(eventName: string, listener: (...args: any[]) => any): void {
-    this._socket.removeListener(eventName, listener);
+    this._emitterOf(eventName).removeListener(eventName, listener);
   }
 
   public removeAllListeners(eventName: string): void {
-    this._socket.removeAllListeners(eventName);
+    this._emitterOf(eventName).removeAllListeners(eventName);
   }
 
   public once(eventName: string, listener: (...args: any[]) => any): void {
-    this._socket.once(eventName, listener);
+    if (eventName === 'data' && !this._deliverData) {
+      return;
+    }
+    this._emitterOf(eventName).once(eventName, listener);
+  }
+
+  /**
+   * Delivers output the pty sent before the terminal was handed out, such as
+   * the prompt of a pooled shell, to onData and 'data' listeners only. The
+   * scrollback, screen and other consumers of the raw output saw it already.
+   */
+  public replay(data: string | Buffer): void {
+    if (this._deliverData) {
+      this._onData.fire(data as string);
+      this._internalee.emit('data', data);
+    }
+  }
+
+  // 'close' is the terminal's own. 'data' listeners are kept apart from the
+  // socket as well, which the consumers of the raw output listen on.
+  private _emitterOf(eventName: string): EventEmitter {
+    return eventName === 'close' || eventName === 'data' ? this._internalee : this._socket;
   }
 
   public abstract resize(cols: number, rows: number): void;
@@ -187,6 +243,9 @@ export abstract class Terminal implements ITerminal {
   public abstract get slave(): Socket;
 
   protected _close(): void {
+    if (this._throttle) {
+      this._throttle.dispose();
+    }
     this._socket.writable = false;
     this._socket.readable = false;
     this.write = () => {};
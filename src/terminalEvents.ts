@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { EventEmitter2, IEvent } from './eventEmitter2';
+import { ICwdChangeEvent, IClipboardEvent, ICommandEvent } from './interfaces';
+
+/**
+ * The events the native scanner picks out of the output of a terminal.
+ */
+export class TerminalEvents {
+  private _onTitleChange = new EventEmitter2<string>();
+  public get onTitleChange(): IEvent<string> { return this._onTitleChange.event; }
+  private _onBell = new EventEmitter2<void>();
+  public get onBell(): IEvent<void> { return this._onBell.event; }
+  private _onCwdChange = new EventEmitter2<ICwdChangeEvent>();
+  public get onCwdChange(): IEvent<ICwdChangeEvent> { return this._onCwdChange.event; }
+  private _onClipboard = new EventEmitter2<IClipboardEvent>();
+  public get onClipboard(): IEvent<IClipboardEvent> { return this._onClipboard.event; }
+  private _onCommand = new EventEmitter2<ICommandEvent>();
+  public get onCommand(): IEvent<ICommandEvent> { return this._onCommand.event; }
+
+  public fire(e: IUnixEvent): void {
+    switch (e.type) {
+      case 'title':
+        this._onTitleChange.fire(e.title);
+        break;
+      case 'bell':
+        this._onBell.fire(undefined);
+        break;
+      case 'cwd':
+        this._onCwdChange.fire({ path: e.path, host: e.host });
+        break;
+      case 'clipboard':
+        // a query asks for the clipboard instead of setting it
+        this._onClipboard.fire({ selection: e.selection, data: e.data === '?' ? null : Buffer.from(e.data, 'base64').toString('utf8') });
+        break;
+      case 'command':
+        this._onCommand.fire({
+          promptStart: e.promptStart,
+          commandStart: e.commandStart,
+          outputStart: e.outputStart,
+          outputEnd: e.outputEnd,
+          exitCode: e.exitCode === undefined ? null : e.exitCode,
+          duration: e.duration
+        });
+        break;
+    }
+  }
+}
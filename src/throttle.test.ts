@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import * as assert from 'assert';
+import { RateMeter, Throttle } from './throttle';
+import { IThrottleEvent } from './interfaces';
+import { pollUntil } from './testUtils.test';
+
+describe('RateMeter', () => {
+  it('should measure a constant rate', () => {
+    const meter = new RateMeter(1000);
+    // 1000 bytes in 10 events per second for 10 half lives
+    for (let t = 0; t <= 10000; t += 100) {
+      meter.add(100, t);
+    }
+    assert.ok(Math.abs(meter.bytesPerSecond(10000) - 1000) < 50, String(meter.bytesPerSecond(10000)));
+    assert.ok(Math.abs(meter.eventsPerSecond(10000) - 10) < 0.5, String(meter.eventsPerSecond(10000)));
+  });
+
+  it('should halve a rate after the half life', () => {
+    const meter = new RateMeter(500);
+    meter.add(1000, 0);
+    const rate = meter.bytesPerSecond(0);
+    assert.ok(Math.abs(meter.bytesPerSecond(500) - rate / 2) < 1e-6);
+  });
+
+  it('should tell when a rate is back under its limit', () => {
+    const meter = new RateMeter(1000);
+    meter.add(4000, 0);
+    const rate = meter.bytesPerSecond(0);
+    assert.equal(meter.msUntilBelow(rate * 2, 0, 0), 0);
+    assert.equal(meter.msUntilBelow(rate / 4, 0, 0), 2000);
+    assert.equal(meter.msUntilBelow(0, 0, 0), 0);
+  });
+});
+
+describe('Throttle', () => {
+  it('should require a limit', () => {
+    assert.throws(() => new Throttle({}, () => {}, () => {}), /positive/);
+    assert.throws(() => new Throttle({ bytesPerSecond: -1 }, () => {}, () => {}), /positive/);
+  });
+
+  it('should pause while over the limit', async () => {
+    const events: IThrottleEvent[] = [];
+    const paused: boolean[] = [];
+    const throttle = new Throttle({ bytesPerSecond: 1000, pause: true, halfLife: 20 }, e => events.push(e), p => paused.push(p));
+    throttle.record(10);
+    assert.equal(events.length, 0);
+    throttle.record(100000);
+    assert.equal(events.length, 1);
+    assert.equal(events[0].throttled, true);
+    assert.ok(events[0].bytesPerSecond > 1000);
+    assert.ok(throttle.pausing);
+    // once throttled further output does not fire again
+    throttle.record(100000);
+    assert.equal(events.length, 1);
+    await pollUntil(() => events.length === 2, 2000, 10);
+    assert.equal(events[1].throttled, false);
+    assert.ok(events[1].bytesPerSecond <= 1000);
+    assert.deepEqual(paused, [true, false]);
+    throttle.dispose();
+  });
+
+  it('should only report without pause', () => {
+    const paused: boolean[] = [];
+    const throttle = new Throttle({ eventsPerSecond: 10, halfLife: 100 }, () => {}, p => paused.push(p));
+    for (let i = 0; i < 100; i++) {
+      throttle.record(1);
+    }
+    assert.ok(throttle.throttled);
+    assert.ok(!throttle.pausing);
+    assert.deepEqual(paused, []);
+    throttle.dispose();
+  });
+});
@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ */
+
+import { IThrottleOptions, IThrottleEvent } from './interfaces';
+
+const DEFAULT_HALF_LIFE_MS = 1000;
+
+/**
+ * Exponentially decaying output rates. A constant rate R is measured as R, a
+ * burst counts for less the longer ago it was, half as much after the half
+ * life.
+ */
+export class RateMeter {
+  private _tau: number;
+  private _bytes: number = 0;
+  private _events: number = 0;
+  private _last: number = 0;
+
+  constructor(halfLifeMs: number = DEFAULT_HALF_LIFE_MS) {
+    // the time constant of the decay, in seconds
+    this._tau = halfLifeMs / 1000 / Math.LN2;
+  }
+
+  public add(bytes: number, now: number): void {
+    this._decay(now);
+    this._bytes += bytes / this._tau;
+    this._events += 1 / this._tau;
+  }
+
+  public bytesPerSecond(now: number): number {
+    this._decay(now);
+    return this._bytes;
+  }
+
+  public eventsPerSecond(now: number): number {
+    this._decay(now);
+    return this._events;
+  }
+
+  /**
+   * The milliseconds until both rates are at most their limit without new
+   * output, a limit of 0 is ignored.
+   */
+  public msUntilBelow(bytesLimit: number, eventsLimit: number, now: number): number {
+    this._decay(now);
+    const bytes = bytesLimit > 0 && this._bytes > bytesLimit ? Math.log(this._bytes / bytesLimit) : 0;
+    const events = eventsLimit > 0 && this._events > eventsLimit ? Math.log(this._events / eventsLimit) : 0;
+    return Math.ceil(Math.max(bytes, events) * this._tau * 1000);
+  }
+
+  private _decay(now: number): void {
+    if (now > this._last) {
+      const factor = Math.exp(-(now - this._last) / 1000 / this._tau);
+      this._bytes *= factor;
+      this._events *= factor;
+    }
+    this._last = now;
+  }
+}
+
+/**
+ * Watches the output rate of a terminal and reports when it goes over the
+ * limits and when it is back under them. With `pause` reading stops in
+ * between, so that a runaway program blocks on its full pty instead of
+ * flooding the process.
+ */
+export class Throttle {
+  private _meter: RateMeter;
+  private _bytesLimit: number;
+  private _eventsLimit: number;
+  private _pause: boolean;
+  private _throttled: boolean = false;
+  private _timer: NodeJS.Timer | null = null;
+
+  public get throttled(): boolean { return this._throttled; }
+  /** Whether reading is stopped by the throttle. */
+  public get pausing(): boolean { return this._throttled && this._pause; }
+
+  constructor(
+    opt: IThrottleOptions,
+    private _onChange: (e: IThrottleEvent) => void,
+    private _setPaused: (paused: boolean) => void
+  ) {
+    this._bytesLimit = opt.bytesPerSecond || 0;
+    this._eventsLimit = opt.eventsPerSecond || 0;
+    if (this._bytesLimit < 0 || this._eventsLimit < 0 || (!this._bytesLimit && !this._eventsLimit)) {
+      throw new Error('throttle needs a positive bytesPerSecond or eventsPerSecond');
+    }
+    this._pause = !!opt.pause;
+    this._meter = new RateMeter(opt.halfLife);
+  }
+
+  /**
+   * Counts one chunk of output.
+   */
+  public record(bytes: number): void {
+    const now = Date.now();
+    this._meter.add(bytes, now);
+    if (this._throttled || this._meter.msUntilBelow(this._bytesLimit, this._eventsLimit, now) === 0) {
+      return;
+    }
+    this._throttled = true;
+    if (this._pause) {
+      this._setPaused(true);
+    }
+    this._fire(now);
+    this._schedule(now);
+  }
+
+  public dispose(): void {
+    if (this._timer) {
+      clearTimeout(this._timer);
+      this._timer = null;
+    }
+  }
+
+  private _schedule(now: number): void {
+    const delay = this._meter.msUntilBelow(this._bytesLimit, this._eventsLimit, now);
+    this._timer = setTimeout(() => {
+      this._timer = null;
+      const later = Date.now();
+      // output that kept coming in without pausing keeps the throttle on
+      if (this._meter.msUntilBelow(this._bytesLimit, this._eventsLimit, later) > 0) {
+        this._schedule(later);
+        return;
+      }
+      this._throttled = false;
+      if (this._pause) {
+        this._setPaused(false);
+      }
+      this._fire(later);
+    }, Math.max(delay, 1));
+  }
+
+  private _fire(now: number): void {
+    this._onChange({
+      throttled: this._throttled,
+      bytesPerSecond: this._meter.bytesPerSecond(now),
+      eventsPerSecond: this._meter.eventsPerSecond(now)
+    });
+  }
+}
@@ -0,0 +1,254 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * budget.cc:
+ *   The process-wide budget of buffered output and its reclaim thread.
+ */
+
+#include "budget.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace budget {
+
+// Reclaiming goes on down to this part of the limit, so that it does not run
+// again for every read once the budget is full.
+static const int64_t kLowWatermarkEighths = 7;
+
+/**
+ * Budget
+ */
+
+class Budget {
+  public:
+    static Budget *Get() {
+      static Budget *budget = new Budget();
+      return budget;
+    }
+
+    void Charge(Kind kind, int64_t delta) {
+      kinds[kind] += delta;
+      used += delta;
+      int64_t max = limit;
+      if (delta > 0 && max > 0 && Held() > max && !wake.exchange(true)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cond.notify_one();
+      }
+    }
+
+    void ChargeFloor(int64_t delta) {
+      floor += delta;
+    }
+
+    bool Exceeded() const {
+      int64_t max = limit;
+      return max > 0 && Held() > max;
+    }
+
+    void Register(const std::shared_ptr<Account> &account) {
+      std::lock_guard<std::mutex> lock(mutex);
+      accounts.push_back(account);
+    }
+
+    void SetLimit(int64_t bytes) {
+      std::lock_guard<std::mutex> lock(mutex);
+      limit = bytes;
+      if (bytes > 0 && !started) {
+        started = true;
+        std::thread(&Budget::Run, this).detach();
+      }
+      if (Exceeded()) {
+        wake = true;
+        cond.notify_one();
+      }
+    }
+
+    Stats GetStats() {
+      std::lock_guard<std::mutex> lock(mutex);
+      Prune();
+      Stats stats;
+      stats.limit = limit;
+      stats.used = used;
+      stats.floor = floor;
+      for (int k = 0; k < kKinds; k++) stats.kinds[k] = kinds[k];
+      stats.accounts = accounts.size();
+      stats.reclaims = reclaims;
+      stats.reclaimed = reclaimed;
+      return stats;
+    }
+
+  private:
+    typedef std::pair<int64_t, std::shared_ptr<Account> > Candidate;
+
+    Budget() : limit(0), used(0), floor(0), wake(false), started(false), reclaims(0), reclaimed(0) {
+      for (int k = 0; k < kKinds; k++) kinds[k] = 0;
+    }
+
+    // The bytes counted against the limit. Input waiting for a pty is left
+    // out: only the pty reading it frees it, which may first need its output
+    // read, so holding back reads for it could hang the terminal for good.
+    // So are the floors, which no reclaim gets under.
+    int64_t Held() const {
+      return used - kinds[kWrites] - floor;
+    }
+
+    // Drops the accounts of terminals that are gone, the mutex must be held.
+    void Prune() {
+      accounts.erase(std::remove_if(accounts.begin(), accounts.end(),
+        [](const std::weak_ptr<Account> &a) { return a.expired(); }), accounts.end());
+    }
+
+    void Run() {
+      for (;;) {
+        std::vector<Candidate> live;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [this] { return wake.load(); });
+          wake = false;
+          Prune();
+          for (size_t i = 0; i < accounts.size(); i++) {
+            std::shared_ptr<Account> account = accounts[i].lock();
+            // viewed is read once, it may change while sorting
+            if (account && !account->owner.expired()) {
+              live.push_back(Candidate(account->ViewedMs(), account));
+            }
+          }
+        }
+        Reclaim(&live);
+      }
+    }
+
+    // Compresses the scrollback of the least recently viewed terminals first,
+    // and only evicts from them once compressing everything did not do.
+    void Reclaim(std::vector<Candidate> *live) {
+      std::sort(live->begin(), live->end(),
+        [](const Candidate &a, const Candidate &b) { return a.first < b.first; });
+      int64_t low = limit / 8 * kLowWatermarkEighths;
+      uint64_t freed = 0;
+      for (int evict = 0; evict < 2 && Held() > low; evict++) {
+        for (size_t i = 0; i < live->size() && Held() > low; i++) {
+          std::shared_ptr<Reclaimable> owner = (*live)[i].second->owner.lock();
+          if (owner) freed += owner->Reclaim(Held() - low, evict == 1);
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      reclaims++;
+      reclaimed += freed;
+    }
+
+    std::atomic<int64_t> limit;
+    std::atomic<int64_t> used;
+    std::atomic<int64_t> floor;
+    std::atomic<int64_t> kinds[kKinds];
+    std::atomic<bool> wake;
+
+    // guards everything below
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<std::weak_ptr<Account> > accounts;
+    bool started;
+    uint64_t reclaims;
+    uint64_t reclaimed;
+};
+
+/**
+ * Account
+ */
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Account::Account(const std::weak_ptr<Reclaimable> &owner)
+  : owner(owner), floor(0), viewed(NowMs()) {
+  for (int k = 0; k < kKinds; k++) bytes[k] = 0;
+}
+
+Account::~Account() {
+  for (int k = 0; k < kKinds; k++) {
+    if (bytes[k] != 0) Budget::Get()->Charge((Kind)k, -bytes[k]);
+  }
+  if (floor != 0) Budget::Get()->ChargeFloor(-floor);
+}
+
+void Account::Charge(Kind kind, int64_t delta) {
+  if (delta == 0) return;
+  bytes[kind] += delta;
+  Budget::Get()->Charge(kind, delta);
+}
+
+void Account::Set(Kind kind, int64_t value) {
+  int64_t old = bytes[kind].exchange(value);
+  if (value != old) Budget::Get()->Charge(kind, value - old);
+}
+
+void Account::SetFloor(int64_t value) {
+  int64_t old = floor.exchange(value);
+  if (value != old) Budget::Get()->ChargeFloor(value - old);
+}
+
+void Account::Viewed() {
+  viewed = NowMs();
+}
+
+std::shared_ptr<Account> Open(const std::weak_ptr<Reclaimable> &owner) {
+  std::shared_ptr<Account> account = std::make_shared<Account>(owner);
+  Budget::Get()->Register(account);
+  return account;
+}
+
+bool Exceeded() {
+  return Budget::Get()->Exceeded();
+}
+
+/**
+ * JS
+ */
+
+static Napi::Value
+SetMemoryBudget(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !info[0].IsNumber() ||
+      info[0].As<Napi::Number>().Int64Value() < 0) {
+    Napi::Error::New(env, "Usage: pty.setMemoryBudget(limit)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Budget::Get()->SetLimit(info[0].As<Napi::Number>().Int64Value());
+  return env.Undefined();
+}
+
+static Napi::Value
+GetMemoryBudget(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  Stats stats = Budget::Get()->GetStats();
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("limit", Napi::Number::New(env, (double)stats.limit));
+  obj.Set("used", Napi::Number::New(env, (double)stats.used));
+  obj.Set("scrollback", Napi::Number::New(env, (double)stats.kinds[kScrollback]));
+  obj.Set("writes", Napi::Number::New(env, (double)stats.kinds[kWrites]));
+  obj.Set("output", Napi::Number::New(env, (double)stats.kinds[kOutput]));
+  obj.Set("floor", Napi::Number::New(env, (double)stats.floor));
+  obj.Set("sessions", Napi::Number::New(env, stats.accounts));
+  obj.Set("reclaims", Napi::Number::New(env, (double)stats.reclaims));
+  obj.Set("reclaimed", Napi::Number::New(env, (double)stats.reclaimed));
+  obj.Set("backpressure", Napi::Boolean::New(env, stats.limit > 0 && stats.used - stats.kinds[kWrites] - stats.floor > stats.limit));
+  return obj;
+}
+
+void Init(Napi::Env env, Napi::Object exports) {
+  exports.Set(Napi::String::New(env, "setMemoryBudget"), Napi::Function::New(env, SetMemoryBudget));
+  exports.Set(Napi::String::New(env, "getMemoryBudget"), Napi::Function::New(env, GetMemoryBudget));
+}
+
+}  // namespace budget
@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * budget.h:
+ *   A process-wide budget for the output buffered by all terminals. Every
+ *   terminal charges what it holds to an account, once the total goes over
+ *   the limit a background thread compresses and then evicts the scrollback
+ *   of the least recently viewed terminals, and hub shards stop reading
+ *   while the total stays over it. What cannot be reclaimed, such as the
+ *   segment a scrollback is appending to, is a floor left out of the total.
+ */
+
+#ifndef NODE_PTY_BUDGET_H_
+#define NODE_PTY_BUDGET_H_
+
+#include <napi.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace budget {
+
+// What the bytes of an account are buffered for.
+enum Kind {
+  kScrollback = 0,
+  kWrites = 1,  // input not accepted by the pty yet
+  kOutput = 2,  // read but not delivered to JS yet
+  kKinds = 3
+};
+
+// Holds memory that can be given back under pressure.
+class Reclaimable {
+  public:
+    virtual ~Reclaimable() {}
+    // Frees up to bytes by compressing, or by evicting when evict is set,
+    // returns the bytes freed.
+    virtual size_t Reclaim(size_t bytes, bool evict) = 0;
+};
+
+// The bytes buffered for one terminal, shared by its hub session and its
+// scrollback. Thread-safe.
+class Account {
+  public:
+    explicit Account(const std::weak_ptr<Reclaimable> &owner);
+    ~Account();
+
+    void Charge(Kind kind, int64_t delta);
+    void Set(Kind kind, int64_t bytes);
+    // Sets the part of the bytes charged that reclaiming cannot free, which
+    // is left out of the limit.
+    void SetFloor(int64_t bytes);
+    int64_t Usage(Kind kind) const { return bytes[kind]; }
+    // Marks the terminal as looked at, the least recently viewed ones are
+    // reclaimed from first.
+    void Viewed();
+    int64_t ViewedMs() const { return viewed; }
+
+    const std::weak_ptr<Reclaimable> owner;
+
+  private:
+    std::atomic<int64_t> bytes[kKinds];
+    std::atomic<int64_t> floor;
+    std::atomic<int64_t> viewed;  // steady clock ms
+};
+
+struct Stats {
+  int64_t limit;  // 0 without a budget
+  int64_t used;
+  int64_t kinds[kKinds];
+  int64_t floor;  // of used, not counted against the limit
+  size_t accounts;
+  uint64_t reclaims;   // passes of the background thread
+  uint64_t reclaimed;  // bytes they freed
+
+  Stats() : limit(0), used(0), floor(0), accounts(0), reclaims(0), reclaimed(0) {
+    for (int k = 0; k < kKinds; k++) kinds[k] = 0;
+  }
+};
+
+// A new account charged to the process-wide budget.
+std::shared_ptr<Account> Open(const std::weak_ptr<Reclaimable> &owner);
+// Whether more is buffered than the limit, readers hold back meanwhile. Input
+// waiting for a pty and the floors of the accounts do not count.
+bool Exceeded();
+int64_t NowMs();
+
+void Init(Napi::Env env, Napi::Object exports);
+
+}  // namespace budget
+
+#endif  // NODE_PTY_BUDGET_H_
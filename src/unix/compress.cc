@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * compress.cc:
+ *   LZ4 block format compression and decompression.
+ */
+
+#include "compress.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+namespace compress {
+
+// A block is a run of sequences: a token with the literal and match lengths
+// in its nibbles, more length bytes for nibbles of 15, the literals, the
+// little-endian offset of the match and more match length bytes. The last
+// sequence only has literals.
+static const size_t kMinMatch = 4;
+static const size_t kLastLiterals = 5;   // the block ends with literals
+static const size_t kMatchLimit = 12;    // no match starts closer to the end
+static const size_t kMaxOffset = 65535;
+static const int kHashLog = 12;
+// Skips ahead faster the longer no match was found, for incompressible data.
+static const int kSkipTrigger = 6;
+
+static inline uint32_t
+read32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t
+hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - kHashLog);
+}
+
+static void
+put_length(std::string *out, size_t n) {
+  for (; n >= 255; n -= 255) out->push_back((char)255);
+  out->push_back((char)n);
+}
+
+static void
+put_sequence(std::string *out, const char *literals, size_t literal_len,
+             size_t offset, size_t match_len) {
+  size_t extra = match_len - kMinMatch;
+  unsigned char token = (unsigned char)((literal_len < 15 ? literal_len : 15) << 4) |
+                        (unsigned char)(extra < 15 ? extra : 15);
+  out->push_back((char)token);
+  if (literal_len >= 15) put_length(out, literal_len - 15);
+  out->append(literals, literal_len);
+  out->push_back((char)(offset & 0xFF));
+  out->push_back((char)(offset >> 8));
+  if (extra >= 15) put_length(out, extra - 15);
+}
+
+static void
+put_last(std::string *out, const char *literals, size_t literal_len) {
+  out->push_back((char)((literal_len < 15 ? literal_len : 15) << 4));
+  if (literal_len >= 15) put_length(out, literal_len - 15);
+  out->append(literals, literal_len);
+}
+
+bool Pack(const char *src, size_t len, std::string *out) {
+  out->clear();
+  out->reserve(len / 2);
+
+  // positions of the last occurrence of each hashed 4 bytes
+  std::vector<uint32_t> table((size_t)1 << kHashLog, 0);
+  size_t anchor = 0;
+  size_t ip = 0;
+  size_t misses = 1 << kSkipTrigger;
+
+  while (ip + kMatchLimit < len) {
+    uint32_t v = read32(src + ip);
+    uint32_t h = hash(v);
+    size_t ref = table[h];
+    table[h] = (uint32_t)ip;
+
+    if (ref >= ip || ip - ref > kMaxOffset || read32(src + ref) != v) {
+      ip += misses++ >> kSkipTrigger;
+      continue;
+    }
+    misses = 1 << kSkipTrigger;
+
+    // back over equal bytes before the match, then forward as far as it goes
+    while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+      ip--;
+      ref--;
+    }
+    size_t match_len = kMinMatch;
+    size_t max_len = len - kLastLiterals - ip;
+    while (match_len < max_len && src[ref + match_len] == src[ip + match_len]) {
+      match_len++;
+    }
+
+    put_sequence(out, src + anchor, ip - anchor, ip - ref, match_len);
+    ip += match_len;
+    anchor = ip;
+    if (out->size() >= len) return false;
+  }
+
+  put_last(out, src + anchor, len - anchor);
+  return out->size() < len;
+}
+
+static bool
+get_length(const unsigned char *src, size_t packed_len, size_t *ip, size_t *n) {
+  unsigned char b;
+  do {
+    if (*ip >= packed_len) return false;
+    b = src[(*ip)++];
+    *n += b;
+  } while (b == 255);
+  return true;
+}
+
+bool Unpack(const char *packed, size_t packed_len, size_t len, std::string *out) {
+  const unsigned char *src = (const unsigned char *)packed;
+  size_t base = out->size();
+  out->resize(base + len);
+  char *dst = &(*out)[base];
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip < packed_len) {
+    unsigned char token = src[ip++];
+
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && !get_length(src, packed_len, &ip, &literal_len)) break;
+    if (literal_len > packed_len - ip || literal_len > len - op) break;
+    // short copies go 16 bytes at once where both sides have the room, the
+    // bytes beyond are written over later
+    if (literal_len <= 16 && packed_len - ip >= 16 && len - op >= 16) {
+      memcpy(dst + op, packed + ip, 16);
+    } else {
+      memcpy(dst + op, packed + ip, literal_len);
+    }
+    ip += literal_len;
+    op += literal_len;
+    if (ip == packed_len) break;
+
+    if (packed_len - ip < 2) break;
+    size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+    ip += 2;
+    size_t match_len = token & 15;
+    if (match_len == 15 && !get_length(src, packed_len, &ip, &match_len)) break;
+    match_len += kMinMatch;
+    if (offset == 0 || offset > op || match_len > len - op) break;
+
+    if (offset >= 16 && match_len <= 16 && len - op >= 16) {
+      memcpy(dst + op, dst + op - offset, 16);
+    } else if (offset >= match_len) {
+      memcpy(dst + op, dst + op - offset, match_len);
+    } else {
+      // the match overlaps what it repeats
+      for (size_t i = 0; i < match_len; i++) dst[op + i] = dst[op - offset + i];
+    }
+    op += match_len;
+  }
+
+  if (ip != packed_len || op != len) {
+    out->resize(base);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace compress
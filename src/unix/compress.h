@@ -0,0 +1,31 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * compress.h:
+ *   Block compression in the LZ4 block format, a greedy single-pass
+ *   compressor tuned for speed over ratio. Terminal output (repeated
+ *   prompts, escape sequences and indentation) typically packs 3-10x.
+ *
+ * See:
+ *   https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ */
+
+#ifndef NODE_PTY_COMPRESS_H_
+#define NODE_PTY_COMPRESS_H_
+
+#include <stddef.h>
+
+#include <string>
+
+namespace compress {
+
+// Compresses len bytes of src to out, false when that would not save space.
+bool Pack(const char *src, size_t len, std::string *out);
+
+// Appends the len bytes a block of packed_len bytes unpacks to to out, false
+// when the block is malformed.
+bool Unpack(const char *src, size_t packed_len, size_t len, std::string *out);
+
+}  // namespace compress
+
+#endif  // NODE_PTY_COMPRESS_H_
@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * events.cc:
+ *   The scanner of terminal events.
+ */
+
+#include "events.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace events {
+
+// OSC strings longer than this are dropped, clipboard requests carry a
+// whole selection in base64.
+static const size_t kMaxOsc = 1024 * 1024;
+// a buffer grown by a long string is given back after it
+static const size_t kKeepOsc = 4096;
+
+static const uint8_t kBel = 0x07;
+static const uint8_t kEsc = 0x1B;
+static const uint8_t kCan = 0x18;
+static const uint8_t kSub = 0x1A;
+
+size_t FindControl(const char *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i esc = _mm_set1_epi8(kEsc);
+  const __m128i bel = _mm_set1_epi8(kBel);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, esc), _mm_cmpeq_epi8(v, bel)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t esc = vdupq_n_u8(kEsc);
+  const uint8x16_t bel = vdupq_n_u8(kBel);
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8(p + i);
+    uint8x16_t m = vorrq_u8(vceqq_u8(v, esc), vceqq_u8(v, bel));
+    // narrows each byte of the mask to 4 bits
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits) return i + (__builtin_ctzll(bits) >> 2);
+  }
+#else
+  static const uint64_t kOnes = 0x0101010101010101ULL;
+  static const uint64_t kHighs = 0x8080808080808080ULL;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    uint64_t e = w ^ (kOnes * kEsc);
+    uint64_t b = w ^ (kOnes * kBel);
+    // a zero byte in either, the byte loop below finds which
+    if (((e - kOnes) & ~e & kHighs) | ((b - kOnes) & ~b & kHighs)) break;
+  }
+#endif
+  for (; i < len; i++) {
+    if (p[i] == kEsc || p[i] == kBel) return i;
+  }
+  return len;
+}
+
+static int
+hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static std::string
+percent_decode(const std::string &s) {
+  std::string out;
+  out.reserve(s.size());
+  for (size_t i = 0; i < s.size(); i++) {
+    int hi, lo;
+    if (s[i] == '%' && i + 2 < s.size() && (hi = hex_digit(s[i + 1])) >= 0 && (lo = hex_digit(s[i + 2])) >= 0) {
+      out.push_back((char)(hi << 4 | lo));
+      i += 2;
+    } else {
+      out.push_back(s[i]);
+    }
+  }
+  return out;
+}
+
+Scanner::Scanner(uint64_t offset)
+  : state(kGround), offset(offset), esc_at(0), osc_at(0), overflow(false) {}
+
+void Scanner::Reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  state = kGround;
+  std::string().swap(osc);
+  overflow = false;
+  command = Command();
+}
+
+void Scanner::Seek(uint64_t offset) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->offset = offset;
+}
+
+void Scanner::Scan(const char *data, size_t len, std::vector<Event> *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t i = 0;
+  while (i < len) {
+    uint8_t c;
+    switch (state) {
+      case kGround:
+        i += FindControl(data + i, len - i);
+        if (i == len) break;
+        if ((uint8_t)data[i] == kBel) {
+          out->push_back(Event("bell"));
+        } else {
+          esc_at = offset + i;
+          state = kEscape;
+        }
+        i++;
+        break;
+
+      case kEscape:
+        c = data[i++];
+        if (c == ']') {
+          osc.clear();
+          overflow = false;
+          osc_at = esc_at;
+          state = kOsc;
+        } else if (c == 'P' || c == 'X' || c == '^' || c == '_') {
+          state = kString;
+        } else if (c == kBel) {
+          // executed, the sequence goes on
+          out->push_back(Event("bell"));
+        } else if (c == kEsc) {
+          esc_at = offset + i - 1;
+        } else if (c == kCan || c == kSub || (c >= 0x20 && c < 0x7F)) {
+          // anything else is left to the screen parser
+          state = kGround;
+        }
+        break;
+
+      case kOsc: {
+        size_t start = i;
+        while (i < len && (uint8_t)data[i] >= 0x20) i++;
+        if (overflow || osc.size() + (i - start) > kMaxOsc) {
+          overflow = true;
+        } else {
+          osc.append(data + start, i - start);
+        }
+        if (i == len) break;
+        c = data[i++];
+        if (c == kEsc) {
+          esc_at = offset + i - 1;
+          state = kOscEscape;
+        } else if (c == kBel || c == kCan || c == kSub) {
+          // BEL ends the string too, as in xterm
+          Dispatch(offset + i, out);
+          state = kGround;
+        }
+        // other controls are dropped
+        break;
+      }
+
+      case kOscEscape:
+        // any ESC ends the string, the backslash of ST belongs to it
+        if (data[i] == '\\') {
+          i++;
+          Dispatch(offset + i, out);
+          state = kGround;
+        } else {
+          Dispatch(esc_at, out);
+          state = kEscape;
+        }
+        break;
+
+      case kString:
+        for (; i < len; i++) {
+          c = data[i];
+          if (c == kEsc || c == kCan || c == kSub) {
+            if (c == kEsc) esc_at = offset + i;
+            state = c == kEsc ? kEscape : kGround;
+            i++;
+            break;
+          }
+        }
+        break;
+    }
+  }
+  offset += len;
+}
+
+void Scanner::Dispatch(uint64_t end, std::vector<Event> *out) {
+  size_t semi = osc.find(';');
+  if (!overflow && semi != std::string::npos) {
+    std::string command = osc.substr(0, semi);
+    std::string text = osc.substr(semi + 1);
+    if (command == "0" || command == "2") {
+      out->push_back(Event("title").String("title", text));
+    } else if (command == "7") {
+      // file://host/path with the path percent-encoded, a bare path as is
+      std::string host;
+      std::string path = text;
+      size_t scheme = text.find("://");
+      if (scheme != std::string::npos) {
+        size_t slash = text.find('/', scheme + 3);
+        host = text.substr(scheme + 3, slash == std::string::npos ? std::string::npos : slash - scheme - 3);
+        path = slash == std::string::npos ? "/" : percent_decode(text.substr(slash));
+      }
+      out->push_back(Event("cwd").String("path", path).String("host", host));
+    } else if (command == "52") {
+      // the selection (c, p, s, ...) and the base64 data or "?" to query it
+      size_t sep = text.find(';');
+      if (sep != std::string::npos) {
+        out->push_back(Event("clipboard").String("selection", text.substr(0, sep)).String("data", text.substr(sep + 1)));
+      }
+    } else if (command == "133" || command == "633") {
+      // FinalTerm shell integration, VS Code uses 633 for the same marks
+      Mark(text, end, out);
+    }
+  }
+  if (osc.capacity() > kKeepOsc) {
+    std::string().swap(osc);
+  } else {
+    osc.clear();
+  }
+}
+
+void Scanner::Mark(const std::string &params, uint64_t end, std::vector<Event> *out) {
+  switch (params.empty() ? 0 : params[0]) {
+    case 'A':
+      // a new prompt, a command that never finished is forgotten
+      command = Command();
+      command.prompt = osc_at;
+      break;
+    case 'B':
+      command.input = end;
+      break;
+    case 'C':
+      command.output = end;
+      command.started = std::chrono::steady_clock::now();
+      break;
+    case 'D': {
+      // an empty command line finishes without being executed
+      if (command.output < 0) break;
+      double duration = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - command.started).count();
+      Event event("command");
+      event.Number("promptStart", command.prompt)
+           .Number("commandStart", command.input)
+           .Number("outputStart", command.output)
+           .Number("outputEnd", osc_at)
+           .Number("duration", duration);
+      // D;<exit code>, more parameters may follow
+      if (params.size() > 2 && params[1] == ';') {
+        const char *code = params.c_str() + 2;
+        char *stop;
+        long value = strtol(code, &stop, 10);
+        if (stop != code && (*stop == 0 || *stop == ';')) event.Number("exitCode", value);
+      }
+      out->push_back(event);
+      command = Command();
+      break;
+    }
+  }
+}
+
+Napi::FunctionReference EventScanner::constructor;
+
+void EventScanner::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "EventScanner", {
+    InstanceMethod("scan", &EventScanner::Scan),
+    InstanceMethod("reset", &EventScanner::Reset)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("EventScanner", ctor);
+}
+
+std::shared_ptr<Scanner> EventScanner::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Scanner>();
+  }
+  return Napi::ObjectWrap<EventScanner>::Unwrap(value.As<Napi::Object>())->scanner;
+}
+
+EventScanner::EventScanner(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<EventScanner>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() > 1 || (info.Length() == 1 && !info[0].IsNumber())) {
+    Napi::Error::New(env, "Usage: new pty.EventScanner(offset)").ThrowAsJavaScriptException();
+    return;
+  }
+  int64_t offset = info.Length() == 1 ? info[0].As<Napi::Number>().Int64Value() : 0;
+  scanner = std::make_shared<Scanner>(offset > 0 ? offset : 0);
+}
+
+Napi::Value EventScanner::Scan(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: scanner.scan(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  std::vector<Event> found;
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    scanner->Scan(buffer.Data(), buffer.Length(), &found);
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    scanner->Scan(data.data(), data.size(), &found);
+  }
+
+  Napi::Array result = Napi::Array::New(env, found.size());
+  for (size_t i = 0; i < found.size(); i++) {
+    const Event &e = found[i];
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("type", Napi::String::New(env, e.type));
+    for (size_t j = 0; j < e.numbers.size(); j++) {
+      obj.Set(e.numbers[j].first, Napi::Number::New(env, e.numbers[j].second));
+    }
+    for (size_t j = 0; j < e.strings.size(); j++) {
+      obj.Set(e.strings[j].first, Napi::String::New(env, e.strings[j].second));
+    }
+    result[i] = obj;
+  }
+  return result;
+}
+
+Napi::Value EventScanner::Reset(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  scanner->Reset();
+  return env.Undefined();
+}
+
+}  // namespace events
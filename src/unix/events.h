@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * events.h:
+ *   Picks the sequences consumers care about out of terminal output without
+ *   parsing all of it: titles (OSC 0 and 2), the bell, the working directory
+ *   (OSC 7), clipboard requests (OSC 52) and the commands run by a shell
+ *   with shell integration (OSC 133). Text between escape sequences is
+ *   skipped 16 bytes at a time.
+ */
+
+#ifndef NODE_PTY_EVENTS_H_
+#define NODE_PTY_EVENTS_H_
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace events {
+
+// A recognized sequence, with a few named fields that become an object on
+// the JS side.
+struct Event {
+  const char *type;
+  std::vector<std::pair<const char *, double> > numbers;
+  std::vector<std::pair<const char *, std::string> > strings;
+
+  explicit Event(const char *type) : type(type) {}
+  Event &Number(const char *name, double value) {
+    numbers.push_back(std::make_pair(name, value));
+    return *this;
+  }
+  Event &String(const char *name, const std::string &value) {
+    strings.push_back(std::make_pair(name, value));
+    return *this;
+  }
+};
+
+// The offset of the first ESC or BEL in data, len when there is none.
+size_t FindControl(const char *data, size_t len);
+
+// Follows the output of one terminal, sequences may be split across writes.
+// Strings end and controls act where the screen parser (vt.h) has them.
+// Positions in events are byte offsets in the output, counted from offset
+// on.
+class Scanner {
+  public:
+    explicit Scanner(uint64_t offset = 0);
+
+    // Appends the events completed by data to out.
+    void Scan(const char *data, size_t len, std::vector<Event> *out);
+    void Reset();
+    // Counts positions from offset on, before any output was scanned.
+    void Seek(uint64_t offset);
+
+  private:
+    enum State {
+      kGround,
+      kEscape,
+      kOsc,
+      kOscEscape,  // ESC in an OSC string, ST when a backslash follows
+      kString      // DCS, SOS, PM and APC, skipped
+    };
+
+    // The marks of the command being run, -1 until they are seen.
+    struct Command {
+      int64_t prompt;  // the start of the prompt
+      int64_t input;   // the end of the prompt, the command line follows
+      int64_t output;  // the end of the command line
+      std::chrono::steady_clock::time_point started;
+
+      Command() : prompt(-1), input(-1), output(-1) {}
+    };
+
+    // Handles the OSC string that ended at end.
+    void Dispatch(uint64_t end, std::vector<Event> *out);
+    void Mark(const std::string &params, uint64_t end, std::vector<Event> *out);
+
+    std::mutex mutex;
+    State state;
+    uint64_t offset;  // of data[0] in Scan
+    uint64_t esc_at;  // of the last ESC
+    uint64_t osc_at;  // of the OSC string
+    std::string osc;
+    bool overflow;  // the OSC string was too long and is dropped
+    Command command;
+};
+
+// The JS handle of a scanner.
+class EventScanner : public Napi::ObjectWrap<EventScanner> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The scanner of an EventScanner object, null for anything else.
+    static std::shared_ptr<Scanner> Unwrap(Napi::Value value);
+
+    EventScanner(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Scanner> scanner;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Scan(const Napi::CallbackInfo& info);
+    Napi::Value Reset(const Napi::CallbackInfo& info);
+};
+
+}  // namespace events
+
+#endif  // NODE_PTY_EVENTS_H_
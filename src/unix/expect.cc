@@ -0,0 +1,1011 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * expect.cc:
+ *   The expect engine of terminal output.
+ */
+
+#include "expect.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+namespace expect {
+
+static const size_t kMaxLiteral = 1024;
+// of all literals of an expectation, which bounds the table
+static const size_t kMaxLiterals = 64 * 1024;
+// a regex sees this much output after its literal at most
+static const size_t kWindow = 1024;
+// of the output since the last match, enough for a literal and its window
+static const size_t kKeep = kMaxLiteral + kWindow;
+// literals found of patterns with regexes that may still match
+static const size_t kMaxCandidates = 32;
+
+static std::mutex cache_mutex;
+static std::map<std::string, std::weak_ptr<const Automaton> > cache;
+// the cache is swept of automata no session uses once it grows to this
+static size_t sweep_at = 64;
+
+static uint8_t
+fold(uint8_t c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Instructions a regex may compile to, each runs once per byte at most.
+static const size_t kMaxProgram = 1024;
+// of a counted repeat, {n,m}
+static const int kMaxRepeat = 1000;
+// of nested groups, which are parsed and compiled recursively
+static const int kMaxDepth = 256;
+
+// A regex parsed into a tree of nodes held by index, compiled to the
+// program of a Regex.
+class Compiler {
+  public:
+    Compiler(const std::string &source, bool icase, Regex *regex)
+      : source(source), icase(icase), at(0), depth(0), regex(regex) {}
+
+    bool Run(std::string *error) {
+      int root = ParseAlternation();
+      if (root >= 0 && at < source.size()) Fail("unmatched )");
+      if (root < 0 || !this->error.empty()) {
+        *error = this->error;
+        return false;
+      }
+      regex->program.clear();
+      Emit(root);
+      Add(Regex::kMatch);
+      if (regex->program.size() > kMaxProgram) {
+        *error = "too large";
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    enum Type {
+      kSet,     // a byte of sets[set]
+      kConcat,  // the children in order, none for the empty regex
+      kAlternation,
+      kRepeat,  // the child min to max times, max -1 for no limit
+      kAssert   // an assertion, op
+    };
+
+    struct Node {
+      Type type;
+      int set;
+      std::vector<int> children;
+      int min;
+      int max;
+      bool greedy;
+      Regex::Op op;
+    };
+
+    int Fail(const char *why) {
+      if (error.empty()) error = why;
+      return -1;
+    }
+
+    bool Error(const char *why) {
+      Fail(why);
+      return false;
+    }
+
+    int New(Type type) {
+      Node node;
+      node.type = type;
+      node.set = -1;
+      node.min = node.max = 0;
+      node.greedy = true;
+      node.op = Regex::kMatch;
+      nodes.push_back(node);
+      return nodes.size() - 1;
+    }
+
+    int NewSet(std::bitset<256> set) {
+      if (icase) {
+        for (int c = 'a'; c <= 'z'; c++) {
+          if (set[c] || set[c - 'a' + 'A']) set[c] = set[c - 'a' + 'A'] = true;
+        }
+      }
+      int node = New(kSet);
+      nodes[node].set = regex->sets.size();
+      regex->sets.push_back(set);
+      return node;
+    }
+
+    // The bytes of the UTF-8 encoding of a code point, in sequence.
+    int NewCodePoint(uint32_t cp) {
+      char bytes[4];
+      size_t n;
+      if (cp < 0x80) {
+        bytes[0] = cp;
+        n = 1;
+      } else if (cp < 0x800) {
+        bytes[0] = 0xC0 | (cp >> 6);
+        bytes[1] = 0x80 | (cp & 0x3F);
+        n = 2;
+      } else if (cp < 0x10000) {
+        bytes[0] = 0xE0 | (cp >> 12);
+        bytes[1] = 0x80 | ((cp >> 6) & 0x3F);
+        bytes[2] = 0x80 | (cp & 0x3F);
+        n = 3;
+      } else {
+        bytes[0] = 0xF0 | (cp >> 18);
+        bytes[1] = 0x80 | ((cp >> 12) & 0x3F);
+        bytes[2] = 0x80 | ((cp >> 6) & 0x3F);
+        bytes[3] = 0x80 | (cp & 0x3F);
+        n = 4;
+      }
+      int node = New(kConcat);
+      for (size_t i = 0; i < n; i++) {
+        std::bitset<256> set;
+        set[(uint8_t)bytes[i]] = true;
+        int byte = NewSet(set);
+        nodes[node].children.push_back(byte);
+      }
+      return node;
+    }
+
+    bool More() const { return at < source.size(); }
+    char Peek() const { return source[at]; }
+
+    // Reads count hex digits, -1 when there are not as many.
+    int64_t Hex(size_t count) {
+      if (source.size() - at < count) return -1;
+      int64_t value = 0;
+      for (size_t i = 0; i < count; i++) {
+        char c = source[at + i];
+        int digit = c >= '0' && c <= '9' ? c - '0' :
+                    c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                    c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return -1;
+        value = value * 16 + digit;
+      }
+      at += count;
+      return value;
+    }
+
+    // Reads the escape after a backslash as a set of bytes, or as a code
+    // point when it is one character. Returns false on an error.
+    bool Escape(bool in_class, std::bitset<256> *set, int64_t *cp) {
+      *cp = -1;
+      if (!More()) return Error("\\ at end of pattern");
+      char c = source[at++];
+      switch (c) {
+        case 'd': case 'D':
+          for (int b = '0'; b <= '9'; b++) set->set(b);
+          if (c == 'D') set->flip();
+          return true;
+        case 'w': case 'W':
+          for (int b = 0; b < 256; b++) {
+            if ((b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_') set->set(b);
+          }
+          if (c == 'W') set->flip();
+          return true;
+        case 's': case 'S':
+          for (const char *b = " \t\n\v\f\r"; *b; b++) set->set((uint8_t)*b);
+          if (c == 'S') set->flip();
+          return true;
+        case 't': *cp = '\t'; return true;
+        case 'n': *cp = '\n'; return true;
+        case 'r': *cp = '\r'; return true;
+        case 'v': *cp = '\v'; return true;
+        case 'f': *cp = '\f'; return true;
+        case 'b': *cp = '\b'; return true;  // only reached in a class
+        case '0':
+          if (More() && Peek() >= '0' && Peek() <= '9') return Error("octal escapes are not supported");
+          *cp = 0;
+          return true;
+        case 'x':
+          *cp = Hex(2);
+          if (*cp < 0) return Error("invalid \\x escape");
+          break;
+        case 'u':
+          *cp = Hex(4);
+          if (*cp < 0) return Error("invalid \\u escape");
+          // a surrogate pair is one character
+          if (*cp >= 0xD800 && *cp < 0xDC00 && source.compare(at, 2, "\\u") == 0) {
+            size_t pair = at;
+            at += 2;
+            int64_t low = Hex(4);
+            if (low >= 0xDC00 && low < 0xE000) {
+              *cp = 0x10000 + ((*cp - 0xD800) << 10) + (low - 0xDC00);
+            } else {
+              at = pair;
+            }
+          }
+          if (*cp >= 0xD800 && *cp < 0xE000) return Error("lone surrogates are not supported");
+          break;
+        case 'c':
+          if (!More() || !((Peek() >= 'a' && Peek() <= 'z') || (Peek() >= 'A' && Peek() <= 'Z'))) {
+            return Error("invalid \\c escape");
+          }
+          *cp = source[at++] & 0x1F;
+          return true;
+        case 'k':
+          return Error("named backreferences are not supported");
+        default:
+          if (c >= '1' && c <= '9') return Error("backreferences are not supported");
+          // any other character stands for itself
+          *cp = (uint8_t)c;
+          return true;
+      }
+      if (in_class && *cp >= 0x80) return Error("non-ASCII escapes in classes are not supported");
+      return true;
+    }
+
+    int ParseClass() {
+      at++;  // [
+      bool negate = More() && Peek() == '^';
+      if (negate) at++;
+      std::bitset<256> set;
+      for (;;) {
+        if (!More()) return Fail("missing ]");
+        if (Peek() == ']') break;
+        int64_t lo = -1;
+        if (!ClassAtom(&set, &lo)) return -1;
+        if (More() && Peek() == '-' && at + 1 < source.size() && source[at + 1] != ']') {
+          at++;
+          int64_t hi = -1;
+          if (!ClassAtom(&set, &hi)) return -1;
+          if (lo < 0 || hi < 0) return Fail("invalid class range");
+          if (lo > hi) return Fail("class range out of order");
+          if (hi >= 0x80) return Fail("non-ASCII class ranges are not supported");
+          for (int64_t b = lo; b <= hi; b++) set.set(b);
+        } else if (lo >= 0) {
+          set.set(lo);
+        }
+      }
+      at++;  // ]
+      // folded before negating, as the set holds either case
+      if (icase) {
+        for (int c = 'a'; c <= 'z'; c++) {
+          if (set[c] || set[c - 'a' + 'A']) set[c] = set[c - 'a' + 'A'] = true;
+        }
+      }
+      if (negate) set.flip();
+      return NewSet(set);
+    }
+
+    // One member of a class: a character, whose code is set, or an escape
+    // standing for many, which is added to set.
+    bool ClassAtom(std::bitset<256> *set, int64_t *cp) {
+      char c = source[at++];
+      if (c != '\\') {
+        // bytes of UTF-8 characters are members on their own
+        *cp = (uint8_t)c;
+        return true;
+      }
+      std::bitset<256> escaped;
+      if (!Escape(true, &escaped, cp)) return false;
+      *set |= escaped;
+      return true;
+    }
+
+    int ParseAtom() {
+      char c = source[at];
+      switch (c) {
+        case '(': {
+          at++;
+          if (++depth > kMaxDepth) return Fail("too deeply nested");
+          if (More() && Peek() == '?') {
+            if (source.compare(at, 2, "?:") != 0) return Fail("lookarounds and named groups are not supported");
+            at += 2;
+          }
+          int node = ParseAlternation();
+          if (node < 0) return -1;
+          if (!More() || Peek() != ')') return Fail("missing )");
+          at++;
+          depth--;
+          return node;
+        }
+        case '*': case '+': case '?':
+          return Fail("nothing to repeat");
+        case '^': case '$': {
+          at++;
+          int node = New(kAssert);
+          nodes[node].op = c == '^' ? Regex::kBegin : Regex::kEnd;
+          return node;
+        }
+        case '.': {
+          at++;
+          std::bitset<256> set;
+          set.flip();
+          set[(uint8_t)'\n'] = set[(uint8_t)'\r'] = false;
+          return NewSet(set);
+        }
+        case '[':
+          return ParseClass();
+        case '\\': {
+          at++;
+          if (More() && (Peek() == 'b' || Peek() == 'B')) {
+            regex->boundaries = true;
+            int node = New(kAssert);
+            nodes[node].op = Peek() == 'b' ? Regex::kBoundary : Regex::kNotBoundary;
+            at++;
+            return node;
+          }
+          std::bitset<256> set;
+          int64_t cp;
+          if (!Escape(false, &set, &cp)) return -1;
+          if (cp >= 0x80) return NewCodePoint(cp);
+          if (cp >= 0) set.set(cp);
+          return NewSet(set);
+        }
+        default: {
+          at++;
+          std::bitset<256> set;
+          set.set((uint8_t)c);
+          return NewSet(set);
+        }
+      }
+    }
+
+    // Reads a counted repeat, {n}, {n,} or {n,m}. Leaves at as it was and
+    // returns false when there is none, the brace is a character then.
+    bool Count(int *min, int *max) {
+      size_t start = at;
+      int64_t values[2] = { -1, -1 };
+      bool comma = false;
+      at++;  // {
+      for (int v = 0; v < 2; v++) {
+        while (More() && Peek() >= '0' && Peek() <= '9') {
+          values[v] = (values[v] < 0 ? 0 : values[v]) * 10 + (Peek() - '0');
+          if (values[v] > kMaxRepeat) values[v] = kMaxRepeat + 1;
+          at++;
+        }
+        if (v == 0 && More() && Peek() == ',') {
+          comma = true;
+          at++;
+        } else {
+          break;
+        }
+      }
+      if (values[0] < 0 || !More() || Peek() != '}') {
+        at = start;
+        return false;
+      }
+      at++;
+      *min = values[0];
+      *max = comma ? values[1] : values[0];
+      return true;
+    }
+
+    int ParseRepeat() {
+      int atom = ParseAtom();
+      if (atom < 0 || !More()) return atom;
+      int min;
+      int max;
+      char c = Peek();
+      if (c == '*' || c == '+' || c == '?') {
+        at++;
+        min = c == '+' ? 1 : 0;
+        max = c == '?' ? 1 : -1;
+      } else if (c != '{' || !Count(&min, &max)) {
+        return atom;
+      }
+      if (nodes[atom].type == kAssert) return Fail("nothing to repeat");
+      if (min > kMaxRepeat || max > kMaxRepeat) return Fail("repeat count too large");
+      if (max >= 0 && max < min) return Fail("numbers out of order in {} quantifier");
+      int node = New(kRepeat);
+      nodes[node].children.push_back(atom);
+      nodes[node].min = min;
+      nodes[node].max = max;
+      if (More() && Peek() == '?') {
+        nodes[node].greedy = false;
+        at++;
+      }
+      return node;
+    }
+
+    int ParseConcatenation() {
+      int node = New(kConcat);
+      while (More() && Peek() != '|' && Peek() != ')') {
+        int child = ParseRepeat();
+        if (child < 0) return -1;
+        nodes[node].children.push_back(child);
+      }
+      return node;
+    }
+
+    int ParseAlternation() {
+      int first = ParseConcatenation();
+      if (first < 0 || !More() || Peek() != '|') return first;
+      int node = New(kAlternation);
+      nodes[node].children.push_back(first);
+      while (More() && Peek() == '|') {
+        at++;
+        int child = ParseConcatenation();
+        if (child < 0) return -1;
+        nodes[node].children.push_back(child);
+      }
+      return node;
+    }
+
+    int Add(Regex::Op op, int x = 0, int y = 0) {
+      Regex::Inst inst = { op, x, y };
+      regex->program.push_back(inst);
+      return regex->program.size() - 1;
+    }
+
+    void Emit(int index) {
+      // past the limit already, Run fails
+      if (regex->program.size() > kMaxProgram) return;
+      std::vector<Regex::Inst> &program = regex->program;
+      const Node &node = nodes[index];
+      switch (node.type) {
+        case kSet:
+          Add(Regex::kClass, node.set);
+          break;
+        case kAssert:
+          Add(node.op);
+          break;
+        case kConcat:
+          for (size_t i = 0; i < node.children.size(); i++) Emit(node.children[i]);
+          break;
+        case kAlternation: {
+          std::vector<int> jumps;
+          for (size_t i = 0; i + 1 < node.children.size(); i++) {
+            int split = Add(Regex::kSplit);
+            program[split].x = split + 1;
+            Emit(node.children[i]);
+            jumps.push_back(Add(Regex::kJump));
+            program[split].y = program.size();
+          }
+          Emit(node.children.back());
+          for (size_t i = 0; i < jumps.size(); i++) program[jumps[i]].x = program.size();
+          break;
+        }
+        case kRepeat: {
+          for (int i = 0; i < node.min && program.size() <= kMaxProgram; i++) Emit(node.children[0]);
+          if (node.max < 0) {
+            int split = Add(Regex::kSplit);
+            Emit(node.children[0]);
+            Add(Regex::kJump, split);
+            Branch(split, program.size(), node.greedy);
+            break;
+          }
+          // each further one is optional within the one before
+          std::vector<int> splits;
+          for (int i = node.min; i < node.max && program.size() <= kMaxProgram; i++) {
+            splits.push_back(Add(Regex::kSplit));
+            Emit(node.children[0]);
+          }
+          for (size_t i = 0; i < splits.size(); i++) Branch(splits[i], program.size(), node.greedy);
+          break;
+        }
+      }
+    }
+
+    // Points the split at the instruction after it and at skip, preferring
+    // the first when greedy.
+    void Branch(int split, int skip, bool greedy) {
+      Regex::Inst &inst = regex->program[split];
+      inst.x = greedy ? split + 1 : skip;
+      inst.y = greedy ? skip : split + 1;
+    }
+
+    const std::string &source;
+    bool icase;
+    size_t at;
+    int depth;  // of the groups being parsed
+    Regex *regex;
+    std::vector<Node> nodes;
+    std::string error;
+};
+
+bool Regex::Compile(const std::string &source, bool icase, std::string *error) {
+  sets.clear();
+  boundaries = false;
+  Compiler compiler(source, icase, this);
+  return compiler.Run(error);
+}
+
+static bool
+is_word(uint8_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+void Regex::Add(std::vector<int> *list, std::vector<size_t> *marks, std::vector<int> *stack,
+                int pc, const uint8_t *text, size_t len, size_t pos) const {
+  stack->push_back(pc);
+  while (!stack->empty()) {
+    pc = stack->back();
+    stack->pop_back();
+    // reached this turn already, by a path of higher priority
+    if ((*marks)[pc] == pos) continue;
+    (*marks)[pc] = pos;
+    const Inst &inst = program[pc];
+    switch (inst.op) {
+      case kJump:
+        stack->push_back(inst.x);
+        break;
+      case kSplit:
+        // x is followed first
+        stack->push_back(inst.y);
+        stack->push_back(inst.x);
+        break;
+      case kBegin:
+        if (pos == 0) stack->push_back(pc + 1);
+        break;
+      case kEnd:
+        if (pos == len) stack->push_back(pc + 1);
+        break;
+      case kBoundary:
+      case kNotBoundary: {
+        bool before = pos > 0 && is_word(text[pos - 1]);
+        bool after = pos < len && is_word(text[pos]);
+        if ((before != after) == (inst.op == kBoundary)) stack->push_back(pc + 1);
+        break;
+      }
+      case kClass:
+      case kMatch:
+        list->push_back(pc);
+        break;
+    }
+  }
+}
+
+bool Regex::Match(const char *text, size_t len, size_t *length, bool *more) const {
+  const uint8_t *p = (const uint8_t *)text;
+  std::vector<int> current;
+  std::vector<int> next;
+  std::vector<int> stack;
+  std::vector<size_t> marks(program.size(), (size_t)-1);
+  bool matched = false;
+  *more = boundaries;
+  Add(&current, &marks, &stack, 0, p, len, 0);
+  for (size_t pos = 0; !current.empty(); pos++) {
+    next.clear();
+    for (size_t t = 0; t < current.size(); t++) {
+      const Inst &inst = program[current[t]];
+      if (inst.op == kMatch) {
+        // the threads after it have lower priority, those of the next
+        // position higher
+        matched = true;
+        *length = pos;
+        break;
+      }
+      if (pos == len) {
+        // waits for the text to go on
+        *more = true;
+      } else if (sets[inst.x][p[pos]]) {
+        Add(&next, &marks, &stack, current[t] + 1, p, len, pos + 1);
+      }
+    }
+    current.swap(next);
+  }
+  return matched;
+}
+
+bool Regex::Search(const char *text, size_t len, size_t from, size_t *start, size_t *length) const {
+  const uint8_t *p = (const uint8_t *)text;
+  std::vector<int> current;
+  std::vector<int> next;
+  std::vector<int> stack;
+  std::vector<size_t> marks(program.size(), (size_t)-1);
+  // where the thread at each pc started, each pc is in a list once
+  std::vector<size_t> starts(program.size());
+  std::vector<size_t> next_starts(program.size());
+  bool matched = false;
+  for (size_t pos = from; pos <= len; pos++) {
+    if (!matched) {
+      // a thread starting here has the lowest priority
+      size_t added = current.size();
+      Add(&current, &marks, &stack, 0, p, len, pos);
+      for (; added < current.size(); added++) starts[current[added]] = pos;
+    }
+    if (current.empty()) {
+      if (matched) break;
+      continue;
+    }
+    next.clear();
+    for (size_t t = 0; t < current.size(); t++) {
+      const Inst &inst = program[current[t]];
+      if (inst.op == kMatch) {
+        // the threads after it have lower priority
+        matched = true;
+        *start = starts[current[t]];
+        *length = pos - *start;
+        break;
+      }
+      if (pos < len && sets[inst.x][p[pos]]) {
+        size_t added = next.size();
+        Add(&next, &marks, &stack, current[t] + 1, p, len, pos + 1);
+        for (; added < next.size(); added++) next_starts[next[added]] = starts[current[t]];
+      }
+    }
+    current.swap(next);
+    starts.swap(next_starts);
+  }
+  return matched;
+}
+
+static std::string
+cache_key(const std::vector<Pattern> &patterns, bool icase) {
+  std::string key(1, icase ? 'i' : 'c');
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const Pattern &p = patterns[i];
+    key += std::to_string(p.literal.size()) + ":" + p.literal;
+    key += std::to_string(p.regex.size()) + ":" + p.regex + (p.icase ? "i" : "c");
+  }
+  return key;
+}
+
+std::shared_ptr<const Automaton> Automaton::Get(const std::vector<Pattern> &patterns,
+                                                bool icase, std::string *error) {
+  std::string key = cache_key(patterns, icase);
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  std::map<std::string, std::weak_ptr<const Automaton> >::iterator it = cache.find(key);
+  if (it != cache.end()) {
+    std::shared_ptr<const Automaton> found = it->second.lock();
+    if (found) return found;
+  }
+
+  std::shared_ptr<Automaton> automaton(new Automaton());
+  automaton->patterns = patterns;
+  if (!automaton->Build(error, icase)) return std::shared_ptr<const Automaton>();
+
+  if (cache.size() >= sweep_at) {
+    for (it = cache.begin(); it != cache.end();) {
+      if (it->second.expired()) {
+        cache.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+    sweep_at = std::max<size_t>(64, cache.size() * 2);
+  }
+  cache[key] = automaton;
+  return automaton;
+}
+
+bool Automaton::Build(std::string *error, bool icase) {
+  regexes.resize(patterns.size());
+  size_t total = 0;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const Pattern &p = patterns[i];
+    if (p.literal.empty() || p.literal.size() > kMaxLiteral) {
+      *error = "The literal of pattern " + std::to_string(i) + " must be 1 to " +
+        std::to_string(kMaxLiteral) + " bytes long";
+      return false;
+    }
+    total += p.literal.size();
+    if (total > kMaxLiterals) {
+      *error = "The literals of the patterns must be " + std::to_string(kMaxLiterals) + " bytes long at most";
+      return false;
+    }
+    if (p.regex.empty()) continue;
+    std::string why;
+    if (!regexes[i].Compile(p.regex, p.icase, &why)) {
+      *error = "Invalid regex of pattern " + std::to_string(i) + ": " + why;
+      return false;
+    }
+  }
+
+  // only the bytes of literals get a class, which keeps the table small
+  memset(map, 0, sizeof(map));
+  classes = 1;
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const std::string &literal = patterns[i].literal;
+    for (size_t j = 0; j < literal.size(); j++) {
+      uint8_t c = icase ? fold(literal[j]) : literal[j];
+      if (map[c]) continue;
+      map[c] = classes++;
+      if (icase && c >= 'a' && c <= 'z') map[c - ('a' - 'A')] = map[c];
+    }
+  }
+
+  // the trie of the literals
+  std::vector<int32_t> table(classes, -1);
+  std::vector<std::vector<int> > out(1);
+  for (size_t i = 0; i < patterns.size(); i++) {
+    const std::string &literal = patterns[i].literal;
+    int state = 0;
+    for (size_t j = 0; j < literal.size(); j++) {
+      int32_t &next = table[state * classes + map[(uint8_t)literal[j]]];
+      if (next < 0) {
+        next = out.size();
+        out.push_back(std::vector<int>());
+        table.resize(table.size() + classes, -1);
+      }
+      // table may have moved
+      state = table[state * classes + map[(uint8_t)literal[j]]];
+    }
+    out[state].push_back(i);
+  }
+
+  // the failure links turn it into a DFA, breadth first: a state takes the
+  // outputs of the longest suffix of it that is in the trie too
+  std::vector<int> fail(out.size(), 0);
+  std::vector<int> queue;
+  for (int c = 0; c < classes; c++) {
+    if (table[c] < 0) {
+      table[c] = 0;
+    } else {
+      queue.push_back(table[c]);
+    }
+  }
+  for (size_t q = 0; q < queue.size(); q++) {
+    int state = queue[q];
+    for (int c = 0; c < classes; c++) {
+      int32_t next = table[state * classes + c];
+      int32_t fallback = table[fail[state] * classes + c];
+      if (next < 0) {
+        table[state * classes + c] = fallback;
+      } else {
+        fail[next] = fallback;
+        out[next].insert(out[next].end(), out[fallback].begin(), out[fallback].end());
+        queue.push_back(next);
+      }
+    }
+  }
+
+  steps.resize(table.size());
+  for (size_t i = 0; i < table.size(); i++) {
+    steps[i] = (uint32_t)(table[i] * classes) << 1 | (out[table[i]].empty() ? 0 : 1);
+  }
+
+  output_at.resize(out.size() + 1);
+  for (size_t s = 0; s < out.size(); s++) {
+    std::sort(out[s].begin(), out[s].end());
+    output_at[s] = outputs.size();
+    outputs.insert(outputs.end(), out[s].begin(), out[s].end());
+  }
+  output_at[out.size()] = outputs.size();
+  // OutputBegin of a state without outputs may point at the end
+  outputs.push_back(-1);
+  return true;
+}
+
+Matcher::Matcher(uint64_t offset)
+  : kept_at(offset), token(0), state(0) {}
+
+void Matcher::Seek(uint64_t offset) {
+  std::lock_guard<std::mutex> lock(mutex);
+  kept_at = offset;
+}
+
+uint32_t Matcher::Arm(const std::shared_ptr<const Automaton> &automaton, Match *out, bool *matched) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->automaton = automaton;
+  token++;
+  state = 0;
+  candidates.clear();
+  *matched = Scan(kept_at, out);
+  return token;
+}
+
+void Matcher::Cancel(uint32_t token) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (automaton && token == this->token) {
+    automaton.reset();
+    candidates.clear();
+  }
+}
+
+bool Matcher::Write(const char *data, size_t len, Match *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!automaton && len >= kKeep) {
+    // nothing waits, only the end is kept
+    kept_at += kept.size() + len - kKeep;
+    kept.assign(data + len - kKeep, kKeep);
+    return false;
+  }
+  uint64_t from = kept_at + kept.size();
+  kept.append(data, len);
+  bool matched = automaton && Scan(from, out);
+  Trim();
+  return matched;
+}
+
+void Matcher::Trim() {
+  if (kept.size() < 2 * kKeep) return;
+  size_t drop = kept.size() - kKeep;
+  kept.erase(0, drop);
+  kept_at += drop;
+  if (kept.capacity() > 4 * kKeep) std::string(kept).swap(kept);
+}
+
+bool Matcher::Scan(uint64_t from, Match *out) {
+  const Automaton &a = *automaton;
+  const uint8_t *p = (const uint8_t *)kept.data();
+  size_t n = kept.size();
+
+  // the first literal of a pattern without a regex ends the scan, no match
+  // ending later can win
+  int best = -1;
+  uint64_t best_start = 0;
+  uint64_t best_end = 0;
+  for (size_t i = from - kept_at; i < n && best < 0; i++) {
+    uint32_t step = a.Next(state, p[i]);
+    state = step >> 1;
+    if (!(step & 1)) continue;
+    const int *o = a.OutputBegin(state);
+    const int *e = a.OutputEnd(state);
+    for (; o != e; o++) {
+      uint64_t end = kept_at + i + 1;
+      uint64_t start = end - a.patterns[*o].literal.size();
+      if (a.patterns[*o].regex.empty()) {
+        best = *o;
+        best_start = start;
+        best_end = end;
+        break;
+      }
+      if (candidates.size() == kMaxCandidates) candidates.erase(candidates.begin());
+      Candidate candidate = { *o, start, end };
+      candidates.push_back(candidate);
+    }
+  }
+
+  // a regex matches the output after its literal that was read so far, the
+  // match that ends first wins, the first listed pattern on a tie
+  size_t live = 0;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    const Candidate c = candidates[i];
+    size_t at = c.literal_end - kept_at;
+    size_t len = std::min(n - at, kWindow);
+    size_t length;
+    bool more;
+    bool found = a.regexes[c.index].Match(kept.data() + at, len, &length, &more);
+    // a regex that did not match its window, or can not match whatever
+    // follows, does not anymore
+    if (found || (more && len < kWindow)) candidates[live++] = c;
+    if (!found) continue;
+    uint64_t end = c.literal_end + length;
+    if (best < 0 || end < best_end || (end == best_end && c.index < best)) {
+      best = c.index;
+      best_start = c.start;
+      best_end = end;
+    }
+  }
+  candidates.resize(live);
+  if (best < 0) return false;
+
+  out->token = token;
+  out->index = best;
+  out->start = best_start;
+  out->end = best_end;
+  out->text.assign(kept, best_start - kept_at, best_end - best_start);
+  // the output up to the match is used up
+  kept.erase(0, best_end - kept_at);
+  kept_at = best_end;
+  automaton.reset();
+  candidates.clear();
+  state = 0;
+  return true;
+}
+
+Napi::FunctionReference ExpectMatcher::constructor;
+
+void ExpectMatcher::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "ExpectMatcher", {
+    InstanceMethod("arm", &ExpectMatcher::Arm),
+    InstanceMethod("cancel", &ExpectMatcher::Cancel),
+    InstanceMethod("write", &ExpectMatcher::Write)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("ExpectMatcher", ctor);
+}
+
+std::shared_ptr<Matcher> ExpectMatcher::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Matcher>();
+  }
+  return Napi::ObjectWrap<ExpectMatcher>::Unwrap(value.As<Napi::Object>())->matcher;
+}
+
+ExpectMatcher::ExpectMatcher(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<ExpectMatcher>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() > 1 || (info.Length() == 1 && !info[0].IsNumber())) {
+    Napi::Error::New(env, "Usage: new pty.ExpectMatcher(offset)").ThrowAsJavaScriptException();
+    return;
+  }
+  int64_t offset = info.Length() == 1 ? info[0].As<Napi::Number>().Int64Value() : 0;
+  matcher = std::make_shared<Matcher>(offset > 0 ? offset : 0);
+}
+
+static Napi::Value
+match_value(Napi::Env env, const Match &match) {
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("token", Napi::Number::New(env, match.token));
+  obj.Set("index", Napi::Number::New(env, match.index));
+  obj.Set("start", Napi::Number::New(env, match.start));
+  obj.Set("end", Napi::Number::New(env, match.end));
+  obj.Set("text", Napi::String::New(env, match.text));
+  return obj;
+}
+
+Napi::Value ExpectMatcher::Arm(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 2 || !info[0].IsArray() || !info[1].IsBoolean()) {
+    Napi::Error::New(env, "Usage: expectMatcher.arm(patterns, caseInsensitive)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Napi::Array array = info[0].As<Napi::Array>();
+  std::vector<Pattern> patterns(array.Length());
+  for (uint32_t i = 0; i < array.Length(); i++) {
+    Napi::Value value = array[i];
+    if (!value.IsObject()) {
+      Napi::Error::New(env, "Usage: expectMatcher.arm(patterns, caseInsensitive)").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    // {literal, regex?, ignoreCase?}, the regex in ECMAScript syntax
+    Napi::Object obj = value.As<Napi::Object>();
+    Napi::Value literal = obj.Get("literal");
+    Napi::Value regex = obj.Get("regex");
+    Napi::Value icase = obj.Get("ignoreCase");
+    if (!literal.IsString() || !(regex.IsString() || regex.IsUndefined())) {
+      Napi::Error::New(env, "Usage: expectMatcher.arm(patterns, caseInsensitive)").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    patterns[i].literal = literal.As<Napi::String>().Utf8Value();
+    if (regex.IsString()) patterns[i].regex = regex.As<Napi::String>().Utf8Value();
+    patterns[i].icase = icase.IsBoolean() && icase.As<Napi::Boolean>().Value();
+  }
+  if (patterns.empty()) {
+    Napi::Error::New(env, "Expected at least one pattern").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string error;
+  std::shared_ptr<const Automaton> automaton = Automaton::Get(patterns, info[1].As<Napi::Boolean>().Value(), &error);
+  if (!automaton) {
+    Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Match match;
+  bool matched;
+  uint32_t token = matcher->Arm(automaton, &match, &matched);
+
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("token", Napi::Number::New(env, token));
+  result.Set("match", matched ? match_value(env, match) : env.Null());
+  return result;
+}
+
+Napi::Value ExpectMatcher::Cancel(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() != 1 || !info[0].IsNumber()) {
+    Napi::Error::New(env, "Usage: expectMatcher.cancel(token)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  matcher->Cancel(info[0].As<Napi::Number>().Uint32Value());
+  return env.Undefined();
+}
+
+Napi::Value ExpectMatcher::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: expectMatcher.write(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Match match;
+  bool matched;
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    matched = matcher->Write(buffer.Data(), buffer.Length(), &match);
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    matched = matcher->Write(data.data(), data.size(), &match);
+  }
+  return matched ? match_value(env, match) : env.Null();
+}
+
+}  // namespace expect
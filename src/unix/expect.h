@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * expect.h:
+ *   Waits for one of many patterns in terminal output, for automating
+ *   interactive programs. The literals of the patterns are found together by
+ *   an Aho-Corasick automaton as the output is read, a pattern may go on
+ *   with a regex matched right after its literal. The automaton of a pattern
+ *   list is shared by the sessions that expect it. Regexes run on the I/O
+ *   thread, so they are limited to what runs in linear time.
+ */
+
+#ifndef NODE_PTY_EXPECT_H_
+#define NODE_PTY_EXPECT_H_
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bitset>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace expect {
+
+// A regex in ECMAScript syntax without backreferences, lookarounds and
+// named groups, run over bytes as a Pike VM: every position of the text is
+// looked at once with each instruction at most, however the regex is
+// written. The match is the one a backtracking engine would find, but that
+// a loop may go around once more matching nothing, which ECMAScript
+// rejects.
+class Regex {
+  public:
+    Regex() : boundaries(false) {}
+
+    // Compiles source, ASCII letters match either case with icase. Fails
+    // with error set for syntax outside the subset.
+    bool Compile(const std::string &source, bool icase, std::string *error);
+    // Whether the regex matches at the start of text, sets the length of the
+    // match then. more is set when text going on could still match.
+    bool Match(const char *text, size_t len, size_t *length, bool *more) const;
+    // Finds the leftmost match in text that starts at from or later, in one
+    // pass. ^ and $ are the start and end of text.
+    bool Search(const char *text, size_t len, size_t from, size_t *start, size_t *length) const;
+
+  private:
+    enum Op {
+      kClass,     // a byte of sets[x]
+      kSplit,     // to x first, then y
+      kJump,      // to x
+      kMatch,
+      kBegin,     // ^
+      kEnd,       // $
+      kBoundary,  // \b
+      kNotBoundary
+    };
+
+    struct Inst {
+      Op op;
+      int x;
+      int y;
+    };
+
+    friend class Compiler;
+
+    // Adds the thread at pc to list, following jumps and assertions in
+    // order of priority.
+    void Add(std::vector<int> *list, std::vector<size_t> *marks, std::vector<int> *stack,
+             int pc, const uint8_t *text, size_t len, size_t pos) const;
+
+    std::vector<Inst> program;
+    std::vector<std::bitset<256> > sets;
+    bool boundaries;  // \b or \B, which text after the end may change
+};
+
+struct Pattern {
+  std::string literal;
+  std::string regex;  // empty for none
+  bool icase;         // of the regex
+};
+
+class Automaton {
+  public:
+    // The automaton of patterns, null with error set when they are invalid.
+    // Literals are matched ignoring ASCII case with icase.
+    static std::shared_ptr<const Automaton> Get(const std::vector<Pattern> &patterns,
+                                                bool icase, std::string *error);
+
+    // A state is the offset of its row in the table, a step to it has that
+    // shifted left by one and the low bit set when literals end in it.
+    uint32_t Next(uint32_t row, uint8_t c) const { return steps[row + map[c]]; }
+    // The patterns whose literals end in the state, first listed first.
+    const int *OutputBegin(uint32_t row) const { return &outputs[output_at[row / classes]]; }
+    const int *OutputEnd(uint32_t row) const { return &outputs[output_at[row / classes + 1]]; }
+
+    std::vector<Pattern> patterns;
+    std::vector<Regex> regexes;  // by pattern, unused without a regex
+
+  private:
+    Automaton() : classes(0) {}
+    bool Build(std::string *error, bool icase);
+
+    uint16_t map[256];  // byte to class, 0 for bytes of no literal
+    int classes;
+    std::vector<uint32_t> steps;  // row + class to the step to the next state
+    std::vector<int> outputs;
+    std::vector<size_t> output_at;  // of the outputs of each state, and the end
+};
+
+struct Match {
+  uint32_t token;  // of the expectation it ends
+  int index;       // of the pattern
+  uint64_t start;  // byte offsets in the output
+  uint64_t end;
+  std::string text;
+};
+
+// Follows the output of one terminal. The output since the last match, up
+// to a few KB, is kept so an expectation armed after the text it waits for
+// arrived still sees it.
+class Matcher {
+  public:
+    explicit Matcher(uint64_t offset = 0);
+
+    // Waits for the patterns of automaton, out is set when the output kept
+    // already matches. Returns the token of the expectation.
+    uint32_t Arm(const std::shared_ptr<const Automaton> &automaton, Match *out, bool *matched);
+    void Cancel(uint32_t token);
+    // Sets out when data ends the expectation.
+    bool Write(const char *data, size_t len, Match *out);
+    // Counts offsets from offset on, before any output was written.
+    void Seek(uint64_t offset);
+
+  private:
+    // A literal found of a pattern with a regex, which may match later.
+    struct Candidate {
+      int index;
+      uint64_t start;
+      uint64_t literal_end;
+    };
+
+    // Scans the kept output from offset from on.
+    bool Scan(uint64_t from, Match *out);
+    void Trim();
+
+    std::mutex mutex;
+    std::string kept;
+    uint64_t kept_at;  // the offset of kept[0]
+    std::shared_ptr<const Automaton> automaton;  // null when not armed
+    uint32_t token;
+    uint32_t state;  // the row of the automaton
+    std::vector<Candidate> candidates;
+};
+
+// The JS handle of a matcher.
+class ExpectMatcher : public Napi::ObjectWrap<ExpectMatcher> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The matcher of an ExpectMatcher object, null for anything else.
+    static std::shared_ptr<Matcher> Unwrap(Napi::Value value);
+
+    ExpectMatcher(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Matcher> matcher;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Arm(const Napi::CallbackInfo& info);
+    Napi::Value Cancel(const Napi::CallbackInfo& info);
+    Napi::Value Write(const Napi::CallbackInfo& info);
+};
+
+}  // namespace expect
+
+#endif  // NODE_PTY_EXPECT_H_
@@ -0,0 +1,1252 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * hub.cc:
+ *   Multiplexes the master fds of many ptys onto native I/O threads. Each
+ *   thread waits on one poller for all its fds, reads every ready fd and
+ *   delivers the collected output of the turn to JS with a single call of a
+ *   thread-safe function.
+ */
+
+#include <napi.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <uv.h> /* uv_err_name */
+
+#include "hub.h"
+
+#if defined(NODE_PTY_URING)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace hub {
+
+// Bytes requested per read(2).
+static const size_t kReadSize = 64 * 1024;
+
+// Batches that may wait for the JS thread before the I/O thread blocks, which
+// stops reading and lets the ptys apply backpressure to their programs.
+static const size_t kMaxQueuedBatches = 4;
+
+// Undelivered batches of a shard from which on JS counts as behind: batch
+// sessions are held back at this backlog, normal ones one batch later.
+static const uint32_t kOverloadBacklog = 2;
+
+// How often held back sessions are looked at again, less often over the
+// memory budget which frees up at the pace of JS and the reclaim thread.
+static const int kThrottleRetryMs = 1;
+static const int kBudgetRetryMs = 10;
+
+static const uint32_t kMaxThreads = 64;
+
+/**
+ * State
+ */
+
+State::~State() {
+  for (size_t i = 0; i < shards.size(); i++) {
+    delete shards[i];
+  }
+  for (auto it = sessions.begin(); it != sessions.end(); ++it) {
+    close(it->second->fd);
+  }
+}
+
+std::shared_ptr<Session> State::Find(uint32_t id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = sessions.find(id);
+  if (it == sessions.end()) return std::shared_ptr<Session>();
+  return it->second;
+}
+
+Batch::~Batch() {
+  for (size_t i = 0; i < accounts.size(); i++) {
+    accounts[i]->Charge(budget::kOutput, -(int64_t)(ends[i] - (i > 0 ? ends[i - 1] : 0)));
+  }
+}
+
+/**
+ * Writes
+ */
+
+void ChargeWrites(Session *session) {
+  session->account->Set(budget::kWrites, session->pending.size() + session->inflight.size());
+}
+
+void Flush(Session *session, Stats *stats) {
+  while (!session->pending.empty()) {
+    ssize_t n = write(session->fd, session->pending.data(), session->pending.size());
+    stats->syscalls++;
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // the pty is gone, the read side reports the close
+        session->pending.clear();
+      }
+      break;
+    }
+    stats->writes++;
+    stats->bytes_written += n;
+    session->pending.erase(0, n);
+  }
+  ChargeWrites(session);
+}
+
+/**
+ * Shard
+ */
+
+#if defined(NODE_PTY_URING)
+// Buffers the kernel picks from for reads on io_uring, all of them are handed
+// back at the end of each turn.
+static const uint16_t kBufferGroup = 0;
+static const uint16_t kBufferCount = 256;
+static const uint32_t kBufferSize = 16 * 1024;
+
+// Request kinds, kept in the upper half of the user data next to the id.
+enum {
+  kOpRead = 1,
+  kOpWrite,
+  kOpCancel,
+  kOpProvide
+};
+
+static uint64_t
+op_data(int op, uint32_t id) {
+  return ((uint64_t)op << 32) | id;
+}
+#endif
+
+Shard::Shard(State *state) : sessions(0), backlog(0), state(state) {
+#if defined(NODE_PTY_URING)
+  ring = NULL;
+  wake_fd = -1;
+  wake_value = 0;
+  wake_pending = false;
+#endif
+}
+
+Shard::~Shard() {
+#if defined(NODE_PTY_URING)
+  // removed sessions with requests left in flight still own their fd
+  delete ring;
+  for (auto it = active.begin(); it != active.end(); ++it) {
+    if (it->second->detached && it->second->fd != -1) close(it->second->fd);
+    it->second->fd = -1;
+  }
+  for (size_t i = 0; i < commands.size(); i++) {
+    if (commands[i]->detached && commands[i]->fd != -1) close(commands[i]->fd);
+    commands[i]->fd = -1;
+  }
+  if (wake_fd != -1) close(wake_fd);
+#endif
+}
+
+bool Shard::Start(bool use_uring) {
+#if defined(NODE_PTY_URING)
+  if (use_uring) {
+    uring::Ring *r = new uring::Ring();
+    std::string error;
+    bool ok = r->Init(kBufferCount * 2, &error);
+    if (ok) {
+      buffers.resize((size_t)kBufferCount * kBufferSize);
+      r->Provide(kBufferGroup, &buffers[0], kBufferSize, kBufferCount, 0,
+                 op_data(kOpProvide, 0));
+      uring::Completion completion;
+      ok = r->Enter(1) >= 0 && r->Reap(&completion, 1) == 1 && completion.res >= 0;
+    }
+    wake_fd = ok ? eventfd(0, EFD_CLOEXEC) : -1;
+    if (wake_fd != -1) {
+      ring = r;
+      thread = std::thread(&Shard::RunUring, this);
+      return true;
+    }
+    // io_uring is unavailable or lacks provided buffers, use the poller
+    delete r;
+    buffers.clear();
+  }
+#endif
+  if (!poller.Ok()) return false;
+  thread = std::thread(&Shard::Run, this);
+  return true;
+}
+
+void Shard::Stop() {
+#if defined(NODE_PTY_URING)
+  if (ring) {
+    uint64_t one = 1;
+    ssize_t r = write(wake_fd, &one, sizeof(one));
+    (void)r;
+    return;
+  }
+#endif
+  poller.Wake();
+}
+
+void Shard::Join() {
+  if (thread.joinable()) thread.join();
+}
+
+const char *Shard::Backend() const {
+#if defined(NODE_PTY_URING)
+  if (ring) return "io_uring";
+#endif
+  return poller::Poller::Name();
+}
+
+bool Shard::Attach(const std::shared_ptr<Session> &session) {
+#if defined(NODE_PTY_URING)
+  if (ring) {
+    Queue(session);
+    return true;
+  }
+#endif
+  stats.syscalls++;
+  return poller.Add(session->fd, session->id, true, false);
+}
+
+void Shard::Detach(const std::shared_ptr<Session> &session) {
+  bool was_closed = session->closed;
+  session->closed = true;
+  session->detached = true;
+#if defined(NODE_PTY_URING)
+  if (ring) {
+    // the I/O thread closes the fd once its requests completed
+    Queue(session);
+    return;
+  }
+#endif
+  if (!was_closed) {
+    stats.syscalls++;
+    poller.Remove(session->fd);
+  }
+  close(session->fd);
+  session->fd = -1;
+}
+
+void Shard::Watch(const std::shared_ptr<Session> &session) {
+  if (session->closed) return;
+#if defined(NODE_PTY_URING)
+  if (ring) {
+    Queue(session);
+    return;
+  }
+#endif
+  stats.syscalls++;
+  poller.Modify(session->fd, session->id, !session->paused && !session->muted,
+                !session->pending.empty());
+}
+
+void Shard::Send(const std::shared_ptr<Session> &session) {
+#if defined(NODE_PTY_URING)
+  if (ring) {
+    // written with the next submission of the I/O thread
+    Queue(session);
+    return;
+  }
+#endif
+  Flush(session.get(), &stats);
+  if (!session->pending.empty()) Watch(session);
+}
+
+// The length of data without a UTF-8 sequence cut off at its end.
+static size_t
+utf8_boundary(const char *data, size_t len) {
+  // back to the lead byte of the last sequence, past up to 3 continuation
+  // bytes
+  size_t i = len;
+  while (i > 0 && len - i < 3 && ((unsigned char)data[i - 1] & 0xC0) == 0x80) i--;
+  if (i == 0) return len;
+  unsigned char lead = data[i - 1];
+  size_t need = lead >= 0xF8 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+  return len - (i - 1) < need ? i - 1 : len;
+}
+
+// Adds an event of the output of a session, ahead of the close read along
+// with the output.
+static void
+add_event(Session *session, Batch *batch, const Event &event) {
+  std::vector<Event>::iterator at = batch->events.end();
+  if (session->closed && at != batch->events.begin() && (at - 1)->id == session->id) at--;
+  batch->events.insert(at, event);
+}
+
+// Records the output of a session appended to the batch from start on.
+void Shard::Emit(Session *session, Batch *batch, size_t start) {
+  if (session->utf8 && !session->closed) {
+    size_t end = start + utf8_boundary(&batch->data[start], batch->data.size() - start);
+    session->carry.assign(batch->data, end, std::string::npos);
+    batch->data.resize(end);
+  }
+  if (batch->data.size() > start) {
+    session->seq += batch->data.size() - start;
+    if (session->scrollback) {
+      session->scrollback->Append(&batch->data[start], batch->data.size() - start);
+    }
+    if (session->screen) {
+      session->screen->Write(&batch->data[start], batch->data.size() - start);
+    }
+    if (session->events) {
+      std::vector<events::Event> found;
+      session->events->Scan(&batch->data[start], batch->data.size() - start, &found);
+      for (size_t i = 0; i < found.size(); i++) {
+        add_event(session, batch, Event(session->id, found[i]));
+      }
+    }
+    if (session->expect) {
+      expect::Match match;
+      if (session->expect->Write(&batch->data[start], batch->data.size() - start, &match)) {
+        add_event(session, batch, Event(session->id, "expect")
+          .Number("token", match.token)
+          .Number("index", match.index)
+          .Number("start", match.start)
+          .Number("end", match.end)
+          .String("text", match.text));
+      }
+    }
+    if (!session->lines) {
+      batch->ids.push_back(session->id);
+      batch->ends.push_back(batch->data.size());
+      session->account->Charge(budget::kOutput, batch->data.size() - start);
+      batch->accounts.push_back(session->account);
+    }
+  }
+  if (session->links) {
+    links::Links found;
+    session->links->Write(&batch->data[start], batch->data.size() - start, &found);
+    // a link at the end of the output ends with it
+    if (session->closed) session->links->Flush(&found);
+    if (found.count > 0) add_event(session, batch, Event(session->id, "links").String("links", found.text));
+  }
+  if (session->plain) {
+    std::string text;
+    session->plain->Write(&batch->data[start], batch->data.size() - start, &text);
+    // the last line of the output ends with it
+    if (session->closed) session->plain->Flush(&text, false);
+    if (!text.empty()) add_event(session, batch, Event(session->id, "text").String("text", text));
+  }
+  if (session->lines) {
+    lines::Lines found;
+    session->lines->Write(&batch->data[start], batch->data.size() - start, &found);
+    if (session->closed) session->lines->Flush(0, &found);
+    if (found.count > 0) {
+      add_event(session, batch, Event(session->id, "lines")
+        .String("lines", found.text)
+        .Number("time", found.time)
+        .Number("seq", found.seq)
+        .Number("partial", found.partial));
+    }
+    // only the lines go to JS
+    batch->data.resize(start);
+  }
+}
+
+// Reads up to budget bytes, drained is set once the pty has no more output.
+size_t Shard::Read(Session *session, Batch *batch, size_t budget, bool *drained) {
+  size_t start = batch->data.size();
+  size_t total = 0;
+
+  batch->data += session->carry;
+  session->carry.clear();
+
+  *drained = false;
+  while (total < budget) {
+    size_t size = batch->data.size();
+    size_t want = budget - total < kReadSize ? budget - total : kReadSize;
+    batch->data.resize(size + want);
+    ssize_t n = read(session->fd, &batch->data[size], want);
+    batch->data.resize(size + (n > 0 ? n : 0));
+    stats.syscalls++;
+
+    if (n > 0) {
+      stats.reads++;
+      stats.bytes_read += n;
+      total += n;
+      continue;
+    }
+    if (n == -1 && errno == EINTR) continue;
+    *drained = true;
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+    // EOF, or EIO once the last process holding the slave side exited
+    int err = n == -1 ? errno : 0;
+    session->closed = true;
+    stats.syscalls++;
+    poller.Remove(session->fd);
+    Event event(session->id, "close");
+    if (err) event.String("code", uv_err_name(-err));
+    batch->events.push_back(event);
+    break;
+  }
+
+  Emit(session, batch, start);
+  return total;
+}
+
+// Stops or restarts polling a queued session for output, so that the poller
+// does not keep reporting output the session is not read for yet.
+void Shard::Mute(Session *session, bool muted) {
+  session->muted = muted;
+  stats.syscalls++;
+  poller.Modify(session->fd, session->id, !muted && !session->paused,
+                !session->pending.empty());
+}
+
+// The first priority class not read this turn, kPriorities while JS keeps up
+// and none over the memory budget.
+int Shard::Throttle() const {
+  if (budget::Exceeded()) return kInteractive;
+  uint32_t behind = backlog;
+  if (behind > kOverloadBacklog) return kNormal;
+  if (behind == kOverloadBacklog) return kBatch;
+  return kPriorities;
+}
+
+// Reads the sessions that were ready at the start of the turn once each, in
+// priority and queue order. A session that still has output after its share
+// goes to the back of its queue, so a flooding session gets at most its
+// quantum per turn and everyone else is read in between. Returns how long the
+// poller may wait for the next turn.
+int Shard::Serve(Batch *batch) {
+  const Schedule &schedule = state->schedule;
+  int throttle = Throttle();
+  Clock::time_point start = Clock::now();
+  Clock::time_point next = Clock::time_point::max();
+
+  for (int p = 0; p < kPriorities; p++) {
+    std::deque<std::shared_ptr<Session> > &queue = ready[p];
+    for (size_t count = queue.size(); count > 0 && !state->stopping; count--) {
+      std::shared_ptr<Session> session = queue.front();
+      queue.pop_front();
+
+      std::lock_guard<std::mutex> lock(session->mutex);
+      Session *s = session.get();
+      if (s->closed || s->paused) {
+        // requeued by the poller once resumed, pausing stopped polling already
+        s->queued = false;
+        s->muted = false;
+        continue;
+      }
+
+      // Within its coalescing window, or held back while JS is behind: wait
+      // without being polled.
+      if (p >= throttle || start < s->due) {
+        Clock::time_point retry = s->due;
+        if (p >= throttle) {
+          stats.throttled++;
+          retry = start + std::chrono::milliseconds(throttle == kInteractive ? kBudgetRetryMs : kThrottleRetryMs);
+        }
+        if (retry < next) next = retry;
+        if (!s->muted) Mute(s, true);
+        queue.push_back(session);
+        continue;
+      }
+
+      // Round-robin reads at most the quantum. Deficit round-robin reads
+      // whole chunks while credit is left and pays an overshoot back next
+      // turn, which takes fewer reads for the same share.
+      size_t budget = schedule.quantum;
+      if (schedule.drr) {
+        s->deficit += schedule.quantum;
+        budget = s->deficit > 0 ? (((size_t)s->deficit + kReadSize - 1) / kReadSize) * kReadSize : 0;
+      }
+
+      Clock::time_point now = Clock::now();
+      uint64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(now - s->ready_since).count();
+      bool drained = false;
+      size_t bytes = budget > 0 ? Read(s, batch, budget, &drained) : 0;
+
+      Fairness &f = s->fairness;
+      f.bytes += bytes;
+      f.turns++;
+      f.wait_us += wait;
+      if (wait > f.max_wait_us) f.max_wait_us = wait;
+
+      if (schedule.drr) {
+        // credit is not saved up while idle
+        s->deficit = drained ? 0 : s->deficit - (int64_t)bytes;
+      }
+      if (drained) {
+        s->queued = false;
+        if (s->muted && !s->closed) Mute(s, false);
+      } else {
+        // read again next turn, without another window
+        f.deferred++;
+        stats.deferred++;
+        s->ready_since = now;
+        s->due = now;
+        next = start;
+        queue.push_back(session);
+      }
+    }
+  }
+
+  if (next == Clock::time_point::max()) return -1;
+  Clock::time_point now = Clock::now();
+  if (next <= now) return 0;
+  // rounded up, waking early would only find nothing due
+  return (int)((std::chrono::duration_cast<std::chrono::microseconds>(next - now).count() + 999) / 1000);
+}
+
+static void
+deliver(Napi::Env env, Napi::Function callback, Batch *batch) {
+  if (env != nullptr && callback != nullptr) {
+    try {
+      Napi::HandleScope scope(env);
+
+      size_t count = batch->ids.size();
+      Napi::Uint32Array ids = Napi::Uint32Array::New(env, count);
+      Napi::Uint32Array ends = Napi::Uint32Array::New(env, count);
+      for (size_t i = 0; i < count; i++) {
+        ids[i] = batch->ids[i];
+        ends[i] = batch->ends[i];
+      }
+      Napi::Buffer<char> data = Napi::Buffer<char>::Copy(env,
+        batch->data.data(), batch->data.size());
+
+      Napi::Array events = Napi::Array::New(env, batch->events.size());
+      for (size_t i = 0; i < batch->events.size(); i++) {
+        const Event &e = batch->events[i];
+        Napi::Object obj = Napi::Object::New(env);
+        obj.Set("id", Napi::Number::New(env, e.id));
+        obj.Set("type", Napi::String::New(env, e.type));
+        for (size_t j = 0; j < e.numbers.size(); j++) {
+          obj.Set(e.numbers[j].first, Napi::Number::New(env, e.numbers[j].second));
+        }
+        for (size_t j = 0; j < e.strings.size(); j++) {
+          obj.Set(e.strings[j].first, Napi::String::New(env, e.strings[j].second));
+        }
+        events[i] = obj;
+      }
+
+      callback.Call({ ids, ends, data, events });
+    } catch (const Napi::Error& e) {
+      // surfaces as an uncaught exception
+      e.ThrowAsJavaScriptException();
+    }
+  }
+  if (batch->shard) batch->shard->backlog--;
+  delete batch;
+}
+
+void Shard::Deliver(Batch *batch) {
+  if (batch->Empty() || state->stopping) {
+    delete batch;
+    return;
+  }
+  // no session lock is held here, the JS thread may need them to drain the
+  // queue
+  stats.batches++;
+  batch->shard = this;
+  backlog++;
+  if (state->tsfn.BlockingCall(batch, deliver) != napi_ok) {
+    backlog--;
+    delete batch;
+  }
+}
+
+void Shard::Run() {
+  poller::PollEvent events[64];
+  int timeout = -1;
+
+  while (!state->stopping) {
+    // sessions left over from the last turn are read without waiting
+    int n = poller.Wait(events, 64, timeout);
+    stats.syscalls++;
+    stats.wakeups++;
+    Clock::time_point now = Clock::now();
+
+    Batch *batch = new Batch();
+    for (int i = 0; i < n && !state->stopping; i++) {
+      if (events[i].data == poller::Poller::kWakeData) continue;
+
+      std::shared_ptr<Session> session = state->Find(events[i].data);
+      if (!session) continue;
+
+      std::lock_guard<std::mutex> lock(session->mutex);
+      if (session->closed) continue;
+
+      if (events[i].writable) {
+        Flush(session.get(), &stats);
+        if (session->pending.empty()) Watch(session);
+      }
+      if ((events[i].readable || events[i].hangup) && !session->paused &&
+          !session->queued) {
+        session->queued = true;
+        session->ready_since = now;
+        session->due = now + state->schedule.window[session->priority];
+        ready[session->priority].push_back(session);
+      }
+    }
+
+    timeout = Serve(batch);
+    Deliver(batch);
+  }
+  for (int p = 0; p < kPriorities; p++) ready[p].clear();
+
+  state->tsfn.Release();
+}
+
+#if defined(NODE_PTY_URING)
+void Shard::Queue(const std::shared_ptr<Session> &session) {
+  {
+    std::lock_guard<std::mutex> lock(commands_mutex);
+    commands.push_back(session);
+  }
+  // one wakeup per turn however many sessions changed
+  if (!wake_pending.exchange(true)) {
+    uint64_t one = 1;
+    ssize_t r = write(wake_fd, &one, sizeof(one));
+    (void)r;
+    stats.syscalls++;
+  }
+}
+
+// Submits what a session needs next, its mutex must be held.
+void Shard::Arm(const std::shared_ptr<Session> &session) {
+  Session *s = session.get();
+
+  if (s->detached) {
+    if (s->reading && !s->canceling) {
+      ring->Cancel(op_data(kOpRead, s->id), op_data(kOpCancel, s->id));
+      s->canceling = true;
+    }
+    if (!s->reading && !s->writing && s->fd != -1) {
+      close(s->fd);
+      s->fd = -1;
+      active.erase(s->id);
+    }
+    return;
+  }
+
+  active[s->id] = session;
+  if (!s->closed && !s->paused && !s->reading) {
+    ring->Read(s->fd, op_data(kOpRead, s->id), kBufferGroup, kBufferSize);
+    s->reading = true;
+  }
+  if (!s->closed && !s->writing && !s->pending.empty()) {
+    s->inflight.swap(s->pending);
+    ring->Write(s->fd, op_data(kOpWrite, s->id), s->inflight.data(), s->inflight.size());
+    s->writing = true;
+  }
+}
+
+void Shard::Complete(const uring::Completion &c, Batch *batch,
+                     std::vector<std::shared_ptr<Session> > *rearm) {
+  int op = c.data >> 32;
+  uint32_t id = (uint32_t)c.data;
+
+  int bid = -1;
+  if (op == kOpRead && (c.flags & IORING_CQE_F_BUFFER)) {
+    bid = c.flags >> IORING_CQE_BUFFER_SHIFT;
+  }
+
+  auto it = active.find(id);
+  if ((op == kOpRead || op == kOpWrite) && it != active.end()) {
+    std::shared_ptr<Session> session = it->second;
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (op == kOpRead) {
+      CompleteRead(session.get(), c.res, bid, batch);
+    } else {
+      CompleteWrite(session.get(), c.res);
+    }
+    rearm->push_back(session);
+  }
+
+  // hand the buffer back once its data was copied, whatever happened to it
+  if (bid != -1) {
+    ring->Provide(kBufferGroup, &buffers[(size_t)bid * kBufferSize], kBufferSize,
+                  1, bid, op_data(kOpProvide, 0));
+  }
+}
+
+void Shard::CompleteRead(Session *s, int res, int bid, Batch *batch) {
+  s->reading = false;
+  if (res > 0) {
+    stats.reads++;
+    stats.bytes_read += res;
+    // the ring reads one buffer per session and turn
+    s->fairness.bytes += res;
+    s->fairness.turns++;
+  }
+  if (s->detached) return;
+
+  size_t start = batch->data.size();
+  batch->data += s->carry;
+  s->carry.clear();
+  if (res > 0 && bid != -1) {
+    batch->data.append(&buffers[(size_t)bid * kBufferSize], res);
+  } else if (res != -ENOBUFS && res != -ECANCELED && res != -EINTR && res != -EAGAIN) {
+    // EOF, or EIO once the last process holding the slave side exited
+    s->closed = true;
+    Event event(s->id, "close");
+    if (res < 0) event.String("code", uv_err_name(res));
+    batch->events.push_back(event);
+  }
+  Emit(s, batch, start);
+}
+
+void Shard::CompleteWrite(Session *s, int res) {
+  s->writing = false;
+  if (res > 0) {
+    stats.writes++;
+    stats.bytes_written += res;
+    s->inflight.erase(0, res);
+  } else if (res != -EINTR && res != -EAGAIN) {
+    // the pty is gone, the read side reports the close
+    s->inflight.clear();
+    s->pending.clear();
+  }
+  // the rest goes before input queued meanwhile
+  s->pending.insert(0, s->inflight);
+  s->inflight.clear();
+  ChargeWrites(s);
+}
+
+void Shard::RunUring() {
+  uring::Completion completions[256];
+  std::vector<std::shared_ptr<Session> > rearm;
+
+  ring->ReadInto(wake_fd, poller::Poller::kWakeData, &wake_value, sizeof(wake_value));
+
+  while (!state->stopping) {
+    // submits everything queued last turn and waits in one system call
+    int r = ring->Enter(1);
+    if (r < 0 && r != -EBUSY && r != -EAGAIN) {
+      FailUring(r);
+      break;
+    }
+    stats.syscalls++;
+    stats.wakeups++;
+
+    Batch *batch = new Batch();
+    unsigned n = ring->Reap(completions, 256);
+    for (unsigned i = 0; i < n; i++) {
+      if (completions[i].data != poller::Poller::kWakeData) {
+        Complete(completions[i], batch, &rearm);
+        continue;
+      }
+      std::vector<std::shared_ptr<Session> > changed;
+      {
+        std::lock_guard<std::mutex> lock(commands_mutex);
+        changed.swap(commands);
+        wake_pending = false;
+      }
+      rearm.insert(rearm.end(), changed.begin(), changed.end());
+      ring->ReadInto(wake_fd, poller::Poller::kWakeData, &wake_value, sizeof(wake_value));
+    }
+
+    for (size_t i = 0; i < rearm.size(); i++) {
+      std::lock_guard<std::mutex> lock(rearm[i]->mutex);
+      Arm(rearm[i]);
+    }
+    rearm.clear();
+
+    Deliver(batch);
+  }
+
+  state->tsfn.Release();
+}
+
+// The ring failed for good: every session is closed with the error, as are
+// those added later, until the hub stops. Output already read is delivered.
+void Shard::FailUring(int error) {
+  std::vector<std::shared_ptr<Session> > failed;
+  for (auto it = active.begin(); it != active.end(); ++it) failed.push_back(it->second);
+
+  // a read of the ring may still take a wakeup, so wait with a timeout
+  fcntl(wake_fd, F_SETFL, fcntl(wake_fd, F_GETFL) | O_NONBLOCK);
+  while (!state->stopping) {
+    Batch *batch = new Batch();
+    for (size_t i = 0; i < failed.size(); i++) {
+      Session *s = failed[i].get();
+      std::lock_guard<std::mutex> lock(s->mutex);
+      // nothing completes anymore
+      s->reading = false;
+      s->writing = false;
+      s->inflight.clear();
+      s->pending.clear();
+      ChargeWrites(s);
+      if (s->detached) {
+        if (s->fd != -1) close(s->fd);
+        s->fd = -1;
+        active.erase(s->id);
+        continue;
+      }
+      active[s->id] = failed[i];
+      if (s->closed) continue;
+      s->closed = true;
+      size_t start = batch->data.size();
+      batch->data += s->carry;
+      s->carry.clear();
+      batch->events.push_back(Event(s->id, "close").String("code", uv_err_name(error)));
+      Emit(s, batch, start);
+    }
+    failed.clear();
+    Deliver(batch);
+
+    struct pollfd pfd = { wake_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 100) > 0) {
+      ssize_t r = read(wake_fd, &wake_value, sizeof(wake_value));
+      (void)r;
+    }
+    stats.syscalls += 2;
+    std::lock_guard<std::mutex> lock(commands_mutex);
+    failed.swap(commands);
+    wake_pending = false;
+  }
+}
+#endif
+
+/**
+ * PtyHub
+ */
+
+void PtyHub::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "PtyHub", {
+    InstanceMethod("add", &PtyHub::Add),
+    InstanceMethod("remove", &PtyHub::Remove),
+    InstanceMethod("write", &PtyHub::Write),
+    InstanceMethod("observe", &PtyHub::Observe),
+    InstanceMethod("pause", &PtyHub::Pause),
+    InstanceMethod("resume", &PtyHub::Resume),
+    InstanceMethod("stats", &PtyHub::GetStats),
+    InstanceMethod("fairness", &PtyHub::GetFairness),
+    InstanceMethod("usage", &PtyHub::GetUsage),
+    InstanceMethod("markViewed", &PtyHub::MarkViewed),
+    InstanceMethod("close", &PtyHub::Close)
+  });
+
+  exports.Set("PtyHub", ctor);
+}
+
+PtyHub::PtyHub(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<PtyHub>(info), state(new State()), closed(true) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() < 1 ||
+      !info[0].IsFunction() ||
+      (info.Length() > 1 && !info[1].IsObject())) {
+    Napi::Error::New(env, "Usage: new pty.PtyHub(onBatch, options)").ThrowAsJavaScriptException();
+    return;
+  }
+
+  bool use_uring = false;
+  uint32_t threads = 1;
+  if (info.Length() > 1) {
+    Napi::Object options = info[1].As<Napi::Object>();
+    Napi::Value backend = options.Get("backend");
+    use_uring = backend.IsString() && backend.As<Napi::String>().Utf8Value() == "io_uring";
+    Napi::Value count = options.Get("threads");
+    if (count.IsNumber()) {
+      threads = count.As<Napi::Number>().Uint32Value();
+    }
+    if (threads < 1 || threads > kMaxThreads) {
+      Napi::Error::New(env, "threads must be between 1 and 64").ThrowAsJavaScriptException();
+      return;
+    }
+    Napi::Value scheduler = options.Get("scheduler");
+    state->schedule.drr = scheduler.IsString() && scheduler.As<Napi::String>().Utf8Value() == "drr";
+    Napi::Value quantum = options.Get("quantum");
+    if (quantum.IsNumber()) {
+      int64_t bytes = quantum.As<Napi::Number>().Int64Value();
+      if (bytes < 1) {
+        Napi::Error::New(env, "quantum must be positive").ThrowAsJavaScriptException();
+        return;
+      }
+      state->schedule.quantum = bytes;
+    }
+    Napi::Value coalesce = options.Get("coalesce");
+    if (coalesce.IsObject()) {
+      static const char *names[kPriorities] = { "interactive", "normal", "batch" };
+      for (int p = 0; p < kPriorities; p++) {
+        Napi::Value ms = coalesce.As<Napi::Object>().Get(names[p]);
+        if (!ms.IsNumber()) continue;
+        double value = ms.As<Napi::Number>().DoubleValue();
+        if (!(value >= 0 && value <= 1000)) {
+          Napi::Error::New(env, "coalesce windows must be between 0 and 1000 ms").ThrowAsJavaScriptException();
+          return;
+        }
+        state->schedule.window[p] = std::chrono::microseconds((int64_t)(value * 1000));
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < threads; i++) {
+    state->shards.push_back(new Shard(state.get()));
+  }
+
+  // The finalizer runs on the JS thread once every I/O thread released the
+  // function, it joins them and drops their reference to the state.
+  std::shared_ptr<State> *ref = new std::shared_ptr<State>(state);
+  state->tsfn = Napi::ThreadSafeFunction::New(
+    env, info[0].As<Napi::Function>(), "PtyHub", kMaxQueuedBatches * threads,
+    threads,
+    [](Napi::Env, std::shared_ptr<State> *ref) {
+      for (size_t i = 0; i < (*ref)->shards.size(); i++) {
+        (*ref)->shards[i]->Join();
+      }
+      delete ref;
+    }, ref);
+  // only sessions keep the event loop alive
+  state->tsfn.Unref(env);
+  closed = false;
+
+  for (size_t i = 0; i < state->shards.size(); i++) {
+    if (!state->shards[i]->Start(use_uring)) {
+      // release on behalf of the threads that never ran
+      for (size_t j = i; j < state->shards.size(); j++) {
+        state->tsfn.Release();
+      }
+      Shutdown();
+      Napi::Error::New(env, "Could not start the pty hub I/O thread.").ThrowAsJavaScriptException();
+      return;
+    }
+  }
+}
+
+PtyHub::~PtyHub() {
+  Shutdown();
+}
+
+void PtyHub::Shutdown() {
+  if (closed) return;
+  closed = true;
+  state->stopping = true;
+  for (size_t i = 0; i < state->shards.size(); i++) {
+    state->shards[i]->Stop();
+  }
+}
+
+std::shared_ptr<Session> PtyHub::Lookup(const Napi::CallbackInfo& info) {
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    return std::shared_ptr<Session>();
+  }
+  return state->Find(info[0].As<Napi::Number>().Uint32Value());
+}
+
+Napi::Value PtyHub::Add(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  std::shared_ptr<scrollback::Store> store;
+  if (info.Length() >= 5 && !info[4].IsUndefined()) {
+    store = scrollback::Scrollback::Unwrap(info[4]);
+  }
+  std::shared_ptr<screen::Model> model;
+  if (info.Length() >= 6 && !info[5].IsUndefined()) {
+    model = screen::Screen::Unwrap(info[5]);
+  }
+  std::shared_ptr<events::Scanner> scanner;
+  if (info.Length() >= 7 && !info[6].IsUndefined()) {
+    scanner = events::EventScanner::Unwrap(info[6]);
+  }
+  std::shared_ptr<plain::Stripper> stripper;
+  if (info.Length() >= 8 && !info[7].IsUndefined()) {
+    stripper = plain::PlainText::Unwrap(info[7]);
+  }
+  std::shared_ptr<lines::Framer> framer;
+  if (info.Length() >= 9 && !info[8].IsUndefined()) {
+    framer = lines::LineFramer::Unwrap(info[8]);
+  }
+  std::shared_ptr<expect::Matcher> matcher;
+  if (info.Length() >= 10 && !info[9].IsUndefined()) {
+    matcher = expect::ExpectMatcher::Unwrap(info[9]);
+  }
+  std::shared_ptr<links::Detector> detector;
+  if (info.Length() == 11 && !info[10].IsUndefined()) {
+    detector = links::LinkDetector::Unwrap(info[10]);
+  }
+  if (info.Length() < 4 || info.Length() > 11 ||
+      !info[0].IsNumber() ||
+      !info[1].IsNumber() ||
+      !info[2].IsBoolean() ||
+      !info[3].IsNumber() ||
+      (info.Length() >= 5 && !info[4].IsUndefined() && !store) ||
+      (info.Length() >= 6 && !info[5].IsUndefined() && !model) ||
+      (info.Length() >= 7 && !info[6].IsUndefined() && !scanner) ||
+      (info.Length() >= 8 && !info[7].IsUndefined() && !stripper) ||
+      (info.Length() >= 9 && !info[8].IsUndefined() && !framer) ||
+      (info.Length() >= 10 && !info[9].IsUndefined() && !matcher) ||
+      (info.Length() == 11 && !info[10].IsUndefined() && !detector)) {
+    Napi::Error::New(env, "Usage: hub.add(fd, shard, utf8, priority, scrollback, screen, events, plainText, lines, expect, links)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (closed) {
+    Napi::Error::New(env, "The pty hub is closed.").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  int fd = info[0].As<Napi::Number>().Int32Value();
+  uint32_t index = info[1].As<Napi::Number>().Uint32Value();
+  if (index >= state->shards.size()) {
+    Napi::Error::New(env, "Invalid shard.").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Shard *shard = state->shards[index];
+  uint32_t priority = info[3].As<Napi::Number>().Uint32Value();
+  if (priority >= kPriorities) {
+    Napi::Error::New(env, "Invalid priority.").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::shared_ptr<Session> session;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    uint32_t id = state->next_id++;
+    session = std::make_shared<Session>(id, fd, shard);
+    session->utf8 = info[2].As<Napi::Boolean>().Value();
+    session->priority = (Priority)priority;
+    session->scrollback = store;
+    session->screen = model;
+    session->events = scanner;
+    session->plain = stripper;
+    session->lines = framer;
+    session->expect = matcher;
+    session->links = detector;
+    session->account = store ? store->account : budget::Open(std::weak_ptr<budget::Reclaimable>());
+    state->sessions[id] = session;
+    if (state->sessions.size() == 1) state->tsfn.Ref(env);
+  }
+
+  if (!shard->Attach(session)) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->sessions.erase(session->id);
+    if (state->sessions.empty()) state->tsfn.Unref(env);
+    Napi::Error::New(env, std::string("Could not watch fd, ") + uv_err_name(-errno)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  shard->sessions++;
+
+  return Napi::Number::New(env, session->id);
+}
+
+// Stops watching a session and closes its fd.
+Napi::Value PtyHub::Remove(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  std::shared_ptr<Session> session = Lookup(info);
+  if (!session) return env.Undefined();
+
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->sessions.erase(session->id);
+    if (state->sessions.empty() && !closed) state->tsfn.Unref(env);
+  }
+  session->shard->sessions--;
+
+  std::lock_guard<std::mutex> lock(session->mutex);
+  session->shard->Detach(session);
+
+  return env.Undefined();
+}
+
+Napi::Value PtyHub::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 2 ||
+      !info[0].IsNumber() ||
+      !(info[1].IsString() || info[1].IsBuffer())) {
+    Napi::Error::New(env, "Usage: hub.write(id, data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::shared_ptr<Session> session = Lookup(info);
+  if (!session) return env.Undefined();
+
+  std::lock_guard<std::mutex> lock(session->mutex);
+  if (session->closed) return env.Undefined();
+
+  bool was_empty = session->pending.empty();
+  if (info[1].IsBuffer()) {
+    Napi::Buffer<char> data = info[1].As<Napi::Buffer<char> >();
+    session->pending.append(data.Data(), data.Length());
+  } else {
+    session->pending += info[1].As<Napi::String>().Utf8Value();
+  }
+  ChargeWrites(session.get());
+  // input means someone is at the terminal
+  session->account->Viewed();
+
+  // Earlier input is already waiting for the I/O thread.
+  if (was_empty) {
+    session->shard->Send(session);
+  }
+
+  return env.Undefined();
+}
+
+// Starts scanning the output of a session for events, or matching it for
+// expect(), from the output the shard reads next on. Each is kept once set.
+Napi::Value PtyHub::Observe(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  std::shared_ptr<events::Scanner> scanner;
+  if (info.Length() >= 2 && !info[1].IsUndefined()) {
+    scanner = events::EventScanner::Unwrap(info[1]);
+  }
+  std::shared_ptr<expect::Matcher> matcher;
+  if (info.Length() == 3 && !info[2].IsUndefined()) {
+    matcher = expect::ExpectMatcher::Unwrap(info[2]);
+  }
+  if (info.Length() < 2 || info.Length() > 3 ||
+      !info[0].IsNumber() ||
+      (!info[1].IsUndefined() && !scanner) ||
+      (info.Length() == 3 && !info[2].IsUndefined() && !matcher)) {
+    Napi::Error::New(env, "Usage: hub.observe(id, events, expect)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::shared_ptr<Session> session = Lookup(info);
+  if (!session) return env.Undefined();
+
+  // the I/O thread emits output with the mutex held, so nothing is read
+  // between taking the offset and attaching
+  std::lock_guard<std::mutex> lock(session->mutex);
+  if (scanner && !session->events) {
+    scanner->Seek(session->seq);
+    session->events = scanner;
+  }
+  if (matcher && !session->expect) {
+    matcher->Seek(session->seq);
+    session->expect = matcher;
+  }
+  return env.Undefined();
+}
+
+Napi::Value PtyHub::Pause(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  std::shared_ptr<Session> session = Lookup(info);
+  if (session) {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->paused = true;
+    session->shard->Watch(session);
+  }
+  return env.Undefined();
+}
+
+Napi::Value PtyHub::Resume(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  std::shared_ptr<Session> session = Lookup(info);
+  if (session) {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->paused = false;
+    session->shard->Watch(session);
+  }
+  return env.Undefined();
+}
+
+Napi::Value PtyHub::GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  Napi::Object obj = Napi::Object::New(env);
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    obj.Set("sessions", Napi::Number::New(env, state->sessions.size()));
+  }
+  obj.Set("backend", Napi::String::New(env, state->shards[0]->Backend()));
+
+  // totals, and the share of each shard
+  Stats total;
+  Napi::Array shards = Napi::Array::New(env, state->shards.size());
+  for (size_t i = 0; i < state->shards.size(); i++) {
+    const Stats &stats = state->shards[i]->stats;
+    total.syscalls += stats.syscalls;
+    total.reads += stats.reads;
+    total.bytes_read += stats.bytes_read;
+    total.writes += stats.writes;
+    total.bytes_written += stats.bytes_written;
+    total.wakeups += stats.wakeups;
+    total.batches += stats.batches;
+    total.deferred += stats.deferred;
+    total.throttled += stats.throttled;
+
+    Napi::Object shard = Napi::Object::New(env);
+    shard.Set("sessions", Napi::Number::New(env, state->shards[i]->sessions));
+    shard.Set("bytesRead", Napi::Number::New(env, stats.bytes_read));
+    shard.Set("batches", Napi::Number::New(env, stats.batches));
+    shards[i] = shard;
+  }
+
+  obj.Set("syscalls", Napi::Number::New(env, total.syscalls));
+  obj.Set("reads", Napi::Number::New(env, total.reads));
+  obj.Set("bytesRead", Napi::Number::New(env, total.bytes_read));
+  obj.Set("writes", Napi::Number::New(env, total.writes));
+  obj.Set("bytesWritten", Napi::Number::New(env, total.bytes_written));
+  obj.Set("wakeups", Napi::Number::New(env, total.wakeups));
+  obj.Set("batches", Napi::Number::New(env, total.batches));
+  obj.Set("deferred", Napi::Number::New(env, total.deferred));
+  obj.Set("throttled", Napi::Number::New(env, total.throttled));
+  obj.Set("shards", shards);
+  return obj;
+}
+
+// What the scheduler gave a session, undefined once it was removed.
+Napi::Value PtyHub::GetFairness(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  std::shared_ptr<Session> session = Lookup(info);
+  if (!session) return env.Undefined();
+
+  Fairness f;
+  {
+    std::lock_guard<std::mutex> lock(session->mutex);
+    f = session->fairness;
+  }
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("bytesRead", Napi::Number::New(env, f.bytes));
+  obj.Set("turns", Napi::Number::New(env, f.turns));
+  obj.Set("deferred", Napi::Number::New(env, f.deferred));
+  obj.Set("waitUs", Napi::Number::New(env, f.wait_us));
+  obj.Set("maxWaitUs", Napi::Number::New(env, f.max_wait_us));
+  return obj;
+}
+
+// The memory a session holds in the budget, undefined once it was removed.
+Napi::Value PtyHub::GetUsage(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  std::shared_ptr<Session> session = Lookup(info);
+  if (!session) return env.Undefined();
+
+  const budget::Account &account = *session->account;
+  int64_t scrollback = account.Usage(budget::kScrollback);
+  int64_t writes = account.Usage(budget::kWrites);
+  int64_t output = account.Usage(budget::kOutput);
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("scrollback", Napi::Number::New(env, (double)scrollback));
+  obj.Set("writes", Napi::Number::New(env, (double)writes));
+  obj.Set("output", Napi::Number::New(env, (double)output));
+  obj.Set("total", Napi::Number::New(env, (double)(scrollback + writes + output)));
+  obj.Set("idleMs", Napi::Number::New(env, (double)(budget::NowMs() - account.ViewedMs())));
+  return obj;
+}
+
+Napi::Value PtyHub::MarkViewed(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  std::shared_ptr<Session> session = Lookup(info);
+  if (session) session->account->Viewed();
+  return env.Undefined();
+}
+
+// Stops the I/O threads, the fds of remaining sessions are closed once they
+// exited.
+Napi::Value PtyHub::Close(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Shutdown();
+  return env.Undefined();
+}
+
+}  // namespace hub
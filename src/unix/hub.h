@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * hub.h:
+ *   Multiplexes the master fds of many ptys onto a native I/O thread that
+ *   reads them in a tight loop and hands the output to JS in batches, one
+ *   callback per loop turn instead of one stream per pty.
+ */
+
+#ifndef NODE_PTY_HUB_H_
+#define NODE_PTY_HUB_H_
+
+#include <napi.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "budget.h"
+#include "events.h"
+#include "expect.h"
+#include "lines.h"
+#include "links.h"
+#include "plain.h"
+#include "poller.h"
+#include "screen.h"
+#include "scrollback.h"
+#include "uring.h"
+
+namespace hub {
+
+// An event of a session delivered after the data of the same batch, with a
+// type and a few named fields that become an object on the JS side.
+struct Event {
+  uint32_t id;
+  const char *type;
+  std::vector<std::pair<const char *, double> > numbers;
+  std::vector<std::pair<const char *, std::string> > strings;
+
+  Event(uint32_t id, const char *type) : id(id), type(type) {}
+  Event(uint32_t id, const events::Event &e)
+    : id(id), type(e.type), numbers(e.numbers), strings(e.strings) {}
+  Event &Number(const char *name, double value) {
+    numbers.push_back(std::make_pair(name, value));
+    return *this;
+  }
+  Event &String(const char *name, const std::string &value) {
+    strings.push_back(std::make_pair(name, value));
+    return *this;
+  }
+};
+
+class Shard;
+
+// The output read during one loop turn: the data of session ids[i] is
+// data[ends[i - 1], ends[i]), charged to accounts[i] until the batch is gone.
+struct Batch {
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> ends;
+  std::vector<std::shared_ptr<budget::Account> > accounts;
+  std::string data;
+  std::vector<Event> events;
+  Shard *shard;  // that read it, set once it is handed to JS
+
+  Batch() : shard(nullptr) {}
+  ~Batch();
+  bool Empty() const { return ids.empty() && events.empty(); }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// Priority classes, read in this order each turn and held back in reverse
+// order when JS falls behind.
+enum Priority {
+  kInteractive = 0,
+  kNormal = 1,
+  kBatch = 2,
+  kPriorities = 3
+};
+
+// How the bytes a shard reads per turn are shared among ready sessions.
+struct Schedule {
+  bool drr;         // deficit round-robin instead of a plain per-turn budget
+  size_t quantum;   // bytes per session per turn
+  // how long a session of each class waits after it became ready, so that
+  // more output is read with fewer reads and batches
+  std::chrono::microseconds window[kPriorities];
+
+  Schedule() : drr(false), quantum(64 * 1024) {
+    window[kInteractive] = std::chrono::microseconds(0);
+    window[kNormal] = std::chrono::microseconds(0);
+    window[kBatch] = std::chrono::microseconds(5000);
+  }
+};
+
+// What a session got from the scheduler.
+struct Fairness {
+  uint64_t bytes;
+  uint64_t turns;      // turns it was read in
+  uint64_t deferred;   // turns that ended with output left for the next one
+  uint64_t wait_us;    // total and longest time from ready to read
+  uint64_t max_wait_us;
+
+  Fairness() : bytes(0), turns(0), deferred(0), wait_us(0), max_wait_us(0) {}
+};
+
+struct Session {
+  uint32_t id;
+  int fd;
+  Shard *shard;
+
+  // guards everything below, held by the I/O thread while reading
+  std::mutex mutex;
+  bool paused;
+  bool closed;
+  std::string pending;  // input not accepted by the pty yet
+  uint64_t seq;  // bytes of output emitted so far
+
+  // Output is cut at UTF-8 character boundaries, the start of a character
+  // split across reads waits in carry for the rest.
+  bool utf8;
+  std::string carry;
+  // keeps the output as it is read, optional
+  std::shared_ptr<scrollback::Store> scrollback;
+  // parses the output into a screen as it is read, optional
+  std::shared_ptr<screen::Model> screen;
+  // picks titles, bells and the like out of the output, optional
+  std::shared_ptr<events::Scanner> events;
+  // strips the output to plain text for a log, optional
+  std::shared_ptr<plain::Stripper> plain;
+  // frames the output into lines, which are delivered instead of it,
+  // optional
+  std::shared_ptr<lines::Framer> lines;
+  // waits for the patterns of expect() calls
+  std::shared_ptr<expect::Matcher> expect;
+  // finds URLs and file paths in the output, optional
+  std::shared_ptr<links::Detector> links;
+  // charged with pending input and undelivered output, the one of the
+  // scrollback when there is one
+  std::shared_ptr<budget::Account> account;
+
+  // poller backend: waiting in the ready queue of the shard since
+  // ready_since, to be read from due on. A muted session is not polled for
+  // output meanwhile.
+  Priority priority;
+  bool queued;
+  bool muted;
+  int64_t deficit;
+  Clock::time_point ready_since;
+  Clock::time_point due;
+  Fairness fairness;
+
+  // io_uring backend: requests in flight and the input being written
+  bool reading;
+  bool writing;
+  bool canceling;
+  bool detached;  // removed, the fd is closed once nothing is in flight
+  std::string inflight;
+
+  Session(uint32_t id, int fd, Shard *shard)
+    : id(id), fd(fd), shard(shard), paused(false), closed(false), seq(0),
+      utf8(false), priority(kNormal), queued(false), muted(false), deficit(0), reading(false), writing(false), canceling(false),
+      detached(false) {}
+};
+
+struct Stats {
+  std::atomic<uint64_t> syscalls;  // made for pty I/O, including polling
+  std::atomic<uint64_t> reads;
+  std::atomic<uint64_t> bytes_read;
+  std::atomic<uint64_t> writes;
+  std::atomic<uint64_t> bytes_written;
+  std::atomic<uint64_t> wakeups;
+  std::atomic<uint64_t> batches;
+  std::atomic<uint64_t> deferred;   // sessions left ready after their turn
+  std::atomic<uint64_t> throttled;  // sessions held back while JS is behind
+                                    // or over the memory budget
+
+  Stats() : syscalls(0), reads(0), bytes_read(0), writes(0), bytes_written(0),
+            wakeups(0), batches(0), deferred(0), throttled(0) {}
+};
+
+// State shared by the JS object and the I/O threads. It is released by the
+// finalizer of the thread-safe function once all threads have exited.
+struct State {
+  std::mutex mutex;  // guards sessions and next_id
+  std::unordered_map<uint32_t, std::shared_ptr<Session> > sessions;
+  uint32_t next_id;
+  std::atomic<bool> stopping;
+  std::vector<Shard *> shards;
+  Schedule schedule;
+  Napi::ThreadSafeFunction tsfn;
+
+  State() : next_id(1), stopping(false) {}
+  ~State();
+  std::shared_ptr<Session> Find(uint32_t id);
+};
+
+// An I/O thread that waits for its sessions on a poller, or submits their
+// reads and writes to an io_uring.
+class Shard {
+  public:
+    Shard(State *state);
+    ~Shard();
+
+    // Starts the thread, on io_uring if asked and the kernel supports it.
+    bool Start(bool use_uring);
+    void Stop();
+    void Join();
+    const char *Backend() const;
+
+    Stats stats;
+    uint32_t sessions;  // assigned to the shard, only used on the JS thread
+    std::atomic<uint32_t> backlog;  // batches not yet delivered to JS
+
+    // Called on the JS thread with the mutex of the session held.
+    bool Attach(const std::shared_ptr<Session> &session);
+    void Detach(const std::shared_ptr<Session> &session);
+    // Applies changes of paused and pending.
+    void Watch(const std::shared_ptr<Session> &session);
+    // Writes or queues the pending input.
+    void Send(const std::shared_ptr<Session> &session);
+
+  private:
+    void Run();
+    size_t Read(Session *session, Batch *batch, size_t budget, bool *drained);
+    int Serve(Batch *batch);
+    int Throttle() const;
+    void Mute(Session *session, bool muted);
+    void Emit(Session *session, Batch *batch, size_t start);
+    void Deliver(Batch *batch);
+
+    State *state;  // owns the shard
+    std::thread thread;
+    poller::Poller poller;
+
+    // sessions with output by priority, served in order, only used by the
+    // I/O thread
+    std::deque<std::shared_ptr<Session> > ready[kPriorities];
+
+#if defined(NODE_PTY_URING)
+    void RunUring();
+    void Queue(const std::shared_ptr<Session> &session);
+    void Arm(const std::shared_ptr<Session> &session);
+    void Complete(const uring::Completion &completion, Batch *batch,
+                  std::vector<std::shared_ptr<Session> > *rearm);
+    void CompleteRead(Session *session, int res, int bid, Batch *batch);
+    void CompleteWrite(Session *session, int res);
+    void FailUring(int error);
+
+    uring::Ring *ring;  // null on the poller backend
+    std::vector<char> buffers;
+    int wake_fd;
+    uint64_t wake_value;
+
+    // sessions changed on the JS thread since the last turn
+    std::mutex commands_mutex;
+    std::vector<std::shared_ptr<Session> > commands;
+    std::atomic<bool> wake_pending;
+
+    // sessions with requests in the ring, only used by the I/O thread
+    std::unordered_map<uint32_t, std::shared_ptr<Session> > active;
+#endif
+};
+
+class PtyHub : public Napi::ObjectWrap<PtyHub> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+
+    PtyHub(const Napi::CallbackInfo& info);
+    ~PtyHub();
+
+  private:
+    Napi::Value Add(const Napi::CallbackInfo& info);
+    Napi::Value Remove(const Napi::CallbackInfo& info);
+    Napi::Value Write(const Napi::CallbackInfo& info);
+    Napi::Value Observe(const Napi::CallbackInfo& info);
+    Napi::Value Pause(const Napi::CallbackInfo& info);
+    Napi::Value Resume(const Napi::CallbackInfo& info);
+    Napi::Value GetStats(const Napi::CallbackInfo& info);
+    Napi::Value GetFairness(const Napi::CallbackInfo& info);
+    Napi::Value GetUsage(const Napi::CallbackInfo& info);
+    Napi::Value MarkViewed(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+
+    void Shutdown();
+    std::shared_ptr<Session> Lookup(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<State> state;
+    bool closed;
+};
+
+// Writes as much of the pending input of a session as the pty accepts, its
+// mutex must be held.
+void Flush(Session *session, Stats *stats);
+// Charges the input a session holds, its mutex must be held.
+void ChargeWrites(Session *session);
+
+}  // namespace hub
+
+#endif  // NODE_PTY_HUB_H_
@@ -0,0 +1,250 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * lines.cc:
+ *   The line framer of terminal output.
+ */
+
+#include "lines.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace lines {
+
+// a buffer grown by a long line is given back after it
+static const size_t kKeepLine = 4096;
+
+static const uint8_t kCr = '\r';
+static const uint8_t kLf = '\n';
+
+// The offset of the first CR or LF in data, len when there is none.
+static size_t
+find_break(const uint8_t *p, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i cr = _mm_set1_epi8(kCr);
+  const __m128i lf = _mm_set1_epi8(kLf);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t cr = vdupq_n_u8(kCr);
+  const uint8x16_t lf = vdupq_n_u8(kLf);
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8(p + i);
+    uint8x16_t m = vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf));
+    // narrows each byte of the mask to 4 bits
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits) return i + (__builtin_ctzll(bits) >> 2);
+  }
+#else
+  static const uint64_t kOnes = 0x0101010101010101ULL;
+  static const uint64_t kHighs = 0x8080808080808080ULL;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    uint64_t c = w ^ (kOnes * kCr);
+    uint64_t l = w ^ (kOnes * kLf);
+    // a zero byte in either, the byte loop below finds which
+    if (((c - kOnes) & ~c & kHighs) | ((l - kOnes) & ~l & kHighs)) break;
+  }
+#endif
+  for (; i < len; i++) {
+    if (p[i] == kCr || p[i] == kLf) return i;
+  }
+  return len;
+}
+
+static double
+epoch_ms() {
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+Framer::Framer(size_t max_length)
+  : max_length(max_length > 0 ? max_length : 1), cr(false), seq(0) {}
+
+void Framer::EndLine(Lines *out, bool partial) {
+  if (out->count > 0) out->text.push_back('\n');
+  out->text += line;
+  out->count++;
+  out->partial = partial;
+  if (line.capacity() > kKeepLine) {
+    std::string().swap(line);
+  } else {
+    line.clear();
+  }
+}
+
+// The start of a UTF-8 sequence at the end of line that may not be complete,
+// its size when there is none.
+static size_t
+last_sequence(const std::string &line) {
+  size_t i = line.size();
+  while (i > 0 && line.size() - i < 3 && ((uint8_t)line[i - 1] & 0xC0) == 0x80) i--;
+  return i > 0 && (uint8_t)line[i - 1] >= 0xC0 ? i - 1 : line.size();
+}
+
+void Framer::Append(const char *data, size_t len, Lines *out) {
+  while (line.size() + len > max_length) {
+    // cut where a character starts
+    size_t cut = max_length - line.size();
+    while (cut > 0 && ((uint8_t)data[cut] & 0xC0) == 0x80) cut--;
+    std::string rest;
+    if (cut == 0) {
+      // a character split across writes moves to the next line, unless it
+      // is all there is
+      size_t at = last_sequence(line);
+      if (at == 0) {
+        cut = max_length - line.size();
+      } else {
+        rest.assign(line, at, std::string::npos);
+        line.resize(at);
+      }
+    }
+    line.append(data, cut);
+    EndLine(out, false);
+    line = rest;
+    data += cut;
+    len -= cut;
+  }
+  line.append(data, len);
+}
+
+void Framer::Write(const char *data, size_t len, Lines *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i = 0;
+  while (i < len) {
+    if (cr) {
+      if (p[i] == kLf) {
+        EndLine(out, false);
+        cr = false;
+        i++;
+        continue;
+      }
+      if (p[i] == kCr) {
+        // CR CR LF is how a pty sends CR LF
+        i++;
+        continue;
+      }
+      // the line is written over from its start, a progress bar keeps its
+      // last state
+      line.clear();
+      cr = false;
+    }
+    size_t n = find_break(p + i, len - i);
+    Append(data + i, n, out);
+    i += n;
+    if (i == len) break;
+    if (p[i] == kLf) {
+      EndLine(out, false);
+    } else {
+      cr = true;
+    }
+    i++;
+  }
+  seq += len;
+  written = std::chrono::steady_clock::now();
+  if (out->count > 0) {
+    out->time = epoch_ms();
+    out->seq = seq;
+  }
+}
+
+void Framer::Flush(int64_t idle, Lines *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (line.empty()) return;
+  if (idle > 0 && std::chrono::steady_clock::now() - written < std::chrono::milliseconds(idle)) return;
+  EndLine(out, true);
+  cr = false;
+  out->time = epoch_ms();
+  out->seq = seq;
+}
+
+Napi::FunctionReference LineFramer::constructor;
+
+void LineFramer::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "LineFramer", {
+    InstanceMethod("write", &LineFramer::Write),
+    InstanceMethod("flush", &LineFramer::Flush)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("LineFramer", ctor);
+}
+
+std::shared_ptr<Framer> LineFramer::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Framer>();
+  }
+  return Napi::ObjectWrap<LineFramer>::Unwrap(value.As<Napi::Object>())->framer;
+}
+
+LineFramer::LineFramer(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<LineFramer>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() != 1 || !info[0].IsNumber() || info[0].As<Napi::Number>().Int64Value() <= 0) {
+    Napi::Error::New(env, "Usage: new pty.LineFramer(maxLength)").ThrowAsJavaScriptException();
+    return;
+  }
+  framer = std::make_shared<Framer>(info[0].As<Napi::Number>().Int64Value());
+}
+
+static Napi::Value
+lines_value(Napi::Env env, const Lines &lines) {
+  if (lines.count == 0) return env.Null();
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("lines", Napi::String::New(env, lines.text));
+  obj.Set("time", Napi::Number::New(env, lines.time));
+  obj.Set("seq", Napi::Number::New(env, lines.seq));
+  obj.Set("partial", Napi::Boolean::New(env, lines.partial));
+  return obj;
+}
+
+Napi::Value LineFramer::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: lineFramer.write(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Lines lines;
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    framer->Write(buffer.Data(), buffer.Length(), &lines);
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    framer->Write(data.data(), data.size(), &lines);
+  }
+  return lines_value(env, lines);
+}
+
+Napi::Value LineFramer::Flush(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() > 1 || (info.Length() == 1 && !info[0].IsNumber())) {
+    Napi::Error::New(env, "Usage: lineFramer.flush(idleMs)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Lines lines;
+  framer->Flush(info.Length() == 1 ? info[0].As<Napi::Number>().Int64Value() : 0, &lines);
+  return lines_value(env, lines);
+}
+
+}  // namespace lines
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * lines.h:
+ *   Frames terminal output into complete lines for log capture. A carriage
+ *   return that does not end a line starts it over, so a progress bar
+ *   leaves its last state; escape sequences are kept.
+ */
+
+#ifndef NODE_PTY_LINES_H_
+#define NODE_PTY_LINES_H_
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace lines {
+
+// Lines given out at once, joined by newlines.
+struct Lines {
+  std::string text;
+  size_t count;
+  bool partial;   // the last line was given out before it ended
+  double time;    // when they were framed, in milliseconds since the epoch
+  uint64_t seq;   // the bytes framed until then
+
+  Lines() : count(0), partial(false), time(0), seq(0) {}
+};
+
+class Framer {
+  public:
+    // Lines longer than max_length bytes are cut.
+    explicit Framer(size_t max_length);
+
+    // Appends the lines data ends to out.
+    void Write(const char *data, size_t len, Lines *out);
+    // Gives out the line being written when nothing was written to it for
+    // idle milliseconds, 0 for right away.
+    void Flush(int64_t idle, Lines *out);
+
+  private:
+    void Append(const char *data, size_t len, Lines *out);
+    void EndLine(Lines *out, bool partial);
+
+    std::mutex mutex;
+    size_t max_length;
+    std::string line;
+    bool cr;  // the last byte was a carriage return
+    uint64_t seq;
+    std::chrono::steady_clock::time_point written;
+};
+
+// The JS handle of a framer.
+class LineFramer : public Napi::ObjectWrap<LineFramer> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The framer of a LineFramer object, null for anything else.
+    static std::shared_ptr<Framer> Unwrap(Napi::Value value);
+
+    LineFramer(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Framer> framer;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Write(const Napi::CallbackInfo& info);
+    Napi::Value Flush(const Napi::CallbackInfo& info);
+};
+
+}  // namespace lines
+
+#endif  // NODE_PTY_LINES_H_
@@ -0,0 +1,547 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * links.cc:
+ *   The link detector of terminal output.
+ */
+
+#include "links.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "events.h"
+
+namespace links {
+
+// words longer than this are not looked at
+static const size_t kMaxLink = 2048;
+// of the line and column numbers after a path
+static const size_t kMaxDigits = 9;
+
+static const uint8_t kBel = 0x07;
+static const uint8_t kEsc = 0x1B;
+static const uint8_t kColon = ':';
+static const uint8_t kSlash = '/';
+
+// Words are split at whitespace and controls.
+static inline bool
+is_space(uint8_t c) {
+  return c <= 0x20 || c == 0x7F;
+}
+
+static inline bool
+is_alpha(uint8_t c) {
+  return (unsigned)((c | 0x20) - 'a') < 26u;
+}
+
+static inline bool
+is_digit(uint8_t c) {
+  return (unsigned)(c - '0') < 10u;
+}
+
+static inline bool
+is_alnum(uint8_t c) {
+  return is_alpha(c) || is_digit(c);
+}
+
+static inline bool
+is_scheme(uint8_t c) {
+  return is_alnum(c) || c == '+' || c == '.' || c == '-';
+}
+
+// What RFC 3986 leaves out of URLs, but for non-ASCII characters.
+static inline bool
+is_url(uint8_t c) {
+  switch (c) {
+    case '<': case '>': case '"': case '{': case '}':
+    case '|': case '\\': case '^': case '`':
+      return false;
+  }
+  return !is_space(c);
+}
+
+static inline bool
+is_path(uint8_t c) {
+  switch (c) {
+    case '.': case '_': case '-': case '/': case '~': case '+': case '@': case '%':
+      return true;
+  }
+  return is_alnum(c) || c >= 0x80;
+}
+
+// The offset of the first ':', '/' or ESC in p, len when there is none.
+static size_t
+find_candidate(const uint8_t *p, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i colon = _mm_set1_epi8(kColon);
+  const __m128i slash = _mm_set1_epi8(kSlash);
+  const __m128i esc = _mm_set1_epi8(kEsc);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, slash)), _mm_cmpeq_epi8(v, esc));
+    int mask = _mm_movemask_epi8(m);
+    if (mask) return i + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t colon = vdupq_n_u8(kColon);
+  const uint8x16_t slash = vdupq_n_u8(kSlash);
+  const uint8x16_t esc = vdupq_n_u8(kEsc);
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8(p + i);
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, colon), vceqq_u8(v, slash)), vceqq_u8(v, esc));
+    // narrows each byte of the mask to 4 bits
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits) return i + (__builtin_ctzll(bits) >> 2);
+  }
+#else
+  static const uint64_t kOnes = 0x0101010101010101ULL;
+  static const uint64_t kHighs = 0x8080808080808080ULL;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    uint64_t c = w ^ (kOnes * kColon);
+    uint64_t s = w ^ (kOnes * kSlash);
+    uint64_t e = w ^ (kOnes * kEsc);
+    // a zero byte in any, the byte loop below finds which
+    if (((c - kOnes) & ~c & kHighs) | ((s - kOnes) & ~s & kHighs) | ((e - kOnes) & ~e & kHighs)) break;
+  }
+#endif
+  for (; i < len; i++) {
+    if (p[i] == kColon || p[i] == kSlash || p[i] == kEsc) return i;
+  }
+  return len;
+}
+
+/**
+ * Validation
+ */
+
+// The end of the URL whose "://" is at colon in p, with its scheme from
+// *start on (moved to where the scheme starts), or 0 when there is none.
+static size_t
+url_end(const uint8_t *p, size_t *start, size_t colon, size_t len) {
+  size_t s = colon;
+  while (s > *start && is_scheme(p[s - 1])) s--;
+  while (s < colon && !is_alpha(p[s])) s++;
+  if (colon - s < 2) return 0;
+
+  size_t body = colon + 3;
+  size_t end = body;
+  while (end < len && is_url(p[end])) end++;
+  // punctuation after a URL is left out, and closing brackets it did not
+  // open
+  while (end > body) {
+    uint8_t c = p[end - 1];
+    if (c == '.' || c == ',' || c == ';' || c == ':' || c == '!' || c == '?' || c == '\'' || c == '*') {
+      end--;
+      continue;
+    }
+    if (c == ')' || c == ']') {
+      uint8_t open = c == ')' ? '(' : '[';
+      int depth = 0;
+      for (size_t i = body; i < end; i++) {
+        if (p[i] == open) depth++;
+        if (p[i] == c) depth--;
+      }
+      if (depth < 0) {
+        end--;
+        continue;
+      }
+    }
+    break;
+  }
+  if (end == body) return 0;
+  // only file URLs go without a host
+  bool file = colon - s == 4 && memcmp("file", p + s, 4) == 0;
+  if ((p[body] == '/') != file) return 0;
+  *start = s;
+  return end;
+}
+
+static bool
+has_extension(const uint8_t *name, size_t len) {
+  size_t dot = len;
+  while (dot > 0 && name[dot - 1] != '.') dot--;
+  // a hidden file or none
+  if (dot <= 1 || dot == len || len - dot > 10) return false;
+  bool letter = false;
+  for (size_t i = dot; i < len; i++) {
+    if (!is_alnum(name[i])) return false;
+    letter = letter || is_alpha(name[i]);
+  }
+  return letter;
+}
+
+// Whether the path characters in p look like a file path. A number after
+// it makes a relative path without an extension one.
+static bool
+is_path_link(const uint8_t *p, size_t len, bool numbered) {
+  if (len < 2) return false;
+  size_t name = len;
+  while (name > 0 && p[name - 1] != '/') name--;
+  bool named = has_extension(p + name, len - name);
+  if (p[0] == '/' || (p[0] == '~' && p[1] == '/') ||
+      (p[0] == '.' && (p[1] == '/' || (len > 2 && p[1] == '.' && p[2] == '/')))) {
+    // not a comment
+    if (p[0] == '/' && p[1] == '/') return false;
+    for (size_t i = 0; i < len; i++) {
+      if (is_alnum(p[i])) return true;
+    }
+    return false;
+  }
+  if (name == 0) return numbered && named;
+  return numbered || named;
+}
+
+// Reads ":number" at p[at], returns where it ends or at when there is none.
+static size_t
+read_number(const uint8_t *p, size_t at, size_t len, uint32_t *value) {
+  if (at + 1 >= len || p[at] != ':' || !is_digit(p[at + 1])) return at;
+  size_t end = at + 1;
+  uint32_t n = 0;
+  while (end < len && is_digit(p[end])) {
+    if (end - at > kMaxDigits) return at;
+    n = n * 10 + (p[end++] - '0');
+  }
+  // a port or a time
+  if (n == 0 || (end < len && p[end] != ':' && is_path(p[end]))) return at;
+  *value = n;
+  return end;
+}
+
+/**
+ * Links
+ */
+
+void Links::Add(const Link &link) {
+  char head[80];
+  snprintf(head, sizeof(head), "%c %llu %llu %u %u ", link.kind == kUrl ? 'u' : 'p',
+           (unsigned long long)link.start, (unsigned long long)link.end, link.line, link.column);
+  if (count++ > 0) text += '\n';
+  text += head;
+  text += link.text;
+}
+
+/**
+ * Detector
+ */
+
+Detector::Detector(int kinds, uint64_t offset)
+  : kinds(kinds), offset(offset), state(kGround), keeps(false), zero(false), overflow(false) {}
+
+uint64_t Detector::OffsetOf(size_t at, uint64_t offset) const {
+  if (pieces.empty()) return offset + at;
+  size_t i = pieces.size() - 1;
+  while (i > 0 && pieces[i].first > at) i--;
+  return pieces[i].second + (at - pieces[i].first);
+}
+
+void Detector::Find(const char *text, size_t len, uint64_t offset, Links *out) const {
+  const uint8_t *p = (const uint8_t *)text;
+  size_t i = 0;
+  while (i < len) {
+    // the next URL, paths are looked for before it
+    size_t url = len, end = len;
+    if (kinds & kUrl) {
+      const char *found = text + i;
+      while ((found = (const char *)memmem(found, text + len - found, "://", 3))) {
+        size_t start = i;
+        end = url_end(p, &start, found - text, len);
+        if (end) {
+          url = start;
+          break;
+        }
+        found += 3;
+      }
+      if (!found) end = len;
+    }
+
+    for (size_t at = i; (kinds & kPath) && at < url;) {
+      while (at < url && !is_path(p[at])) at++;
+      size_t start = at;
+      while (at < url && is_path(p[at])) at++;
+      Link link;
+      link.kind = kPath;
+      link.line = link.column = 0;
+      size_t stop = read_number(p, at, url, &link.line);
+      if (stop != at) stop = read_number(p, stop, url, &link.column);
+      size_t name = at;
+      // a full stop after a path ends the sentence
+      if (stop == at) {
+        while (name > start && p[name - 1] == '.') name--;
+      }
+      if (is_path_link(p + start, name - start, link.line > 0)) {
+        if (stop == at) stop = name;
+        link.start = OffsetOf(start, offset);
+        link.end = OffsetOf(stop - 1, offset) + 1;
+        link.text.assign(text + start, stop - start);
+        out->Add(link);
+      }
+      at = stop > at ? stop : at;
+    }
+
+    if (url == len) break;
+    Link link;
+    link.kind = kUrl;
+    link.start = OffsetOf(url, offset);
+    link.end = OffsetOf(end - 1, offset) + 1;
+    link.line = link.column = 0;
+    link.text.assign(text + url, end - url);
+    out->Add(link);
+    i = end;
+  }
+}
+
+void Detector::Keep(const char *data, size_t len, uint64_t offset) {
+  if (len == 0) return;
+  // output read in pieces goes on where it left off
+  if (pieces.empty() || pieces.back().second + (word.size() - pieces.back().first) != offset) {
+    pieces.push_back(std::make_pair(word.size(), offset));
+  }
+  word.append(data, len);
+}
+
+void Detector::EndWord(Links *out) {
+  if (!word.empty() && !overflow) Find(word.data(), word.size(), 0, out);
+  word.clear();
+  pieces.clear();
+  overflow = false;
+}
+
+size_t Detector::Text(const char *data, size_t from, size_t len, uint64_t offset, Links *out) {
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i = from;
+  // the word being written goes on to the first space
+  if (!word.empty() || overflow) {
+    size_t end = i;
+    while (end < len && !is_space(p[end]) && p[end] != kEsc) end++;
+    if (overflow || word.size() + (end - i) > kMaxLink) {
+      word.clear();
+      pieces.clear();
+      overflow = true;
+    } else {
+      Keep(data + i, end - i, offset + i);
+    }
+    if (end == len || p[end] == kEsc) return end;
+    EndWord(out);
+    i = end;
+  }
+
+  // the words before floor are done
+  size_t floor = i;
+  for (;;) {
+    size_t at = i + find_candidate(p + i, len - i);
+    if (at == len || p[at] == kEsc) {
+      // the last word may go on
+      size_t start = at;
+      while (start > floor && !is_space(p[start - 1])) {
+        if (at - start == kMaxLink) {
+          overflow = true;
+          return at;
+        }
+        start--;
+      }
+      Keep(data + start, at - start, offset + start);
+      return at;
+    }
+
+    size_t start = at;
+    while (start > floor && !is_space(p[start - 1])) start--;
+    size_t end = at + 1;
+    while (end < len && !is_space(p[end]) && p[end] != kEsc) end++;
+    if (end == len || p[end] == kEsc) {
+      if (end - start > kMaxLink) {
+        overflow = true;
+      } else {
+        Keep(data + start, end - start, offset + start);
+      }
+      return end;
+    }
+    if (end - start <= kMaxLink) Find(data + start, end - start, offset + start, out);
+    i = floor = end;
+  }
+}
+
+void Detector::Write(const char *data, size_t len, Links *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t c;
+    switch (state) {
+      case kGround:
+        i = Text(data, i, len, offset, out);
+        if (i < len) {
+          state = kEscape;
+          i++;
+        }
+        break;
+
+      case kEscape:
+        c = p[i++];
+        if (c == '[') {
+          keeps = true;
+          zero = true;
+          state = kCsi;
+        } else if (c >= 0x20 && c <= 0x2F) {
+          state = kIntermediate;
+        } else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') {
+          EndWord(out);
+          state = kString;
+        } else if (c == kEsc) {
+          EndWord(out);
+        } else {
+          EndWord(out);
+          state = kGround;
+          // a control or a character is text again
+          if (c < 0x30 || c >= 0x7F) i--;
+        }
+        break;
+
+      case kIntermediate:
+        c = p[i++];
+        if (c >= 0x30 && c < 0x7F) {
+          // charset designations go with SGRs, as in tput sgr0
+          state = kGround;
+        } else if (c == kEsc) {
+          EndWord(out);
+          state = kEscape;
+        } else if (c < 0x20 || c >= 0x7F) {
+          EndWord(out);
+          state = kGround;
+          i--;
+        }
+        break;
+
+      case kCsi:
+        // parameters are skipped, a private marker or intermediate makes it
+        // something else
+        while (i < len && (c = p[i]) >= 0x20 && c < 0x40) {
+          if (c >= 0x3C || c < 0x30) keeps = false;
+          if (c != '0') zero = false;
+          i++;
+        }
+        if (i == len) break;
+        c = p[i++];
+        if (c >= 0x40 && c < 0x7F) {
+          if (!keeps || (c != 'm' && (c != 'K' || !zero))) EndWord(out);
+          state = kGround;
+        } else if (c == kEsc) {
+          EndWord(out);
+          state = kEscape;
+        }
+        // controls are executed within the sequence
+        break;
+
+      case kString:
+        i += events::FindControl(data + i, len - i);
+        if (i == len) break;
+        state = p[i++] == kBel ? kGround : kStringEscape;
+        break;
+
+      case kStringEscape:
+        c = p[i++];
+        if (c == '\\') {
+          state = kGround;
+        } else if (c != kEsc) {
+          // anything but ST ends the string and starts a sequence
+          state = kEscape;
+          i--;
+        }
+        break;
+    }
+  }
+  offset += len;
+}
+
+void Detector::Flush(Links *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  EndWord(out);
+}
+
+/**
+ * LinkDetector
+ */
+
+Napi::FunctionReference LinkDetector::constructor;
+
+void LinkDetector::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "LinkDetector", {
+    InstanceMethod("write", &LinkDetector::Write),
+    InstanceMethod("flush", &LinkDetector::Flush)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("LinkDetector", ctor);
+}
+
+std::shared_ptr<Detector> LinkDetector::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Detector>();
+  }
+  return Napi::ObjectWrap<LinkDetector>::Unwrap(value.As<Napi::Object>())->detector;
+}
+
+LinkDetector::LinkDetector(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<LinkDetector>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() < 1 || info.Length() > 2 || !info[0].IsNumber() ||
+      (info.Length() == 2 && !info[1].IsNumber())) {
+    Napi::Error::New(env, "Usage: new pty.LinkDetector(kinds, offset)").ThrowAsJavaScriptException();
+    return;
+  }
+  int kinds = info[0].As<Napi::Number>().Int32Value() & (kUrl | kPath);
+  int64_t offset = info.Length() == 2 ? info[1].As<Napi::Number>().Int64Value() : 0;
+  detector = std::make_shared<Detector>(kinds, offset);
+}
+
+static Napi::Value
+links_value(Napi::Env env, const Links &links) {
+  if (links.count == 0) return env.Null();
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("links", Napi::String::New(env, links.text));
+  return obj;
+}
+
+Napi::Value LinkDetector::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: linkDetector.write(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Links links;
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    detector->Write(buffer.Data(), buffer.Length(), &links);
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    detector->Write(data.data(), data.size(), &links);
+  }
+  return links_value(env, links);
+}
+
+Napi::Value LinkDetector::Flush(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  Links links;
+  detector->Flush(&links);
+  return links_value(env, links);
+}
+
+}  // namespace links
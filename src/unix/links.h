@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * links.h:
+ *   Finds URLs and file paths in terminal output for the UI to highlight.
+ *   The output is skipped 16 bytes at a time to the next ':' or '/', which
+ *   every link has, and only the word around one is looked at. SGR
+ *   sequences within a word are skipped so a path colored apart from its
+ *   line number is one link, as is the erase to the end of the line grep
+ *   prints after each. Any other sequence ends the word.
+ */
+
+#ifndef NODE_PTY_LINKS_H_
+#define NODE_PTY_LINKS_H_
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace links {
+
+enum Kind {
+  kUrl = 1,
+  kPath = 2
+};
+
+struct Link {
+  Kind kind;
+  uint64_t start;  // byte offsets in the output, sequences within included
+  uint64_t end;
+  uint32_t line;    // of a path:line:column, 0 when not given
+  uint32_t column;
+  std::string text;  // without the sequences
+};
+
+// Links given out at once, one "kind start end line column text" record
+// each ('u' or 'p' for the kind), joined by newlines. Links hold no
+// whitespace.
+struct Links {
+  std::string text;
+  size_t count;
+
+  Links() : count(0) {}
+  void Add(const Link &link);
+};
+
+// Follows the output of one terminal. A link is given out once the word it
+// is in ends, words and sequences may be split across writes.
+class Detector {
+  public:
+    // Finds the kinds of links or'ed together, offset is that of the
+    // output written next.
+    Detector(int kinds, uint64_t offset);
+
+    void Write(const char *data, size_t len, Links *out);
+    // Ends the word being written, at the end of the output.
+    void Flush(Links *out);
+
+  private:
+    // Scans text without sequences from data[from] on, data[0] is at
+    // offset.
+    size_t Text(const char *data, size_t from, size_t len, uint64_t offset, Links *out);
+    // Appends to the word being written, which goes on past data.
+    void Keep(const char *data, size_t len, uint64_t offset);
+    // Gives out the links in the word being written and starts over.
+    void EndWord(Links *out);
+    // Gives out the links in text, which is at offset where pieces is
+    // empty and else spread over the output as pieces map.
+    void Find(const char *text, size_t len, uint64_t offset, Links *out) const;
+    uint64_t OffsetOf(size_t at, uint64_t offset) const;
+
+    enum State {
+      kGround,
+      kEscape,
+      kIntermediate,  // ESC followed by intermediates, as ESC ( B
+      kCsi,
+      kString,
+      kStringEscape
+    };
+
+    std::mutex mutex;
+    int kinds;
+    uint64_t offset;
+    State state;
+    // the CSI may still leave the word going: an SGR, or an erase to the
+    // end of the line while its parameters are all zero
+    bool keeps;
+    bool zero;
+    // the word being written and where its parts are in the output, by
+    // their index in it
+    std::string word;
+    std::vector<std::pair<size_t, uint64_t> > pieces;
+    bool overflow;  // the word is too long to be a link
+};
+
+// The JS handle of a detector.
+class LinkDetector : public Napi::ObjectWrap<LinkDetector> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The detector of a LinkDetector object, null for anything else.
+    static std::shared_ptr<Detector> Unwrap(Napi::Value value);
+
+    LinkDetector(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Detector> detector;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Write(const Napi::CallbackInfo& info);
+    Napi::Value Flush(const Napi::CallbackInfo& info);
+};
+
+}  // namespace links
+
+#endif  // NODE_PTY_LINKS_H_
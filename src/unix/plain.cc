@@ -0,0 +1,534 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * plain.cc:
+ *   The plain text of terminal output.
+ */
+
+#include "plain.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <uv.h> /* uv_err_name */
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace plain {
+
+// A line longer than this is given out as is, what it ends with can not be
+// overwritten then.
+static const size_t kMaxLine = 64 * 1024;
+static const int kMaxParam = 0xFFFF;
+// Text a file may have waiting for the disk, what comes beyond it is dropped
+// and the file fails with ENOBUFS.
+static const size_t kMaxPending = 16 * 1024 * 1024;
+
+static const uint64_t kOnes = 0x0101010101010101ULL;
+static const uint64_t kHighs = 0x8080808080808080ULL;
+
+// The offset of the first control (C0 or DEL) in data, len when there is
+// none. Bytes of UTF-8 sequences are text.
+static size_t
+find_control(const uint8_t *p, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i space = _mm_set1_epi8(0x1F);
+  const __m128i del = _mm_set1_epi8(0x7F);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    // v <= 0x1F unsigned, as its minimum with 0x1F is itself
+    __m128i c0 = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+    int mask = _mm_movemask_epi8(_mm_or_si128(c0, _mm_cmpeq_epi8(v, del)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t space = vdupq_n_u8(0x1F);
+  const uint8x16_t del = vdupq_n_u8(0x7F);
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t v = vld1q_u8(p + i);
+    uint8x16_t m = vorrq_u8(vcleq_u8(v, space), vceqq_u8(v, del));
+    // narrows each byte of the mask to 4 bits
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+    if (bits) return i + (__builtin_ctzll(bits) >> 2);
+  }
+#else
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    uint64_t d = w ^ (kOnes * 0x7F);
+    // a byte below 0x20 or a DEL, the byte loop below finds which
+    if (((w - kOnes * 0x20) & ~w & kHighs) | ((d - kOnes) & ~d & kHighs)) break;
+  }
+#endif
+  for (; i < len; i++) {
+    if (p[i] < 0x20 || p[i] == 0x7F) return i;
+  }
+  return len;
+}
+
+// The characters of UTF-8 text: the bytes that are not continuation bytes.
+static size_t
+count_chars(const uint8_t *p, size_t len) {
+  size_t continuations = 0;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    // 10xxxxxx: the high bit set and the next one clear
+    continuations += __builtin_popcountll(w & ~(w << 1) & kHighs);
+  }
+  for (; i < len; i++) {
+    if ((p[i] & 0xC0) == 0x80) continuations++;
+  }
+  return len - continuations;
+}
+
+/**
+ * Writer
+ */
+
+// A file the writer appends to, guarded by the writer's mutex.
+struct File {
+  int fd;
+  std::string pending;
+  size_t writing;  // taken from pending by the writer
+  bool queued;
+  bool closing;    // the fd is closed once the text is written
+  int error;
+
+  explicit File(int fd) : fd(fd), writing(0), queued(false), closing(false), error(0) {}
+};
+
+// The thread appending the text of every stripper to its file.
+class Writer {
+  public:
+    static Writer *Get() {
+      static Writer *writer = new Writer();
+      return writer;
+    }
+
+    void Append(const std::shared_ptr<File> &file, std::string *text) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (file->error) return;
+      if (file->pending.size() + text->size() > kMaxPending) {
+        file->error = ENOBUFS;
+        file->pending.clear();
+        return;
+      }
+      if (file->pending.empty()) file->pending.swap(*text);
+      else file->pending.append(*text);
+      Queue(file);
+    }
+
+    void Close(const std::shared_ptr<File> &file) {
+      std::lock_guard<std::mutex> lock(mutex);
+      file->closing = true;
+      Queue(file);
+    }
+
+    // The bytes not yet written and the errno of the file.
+    void GetStats(const std::shared_ptr<File> &file, Stats *stats) {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats->pending = file->pending.size() + file->writing;
+      stats->error = file->error;
+    }
+
+  private:
+    Writer() {
+      std::thread(&Writer::Run, this).detach();
+    }
+
+    // The mutex must be held.
+    void Queue(const std::shared_ptr<File> &file) {
+      if (file->queued) return;
+      file->queued = true;
+      queue.push_back(file);
+      cond.notify_one();
+    }
+
+    void Run() {
+      std::unique_lock<std::mutex> lock(mutex);
+      for (;;) {
+        cond.wait(lock, [this] { return !queue.empty(); });
+        std::shared_ptr<File> file = queue.front();
+        queue.pop_front();
+        file->queued = false;
+        std::string text;
+        text.swap(file->pending);
+        file->writing = text.size();
+        int error = file->error;
+        lock.unlock();
+        size_t done = 0;
+        while (!error && done < text.size()) {
+          ssize_t n = write(file->fd, text.data() + done, text.size() - done);
+          if (n < 0 && errno == EINTR) continue;
+          if (n < 0) error = errno;
+          else done += n;
+        }
+        lock.lock();
+        file->writing = 0;
+        if (error && !file->error) {
+          file->error = error;
+          file->pending.clear();
+        }
+        // more text queued the file again meanwhile
+        if (file->closing && !file->queued && file->fd != -1) {
+          close(file->fd);
+          file->fd = -1;
+        }
+      }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<File> > queue;
+};
+
+/**
+ * Stripper
+ */
+
+Stripper::Stripper(int fd)
+  : closed(false), state(kGround), osc(false), param_count(0),
+    ignoring(false), chars(0), col(0) {
+  if (fd != -1) file = std::make_shared<File>(fd);
+  stats.lines = 0;
+  stats.bytes = 0;
+  stats.pending = 0;
+  stats.error = 0;
+}
+
+Stripper::~Stripper() {
+  if (file) Writer::Get()->Close(file);
+}
+
+size_t Stripper::ByteAt(size_t col) const {
+  if (col >= chars) return line.size();
+  size_t i = 0;
+  for (size_t n = 0; i < line.size(); i++) {
+    if (((uint8_t)line[i] & 0xC0) != 0x80 && n++ == col) break;
+  }
+  return i;
+}
+
+void Stripper::Print(const char *data, size_t len) {
+  size_t n = count_chars((const uint8_t *)data, len);
+  // the line is given out once beyond kMaxLine, so is the cursor
+  if (col > kMaxLine) col = kMaxLine;
+  if (col >= chars) {
+    // the common case, appending
+    line.append(col - chars, ' ');
+    line.append(data, len);
+    chars = col + n;
+  } else {
+    size_t from = ByteAt(col);
+    size_t to = from;
+    size_t replaced = 0;
+    while (to < line.size() && replaced < n) {
+      to++;
+      while (to < line.size() && ((uint8_t)line[to] & 0xC0) == 0x80) to++;
+      replaced++;
+    }
+    line.replace(from, to - from, data, len);
+    chars += n - replaced;
+  }
+  col += n;
+}
+
+void Stripper::EndLine(std::string *text, bool newline) {
+  text->append(line);
+  if (newline) {
+    text->push_back('\n');
+    stats.lines++;
+  }
+  line.clear();
+  chars = 0;
+  col = 0;
+}
+
+void Stripper::Execute(uint8_t c, std::string *text) {
+  switch (c) {
+    case '\n':
+    case '\v':
+    case '\f':
+      EndLine(text, true);
+      break;
+    case '\r':
+      col = 0;
+      break;
+    case '\b':
+      if (col > 0) col--;
+      break;
+    case '\t':
+      Print("\t", 1);
+      break;
+    // the bell and the rest are not text
+  }
+}
+
+void Stripper::CsiDispatch(uint8_t final) {
+  int n = param_count > 0 && params[0] > 0 ? params[0] : 1;
+  switch (final) {
+    case 'K':
+      // erase in line: to the end, from the start, all of it
+      if (param_count == 0 || params[0] == 0) {
+        line.resize(ByteAt(col));
+        if (chars > col) chars = col;
+      } else if (params[0] == 1) {
+        size_t end = ByteAt(col + 1);
+        std::string blanks(col + 1 < chars ? col + 1 : chars, ' ');
+        line.replace(0, end, blanks);
+      } else if (params[0] == 2) {
+        line.clear();
+        chars = 0;
+      }
+      break;
+    case 'C':  // cursor forward
+      col = col + n < kMaxLine ? col + n : kMaxLine;
+      break;
+    case 'D':  // cursor backward
+      col = col > (size_t)n ? col - n : 0;
+      break;
+    case 'G':  // cursor to column
+      col = (size_t)n - 1 < kMaxLine ? n - 1 : kMaxLine;
+      break;
+    // moves to other lines and the rest do not change the line
+  }
+}
+
+void Stripper::Output(std::string *text, std::string *out) {
+  if (text->empty()) return;
+  stats.bytes += text->size();
+  if (!file) {
+    out->append(*text);
+    return;
+  }
+  Writer::Get()->Append(file, text);
+}
+
+void Stripper::Write(const char *data, size_t len, std::string *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (closed) return;
+  const uint8_t *p = (const uint8_t *)data;
+  std::string text;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t c = p[i];
+    // anywhere
+    if (c == 0x18 || c == 0x1A) {
+      state = kGround;
+      i++;
+      continue;
+    }
+
+    switch (state) {
+      case kGround: {
+        size_t n = find_control(p + i, len - i);
+        if (n > 0) {
+          Print(data + i, n);
+          i += n;
+          if (line.size() > kMaxLine) EndLine(&text, false);
+          continue;
+        }
+        if (c == 0x1B) state = kEscape;
+        else Execute(c, &text);
+        break;
+      }
+
+      case kEscape:
+        if (c == '[') {
+          param_count = 0;
+          params[0] = params[1] = 0;
+          ignoring = false;
+          state = kCsi;
+        } else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') {
+          osc = c == ']';
+          state = kString;
+        } else if (c >= 0x20 && c < 0x30) {
+          state = kEscapeIntermediate;
+        } else if (c < 0x20) {
+          if (c != 0x1B) Execute(c, &text);
+        } else if (c < 0x7F) {
+          state = kGround;
+        }
+        break;
+
+      case kEscapeIntermediate:
+        if (c == 0x1B) state = kEscape;
+        else if (c < 0x20) Execute(c, &text);
+        else if (c >= 0x30 && c < 0x7F) state = kGround;
+        break;
+
+      case kCsi:
+        if (c >= '0' && c <= '9') {
+          if (param_count == 0) param_count = 1;
+          if (param_count <= 2) {
+            int &v = params[param_count - 1];
+            v = v * 10 + (c - '0') > kMaxParam ? kMaxParam : v * 10 + (c - '0');
+          }
+        } else if (c == ';' || c == ':') {
+          if (param_count == 0) param_count = 1;
+          param_count++;
+        } else if (c >= 0x3C && c < 0x40) {
+          // private markers
+          ignoring = true;
+        } else if (c >= 0x20 && c < 0x30) {
+          ignoring = true;
+        } else if (c >= 0x40 && c < 0x7F) {
+          if (!ignoring) CsiDispatch(c);
+          state = kGround;
+        } else if (c == 0x1B) {
+          state = kEscape;
+        } else if (c < 0x20) {
+          Execute(c, &text);
+        }
+        break;
+
+      case kString:
+        if (c == 0x1B) state = kStringEscape;
+        // BEL ends an OSC string too, as in xterm
+        else if (c == 0x07 && osc) state = kGround;
+        break;
+
+      case kStringEscape:
+        if (c == '\\') {
+          state = kGround;
+        } else {
+          // the ESC started another sequence
+          state = kEscape;
+          continue;
+        }
+        break;
+    }
+    i++;
+  }
+  Output(&text, out);
+}
+
+void Stripper::Flush(std::string *out, bool close_file) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (closed) return;
+  std::string text;
+  if (!line.empty()) EndLine(&text, true);
+  Output(&text, out);
+  if (close_file) {
+    closed = true;
+    if (file) Writer::Get()->Close(file);
+  }
+}
+
+Stats Stripper::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  Stats result = stats;
+  if (file) Writer::Get()->GetStats(file, &result);
+  return result;
+}
+
+/**
+ * PlainText
+ */
+
+Napi::FunctionReference PlainText::constructor;
+
+void PlainText::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "PlainText", {
+    InstanceMethod("write", &PlainText::Write),
+    InstanceMethod("flush", &PlainText::Flush),
+    InstanceMethod("close", &PlainText::Close),
+    InstanceMethod("stats", &PlainText::GetStats)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("PlainText", ctor);
+}
+
+std::shared_ptr<Stripper> PlainText::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Stripper>();
+  }
+  return Napi::ObjectWrap<PlainText>::Unwrap(value.As<Napi::Object>())->stripper;
+}
+
+PlainText::PlainText(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<PlainText>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() > 1 || (info.Length() == 1 && !info[0].IsString() && !info[0].IsUndefined())) {
+    Napi::Error::New(env, "Usage: new pty.PlainText(file)").ThrowAsJavaScriptException();
+    return;
+  }
+  int fd = -1;
+  if (info.Length() == 1 && info[0].IsString()) {
+    std::string file = info[0].As<Napi::String>().Utf8Value();
+    do {
+      fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+      Napi::Error err = Napi::Error::New(env, "Cannot open " + file + ": " + strerror(errno));
+      err.Set("code", Napi::String::New(env, uv_err_name(-errno)));
+      err.ThrowAsJavaScriptException();
+      return;
+    }
+  }
+  stripper = std::make_shared<Stripper>(fd);
+}
+
+Napi::Value PlainText::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: plainText.write(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  std::string text;
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    stripper->Write(buffer.Data(), buffer.Length(), &text);
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    stripper->Write(data.data(), data.size(), &text);
+  }
+  return Napi::String::New(env, text);
+}
+
+Napi::Value PlainText::Flush(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  std::string text;
+  stripper->Flush(&text, false);
+  return Napi::String::New(env, text);
+}
+
+Napi::Value PlainText::Close(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  std::string text;
+  stripper->Flush(&text, true);
+  return Napi::String::New(env, text);
+}
+
+Napi::Value PlainText::GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Stats stats = stripper->GetStats();
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("lines", Napi::Number::New(env, stats.lines));
+  obj.Set("bytes", Napi::Number::New(env, stats.bytes));
+  obj.Set("pending", Napi::Number::New(env, stats.pending));
+  obj.Set("error", stats.error ? Napi::Value(Napi::String::New(env, uv_err_name(-stats.error))) : env.Null());
+  return obj;
+}
+
+}  // namespace plain
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * plain.h:
+ *   The plain text of terminal output, for logs: escape sequences are
+ *   removed and lines overwritten after a carriage return or backspace keep
+ *   what was written last, as a terminal would show them. Lines are given
+ *   out once they end, or appended to a file by a thread of its own, so a
+ *   slow disk does not stall the I/O thread reading the output.
+ */
+
+#ifndef NODE_PTY_PLAIN_H_
+#define NODE_PTY_PLAIN_H_
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace plain {
+
+struct Stats {
+  uint64_t lines;  // ended so far
+  uint64_t bytes;    // of text given out or written
+  uint64_t pending;  // of text not yet written to the file
+  int error;         // errno of the first failed write to the file, 0 if none
+};
+
+struct File;
+
+// Follows the output of one terminal, sequences may be split across writes.
+// The cursor moves by characters, wide characters count as one.
+class Stripper {
+  public:
+    // Appends the text to the file fd when it is not -1, and closes it once
+    // the text is written.
+    explicit Stripper(int fd);
+    ~Stripper();
+
+    // Appends the text of the lines data ends to out, or writes it to the
+    // file.
+    void Write(const char *data, size_t len, std::string *out);
+    // Ends the line being written, if any. A closed stripper ignores what is
+    // written to it from then on.
+    void Flush(std::string *out, bool close);
+    Stats GetStats();
+
+  private:
+    enum State {
+      kGround,
+      kEscape,
+      kEscapeIntermediate,
+      kCsi,
+      kString,        // OSC, DCS, SOS, PM and APC, skipped
+      kStringEscape   // ESC in a string, ST when a backslash follows
+    };
+
+    void Print(const char *data, size_t len);
+    void Execute(uint8_t c, std::string *text);
+    void CsiDispatch(uint8_t final);
+    void EndLine(std::string *text, bool newline);
+    // The byte of the line where character col starts.
+    size_t ByteAt(size_t col) const;
+    void Output(std::string *text, std::string *out);
+
+    std::mutex mutex;
+    std::shared_ptr<File> file;  // null without one
+    bool closed;
+    Stats stats;
+
+    State state;
+    bool osc;  // the string is an OSC string, which BEL ends too
+    int params[2];
+    int param_count;
+    bool ignoring;  // a private or intermediate CSI, not acted on
+
+    std::string line;
+    size_t chars;  // in the line
+    size_t col;    // of the cursor, may be beyond the line
+};
+
+// The JS handle of a stripper.
+class PlainText : public Napi::ObjectWrap<PlainText> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The stripper of a PlainText object, null for anything else.
+    static std::shared_ptr<Stripper> Unwrap(Napi::Value value);
+
+    PlainText(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Stripper> stripper;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Write(const Napi::CallbackInfo& info);
+    Napi::Value Flush(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+    Napi::Value GetStats(const Napi::CallbackInfo& info);
+};
+
+}  // namespace plain
+
+#endif  // NODE_PTY_PLAIN_H_
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * poller.cc:
+ *   Readiness notification over a set of file descriptors.
+ *
+ * See:
+ *   man epoll
+ *   man kqueue
+ *   man poll
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "poller.h"
+
+#if defined(NODE_PTY_EPOLL)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif defined(NODE_PTY_KQUEUE)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#include <poll.h>
+#endif
+
+namespace poller {
+
+#if !defined(NODE_PTY_EPOLL)
+static int
+set_cloexec_nonblock(int fd) {
+  if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) return -1;
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1) return -1;
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+#endif
+
+Poller::Poller() : fd(-1), wake_read(-1), wake_write(-1) {
+#if defined(NODE_PTY_EPOLL)
+  fd = epoll_create1(EPOLL_CLOEXEC);
+  wake_read = wake_write = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+#if defined(NODE_PTY_KQUEUE)
+  fd = kqueue();
+  if (fd != -1) set_cloexec_nonblock(fd);
+#else
+  fd = 0;  // nothing to create, interests are kept in a map
+#endif
+  int fds[2];
+  if (pipe(fds) == 0) {
+    set_cloexec_nonblock(fds[0]);
+    set_cloexec_nonblock(fds[1]);
+    wake_read = fds[0];
+    wake_write = fds[1];
+  }
+#endif
+
+  if (fd != -1 && wake_read != -1) {
+    Add(wake_read, kWakeData, true, false);
+  }
+}
+
+Poller::~Poller() {
+#if !defined(NODE_PTY_POLL)
+  if (fd != -1) close(fd);
+#endif
+  if (wake_read != -1) close(wake_read);
+  if (wake_write != -1 && wake_write != wake_read) close(wake_write);
+}
+
+bool Poller::Ok() const {
+  return fd != -1 && wake_read != -1;
+}
+
+bool Poller::Add(int target, uint64_t data, bool want_read, bool want_write) {
+#if defined(NODE_PTY_EPOLL)
+  struct epoll_event ev;
+  ev.events = (want_read ? (uint32_t)EPOLLIN : 0) | (want_write ? (uint32_t)EPOLLOUT : 0);
+  ev.data.u64 = data;
+  return epoll_ctl(fd, EPOLL_CTL_ADD, target, &ev) == 0;
+#elif defined(NODE_PTY_KQUEUE)
+  struct kevent changes[2];
+  EV_SET(&changes[0], target, EVFILT_READ, want_read ? EV_ADD | EV_ENABLE : EV_ADD | EV_DISABLE,
+         0, 0, (void *)(uintptr_t)data);
+  EV_SET(&changes[1], target, EVFILT_WRITE, want_write ? EV_ADD | EV_ENABLE : EV_ADD | EV_DISABLE,
+         0, 0, (void *)(uintptr_t)data);
+  return kevent(fd, changes, 2, NULL, 0, NULL) == 0;
+#else
+  std::lock_guard<std::mutex> lock(mutex);
+  Interest interest = { data, want_read, want_write };
+  interests[target] = interest;
+  Wake();
+  return true;
+#endif
+}
+
+bool Poller::Modify(int target, uint64_t data, bool want_read, bool want_write) {
+#if defined(NODE_PTY_EPOLL)
+  struct epoll_event ev;
+  ev.events = (want_read ? (uint32_t)EPOLLIN : 0) | (want_write ? (uint32_t)EPOLLOUT : 0);
+  ev.data.u64 = data;
+  return epoll_ctl(fd, EPOLL_CTL_MOD, target, &ev) == 0;
+#else
+  // kqueue EV_ADD modifies existing filters
+  return Add(target, data, want_read, want_write);
+#endif
+}
+
+void Poller::Remove(int target) {
+#if defined(NODE_PTY_EPOLL)
+  struct epoll_event ev;
+  epoll_ctl(fd, EPOLL_CTL_DEL, target, &ev);
+#elif defined(NODE_PTY_KQUEUE)
+  struct kevent changes[2];
+  EV_SET(&changes[0], target, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  EV_SET(&changes[1], target, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+  kevent(fd, changes, 2, NULL, 0, NULL);
+#else
+  std::lock_guard<std::mutex> lock(mutex);
+  interests.erase(target);
+  Wake();
+#endif
+}
+
+int Poller::Wait(PollEvent *events, int max, int timeout) {
+#if defined(NODE_PTY_EPOLL)
+  struct epoll_event evs[64];
+  if (max > 64) max = 64;
+  int n = epoll_wait(fd, evs, max, timeout);
+  if (n == -1) return 0;
+  for (int i = 0; i < n; i++) {
+    events[i].data = evs[i].data.u64;
+    events[i].readable = (evs[i].events & EPOLLIN) != 0;
+    events[i].writable = (evs[i].events & EPOLLOUT) != 0;
+    events[i].hangup = (evs[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+  }
+#elif defined(NODE_PTY_KQUEUE)
+  struct kevent evs[64];
+  struct timespec ts;
+  if (max > 64) max = 64;
+  if (timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+  }
+  int n = kevent(fd, NULL, 0, evs, max, timeout >= 0 ? &ts : NULL);
+  if (n == -1) return 0;
+  // read and write readiness of one fd come as separate events
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    uint64_t data = (uint64_t)(uintptr_t)evs[i].udata;
+    int j = 0;
+    while (j < count && events[j].data != data) j++;
+    if (j == count) {
+      events[j].data = data;
+      events[j].readable = events[j].writable = events[j].hangup = false;
+      count++;
+    }
+    if (evs[i].filter == EVFILT_READ) events[j].readable = true;
+    if (evs[i].filter == EVFILT_WRITE) events[j].writable = true;
+    if (evs[i].flags & (EV_EOF | EV_ERROR)) events[j].hangup = true;
+  }
+  n = count;
+#else
+  std::vector<struct pollfd> fds;
+  std::vector<uint64_t> data;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    struct pollfd wake = { wake_read, POLLIN, 0 };
+    fds.push_back(wake);
+    data.push_back(kWakeData);
+    for (std::map<int, Interest>::iterator it = interests.begin(); it != interests.end(); ++it) {
+      if (it->second.data == kWakeData) continue;
+      struct pollfd pfd = { it->first, 0, 0 };
+      if (it->second.read) pfd.events |= POLLIN;
+      if (it->second.write) pfd.events |= POLLOUT;
+      fds.push_back(pfd);
+      data.push_back(it->second.data);
+    }
+  }
+  if (poll(&fds[0], fds.size(), timeout) <= 0) return 0;
+  int n = 0;
+  for (size_t i = 0; i < fds.size() && n < max; i++) {
+    if (!fds[i].revents) continue;
+    events[n].data = data[i];
+    events[n].readable = (fds[i].revents & POLLIN) != 0;
+    events[n].writable = (fds[i].revents & POLLOUT) != 0;
+    events[n].hangup = (fds[i].revents & (POLLHUP | POLLERR)) != 0;
+    n++;
+  }
+#endif
+
+  // drain the wake fd so that it does not fire again
+  for (int i = 0; i < n; i++) {
+    if (events[i].data == kWakeData) {
+      char buf[64];
+      while (read(wake_read, buf, sizeof(buf)) > 0);
+    }
+  }
+  return n;
+}
+
+const char *Poller::Name() {
+#if defined(NODE_PTY_EPOLL)
+  return "epoll";
+#elif defined(NODE_PTY_KQUEUE)
+  return "kqueue";
+#else
+  return "poll";
+#endif
+}
+
+void Poller::Wake() {
+#if defined(NODE_PTY_EPOLL)
+  uint64_t one = 1;
+  ssize_t r = write(wake_write, &one, sizeof(one));
+#else
+  char one = 1;
+  ssize_t r = write(wake_write, &one, 1);
+#endif
+  (void)r;
+}
+
+}  // namespace poller
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * poller.h:
+ *   Readiness notification over a set of file descriptors, backed by
+ *   epoll(7) on Linux, kqueue(2) on macOS/BSD and poll(2) elsewhere.
+ */
+
+#ifndef NODE_PTY_POLLER_H_
+#define NODE_PTY_POLLER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+
+#if defined(__linux__)
+#define NODE_PTY_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || \
+      defined(__OpenBSD__) || defined(__NetBSD__)
+#define NODE_PTY_KQUEUE 1
+#else
+#define NODE_PTY_POLL 1
+#endif
+
+namespace poller {
+
+struct PollEvent {
+  uint64_t data;
+  bool readable;
+  bool writable;
+  bool hangup;
+};
+
+class Poller {
+  public:
+    Poller();
+    ~Poller();
+
+    // false when the backing kernel object could not be created
+    bool Ok() const;
+
+    // Watches fd for the given interests, data is returned with its events.
+    // Add and Modify can be called from any thread.
+    bool Add(int fd, uint64_t data, bool want_read, bool want_write);
+    bool Modify(int fd, uint64_t data, bool want_read, bool want_write);
+    void Remove(int fd);
+
+    // Waits up to timeout milliseconds (-1 blocks) and returns the number of
+    // events stored, 0 on timeout or interruption.
+    int Wait(PollEvent *events, int max, int timeout);
+
+    // Makes a pending or the next Wait return, safe from any thread. Wait
+    // reports it with data == kWakeData.
+    void Wake();
+
+    static const uint64_t kWakeData = UINT64_MAX;
+
+    // "epoll", "kqueue" or "poll"
+    static const char *Name();
+
+  private:
+    int fd;
+    int wake_read;
+    int wake_write;
+
+#if defined(NODE_PTY_POLL)
+    struct Interest {
+      uint64_t data;
+      bool read;
+      bool write;
+    };
+    std::mutex mutex;
+    std::map<int, Interest> interests;
+#endif
+};
+
+}  // namespace poller
+
+#endif  // NODE_PTY_POLLER_H_
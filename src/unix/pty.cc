@@ -34,6 +34,13 @@
 #include <fcntl.h>
 #include <signal.h>
 
+#include <uv.h> /* uv_err_name */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 /* forkpty */
 /* http://www.gnu.org/software/gnulib/manual/html_node/forkpty.html */
 #if defined(__GLIBC__) || defined(__CYGWIN__)
@@ -76,6 +83,17 @@ extern char **environ;
 #include <libproc.h>
 #endif
 
+#include "budget.h"
+#include "events.h"
+#include "expect.h"
+#include "hub.h"
+#include "lines.h"
+#include "links.h"
+#include "plain.h"
+#include "screen.h"
+#include "scrollback.h"
+#include "width.h"
+
 /* NSIG - macro for highest signal + 1, should be defined */
 #ifndef NSIG
 #define NSIG 32
@@ -146,6 +164,22 @@ class WaitForExit : public Napi::AsyncWorker {
 
 };
 
+/**
+ * Child setup stages, reported through the status pipe when they fail.
+ */
+
+enum {
+  PTY_STAGE_CHDIR = 1,
+  PTY_STAGE_SETGID,
+  PTY_STAGE_SETUID,
+  PTY_STAGE_EXECVP
+};
+
+struct pty_child_status {
+  int stage;
+  int error;
+};
+
 /**
  * Methods
  */
@@ -154,6 +188,10 @@ Napi::Value PtyFork(const Napi::CallbackInfo& info);
 Napi::Value PtyOpen(const Napi::CallbackInfo& info);
 Napi::Value PtyResize(const Napi::CallbackInfo& info);
 Napi::Value PtyGetProc(const Napi::CallbackInfo& info);
+Napi::Value PtySetPoolOptions(const Napi::CallbackInfo& info);
+Napi::Value PtyGetPoolStats(const Napi::CallbackInfo& info);
+Napi::Value PtyGetAttr(const Napi::CallbackInfo& info);
+Napi::Value PtySetAttr(const Napi::CallbackInfo& info);
 
 /**
  * Functions
@@ -165,6 +203,12 @@ pty_execvpe(const char *, char **, char **);
 static int
 pty_nonblock(int);
 
+static int
+pty_cloexec_pipe(int *);
+
+static void
+pty_child_fail(int, int) __attribute__((noreturn));
+
 static char *
 pty_getproc(int, char *);
 
@@ -173,16 +217,59 @@ pty_openpty(int *, int *, char *,
             const struct termios *,
             const struct winsize *);
 
+static int
+pty_openpty_cloexec(int *, int *, const struct winsize *);
+
 static pid_t
 pty_forkpty(int *, char *,
             const struct termios *,
             const struct winsize *);
 
+static pid_t
+pty_fork(int, int);
+
+static void
+pty_default_termios(struct termios *, bool);
+
+static void
+pty_makeraw(struct termios *);
+
+static bool
+pty_termios_from_js(Napi::Value, struct termios *);
+
+static Napi::Object
+pty_termios_to_js(Napi::Env, const struct termios *);
+
+static bool
+pty_pool_take(int *, int *);
+
+/**
+ * Pty pool
+ */
+
+// Master/slave pairs opened ahead of time by a background thread, so that a
+// pooled spawn only has to fork and exec. All pooled fds are opened
+// close-on-exec, so that children forked meanwhile by other threads never
+// inherit them.
+struct pty_pair {
+  int master;
+  int slave;
+};
+
+static std::mutex pool_mutex;
+static std::condition_variable pool_cond;
+static std::deque<pty_pair> pool;
+static size_t pool_size = 0;
+static struct winsize pool_winp;
+static uint64_t pool_hits = 0;
+static uint64_t pool_misses = 0;
+static bool pool_thread_started = false;
+
 Napi::Value PtyFork(const Napi::CallbackInfo& info) {
   Napi::Env napiEnv(info.Env());
   Napi::HandleScope scope(napiEnv);
 
-  if (info.Length() != 10 ||
+  if (info.Length() != 11 ||
       !info[0].IsString() ||
       !info[1].IsArray() ||
       !info[2].IsArray() ||
@@ -192,8 +279,17 @@ Napi::Value PtyFork(const Napi::CallbackInfo& info) {
       !info[6].IsNumber() ||
       !info[7].IsNumber() ||
       !info[8].IsBoolean() ||
-      !info[9].IsFunction()) {
-    Napi::Error::New(napiEnv, "Usage: pty.fork(file, args, env, cwd, cols, rows, uid, gid, utf8, onexit)").ThrowAsJavaScriptException();
+      !info[10].IsFunction()) {
+    Napi::Error::New(napiEnv, "Usage: pty.fork(file, args, env, cwd, cols, rows, uid, gid, utf8, termios, onexit)").ThrowAsJavaScriptException();
+    return napiEnv.Undefined();
+  }
+
+  // termios
+  struct termios t;
+  struct termios *term = &t;
+  pty_default_termios(term, info[8].As<Napi::Boolean>().Value());
+  if (!pty_termios_from_js(info[9], term)) {
+    Napi::Error::New(napiEnv, "termios must be 'default', 'raw' or an object").ThrowAsJavaScriptException();
     return napiEnv.Undefined();
   }
 
@@ -235,50 +331,31 @@ Napi::Value PtyFork(const Napi::CallbackInfo& info) {
   winp.ws_xpixel = 0;
   winp.ws_ypixel = 0;
 
-  // termios
-  struct termios t = termios();
-  struct termios *term = &t;
-  term->c_iflag = ICRNL | IXON | IXANY | IMAXBEL | BRKINT;
-  if (info[8].As<Napi::Boolean>().Value()) {
-#if defined(IUTF8)
-    term->c_iflag |= IUTF8;
-#endif
-  }
-  term->c_oflag = OPOST | ONLCR;
-  term->c_cflag = CREAD | CS8 | HUPCL;
-  term->c_lflag = ICANON | ISIG | IEXTEN | ECHO | ECHOE | ECHOK | ECHOKE | ECHOCTL;
-
-  term->c_cc[VEOF] = 4;
-  term->c_cc[VEOL] = -1;
-  term->c_cc[VEOL2] = -1;
-  term->c_cc[VERASE] = 0x7f;
-  term->c_cc[VWERASE] = 23;
-  term->c_cc[VKILL] = 21;
-  term->c_cc[VREPRINT] = 18;
-  term->c_cc[VINTR] = 3;
-  term->c_cc[VQUIT] = 0x1c;
-  term->c_cc[VSUSP] = 26;
-  term->c_cc[VSTART] = 17;
-  term->c_cc[VSTOP] = 19;
-  term->c_cc[VLNEXT] = 22;
-  term->c_cc[VDISCARD] = 15;
-  term->c_cc[VMIN] = 1;
-  term->c_cc[VTIME] = 0;
-
-  #if (__APPLE__)
-  term->c_cc[VDSUSP] = 25;
-  term->c_cc[VSTATUS] = 20;
-  #endif
-
-  cfsetispeed(term, B38400);
-  cfsetospeed(term, B38400);
-
   // uid / gid
   int uid = info[6].As<Napi::Number>().Int32Value();
   int gid = info[7].As<Napi::Number>().Int32Value();
 
   // fork the pty
   int master = -1;
+  int slave = -1;
+
+  // status pipe: both ends are close-on-exec, so the parent reads EOF once
+  // execvp(3) succeeded, or a pty_child_status if the child failed before.
+  // Created first, a pooled pair is not given back on failure.
+  int status[2];
+  if (pty_cloexec_pipe(status) == -1) {
+    Napi::Error::New(napiEnv, "pipe(2) failed.").ThrowAsJavaScriptException();
+    return napiEnv.Null();
+  }
+
+  // a pooled pair only needs the attributes of this spawn applied
+  bool pooled = pty_pool_take(&master, &slave);
+  if (pooled) {
+    tcsetattr(slave, TCSANOW, term);
+    if (winp.ws_col != pool_winp.ws_col || winp.ws_row != pool_winp.ws_row) {
+      ioctl(slave, TIOCSWINSZ, &winp);
+    }
+  }
 
   sigset_t newmask, oldmask;
   struct sigaction sig_action;
@@ -290,7 +367,9 @@ Napi::Value PtyFork(const Napi::CallbackInfo& info) {
   sigfillset(&newmask);
   pthread_sigmask(SIG_SETMASK, &newmask, &oldmask);
 
-  pid_t pid = pty_forkpty(&master, nullptr, term, &winp);
+  pid_t pid = pooled
+    ? pty_fork(master, slave)
+    : pty_forkpty(&master, nullptr, term, &winp);
 
   if (!pid) {
     // remove all signal handler from child
@@ -314,32 +393,76 @@ Napi::Value PtyFork(const Napi::CallbackInfo& info) {
 
   switch (pid) {
     case -1:
+      close(status[0]);
+      close(status[1]);
+      if (pooled) {
+        close(master);
+        close(slave);
+      }
       Napi::Error::New(napiEnv, "forkpty(3) failed.").ThrowAsJavaScriptException();
       return napiEnv.Null();
     case 0:
+      close(status[0]);
+
       if (strlen(cwd)) {
         if (chdir(cwd) == -1) {
-          perror("chdir(2) failed.");
-          _exit(1);
+          pty_child_fail(status[1], PTY_STAGE_CHDIR);
         }
       }
 
       if (uid != -1 && gid != -1) {
         if (setgid(gid) == -1) {
-          perror("setgid(2) failed.");
-          _exit(1);
+          pty_child_fail(status[1], PTY_STAGE_SETGID);
         }
         if (setuid(uid) == -1) {
-          perror("setuid(2) failed.");
-          _exit(1);
+          pty_child_fail(status[1], PTY_STAGE_SETUID);
         }
       }
 
       pty_execvpe(argv[0], argv, env);
 
-      perror("execvp(3) failed.");
-      _exit(1);
+      pty_child_fail(status[1], PTY_STAGE_EXECVP);
     default:
+      close(status[1]);
+
+      struct pty_child_status child;
+      ssize_t n;
+      do {
+        n = read(status[0], &child, sizeof(child));
+      } while (n == -1 && errno == EINTR);
+      close(status[0]);
+
+      if (n == sizeof(child)) {
+        // The child never reached exec, reap it here since no exit
+        // callback is registered for it.
+        close(master);
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR);
+
+        const char *syscall = "execvp";
+        std::string path = file;
+        switch (child.stage) {
+          case PTY_STAGE_CHDIR:  syscall = "chdir";  path = cwd_; break;
+          case PTY_STAGE_SETGID: syscall = "setgid"; path = ""; break;
+          case PTY_STAGE_SETUID: syscall = "setuid"; path = ""; break;
+        }
+
+        std::string msg = std::string(syscall) +
+          (child.stage == PTY_STAGE_EXECVP ? "(3)" : "(2)") + " failed: " +
+          strerror(child.error);
+        if (!path.empty()) msg += ", '" + path + "'";
+
+        Napi::Error err = Napi::Error::New(napiEnv, msg);
+        err.Set("code", Napi::String::New(napiEnv, uv_err_name(-child.error)));
+        // negative as in the errors of node itself
+        err.Set("errno", Napi::Number::New(napiEnv, -child.error));
+        err.Set("syscall", Napi::String::New(napiEnv, syscall));
+        if (!path.empty()) {
+          err.Set("path", Napi::String::New(napiEnv, path));
+        }
+        err.ThrowAsJavaScriptException();
+        return napiEnv.Null();
+      }
+
       if (pty_nonblock(master) == -1) {
         Napi::Error::New(napiEnv, "Could not set master fd to nonblocking.").ThrowAsJavaScriptException();
         return napiEnv.Null();
@@ -354,7 +477,7 @@ Napi::Value PtyFork(const Napi::CallbackInfo& info) {
         Napi::String::New(napiEnv, ptsname(master)));
 
       // Set up process exit callback.
-      Napi::Function cb = info[9].As<Napi::Function>();
+      Napi::Function cb = info[10].As<Napi::Function>();
       WaitForExit* waitForExit = new WaitForExit(cb, pid);
       waitForExit->Queue();
 
@@ -368,13 +491,25 @@ Napi::Value PtyOpen(const Napi::CallbackInfo& info) {
   Napi::Env env(info.Env());
   Napi::HandleScope scope(env);
 
-  if (info.Length() != 2 ||
+  if (info.Length() != 3 ||
       !info[0].IsNumber() ||
       !info[1].IsNumber()) {
-    Napi::Error::New(env, "Usage: pty.open(cols, rows)").ThrowAsJavaScriptException();
+    Napi::Error::New(env, "Usage: pty.open(cols, rows, termios)").ThrowAsJavaScriptException();
     return env.Null();
   }
 
+  // termios, the kernel defaults apply unless given
+  struct termios t;
+  struct termios *term = NULL;
+  if (!info[2].IsUndefined() && !info[2].IsNull()) {
+    term = &t;
+    pty_default_termios(term, true);
+    if (!pty_termios_from_js(info[2], term)) {
+      Napi::Error::New(env, "termios must be 'default', 'raw' or an object").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  }
+
   // size
   struct winsize winp;
   winp.ws_col = info[0].As<Napi::Number>().Int32Value();
@@ -384,7 +519,7 @@ Napi::Value PtyOpen(const Napi::CallbackInfo& info) {
 
   // pty
   int master, slave;
-  int ret = pty_openpty(&master, &slave, nullptr, NULL, &winp);
+  int ret = pty_openpty(&master, &slave, nullptr, term, &winp);
 
   if (ret == -1) {
     Napi::Error::New(env, "openpty(3) failed.").ThrowAsJavaScriptException();
@@ -450,6 +585,177 @@ Napi::Value PtyResize(const Napi::CallbackInfo& info) {
   return env.Undefined();
 }
 
+/**
+ * Pty pool configuration
+ */
+
+static void
+pty_pool_refill() {
+  std::unique_lock<std::mutex> lock(pool_mutex);
+  for (;;) {
+    pool_cond.wait(lock, [] { return pool.size() < pool_size; });
+
+    struct winsize winp = pool_winp;
+    lock.unlock();
+
+    pty_pair pair;
+    int ret = pty_openpty_cloexec(&pair.master, &pair.slave, &winp);
+
+    lock.lock();
+    if (ret == -1) {
+      // Out of ptys, retry when the next pair is taken.
+      pool_cond.wait(lock);
+      continue;
+    }
+    if (pool.size() >= pool_size ||
+        winp.ws_col != pool_winp.ws_col || winp.ws_row != pool_winp.ws_row) {
+      close(pair.master);
+      close(pair.slave);
+      continue;
+    }
+    pool.push_back(pair);
+  }
+}
+
+static bool
+pty_pool_take(int *amaster, int *aslave) {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (pool_size == 0) return false;
+  if (pool.empty()) {
+    pool_misses++;
+    return false;
+  }
+  pool_hits++;
+  *amaster = pool.front().master;
+  *aslave = pool.front().slave;
+  pool.pop_front();
+  pool_cond.notify_one();
+  return true;
+}
+
+Napi::Value PtySetPoolOptions(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 3 ||
+      !info[0].IsNumber() ||
+      !info[1].IsNumber() ||
+      !info[2].IsNumber()) {
+    Napi::Error::New(env, "Usage: pty.setPoolOptions(size, cols, rows)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::lock_guard<std::mutex> lock(pool_mutex);
+
+  pool_size = info[0].As<Napi::Number>().Uint32Value();
+  pool_winp.ws_col = info[1].As<Napi::Number>().Int32Value();
+  pool_winp.ws_row = info[2].As<Napi::Number>().Int32Value();
+  pool_winp.ws_xpixel = 0;
+  pool_winp.ws_ypixel = 0;
+
+  // drop surplus pairs and pairs opened with a stale size
+  while (!pool.empty()) {
+    struct winsize winp;
+    if (pool.size() <= pool_size &&
+        ioctl(pool.back().master, TIOCGWINSZ, &winp) == 0 &&
+        winp.ws_col == pool_winp.ws_col && winp.ws_row == pool_winp.ws_row) {
+      break;
+    }
+    close(pool.back().master);
+    close(pool.back().slave);
+    pool.pop_back();
+  }
+
+  if (pool_size > 0 && !pool_thread_started) {
+    std::thread(pty_pool_refill).detach();
+    pool_thread_started = true;
+  }
+  pool_cond.notify_one();
+
+  return env.Undefined();
+}
+
+Napi::Value PtyGetPoolStats(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  std::lock_guard<std::mutex> lock(pool_mutex);
+
+  Napi::Object obj = Napi::Object::New(env);
+  (obj).Set(Napi::String::New(env, "size"),
+    Napi::Number::New(env, pool_size));
+  (obj).Set(Napi::String::New(env, "available"),
+    Napi::Number::New(env, pool.size()));
+  (obj).Set(Napi::String::New(env, "hits"),
+    Napi::Number::New(env, pool_hits));
+  (obj).Set(Napi::String::New(env, "misses"),
+    Napi::Number::New(env, pool_misses));
+
+  return obj;
+}
+
+/**
+ * Terminal attributes
+ */
+
+Napi::Value PtyGetAttr(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 ||
+      !info[0].IsNumber()) {
+    Napi::Error::New(env, "Usage: pty.getAttr(fd)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  int fd = info[0].As<Napi::Number>().Int32Value();
+
+  struct termios t;
+  if (tcgetattr(fd, &t) == -1) {
+    Napi::Error::New(env, std::string("tcgetattr(3) failed, ") + uv_err_name(-errno)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  return pty_termios_to_js(env, &t);
+}
+
+Napi::Value PtySetAttr(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 2 ||
+      !info[0].IsNumber()) {
+    Napi::Error::New(env, "Usage: pty.setAttr(fd, termios)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  int fd = info[0].As<Napi::Number>().Int32Value();
+
+  // fields that are not given keep their current value
+  struct termios t;
+  if (tcgetattr(fd, &t) == -1) {
+    Napi::Error::New(env, std::string("tcgetattr(3) failed, ") + uv_err_name(-errno)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (info[1].IsString() && info[1].As<Napi::String>().Utf8Value() == "default") {
+    bool utf8 = false;
+#if defined(IUTF8)
+    utf8 = (t.c_iflag & IUTF8) != 0;
+#endif
+    pty_default_termios(&t, utf8);
+  } else if (!pty_termios_from_js(info[1], &t)) {
+    Napi::Error::New(env, "termios must be 'default', 'raw' or an object").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  if (tcsetattr(fd, TCSANOW, &t) == -1) {
+    Napi::Error::New(env, std::string("tcsetattr(3) failed, ") + uv_err_name(-errno)).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  return env.Undefined();
+}
+
 /**
  * Foreground Process Name
  */
@@ -495,6 +801,201 @@ pty_execvpe(const char *file, char **argv, char **envp) {
   return ret;
 }
 
+/**
+ * termios
+ */
+
+// The attributes ptys are created with unless configured otherwise.
+static void
+pty_default_termios(struct termios *term, bool utf8) {
+  *term = termios();
+  term->c_iflag = ICRNL | IXON | IXANY | IMAXBEL | BRKINT;
+  if (utf8) {
+#if defined(IUTF8)
+    term->c_iflag |= IUTF8;
+#endif
+  }
+  term->c_oflag = OPOST | ONLCR;
+  term->c_cflag = CREAD | CS8 | HUPCL;
+  term->c_lflag = ICANON | ISIG | IEXTEN | ECHO | ECHOE | ECHOK | ECHOKE | ECHOCTL;
+
+  term->c_cc[VEOF] = 4;
+  term->c_cc[VEOL] = -1;
+  term->c_cc[VEOL2] = -1;
+  term->c_cc[VERASE] = 0x7f;
+  term->c_cc[VWERASE] = 23;
+  term->c_cc[VKILL] = 21;
+  term->c_cc[VREPRINT] = 18;
+  term->c_cc[VINTR] = 3;
+  term->c_cc[VQUIT] = 0x1c;
+  term->c_cc[VSUSP] = 26;
+  term->c_cc[VSTART] = 17;
+  term->c_cc[VSTOP] = 19;
+  term->c_cc[VLNEXT] = 22;
+  term->c_cc[VDISCARD] = 15;
+  term->c_cc[VMIN] = 1;
+  term->c_cc[VTIME] = 0;
+
+  #if (__APPLE__)
+  term->c_cc[VDSUSP] = 25;
+  term->c_cc[VSTATUS] = 20;
+  #endif
+
+  cfsetispeed(term, B38400);
+  cfsetospeed(term, B38400);
+}
+
+// cfmakeraw(3) is not portable (missing on Solaris).
+// No input/output processing, no echo, no signals: bytes pass through the
+// line discipline unchanged.
+static void
+pty_makeraw(struct termios *term) {
+  term->c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXANY | IMAXBEL);
+  term->c_oflag &= ~OPOST;
+  term->c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+  term->c_cflag &= ~(CSIZE | PARENB);
+  term->c_cflag |= CS8;
+  term->c_cc[VMIN] = 1;
+  term->c_cc[VTIME] = 0;
+}
+
+static const struct {
+  const char *name;
+  int index;
+} pty_cc_names[] = {
+  { "VEOF", VEOF },
+  { "VEOL", VEOL },
+#if defined(VEOL2)
+  { "VEOL2", VEOL2 },
+#endif
+  { "VERASE", VERASE },
+#if defined(VWERASE)
+  { "VWERASE", VWERASE },
+#endif
+  { "VKILL", VKILL },
+#if defined(VREPRINT)
+  { "VREPRINT", VREPRINT },
+#endif
+  { "VINTR", VINTR },
+  { "VQUIT", VQUIT },
+  { "VSUSP", VSUSP },
+#if defined(VDSUSP)
+  { "VDSUSP", VDSUSP },
+#endif
+  { "VSTART", VSTART },
+  { "VSTOP", VSTOP },
+#if defined(VLNEXT)
+  { "VLNEXT", VLNEXT },
+#endif
+#if defined(VDISCARD)
+  { "VDISCARD", VDISCARD },
+#endif
+#if defined(VSTATUS)
+  { "VSTATUS", VSTATUS },
+#endif
+  { "VMIN", VMIN },
+  { "VTIME", VTIME },
+};
+
+// Applies a preset name or the fields of a termios object onto term, missing
+// fields are left untouched. undefined and null leave term as it is.
+static bool
+pty_termios_from_js(Napi::Value value, struct termios *term) {
+  if (value.IsUndefined() || value.IsNull()) {
+    return true;
+  }
+
+  if (value.IsString()) {
+    std::string preset = value.As<Napi::String>();
+    if (preset == "raw") {
+      pty_makeraw(term);
+      return true;
+    }
+    return preset == "default";
+  }
+
+  if (!value.IsObject()) {
+    return false;
+  }
+
+  Napi::Object obj = value.As<Napi::Object>();
+  Napi::Value v;
+  if ((v = obj.Get("iflag")).IsNumber()) term->c_iflag = v.As<Napi::Number>().Int64Value();
+  if ((v = obj.Get("oflag")).IsNumber()) term->c_oflag = v.As<Napi::Number>().Int64Value();
+  if ((v = obj.Get("cflag")).IsNumber()) term->c_cflag = v.As<Napi::Number>().Int64Value();
+  if ((v = obj.Get("lflag")).IsNumber()) term->c_lflag = v.As<Napi::Number>().Int64Value();
+  if ((v = obj.Get("ispeed")).IsNumber()) cfsetispeed(term, v.As<Napi::Number>().Int64Value());
+  if ((v = obj.Get("ospeed")).IsNumber()) cfsetospeed(term, v.As<Napi::Number>().Int64Value());
+
+  if ((v = obj.Get("cc")).IsObject()) {
+    Napi::Object cc = v.As<Napi::Object>();
+    for (size_t i = 0; i < sizeof(pty_cc_names) / sizeof(pty_cc_names[0]); i++) {
+      if ((v = cc.Get(pty_cc_names[i].name)).IsNumber()) {
+        term->c_cc[pty_cc_names[i].index] = v.As<Napi::Number>().Int32Value();
+      }
+    }
+  }
+
+  return true;
+}
+
+static Napi::Object
+pty_termios_to_js(Napi::Env env, const struct termios *term) {
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("iflag", Napi::Number::New(env, term->c_iflag));
+  obj.Set("oflag", Napi::Number::New(env, term->c_oflag));
+  obj.Set("cflag", Napi::Number::New(env, term->c_cflag));
+  obj.Set("lflag", Napi::Number::New(env, term->c_lflag));
+  obj.Set("ispeed", Napi::Number::New(env, cfgetispeed(term)));
+  obj.Set("ospeed", Napi::Number::New(env, cfgetospeed(term)));
+
+  Napi::Object cc = Napi::Object::New(env);
+  for (size_t i = 0; i < sizeof(pty_cc_names) / sizeof(pty_cc_names[0]); i++) {
+    cc.Set(pty_cc_names[i].name,
+      Napi::Number::New(env, term->c_cc[pty_cc_names[i].index]));
+  }
+  obj.Set("cc", cc);
+
+  return obj;
+}
+
+static Napi::Object
+pty_termios_constants(Napi::Env env) {
+  static const struct {
+    const char *name;
+    tcflag_t value;
+  } flags[] = {
+    // c_iflag
+    { "IGNBRK", IGNBRK }, { "BRKINT", BRKINT }, { "IGNPAR", IGNPAR },
+    { "PARMRK", PARMRK }, { "INPCK", INPCK }, { "ISTRIP", ISTRIP },
+    { "INLCR", INLCR }, { "IGNCR", IGNCR }, { "ICRNL", ICRNL },
+    { "IXON", IXON }, { "IXANY", IXANY }, { "IXOFF", IXOFF },
+    { "IMAXBEL", IMAXBEL },
+#if defined(IUTF8)
+    { "IUTF8", IUTF8 },
+#endif
+    // c_oflag
+    { "OPOST", OPOST }, { "ONLCR", ONLCR }, { "OCRNL", OCRNL },
+    { "ONOCR", ONOCR }, { "ONLRET", ONLRET },
+    // c_cflag
+    { "CSIZE", CSIZE }, { "CS5", CS5 }, { "CS6", CS6 }, { "CS7", CS7 },
+    { "CS8", CS8 }, { "CSTOPB", CSTOPB }, { "CREAD", CREAD },
+    { "PARENB", PARENB }, { "PARODD", PARODD }, { "HUPCL", HUPCL },
+    { "CLOCAL", CLOCAL },
+    // c_lflag
+    { "ISIG", ISIG }, { "ICANON", ICANON }, { "ECHO", ECHO },
+    { "ECHOE", ECHOE }, { "ECHOK", ECHOK }, { "ECHONL", ECHONL },
+    { "ECHOCTL", ECHOCTL }, { "ECHOKE", ECHOKE }, { "NOFLSH", NOFLSH },
+    { "TOSTOP", TOSTOP }, { "IEXTEN", IEXTEN },
+  };
+
+  Napi::Object obj = Napi::Object::New(env);
+  for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+    obj.Set(flags[i].name, Napi::Number::New(env, flags[i].value));
+  }
+  return obj;
+}
+
 /**
  * Nonblocking FD
  */
@@ -506,6 +1007,43 @@ pty_nonblock(int fd) {
   return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+/**
+ * Close-on-exec pipe
+ */
+
+static int
+pty_cloexec_pipe(int *fds) {
+#if defined(__linux__)
+  return pipe2(fds, O_CLOEXEC);
+#else
+  if (pipe(fds) == -1) return -1;
+  if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) == -1 ||
+      fcntl(fds[1], F_SETFD, FD_CLOEXEC) == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+/**
+ * Report a failed setup stage to the parent and exit the child.
+ * Runs between fork and exec, so only async-signal-safe calls.
+ */
+
+static void
+pty_child_fail(int fd, int stage) {
+  struct pty_child_status child;
+  child.stage = stage;
+  child.error = errno;
+  ssize_t n;
+  do {
+    n = write(fd, &child, sizeof(child));
+  } while (n == -1 && errno == EINTR);
+  _exit(1);
+}
+
 /**
  * pty_getproc
  * Taken from tmux.
@@ -648,6 +1186,56 @@ err:
 #endif
 }
 
+// openpty(3) without a window where the pair is not yet close-on-exec. The
+// name of the slave is looked up reentrantly, the JS thread may be calling
+// ptsname(3) meanwhile.
+static int
+pty_openpty_cloexec(int *amaster, int *aslave, const struct winsize *winp) {
+#if defined(__APPLE__)
+  // posix_openpt(3) takes no O_CLOEXEC here
+  int master = open("/dev/ptmx", O_RDWR | O_NOCTTY | O_CLOEXEC);
+#else
+  int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+#endif
+  if (master == -1) return -1;
+
+  char name[128];
+  int slave;
+  if (grantpt(master) == -1) goto err;
+  if (unlockpt(master) == -1) goto err;
+#if defined(__APPLE__)
+  if (ioctl(master, TIOCPTYGNAME, name) == -1) goto err;
+#elif defined(__linux__) || defined(__FreeBSD__)
+  if (ptsname_r(master, name, sizeof(name)) != 0) goto err;
+#else
+  {
+    // no reentrant variant here
+    const char *slave_name = ptsname(master);
+    if (slave_name == NULL || strlen(slave_name) >= sizeof(name)) goto err;
+    strcpy(name, slave_name);
+  }
+#endif
+
+  slave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (slave == -1) goto err;
+
+#if defined(__sun)
+  ioctl(slave, I_PUSH, "ptem");
+  ioctl(slave, I_PUSH, "ldterm");
+  ioctl(slave, I_PUSH, "ttcompat");
+#endif
+
+  if (winp) ioctl(slave, TIOCSWINSZ, winp);
+
+  *amaster = master;
+  *aslave = slave;
+  return 0;
+
+err:
+  close(master);
+  return -1;
+}
+
 static pid_t
 pty_forkpty(int *amaster,
             char *name,
@@ -660,12 +1248,28 @@ pty_forkpty(int *amaster,
   if (ret == -1) return -1;
   if (amaster) *amaster = master;
 
+  pid_t pid = pty_fork(master, slave);
+  if (pid == -1) {
+    close(master);
+    close(slave);
+  }
+  return pid;
+#else
+  return forkpty(amaster, name, (termios *)termp, (winsize *)winp);
+#endif
+}
+
+/**
+ * fork(2) with an already opened master/slave pair, making the slave the
+ * controlling terminal and stdio of the child.
+ */
+
+static pid_t
+pty_fork(int master, int slave) {
   pid_t pid = fork();
 
   switch (pid) {
     case -1:  // error in fork, we are still in parent
-      close(master);
-      close(slave);
       return -1;
     case 0:  // we are in the child process
       close(master);
@@ -691,9 +1295,6 @@ pty_forkpty(int *amaster,
   }
 
   return -1;
-#else
-  return forkpty(amaster, name, (termios *)termp, (winsize *)winp);
-#endif
 }
 
 
@@ -707,6 +1308,21 @@ Napi::Object init(Napi::Env env, Napi::Object exports) {
   exports.Set(Napi::String::New(env, "open"),    Napi::Function::New(env, PtyOpen));
   exports.Set(Napi::String::New(env, "resize"),  Napi::Function::New(env, PtyResize));
   exports.Set(Napi::String::New(env, "process"), Napi::Function::New(env, PtyGetProc));
+  exports.Set(Napi::String::New(env, "setPoolOptions"), Napi::Function::New(env, PtySetPoolOptions));
+  exports.Set(Napi::String::New(env, "getPoolStats"), Napi::Function::New(env, PtyGetPoolStats));
+  exports.Set(Napi::String::New(env, "getAttr"), Napi::Function::New(env, PtyGetAttr));
+  exports.Set(Napi::String::New(env, "setAttr"), Napi::Function::New(env, PtySetAttr));
+  exports.Set(Napi::String::New(env, "termios"), pty_termios_constants(env));
+  budget::Init(env, exports);
+  hub::PtyHub::Init(env, exports);
+  scrollback::Scrollback::Init(env, exports);
+  screen::Screen::Init(env, exports);
+  width::Init(env, exports);
+  events::EventScanner::Init(env, exports);
+  plain::PlainText::Init(env, exports);
+  lines::LineFramer::Init(env, exports);
+  expect::ExpectMatcher::Init(env, exports);
+  links::LinkDetector::Init(env, exports);
   return exports;
 }
 
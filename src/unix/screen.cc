@@ -0,0 +1,1430 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * screen.cc:
+ *   The headless screen model, driven by the VT parser.
+ */
+
+#include "screen.h"
+
+#include <algorithm>
+
+#include "width.h"
+
+namespace screen {
+
+static const size_t kScrollback = 1000;
+// Characters with combining marks are kept in a table, which is swept of
+// the clusters no cell holds when it fills. Marks beyond it are dropped, as
+// are those beyond kMaxMarks on a character.
+static const size_t kMaxClusters = 64 * 1024;
+static const size_t kMaxMarks = 16;
+static const int kMaxSize = 4096;
+
+// DEC special graphics for 0x5F to 0x7E, the line drawing set.
+static const uint16_t kDecGraphics[32] = {
+  0x00A0, 0x25C6, 0x2592, 0x2409, 0x240C, 0x240D, 0x240A, 0x00B0,
+  0x00B1, 0x2424, 0x240B, 0x2518, 0x2510, 0x250C, 0x2514, 0x253C,
+  0x23BA, 0x23BB, 0x2500, 0x23BC, 0x23BD, 0x251C, 0x2524, 0x2534,
+  0x252C, 0x2502, 0x2264, 0x2265, 0x03C0, 0x2260, 0x00A3, 0x00B7
+};
+
+static void
+append_utf8(uint32_t c, std::string *out) {
+  if (c < 0x80) {
+    out->push_back((char)c);
+  } else if (c < 0x800) {
+    out->push_back((char)(0xC0 | (c >> 6)));
+    out->push_back((char)(0x80 | (c & 0x3F)));
+  } else if (c < 0x10000) {
+    out->push_back((char)(0xE0 | (c >> 12)));
+    out->push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+    out->push_back((char)(0x80 | (c & 0x3F)));
+  } else {
+    out->push_back((char)(0xF0 | (c >> 18)));
+    out->push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+    out->push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+    out->push_back((char)(0x80 | (c & 0x3F)));
+  }
+}
+
+static bool
+blank(const Cell &cell) {
+  return cell.ch == 0 && cell.attr.bg == kDefault && !(cell.attr.flags & kInverse);
+}
+
+static void
+pack(const Line &line, int len, SavedLine *saved) {
+  saved->chars.resize(len);
+  saved->runs.clear();
+  for (int x = 0; x < len; x++) {
+    const Cell &cell = line.cells[x];
+    saved->chars[x] = cell.ch;
+    if (x == 0 || cell.attr != saved->runs.back().attr) {
+      SavedLine::Run run;
+      run.start = x;
+      run.attr = cell.attr;
+      saved->runs.push_back(run);
+    }
+  }
+  saved->wrapped = line.wrapped;
+}
+
+static void
+unpack(const SavedLine &saved, Line *line) {
+  line->cells.resize(saved.chars.size());
+  size_t run = 0;
+  for (size_t x = 0; x < saved.chars.size(); x++) {
+    while (run + 1 < saved.runs.size() && saved.runs[run + 1].start <= x) run++;
+    line->cells[x].ch = saved.chars[x];
+    line->cells[x].attr = saved.runs[run].attr;
+  }
+  line->wrapped = saved.wrapped;
+}
+
+/**
+ * Model
+ */
+
+Model::Model(int cols, int rows, size_t scrollback)
+  : parser(this), cols(cols), rows(rows), scrollback_limit(scrollback),
+    saved(0), version(0), dirty(false) {
+  ResetLocked();
+  version++;
+  dirty = false;
+}
+
+void Model::Write(const char *data, size_t len) {
+  std::lock_guard<std::mutex> lock(mutex);
+  int x = cursor.x;
+  int y = cursor.y;
+  parser.Write(data, len);
+  if (dirty || cursor.x != x || cursor.y != y) {
+    version++;
+    dirty = false;
+  }
+}
+
+void Model::Reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  parser.Reset();
+  ResetLocked();
+  version++;
+  dirty = false;
+}
+
+void Model::ResetLocked() {
+  cursor = Cursor();
+  Line line;
+  line.cells.resize(cols);
+  main.lines.assign(rows, line);
+  main.first = 0;
+  main.saved = Cursor();
+  alt.lines.assign(rows, line);
+  alt.first = 0;
+  alt.saved = Cursor();
+  grid = &main;
+  scrollback.clear();
+  clusters.clear();
+  sweep_skip = 0;
+  top = 0;
+  bottom = rows - 1;
+  tabs.assign(cols, false);
+  for (int x = 8; x < cols; x += 8) tabs[x] = true;
+  last = 0;
+  autowrap = true;
+  insert = false;
+  newline_mode = false;
+  cursor_visible = true;
+  application_cursor = false;
+  bracketed_paste = false;
+  title.clear();
+  DamageAll();
+}
+
+void Model::Damage(int y, int from, int to) {
+  Line &line = Row(y);
+  from = std::max(from, 0);
+  to = std::min(to, cols);
+  if (line.version != version + 1) {
+    line.version = version + 1;
+    line.left = from;
+    line.right = to;
+  } else if (from < to) {
+    if (line.left >= line.right) {
+      line.left = from;
+      line.right = to;
+    } else {
+      line.left = std::min(line.left, from);
+      line.right = std::max(line.right, to);
+    }
+  }
+  dirty = true;
+}
+
+void Model::DamageAll() {
+  for (int y = 0; y < rows; y++) Damage(y, 0, cols);
+}
+
+Cell Model::Blank() const {
+  // erasing fills with the current background
+  Cell cell;
+  cell.attr.bg = cursor.attr.bg;
+  return cell;
+}
+
+void Model::Unwide(Line *line, int x) {
+  Cell &cell = line->cells[x];
+  if ((cell.attr.flags & kWideTail) && x > 0) {
+    line->cells[x - 1].ch = 0;
+    line->cells[x - 1].attr.flags &= ~kWide;
+  }
+  if ((cell.attr.flags & kWide) && x + 1 < cols) {
+    line->cells[x + 1].ch = 0;
+    line->cells[x + 1].attr.flags &= ~kWideTail;
+  }
+  cell.attr.flags &= ~(kWide | kWideTail);
+}
+
+void Model::Erase(int y, int from, int to) {
+  if (from >= to) return;
+  Damage(y, from - 1, to + 1);
+  Line &line = Row(y);
+  Unwide(&line, from);
+  Unwide(&line, to - 1);
+  std::fill(line.cells.begin() + from, line.cells.begin() + to, Blank());
+  if (to == cols) line.wrapped = false;
+}
+
+void Model::ClearRow(int y) {
+  Damage(y, 0, cols);
+  Line &line = Row(y);
+  std::fill(line.cells.begin(), line.cells.end(), Blank());
+  line.wrapped = false;
+}
+
+static void
+swap_lines(Line *a, Line *b) {
+  a->cells.swap(b->cells);
+  std::swap(a->wrapped, b->wrapped);
+}
+
+void Model::Save(const Line &line) {
+  saved++;
+  if (scrollback_limit == 0) return;
+  int len = (int)line.cells.size();
+  while (len > 0 && blank(line.cells[len - 1])) len--;
+  // reuses the oldest line once the scrollback is full
+  if (scrollback.size() >= scrollback_limit) {
+    scrollback.push_back(std::move(scrollback.front()));
+    scrollback.pop_front();
+  } else {
+    scrollback.push_back(SavedLine());
+  }
+  pack(line, len, &scrollback.back());
+}
+
+void Model::ScrollUp(int from, int to, int n, bool save) {
+  n = std::min(n, to - from + 1);
+  if (n <= 0) return;
+  if (save && grid == &main && from == 0) {
+    for (int i = 0; i < n; i++) Save(Row(i));
+  }
+  if (from == 0 && to == rows - 1) {
+    // turns the ring, every row shows another line
+    for (int y = 0; y < n; y++) ClearRow(y);
+    grid->first = (grid->first + n) % rows;
+    DamageAll();
+    return;
+  }
+  for (int y = from; y + n <= to; y++) {
+    swap_lines(&Row(y), &Row(y + n));
+    Damage(y, 0, cols);
+  }
+  for (int y = to - n + 1; y <= to; y++) ClearRow(y);
+}
+
+void Model::ScrollDown(int from, int to, int n) {
+  n = std::min(n, to - from + 1);
+  if (n <= 0) return;
+  for (int y = to; y - n >= from; y--) {
+    swap_lines(&Row(y), &Row(y - n));
+    Damage(y, 0, cols);
+  }
+  for (int y = from; y < from + n; y++) ClearRow(y);
+}
+
+void Model::Index() {
+  cursor.wrap = false;
+  if (cursor.y == bottom) {
+    ScrollUp(top, bottom, 1, true);
+  } else if (cursor.y < rows - 1) {
+    cursor.y++;
+  }
+}
+
+void Model::ReverseIndex() {
+  cursor.wrap = false;
+  if (cursor.y == top) {
+    ScrollDown(top, bottom, 1);
+  } else if (cursor.y > 0) {
+    cursor.y--;
+  }
+}
+
+void Model::Wrap() {
+  Row(cursor.y).wrapped = true;
+  Damage(cursor.y, cols, cols);
+  cursor.x = 0;
+  Index();
+}
+
+void Model::MoveTo(int x, int y) {
+  int min_y = 0, max_y = rows - 1;
+  if (cursor.origin) {
+    y += top;
+    min_y = top;
+    max_y = bottom;
+  }
+  cursor.x = std::max(0, std::min(x, cols - 1));
+  cursor.y = std::max(min_y, std::min(y, max_y));
+  cursor.wrap = false;
+}
+
+void Model::Tab(int n) {
+  cursor.wrap = false;
+  for (; n > 0 && cursor.x < cols - 1; n--) {
+    do cursor.x++; while (cursor.x < cols - 1 && !tabs[cursor.x]);
+  }
+  for (; n < 0 && cursor.x > 0; n++) {
+    do cursor.x--; while (cursor.x > 0 && !tabs[cursor.x]);
+  }
+}
+
+void Model::SaveCursor() {
+  grid->saved = cursor;
+}
+
+void Model::RestoreCursor() {
+  cursor = grid->saved;
+  cursor.x = std::min(cursor.x, cols - 1);
+  cursor.y = std::min(cursor.y, rows - 1);
+}
+
+void Model::SwitchScreen(bool alternate, bool clear) {
+  if (alternate == (grid == &alt)) return;
+  grid = alternate ? &alt : &main;
+  if (alternate && clear) {
+    for (int y = 0; y < rows; y++) Erase(y, 0, cols);
+  }
+  DamageAll();
+}
+
+void Model::PrintAscii(const char *data, size_t len) {
+  if (insert || cursor.charsets[cursor.gl] == '0') {
+    for (size_t i = 0; i < len; i++) Print((uint8_t)data[i]);
+    return;
+  }
+  size_t i = 0;
+  while (i < len) {
+    if (cursor.wrap && autowrap) Wrap();
+    Line &line = Row(cursor.y);
+    int n = (int)std::min(len - i, (size_t)(cols - cursor.x));
+    // the halves of wide characters next to it may be cleared
+    Damage(cursor.y, cursor.x - 1, cursor.x + n + 1);
+    Unwide(&line, cursor.x);
+    Unwide(&line, cursor.x + n - 1);
+    Cell *cell = &line.cells[cursor.x];
+    for (int k = 0; k < n; k++) {
+      cell[k].ch = (uint8_t)data[i + k];
+      cell[k].attr = cursor.attr;
+    }
+    i += n;
+    cursor.x += n;
+    if (cursor.x >= cols) {
+      cursor.x = cols - 1;
+      cursor.wrap = true;
+      if (!autowrap && i < len) {
+        // the last column is overwritten by the rest
+        cell = &line.cells[cols - 1];
+        cell->ch = (uint8_t)data[len - 1];
+        i = len;
+      }
+    }
+  }
+  last = (uint8_t)data[len - 1];
+}
+
+void Model::Print(uint32_t code) {
+  if (code >= 0x5F && code <= 0x7E && cursor.charsets[cursor.gl] == '0') {
+    code = kDecGraphics[code - 0x5F];
+  }
+  int columns = width::CodePoint(code);
+  if (columns == 0) {
+    // C1 controls are not shown
+    if (code >= 0xA0) Combine(code);
+    return;
+  }
+  Put(code, columns);
+  last = code;
+}
+
+void Model::Put(uint32_t ch, int width) {
+  if (width > cols) return;
+  if (cursor.wrap && autowrap) Wrap();
+  if (width == 2 && cursor.x == cols - 1) {
+    // does not fit, the last column is left blank
+    if (!autowrap) return;
+    Erase(cursor.y, cursor.x, cols);
+    Wrap();
+  }
+  Line &line = Row(cursor.y);
+  Damage(cursor.y, cursor.x - 1, insert ? cols : cursor.x + width + 1);
+  if (insert) {
+    Unwide(&line, cursor.x);
+    std::copy_backward(line.cells.begin() + cursor.x, line.cells.end() - width, line.cells.end());
+    if (line.cells[cols - 1].attr.flags & kWide) {
+      line.cells[cols - 1].ch = 0;
+      line.cells[cols - 1].attr.flags &= ~kWide;
+    }
+  }
+  Unwide(&line, cursor.x);
+  if (width == 2) Unwide(&line, cursor.x + 1);
+  Cell &cell = line.cells[cursor.x];
+  cell.ch = ch;
+  cell.attr = cursor.attr;
+  if (width == 2) {
+    cell.attr.flags |= kWide;
+    Cell &tail = line.cells[cursor.x + 1];
+    tail.ch = 0;
+    tail.attr = cursor.attr;
+    tail.attr.flags |= kWideTail;
+  }
+  cursor.x += width;
+  if (cursor.x >= cols) {
+    cursor.x = cols - 1;
+    cursor.wrap = true;
+  }
+}
+
+void Model::Combine(uint32_t code) {
+  // the mark goes to the character before the cursor
+  int x = cursor.wrap ? cursor.x : cursor.x - 1;
+  if (x < 0) return;
+  Line &line = Row(cursor.y);
+  if ((line.cells[x].attr.flags & kWideTail) && x > 0) x--;
+  Cell &cell = line.cells[x];
+  if (cell.ch == 0) return;
+  Damage(cursor.y, x, x + 2);
+  if (cell.ch >= kCluster) {
+    std::u32string &cluster = clusters[cell.ch - kCluster];
+    if (cluster.size() <= kMaxMarks) cluster.push_back(code);
+    return;
+  }
+  if (clusters.size() >= kMaxClusters) Sweep();
+  if (clusters.size() < kMaxClusters) {
+    std::u32string cluster;
+    cluster.push_back(cell.ch);
+    cluster.push_back(code);
+    clusters.push_back(cluster);
+    cell.ch = kCluster + (uint32_t)(clusters.size() - 1);
+  }
+}
+
+void Model::Sweep() {
+  // a sweep that frees little is not tried again for a while
+  if (sweep_skip > 0) {
+    sweep_skip--;
+    return;
+  }
+  std::vector<uint32_t> remap(clusters.size(), 0);
+  Grid *grids[2] = { &main, &alt };
+  for (int g = 0; g < 2; g++) {
+    for (size_t i = 0; i < grids[g]->lines.size(); i++) {
+      const std::vector<Cell> &cells = grids[g]->lines[i].cells;
+      for (size_t x = 0; x < cells.size(); x++) {
+        if (cells[x].ch >= kCluster) remap[cells[x].ch - kCluster] = 1;
+      }
+    }
+  }
+  for (size_t i = 0; i < scrollback.size(); i++) {
+    const std::vector<uint32_t> &chars = scrollback[i].chars;
+    for (size_t x = 0; x < chars.size(); x++) {
+      if (chars[x] >= kCluster) remap[chars[x] - kCluster] = 1;
+    }
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < clusters.size(); i++) {
+    if (!remap[i]) continue;
+    if (kept != i) clusters[kept].swap(clusters[i]);
+    remap[i] = kCluster + (uint32_t)kept++;
+  }
+  clusters.resize(kept);
+  for (int g = 0; g < 2; g++) {
+    for (size_t i = 0; i < grids[g]->lines.size(); i++) {
+      std::vector<Cell> &cells = grids[g]->lines[i].cells;
+      for (size_t x = 0; x < cells.size(); x++) {
+        if (cells[x].ch >= kCluster) cells[x].ch = remap[cells[x].ch - kCluster];
+      }
+    }
+  }
+  for (size_t i = 0; i < scrollback.size(); i++) {
+    std::vector<uint32_t> &chars = scrollback[i].chars;
+    for (size_t x = 0; x < chars.size(); x++) {
+      if (chars[x] >= kCluster) chars[x] = remap[chars[x] - kCluster];
+    }
+  }
+  if (kept > kMaxClusters * 3 / 4) sweep_skip = kMaxClusters / 4;
+}
+
+void Model::Execute(uint8_t code) {
+  switch (code) {
+    case 0x08:  // BS
+      if (cursor.x > 0 && !cursor.wrap) cursor.x--;
+      cursor.wrap = false;
+      break;
+    case 0x09:  // HT
+      Tab(1);
+      break;
+    case 0x0A:  // LF, VT, FF
+    case 0x0B:
+    case 0x0C:
+      Index();
+      if (newline_mode) cursor.x = 0;
+      break;
+    case 0x0D:  // CR
+      cursor.x = 0;
+      cursor.wrap = false;
+      break;
+    case 0x0E:  // SO
+      cursor.gl = 1;
+      break;
+    case 0x0F:  // SI
+      cursor.gl = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+// An extended color of SGR 38, 48 or 58 at params[*i], in the forms
+// 5;n, 2;r;g;b, 5:n, 2:r:g:b and 2:cs:r:g:b. Leaves *i at its last parameter.
+static bool
+extended_color(const vt::Params &params, int *i, uint32_t *color) {
+  const uint16_t *v = params.values;
+  int at = *i;
+  if (params.IsSub(at + 1)) {
+    int end = at + 1;
+    while (params.IsSub(end + 1)) end++;
+    *i = end;
+    int subs = end - at;
+    if (v[at + 1] == 5 && subs >= 2) {
+      *color = kPalette | std::min<uint32_t>(v[at + 2], 255);
+      return true;
+    }
+    if (v[at + 1] == 2 && subs >= 4) {
+      int rgb = subs >= 5 ? at + 3 : at + 2;
+      *color = kRgb | std::min<uint32_t>(v[rgb], 255) << 16 |
+               std::min<uint32_t>(v[rgb + 1], 255) << 8 | std::min<uint32_t>(v[rgb + 2], 255);
+      return true;
+    }
+    return false;
+  }
+  if (at + 2 < params.count && v[at + 1] == 5) {
+    *i = at + 2;
+    *color = kPalette | std::min<uint32_t>(v[at + 2], 255);
+    return true;
+  }
+  if (at + 4 < params.count && v[at + 1] == 2) {
+    *i = at + 4;
+    *color = kRgb | std::min<uint32_t>(v[at + 2], 255) << 16 |
+             std::min<uint32_t>(v[at + 3], 255) << 8 | std::min<uint32_t>(v[at + 4], 255);
+    return true;
+  }
+  *i = params.count;
+  return false;
+}
+
+void Model::Sgr(const vt::Params &params) {
+  Attr &attr = cursor.attr;
+  if (params.count == 0) {
+    attr = Attr();
+    return;
+  }
+  for (int i = 0; i < params.count; i++) {
+    int p = params.values[i];
+    uint32_t color;
+    switch (p) {
+      case 0: attr = Attr(); break;
+      case 1: attr.flags |= kBold; break;
+      case 2: attr.flags |= kDim; break;
+      case 3: attr.flags |= kItalic; break;
+      case 4:
+        // 4:0 is no underline, the other styles are all underlines here
+        if (params.IsSub(i + 1) && params.values[i + 1] == 0) attr.flags &= ~kUnderline;
+        else attr.flags |= kUnderline;
+        break;
+      case 5: case 6: attr.flags |= kBlink; break;
+      case 7: attr.flags |= kInverse; break;
+      case 8: attr.flags |= kHidden; break;
+      case 9: attr.flags |= kStrike; break;
+      case 21: attr.flags |= kUnderline; break;
+      case 22: attr.flags &= ~(kBold | kDim); break;
+      case 23: attr.flags &= ~kItalic; break;
+      case 24: attr.flags &= ~kUnderline; break;
+      case 25: attr.flags &= ~kBlink; break;
+      case 27: attr.flags &= ~kInverse; break;
+      case 28: attr.flags &= ~kHidden; break;
+      case 29: attr.flags &= ~kStrike; break;
+      case 38: if (extended_color(params, &i, &color)) attr.fg = color; break;
+      case 39: attr.fg = kDefault; break;
+      case 48: if (extended_color(params, &i, &color)) attr.bg = color; break;
+      case 49: attr.bg = kDefault; break;
+      case 58: extended_color(params, &i, &color); break;  // underline color
+      default:
+        if (p >= 30 && p <= 37) attr.fg = kPalette | (p - 30);
+        else if (p >= 40 && p <= 47) attr.bg = kPalette | (p - 40);
+        else if (p >= 90 && p <= 97) attr.fg = kPalette | (p - 90 + 8);
+        else if (p >= 100 && p <= 107) attr.bg = kPalette | (p - 100 + 8);
+        break;
+    }
+    // sub parameters not taken above
+    while (params.IsSub(i + 1)) i++;
+  }
+}
+
+void Model::SetMode(const vt::Params &params, char prefix, bool set) {
+  dirty = true;
+  for (int i = 0; i < params.count; i++) {
+    int mode = params.values[i];
+    if (prefix == 0) {
+      if (mode == 4) insert = set;
+      else if (mode == 20) newline_mode = set;
+      continue;
+    }
+    switch (mode) {
+      case 1: application_cursor = set; break;
+      case 6: cursor.origin = set; MoveTo(0, 0); break;
+      case 7: autowrap = set; break;
+      case 25: cursor_visible = set; break;
+      case 47: SwitchScreen(set, false); break;
+      case 1047: SwitchScreen(set, true); break;
+      case 1048: if (set) SaveCursor(); else RestoreCursor(); break;
+      case 1049:
+        if (set) {
+          SaveCursor();
+          SwitchScreen(true, true);
+        } else {
+          SwitchScreen(false, false);
+          RestoreCursor();
+        }
+        break;
+      case 2004: bracketed_paste = set; break;
+      default: break;
+    }
+  }
+}
+
+void Model::CsiDispatch(const vt::Params &params, char prefix,
+                        const char *intermediates, uint8_t final) {
+  if (intermediates[0] != 0) {
+    if (intermediates[0] == '!' && final == 'p') {
+      // DECSTR
+      cursor.attr = Attr();
+      cursor.origin = false;
+      cursor.wrap = false;
+      cursor.charsets[0] = cursor.charsets[1] = cursor.charsets[2] = cursor.charsets[3] = 'B';
+      cursor.gl = 0;
+      main.saved = alt.saved = Cursor();
+      top = 0;
+      bottom = rows - 1;
+      autowrap = true;
+      insert = false;
+      cursor_visible = true;
+      application_cursor = false;
+      dirty = true;
+    }
+    return;
+  }
+  if (prefix == '?') {
+    if (final == 'h' || final == 'l') SetMode(params, prefix, final == 'h');
+    return;
+  }
+  if (prefix != 0) return;
+
+  int n = params.Get(0, 1);
+  Line &line = Row(cursor.y);
+  switch (final) {
+    case '@': {  // ICH
+      n = std::min(n, cols - cursor.x);
+      Damage(cursor.y, cursor.x - 1, cols);
+      Unwide(&line, cursor.x);
+      std::copy_backward(line.cells.begin() + cursor.x, line.cells.end() - n, line.cells.end());
+      std::fill(line.cells.begin() + cursor.x, line.cells.begin() + cursor.x + n, Blank());
+      if (line.cells[cols - 1].attr.flags & kWide) {
+        line.cells[cols - 1].ch = 0;
+        line.cells[cols - 1].attr.flags &= ~kWide;
+      }
+      cursor.wrap = false;
+      break;
+    }
+    case 'P': {  // DCH
+      n = std::min(n, cols - cursor.x);
+      Damage(cursor.y, cursor.x - 1, cols);
+      Unwide(&line, cursor.x);
+      Unwide(&line, cursor.x + n - 1);
+      std::copy(line.cells.begin() + cursor.x + n, line.cells.end(), line.cells.begin() + cursor.x);
+      std::fill(line.cells.end() - n, line.cells.end(), Blank());
+      cursor.wrap = false;
+      break;
+    }
+    case 'A':  // CUU
+      cursor.y = std::max(cursor.y - n, cursor.y >= top ? top : 0);
+      cursor.wrap = false;
+      break;
+    case 'B':  // CUD, VPR
+    case 'e':
+      cursor.y = std::min(cursor.y + n, cursor.y <= bottom ? bottom : rows - 1);
+      cursor.wrap = false;
+      break;
+    case 'C':  // CUF, HPR
+    case 'a':
+      cursor.x = std::min(cursor.x + n, cols - 1);
+      cursor.wrap = false;
+      break;
+    case 'D':  // CUB
+      cursor.x = std::max(cursor.x - n, 0);
+      cursor.wrap = false;
+      break;
+    case 'E':  // CNL
+      cursor.y = std::min(cursor.y + n, cursor.y <= bottom ? bottom : rows - 1);
+      cursor.x = 0;
+      cursor.wrap = false;
+      break;
+    case 'F':  // CPL
+      cursor.y = std::max(cursor.y - n, cursor.y >= top ? top : 0);
+      cursor.x = 0;
+      cursor.wrap = false;
+      break;
+    case 'G':  // CHA, HPA
+    case '`':
+      cursor.x = std::min(n, cols) - 1;
+      cursor.wrap = false;
+      break;
+    case 'H':  // CUP, HVP
+    case 'f':
+      MoveTo(params.Get(1, 1) - 1, n - 1);
+      break;
+    case 'd':  // VPA
+      MoveTo(cursor.x, n - 1);
+      break;
+    case 'I':  // CHT
+      Tab(n);
+      break;
+    case 'Z':  // CBT
+      Tab(-n);
+      break;
+    case 'J':  // ED
+      switch (params.Get(0, 0)) {
+        case 0:
+          Erase(cursor.y, cursor.x, cols);
+          for (int y = cursor.y + 1; y < rows; y++) Erase(y, 0, cols);
+          break;
+        case 1:
+          for (int y = 0; y < cursor.y; y++) Erase(y, 0, cols);
+          Erase(cursor.y, 0, cursor.x + 1);
+          break;
+        case 2:
+          for (int y = 0; y < rows; y++) Erase(y, 0, cols);
+          break;
+        case 3:
+          scrollback.clear();
+          dirty = true;
+          break;
+      }
+      break;
+    case 'K':  // EL
+      switch (params.Get(0, 0)) {
+        case 0: Erase(cursor.y, cursor.x, cols); break;
+        case 1: Erase(cursor.y, 0, cursor.x + 1); break;
+        case 2: Erase(cursor.y, 0, cols); break;
+      }
+      break;
+    case 'L':  // IL
+      if (cursor.y >= top && cursor.y <= bottom) {
+        ScrollDown(cursor.y, bottom, n);
+        cursor.x = 0;
+        cursor.wrap = false;
+      }
+      break;
+    case 'M':  // DL
+      if (cursor.y >= top && cursor.y <= bottom) {
+        ScrollUp(cursor.y, bottom, n, false);
+        cursor.x = 0;
+        cursor.wrap = false;
+      }
+      break;
+    case 'S':  // SU
+      ScrollUp(top, bottom, n, true);
+      break;
+    case 'T':  // SD, with more parameters it starts mouse tracking
+      if (params.count <= 1) ScrollDown(top, bottom, n);
+      break;
+    case 'X':  // ECH
+      Erase(cursor.y, cursor.x, std::min(cursor.x + n, cols));
+      cursor.wrap = false;
+      break;
+    case 'b':  // REP
+      if (last != 0) {
+        n = std::min(n, cols * rows);
+        int columns = width::CodePoint(last);
+        for (int i = 0; i < n; i++) Put(last, columns);
+      }
+      break;
+    case 'g':  // TBC
+      if (params.Get(0, 0) == 0) tabs[cursor.x] = false;
+      else if (params.Get(0, 0) == 3) std::fill(tabs.begin(), tabs.end(), false);
+      break;
+    case 'h':  // SM, RM
+    case 'l':
+      SetMode(params, prefix, final == 'h');
+      break;
+    case 'm':  // SGR
+      Sgr(params);
+      break;
+    case 'r': {  // DECSTBM
+      int t = params.Get(0, 1) - 1;
+      int b = std::min(params.Get(1, rows), rows) - 1;
+      if (t < b) {
+        top = t;
+        bottom = b;
+        MoveTo(0, 0);
+      }
+      break;
+    }
+    case 's':  // SCOSC, SCORC
+      SaveCursor();
+      break;
+    case 'u':
+      RestoreCursor();
+      break;
+    default:
+      // reports (DA, DSR) have nobody to answer them here, window
+      // operations do not apply
+      break;
+  }
+}
+
+void Model::EscDispatch(const char *intermediates, uint8_t final) {
+  switch (intermediates[0]) {
+    case 0:
+      break;
+    case '(':  // designates G0 to G3
+    case ')':
+    case '*':
+    case '+':
+      cursor.charsets[intermediates[0] - '('] = (char)final;
+      return;
+    case '#':
+      if (final == '8') {
+        // DECALN fills the screen with E
+        top = 0;
+        bottom = rows - 1;
+        Cell fill;
+        fill.ch = 'E';
+        for (int y = 0; y < rows; y++) {
+          std::fill(Row(y).cells.begin(), Row(y).cells.end(), fill);
+          Row(y).wrapped = false;
+        }
+        DamageAll();
+        MoveTo(0, 0);
+      }
+      return;
+    default:
+      return;
+  }
+  switch (final) {
+    case '7': SaveCursor(); break;     // DECSC
+    case '8': RestoreCursor(); break;  // DECRC
+    case 'D': Index(); break;          // IND
+    case 'E':                          // NEL
+      cursor.x = 0;
+      Index();
+      break;
+    case 'M': ReverseIndex(); break;   // RI
+    case 'H': tabs[cursor.x] = true; break;  // HTS
+    case 'c': ResetLocked(); break;    // RIS
+    case 'n': cursor.gl = 2; break;    // LS2
+    case 'o': cursor.gl = 3; break;    // LS3
+    default: break;
+  }
+}
+
+void Model::OscDispatch(const std::string &data) {
+  size_t semi = data.find(';');
+  if (semi == std::string::npos) return;
+  std::string command = data.substr(0, semi);
+  if (command == "0" || command == "2") {
+    title = data.substr(semi + 1);
+    dirty = true;
+  }
+}
+
+void Model::ResizeGrid(Grid *g, int new_cols, int new_rows, Cursor *c, bool primary) {
+  std::vector<Line> &lines = g->lines;
+  std::rotate(lines.begin(), lines.begin() + g->first, lines.end());
+  g->first = 0;
+  int excess = (int)lines.size() - new_rows;
+  // blank lines below the cursor go first, then lines from the top
+  while (excess > 0 && (int)lines.size() - 1 > c->y) {
+    const Line &line = lines.back();
+    bool empty = true;
+    for (size_t x = 0; x < line.cells.size() && empty; x++) empty = blank(line.cells[x]);
+    if (!empty) break;
+    lines.pop_back();
+    excess--;
+  }
+  if (excess > 0) {
+    for (int i = 0; i < excess && primary; i++) Save(lines[i]);
+    lines.erase(lines.begin(), lines.begin() + excess);
+    c->y = std::max(0, c->y - excess);
+  }
+  // growing brings lines back from the scrollback
+  while ((int)lines.size() < new_rows && primary && !scrollback.empty()) {
+    Line line;
+    unpack(scrollback.back(), &line);
+    scrollback.pop_back();
+    lines.insert(lines.begin(), line);
+    c->y++;
+  }
+  lines.resize(new_rows);
+  for (size_t y = 0; y < lines.size(); y++) {
+    Line &line = lines[y];
+    line.cells.resize(new_cols);
+    Cell &end = line.cells[new_cols - 1];
+    if (end.attr.flags & kWide) {
+      end.ch = 0;
+      end.attr.flags &= ~kWide;
+    }
+  }
+  c->x = std::min(c->x, new_cols - 1);
+  c->y = std::min(c->y, new_rows - 1);
+  c->wrap = false;
+}
+
+void Model::Resize(int new_cols, int new_rows) {
+  std::lock_guard<std::mutex> lock(mutex);
+  new_cols = std::max(1, std::min(new_cols, kMaxSize));
+  new_rows = std::max(1, std::min(new_rows, kMaxSize));
+  if (new_cols == cols && new_rows == rows) return;
+  bool alternate = grid == &alt;
+  ResizeGrid(&main, new_cols, new_rows, alternate ? &main.saved : &cursor, true);
+  ResizeGrid(&alt, new_cols, new_rows, alternate ? &cursor : &alt.saved, false);
+  if (alternate) {
+    // the cursor of the main screen is moved with its lines
+    main.saved.x = std::min(main.saved.x, new_cols - 1);
+  }
+  alt.saved.y = std::min(alt.saved.y, new_rows - 1);
+  main.saved.y = std::min(main.saved.y, new_rows - 1);
+  int old_cols = cols;
+  cols = new_cols;
+  rows = new_rows;
+  top = 0;
+  bottom = rows - 1;
+  tabs.resize(cols, false);
+  for (int x = (old_cols + 7) / 8 * 8; x < cols; x += 8) tabs[x] = true;
+  DamageAll();
+  version++;
+  dirty = false;
+}
+
+void Model::FillInfo(Info *info) {
+  info->cols = cols;
+  info->rows = rows;
+  info->cursor_x = cursor.x;
+  info->cursor_y = cursor.y;
+  info->cursor_visible = cursor_visible;
+  info->alternate = grid == &alt;
+  info->application_cursor = application_cursor;
+  info->bracketed_paste = bracketed_paste;
+  info->scrollback = scrollback.size();
+  info->saved = saved;
+  info->version = version;
+  info->title = title;
+}
+
+Info Model::GetInfo() {
+  std::lock_guard<std::mutex> lock(mutex);
+  Info info;
+  FillInfo(&info);
+  return info;
+}
+
+void Model::Changes(uint64_t since, Info *info, std::vector<RowChange> *changes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  FillInfo(info);
+  changes->clear();
+  for (int y = 0; y < rows; y++) {
+    const Line &line = Row(y);
+    if (line.version <= since) continue;
+    changes->push_back(RowChange());
+    RowChange &change = changes->back();
+    change.y = y;
+    change.wrapped = line.wrapped;
+    // the columns are only known for the last version of the row
+    bool span = line.version == since + 1;
+    change.left = span ? line.left : 0;
+    change.right = span ? line.right : cols;
+    change.chars.resize(change.right - change.left);
+    change.attrs.resize(change.right - change.left);
+    for (int x = change.left; x < change.right; x++) {
+      const Cell &cell = line.cells[x];
+      std::string &chars = change.chars[x - change.left];
+      if (cell.ch >= kCluster) {
+        const std::u32string &cluster = clusters[cell.ch - kCluster];
+        for (size_t i = 0; i < cluster.size(); i++) append_utf8(cluster[i], &chars);
+      } else if (cell.ch != 0) {
+        append_utf8(cell.ch, &chars);
+      } else if (!(cell.attr.flags & kWideTail)) {
+        chars.push_back(' ');
+      }
+      change.attrs[x - change.left] = cell.attr;
+    }
+  }
+}
+
+const Line *Model::RowAt(int64_t y, Line *scratch) {
+  if (y < 0) {
+    int64_t i = (int64_t)scrollback.size() + y;
+    if (i < 0) return nullptr;
+    unpack(scrollback[i], scratch);
+    return scratch;
+  }
+  return y < rows ? &Row((int)y) : nullptr;
+}
+
+void Model::AppendText(const Line &line, std::string *out) {
+  size_t len = line.cells.size();
+  while (len > 0 && line.cells[len - 1].ch == 0) len--;
+  for (size_t x = 0; x < len; x++) {
+    const Cell &cell = line.cells[x];
+    if (cell.attr.flags & kWideTail) continue;
+    if (cell.ch == 0) {
+      out->push_back(' ');
+    } else if (cell.ch >= kCluster) {
+      const std::u32string &cluster = clusters[cell.ch - kCluster];
+      for (size_t i = 0; i < cluster.size(); i++) append_utf8(cluster[i], out);
+    } else {
+      append_utf8(cell.ch, out);
+    }
+  }
+}
+
+std::vector<std::string> Model::Text(int64_t start, int64_t end) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<std::string> text;
+  start = std::max(start, -(int64_t)scrollback.size());
+  end = std::min(end, (int64_t)rows);
+  Line scratch;
+  for (int64_t y = start; y < end; y++) {
+    text.push_back(std::string());
+    AppendText(*RowAt(y, &scratch), &text.back());
+  }
+  return text;
+}
+
+bool Model::GetCell(int x, int64_t y, Cell *cell, std::string *chars) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Line scratch;
+  const Line *line = RowAt(y, &scratch);
+  if (!line || x < 0 || x >= cols) return false;
+  // lines in the scrollback are cut after their last character
+  *cell = x < (int)line->cells.size() ? line->cells[x] : Cell();
+  chars->clear();
+  if (cell->ch >= kCluster) {
+    const std::u32string &cluster = clusters[cell->ch - kCluster];
+    for (size_t i = 0; i < cluster.size(); i++) append_utf8(cluster[i], chars);
+  } else if (cell->ch != 0) {
+    append_utf8(cell->ch, chars);
+  }
+  return true;
+}
+
+static void
+put_varint(uint64_t v, std::string *out) {
+  while (v >= 0x80) {
+    out->push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back((char)v);
+}
+
+static void
+put_token(uint64_t code, int kind, std::string *out) {
+  put_varint(code << 2 | kind, out);
+}
+
+void Model::SnapshotLine(const Line &line, std::string *out) {
+  int len = (int)line.cells.size();
+  while (len > 0 && blank(line.cells[len - 1])) len--;
+  // a wide character keeps the column it covers
+  if (len > 0 && len < (int)line.cells.size() && (line.cells[len - 1].attr.flags & kWide)) len++;
+  put_varint((uint64_t)len << 1 | (line.wrapped ? 1 : 0), out);
+  const uint16_t kAttrs = kWide - 1;
+  int x = 0;
+  while (x < len) {
+    const Attr &attr = line.cells[x].attr;
+    int end = x + 1;
+    while (end < len && line.cells[end].attr.fg == attr.fg && line.cells[end].attr.bg == attr.bg &&
+           (line.cells[end].attr.flags & kAttrs) == (attr.flags & kAttrs)) {
+      end++;
+    }
+    // a run does not split a wide character
+    if (end < len && (line.cells[end].attr.flags & kWideTail)) end++;
+    put_varint(end - x, out);
+    put_varint(attr.fg, out);
+    put_varint(attr.bg, out);
+    put_varint(attr.flags & kAttrs, out);
+    uint64_t repeat = 0;
+    const Cell *prev = nullptr;
+    for (; x < end; x++) {
+      const Cell &cell = line.cells[x];
+      if (cell.attr.flags & kWideTail) {
+        if (x > 0 && (line.cells[x - 1].attr.flags & kWide)) continue;
+      }
+      bool wide = (cell.attr.flags & kWide) && x + 1 < end;
+      if (prev && cell.ch < kCluster && cell.ch == prev->ch &&
+          wide == ((prev->attr.flags & kWide) != 0)) {
+        repeat++;
+        continue;
+      }
+      if (repeat > 0) put_token(repeat, kTokenRepeat, out);
+      repeat = 0;
+      if (cell.ch >= kCluster) {
+        const std::u32string &cluster = clusters[cell.ch - kCluster];
+        put_token(cluster[0], wide ? kTokenWide : kTokenChar, out);
+        for (size_t i = 1; i < cluster.size(); i++) put_token(cluster[i], kTokenCombine, out);
+        prev = nullptr;
+      } else {
+        put_token(cell.ch, wide ? kTokenWide : kTokenChar, out);
+        prev = &cell;
+      }
+    }
+    if (repeat > 0) put_token(repeat, kTokenRepeat, out);
+  }
+}
+
+void Model::Snapshot(size_t lines, std::string *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  out->append(kSnapshotMagic, sizeof(kSnapshotMagic));
+  put_varint(kSnapshotFormat, out);
+  uint32_t modes = 0;
+  if (cursor_visible) modes |= kSnapshotCursorVisible;
+  if (grid == &alt) modes |= kSnapshotAlternate;
+  if (application_cursor) modes |= kSnapshotApplicationCursor;
+  if (bracketed_paste) modes |= kSnapshotBracketedPaste;
+  if (autowrap) modes |= kSnapshotAutowrap;
+  if (cursor.origin) modes |= kSnapshotOrigin;
+  if (insert) modes |= kSnapshotInsert;
+  if (newline_mode) modes |= kSnapshotNewline;
+  if (cursor.wrap) modes |= kSnapshotWrapPending;
+  put_varint(modes, out);
+  put_varint(cols, out);
+  put_varint(rows, out);
+  put_varint(cursor.x, out);
+  put_varint(cursor.y, out);
+  put_varint(top, out);
+  put_varint(bottom, out);
+  put_varint(cursor.attr.fg, out);
+  put_varint(cursor.attr.bg, out);
+  put_varint(cursor.attr.flags & (kWide - 1), out);
+  put_varint(version, out);
+  put_varint(saved, out);
+  put_varint(title.size(), out);
+  out->append(title);
+  lines = std::min(lines, scrollback.size());
+  put_varint(lines, out);
+  Line scratch;
+  for (size_t i = scrollback.size() - lines; i < scrollback.size(); i++) {
+    unpack(scrollback[i], &scratch);
+    SnapshotLine(scratch, out);
+  }
+  for (int y = 0; y < rows; y++) SnapshotLine(Row(y), out);
+}
+
+/**
+ * Screen
+ */
+
+Napi::FunctionReference Screen::constructor;
+
+void Screen::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "Screen", {
+    InstanceMethod("write", &Screen::Write),
+    InstanceMethod("resize", &Screen::Resize),
+    InstanceMethod("reset", &Screen::Reset),
+    InstanceMethod("state", &Screen::GetState),
+    InstanceMethod("lines", &Screen::Lines),
+    InstanceMethod("cell", &Screen::GetCell),
+    InstanceMethod("changes", &Screen::Changes),
+    InstanceMethod("snapshot", &Screen::Snapshot)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("Screen", ctor);
+}
+
+std::shared_ptr<Model> Screen::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Model>();
+  }
+  return Napi::ObjectWrap<Screen>::Unwrap(value.As<Napi::Object>())->model;
+}
+
+static bool
+valid_size(Napi::Value value) {
+  return value.IsNumber() && value.As<Napi::Number>().Int64Value() >= 1 &&
+         value.As<Napi::Number>().Int64Value() <= kMaxSize;
+}
+
+Screen::Screen(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<Screen>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() != 1 || !info[0].IsObject()) {
+    Napi::Error::New(env, "Usage: new pty.Screen(options)").ThrowAsJavaScriptException();
+    return;
+  }
+  Napi::Object opt = info[0].As<Napi::Object>();
+  Napi::Value cols = opt.Get("cols");
+  Napi::Value rows = opt.Get("rows");
+  if (!valid_size(cols) || !valid_size(rows)) {
+    Napi::Error::New(env, "The screen size must be between 1 and 4096.").ThrowAsJavaScriptException();
+    return;
+  }
+  size_t lines = kScrollback;
+  Napi::Value scrollback = opt.Get("scrollback");
+  if (scrollback.IsNumber()) {
+    int64_t n = scrollback.As<Napi::Number>().Int64Value();
+    if (n < 0) {
+      Napi::Error::New(env, "The screen scrollback must not be negative.").ThrowAsJavaScriptException();
+      return;
+    }
+    lines = n;
+  }
+  model = std::make_shared<Model>(cols.As<Napi::Number>().Int32Value(),
+                                  rows.As<Napi::Number>().Int32Value(), lines);
+}
+
+Napi::Value Screen::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: screen.write(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    model->Write(buffer.Data(), buffer.Length());
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    model->Write(data.data(), data.size());
+  }
+  return env.Undefined();
+}
+
+Napi::Value Screen::Resize(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 2 || !valid_size(info[0]) || !valid_size(info[1])) {
+    Napi::Error::New(env, "Usage: screen.resize(cols, rows)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  model->Resize(info[0].As<Napi::Number>().Int32Value(), info[1].As<Napi::Number>().Int32Value());
+  return env.Undefined();
+}
+
+Napi::Value Screen::Reset(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  model->Reset();
+  return env.Undefined();
+}
+
+static void
+set_state(Napi::Env env, const Info &state, Napi::Object obj) {
+  obj.Set("cols", Napi::Number::New(env, state.cols));
+  obj.Set("rows", Napi::Number::New(env, state.rows));
+  obj.Set("cursorX", Napi::Number::New(env, state.cursor_x));
+  obj.Set("cursorY", Napi::Number::New(env, state.cursor_y));
+  obj.Set("cursorVisible", Napi::Boolean::New(env, state.cursor_visible));
+  obj.Set("alternate", Napi::Boolean::New(env, state.alternate));
+  obj.Set("applicationCursor", Napi::Boolean::New(env, state.application_cursor));
+  obj.Set("bracketedPaste", Napi::Boolean::New(env, state.bracketed_paste));
+  obj.Set("scrollback", Napi::Number::New(env, state.scrollback));
+  obj.Set("saved", Napi::Number::New(env, (double)state.saved));
+  obj.Set("version", Napi::Number::New(env, (double)state.version));
+  obj.Set("title", Napi::String::New(env, state.title));
+}
+
+Napi::Value Screen::GetState(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  Napi::Object obj = Napi::Object::New(env);
+  set_state(env, model->GetInfo(), obj);
+  return obj;
+}
+
+Napi::Value Screen::Lines(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+    Napi::Error::New(env, "Usage: screen.lines(start, end)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  std::vector<std::string> text = model->Text(info[0].As<Napi::Number>().Int64Value(),
+                                               info[1].As<Napi::Number>().Int64Value());
+  Napi::Array lines = Napi::Array::New(env, text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    lines.Set(i, Napi::String::New(env, text[i]));
+  }
+  return lines;
+}
+
+// Colors for JS: -1 is the default, 0 to 255 the palette and 0x1000000 plus
+// 0xRRGGBB a direct color.
+static double
+js_color(uint32_t color) {
+  if (color == kDefault) return -1;
+  if ((color & 0xFF000000) == kPalette) return color & 0xFF;
+  return 0x1000000 + (color & 0xFFFFFF);
+}
+
+Napi::Value Screen::GetCell(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+    Napi::Error::New(env, "Usage: screen.cell(x, y)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  Cell cell;
+  std::string chars;
+  if (!model->GetCell(info[0].As<Napi::Number>().Int32Value(),
+                      info[1].As<Napi::Number>().Int64Value(), &cell, &chars)) {
+    return env.Null();
+  }
+  uint16_t flags = cell.attr.flags;
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("chars", Napi::String::New(env, chars));
+  obj.Set("width", Napi::Number::New(env, (flags & kWide) ? 2 : (flags & kWideTail) ? 0 : 1));
+  obj.Set("fg", Napi::Number::New(env, js_color(cell.attr.fg)));
+  obj.Set("bg", Napi::Number::New(env, js_color(cell.attr.bg)));
+  obj.Set("bold", Napi::Boolean::New(env, (flags & kBold) != 0));
+  obj.Set("dim", Napi::Boolean::New(env, (flags & kDim) != 0));
+  obj.Set("italic", Napi::Boolean::New(env, (flags & kItalic) != 0));
+  obj.Set("underline", Napi::Boolean::New(env, (flags & kUnderline) != 0));
+  obj.Set("blink", Napi::Boolean::New(env, (flags & kBlink) != 0));
+  obj.Set("inverse", Napi::Boolean::New(env, (flags & kInverse) != 0));
+  obj.Set("hidden", Napi::Boolean::New(env, (flags & kHidden) != 0));
+  obj.Set("strikethrough", Napi::Boolean::New(env, (flags & kStrike) != 0));
+  return obj;
+}
+
+// The attributes flags for JS, kBold to kStrike, the width of a cell is told
+// by its characters.
+static const uint16_t kJsFlags = 0xFF;
+
+Napi::Value Screen::Changes(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !info[0].IsNumber() || info[0].As<Napi::Number>().DoubleValue() < 0) {
+    Napi::Error::New(env, "Usage: screen.changes(since)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  uint64_t since = (uint64_t)info[0].As<Napi::Number>().DoubleValue();
+  Info state;
+  std::vector<RowChange> changes;
+  model->Changes(since, &state, &changes);
+
+  Napi::Object obj = Napi::Object::New(env);
+  set_state(env, state, obj);
+  obj.Set("since", Napi::Number::New(env, (double)since));
+  Napi::Array lines = Napi::Array::New(env, changes.size());
+  int left = state.cols, right = 0, top = state.rows, bottom = 0;
+  for (size_t i = 0; i < changes.size(); i++) {
+    const RowChange &change = changes[i];
+    Napi::Object line = Napi::Object::New(env);
+    line.Set("y", Napi::Number::New(env, change.y));
+    line.Set("left", Napi::Number::New(env, change.left));
+    line.Set("right", Napi::Number::New(env, change.right));
+    line.Set("wrapped", Napi::Boolean::New(env, change.wrapped));
+    Napi::Array chars = Napi::Array::New(env, change.chars.size());
+    for (size_t x = 0; x < change.chars.size(); x++) {
+      chars.Set(x, Napi::String::New(env, change.chars[x]));
+    }
+    line.Set("chars", chars);
+    // runs of equal attributes
+    Napi::Array runs = Napi::Array::New(env);
+    size_t start = 0;
+    for (size_t x = 1; x <= change.attrs.size(); x++) {
+      if (x < change.attrs.size()) {
+        const Attr &a = change.attrs[x];
+        const Attr &b = change.attrs[start];
+        if (a.fg == b.fg && a.bg == b.bg && (a.flags & kJsFlags) == (b.flags & kJsFlags)) continue;
+      }
+      Napi::Object run = Napi::Object::New(env);
+      run.Set("start", Napi::Number::New(env, change.left + start));
+      run.Set("end", Napi::Number::New(env, change.left + x));
+      run.Set("fg", Napi::Number::New(env, js_color(change.attrs[start].fg)));
+      run.Set("bg", Napi::Number::New(env, js_color(change.attrs[start].bg)));
+      run.Set("flags", Napi::Number::New(env, change.attrs[start].flags & kJsFlags));
+      runs.Set(runs.Length(), run);
+      start = x;
+    }
+    line.Set("runs", runs);
+    lines.Set(i, line);
+    if (change.left < change.right) {
+      left = std::min(left, change.left);
+      right = std::max(right, change.right);
+      top = std::min(top, change.y);
+      bottom = change.y + 1;
+    }
+  }
+  obj.Set("lines", lines);
+  // the bounding box of the changed cells
+  if (left < right) {
+    Napi::Object rect = Napi::Object::New(env);
+    rect.Set("left", Napi::Number::New(env, left));
+    rect.Set("top", Napi::Number::New(env, top));
+    rect.Set("right", Napi::Number::New(env, right));
+    rect.Set("bottom", Napi::Number::New(env, bottom));
+    obj.Set("rect", rect);
+  } else {
+    obj.Set("rect", env.Null());
+  }
+  return obj;
+}
+
+Napi::Value Screen::Snapshot(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !info[0].IsNumber() || info[0].As<Napi::Number>().Int64Value() < 0) {
+    Napi::Error::New(env, "Usage: screen.snapshot(scrollback)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  std::string data;
+  model->Snapshot(info[0].As<Napi::Number>().Int64Value(), &data);
+  return Napi::Buffer<char>::Copy(env, data.data(), data.size());
+}
+
+}  // namespace screen
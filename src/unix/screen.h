@@ -0,0 +1,315 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * screen.h:
+ *   A headless model of a terminal screen. Output is parsed natively as it
+ *   is read and applied to a grid of cells with their attributes, a cursor,
+ *   an alternate screen and a bounded scrollback of lines, so that what a
+ *   terminal shows can be queried at any time without parsing the output in
+ *   JS. Lines are not reflowed on resize.
+ */
+
+#ifndef NODE_PTY_SCREEN_H_
+#define NODE_PTY_SCREEN_H_
+
+#include <napi.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vt.h"
+
+namespace screen {
+
+// Colors are kDefault, kPalette | index or kRgb | 0xRRGGBB.
+static const uint32_t kDefault = 0;
+static const uint32_t kPalette = 1u << 24;
+static const uint32_t kRgb = 2u << 24;
+
+enum Flags {
+  kBold = 1 << 0,
+  kDim = 1 << 1,
+  kItalic = 1 << 2,
+  kUnderline = 1 << 3,
+  kBlink = 1 << 4,
+  kInverse = 1 << 5,
+  kHidden = 1 << 6,
+  kStrike = 1 << 7,
+  kWide = 1 << 8,      // the first column of a double width character
+  kWideTail = 1 << 9   // the column it covers
+};
+
+struct Attr {
+  uint32_t fg;
+  uint32_t bg;
+  uint16_t flags;
+
+  Attr() : fg(kDefault), bg(kDefault), flags(0) {}
+  bool operator!=(const Attr &other) const {
+    return fg != other.fg || bg != other.bg || flags != other.flags;
+  }
+};
+
+// ch is 0 for a blank cell, code points from kCluster on index the clusters
+// of a character and its combining marks.
+struct Cell {
+  uint32_t ch;
+  Attr attr;
+
+  Cell() : ch(0) {}
+};
+
+static const uint32_t kCluster = 0x110000;
+
+// Snapshots start with kSnapshotMagic and the format, bump it on any change
+// to the layout. Then, all numbers as LEB128 varints:
+//   modes (kSnapshot*), cols, rows, cursor x, y, scroll region top, bottom,
+//   the attributes of the cursor (fg, bg, flags), version, saved lines,
+//   the title (length, UTF-8), the count of scrollback lines, the scrollback
+//   lines from the oldest and the rows of the screen.
+// A line is its columns << 1 | wrapped, blanks at its end left out, and runs
+// of columns with the same attributes: the columns, fg, bg and flags, then
+// cells as tokens of code point << 2 | kind (kToken*). Code point 0 is a
+// blank cell.
+static const char kSnapshotMagic[4] = { 'N', 'P', 'S', 'S' };
+static const uint32_t kSnapshotFormat = 1;
+
+enum SnapshotModes {
+  kSnapshotCursorVisible = 1 << 0,
+  kSnapshotAlternate = 1 << 1,
+  kSnapshotApplicationCursor = 1 << 2,
+  kSnapshotBracketedPaste = 1 << 3,
+  kSnapshotAutowrap = 1 << 4,
+  kSnapshotOrigin = 1 << 5,
+  kSnapshotInsert = 1 << 6,
+  kSnapshotNewline = 1 << 7,
+  kSnapshotWrapPending = 1 << 8
+};
+
+enum SnapshotTokens {
+  kTokenChar = 0,     // a character one column wide
+  kTokenWide = 1,     // a character covering two columns
+  kTokenRepeat = 2,   // the cell before, count more times
+  kTokenCombine = 3   // a mark combining with the character before
+};
+
+struct Line {
+  std::vector<Cell> cells;
+  bool wrapped;  // continues on the next line
+  // The version that last changed the line, and the columns [left, right)
+  // changed in it.
+  uint64_t version;
+  int left;
+  int right;
+
+  Line() : wrapped(false), version(0), left(0), right(0) {}
+};
+
+// A line that scrolled off the main screen, kept compact: the characters up
+// to its last non-blank cell and the runs of attributes over them.
+struct SavedLine {
+  struct Run {
+    uint32_t start;
+    Attr attr;
+  };
+  std::vector<uint32_t> chars;
+  std::vector<Run> runs;
+  bool wrapped;
+
+  SavedLine() : wrapped(false) {}
+};
+
+struct Info {
+  int cols;
+  int rows;
+  int cursor_x;
+  int cursor_y;
+  bool cursor_visible;
+  bool alternate;
+  bool application_cursor;
+  bool bracketed_paste;
+  size_t scrollback;  // lines held above the screen
+  uint64_t saved;     // lines that ever scrolled off the main screen
+  uint64_t version;
+  std::string title;
+
+  Info() : cols(0), rows(0), cursor_x(0), cursor_y(0), cursor_visible(true),
+           alternate(false), application_cursor(false), bracketed_paste(false),
+           scrollback(0), saved(0), version(0) {}
+};
+
+// A row changed since some version: the cells of columns [left, right),
+// their characters ('' for the column a wide character covers) and
+// attributes.
+struct RowChange {
+  int y;
+  int left;
+  int right;
+  bool wrapped;
+  std::vector<std::string> chars;
+  std::vector<Attr> attrs;
+};
+
+class Model : private vt::Handler {
+  public:
+    // Keeps up to scrollback lines that scrolled off the main screen.
+    Model(int cols, int rows, size_t scrollback);
+
+    // Thread-safe, output is written by hub I/O threads too.
+    void Write(const char *data, size_t len);
+    void Resize(int cols, int rows);
+    void Reset();
+
+    Info GetInfo();
+    // The text of rows [start, end), 0 is the top of the screen and the
+    // scrollback has negative rows, -1 is its newest line. Trailing blanks
+    // are left out.
+    std::vector<std::string> Text(int64_t start, int64_t end);
+    // The cell at column x of row y, false when there is none.
+    bool GetCell(int x, int64_t y, Cell *cell, std::string *chars);
+    // The rows changed after version since. Every write that changes what
+    // is shown, the cursor or the modes makes a new version. Only the
+    // columns changed are given when since is the version before the last
+    // change of a row, whole rows otherwise.
+    void Changes(uint64_t since, Info *info, std::vector<RowChange> *rows);
+    // Appends a snapshot of the screen shown, with up to lines of the
+    // scrollback, in the format of kSnapshotFormat.
+    void Snapshot(size_t lines, std::string *out);
+
+  private:
+    struct Cursor {
+      int x;
+      int y;
+      Attr attr;
+      bool origin;       // DECOM, rows count from the scroll region
+      bool wrap;         // the last column was written, the next character
+                         // wraps first
+      char charsets[4];  // G0 to G3, '0' for DEC special graphics
+      int gl;            // the set invoked into GL
+
+      Cursor() : x(0), y(0), origin(false), wrap(false), gl(0) {
+        charsets[0] = charsets[1] = charsets[2] = charsets[3] = 'B';
+      }
+    };
+
+    // The rows of a screen in a ring, row 0 is lines[first], so that
+    // scrolling the whole screen moves no lines.
+    struct Grid {
+      std::vector<Line> lines;
+      int first;
+      Cursor saved;
+
+      Grid() : first(0) {}
+    };
+
+    // vt::Handler
+    void PrintAscii(const char *data, size_t len) override;
+    void Print(uint32_t code) override;
+    void Execute(uint8_t code) override;
+    void CsiDispatch(const vt::Params &params, char prefix,
+                     const char *intermediates, uint8_t final) override;
+    void EscDispatch(const char *intermediates, uint8_t final) override;
+    void OscDispatch(const std::string &data) override;
+
+    void ResetLocked();
+    // Marks columns [from, to) of row y changed in the next version.
+    void Damage(int y, int from, int to);
+    void DamageAll();
+    void FillInfo(Info *info);
+    void Put(uint32_t ch, int width);
+    void Combine(uint32_t code);
+    // Drops the clusters no cell on the screens or in the scrollback holds.
+    void Sweep();
+    void Sgr(const vt::Params &params);
+    void SetMode(const vt::Params &params, char prefix, bool set);
+
+    Line &Row(int y) {
+      int i = grid->first + y;
+      return grid->lines[i < rows ? i : i - rows];
+    }
+    Cell Blank() const;
+    void Erase(int y, int from, int to);
+    void ClearRow(int y);
+    // Clears the halves of double width characters cut by writing at x.
+    void Unwide(Line *line, int x);
+    // Scrolls rows [from, to] up, the lines scrolled off the top of the main
+    // screen go to the scrollback when save is set.
+    void ScrollUp(int from, int to, int n, bool save);
+    void ScrollDown(int from, int to, int n);
+    void Index();
+    void ReverseIndex();
+    void Wrap();
+    void MoveTo(int x, int y);  // y relative to the region in origin mode
+    void Tab(int n);
+    void SaveCursor();
+    void RestoreCursor();
+    void SwitchScreen(bool alternate, bool clear);
+    // c is the cursor on the grid, primary is set for the main screen.
+    void ResizeGrid(Grid *g, int cols, int rows, Cursor *c, bool primary);
+    void Save(const Line &line);
+    void AppendText(const Line &line, std::string *out);
+    // Row y, unpacked into scratch when it is in the scrollback.
+    const Line *RowAt(int64_t y, Line *scratch);
+    void SnapshotLine(const Line &line, std::string *out);
+
+    std::mutex mutex;
+    vt::Parser parser;
+
+    int cols;
+    int rows;
+    Grid main;
+    Grid alt;
+    Grid *grid;  // the screen shown
+    std::deque<SavedLine> scrollback;
+    size_t scrollback_limit;
+    uint64_t saved;
+    uint64_t version;
+    bool dirty;  // the next version has changes
+    std::vector<std::u32string> clusters;
+    size_t sweep_skip;  // full clusters tables to leave unswept
+
+    Cursor cursor;
+    int top;      // the scroll region, inclusive
+    int bottom;
+    std::vector<bool> tabs;
+    uint32_t last;  // the last character printed, for REP
+    bool autowrap;
+    bool insert;
+    bool newline_mode;
+    bool cursor_visible;
+    bool application_cursor;
+    bool bracketed_paste;
+    std::string title;
+};
+
+// The JS handle of a model.
+class Screen : public Napi::ObjectWrap<Screen> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The model of a Screen object, null for anything else.
+    static std::shared_ptr<Model> Unwrap(Napi::Value value);
+
+    Screen(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Model> model;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Write(const Napi::CallbackInfo& info);
+    Napi::Value Resize(const Napi::CallbackInfo& info);
+    Napi::Value Reset(const Napi::CallbackInfo& info);
+    Napi::Value GetState(const Napi::CallbackInfo& info);
+    Napi::Value Lines(const Napi::CallbackInfo& info);
+    Napi::Value GetCell(const Napi::CallbackInfo& info);
+    Napi::Value Changes(const Napi::CallbackInfo& info);
+    Napi::Value Snapshot(const Napi::CallbackInfo& info);
+};
+
+}  // namespace screen
+
+#endif  // NODE_PTY_SCREEN_H_
@@ -0,0 +1,854 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * scrollback.cc:
+ *   A bounded store of terminal output with background compression and
+ *   spill files.
+ */
+
+#include "scrollback.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include "compress.h"
+
+namespace scrollback {
+
+// Bytes of output per segment, the unit of compression and eviction.
+static const size_t kSegmentSize = 64 * 1024;
+static const size_t kMinSegmentSize = 256;
+// Spill files are removed as a whole once their segments were dropped, with
+// a disk limit they are smaller so that it is not overshot by much.
+static const uint64_t kSpillFileSize = 64 * 1024 * 1024;
+// Output searched at once, the segments that may hold matches are searched
+// in windows of about this much; lines are searched whole up to this long.
+static const size_t kSearchWindow = 1024 * 1024;
+
+static std::atomic<uint64_t> next_store_id(0);
+
+/**
+ * Compressor
+ */
+
+// Indexes and compresses sealed segments of all stores on one background
+// thread, which lives as long as the process once started.
+class Compressor {
+  public:
+    static Compressor *Get() {
+      static Compressor *compressor = new Compressor();
+      return compressor;
+    }
+
+    void Queue(const std::shared_ptr<Store> &store,
+               const std::shared_ptr<Segment> &segment) {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(Job(store, segment));
+      if (!started) {
+        started = true;
+        std::thread(&Compressor::Run, this).detach();
+      }
+      cond.notify_one();
+    }
+
+  private:
+    struct Job {
+      std::weak_ptr<Store> store;
+      std::shared_ptr<Segment> segment;
+
+      Job(const std::shared_ptr<Store> &store, const std::shared_ptr<Segment> &segment)
+        : store(store), segment(segment) {}
+    };
+
+    Compressor() : started(false) {}
+
+    void Run() {
+      for (;;) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return !jobs.empty(); });
+        Job job = jobs.front();
+        jobs.pop_front();
+        lock.unlock();
+
+        std::shared_ptr<Store> store = job.store.lock();
+        if (store) store->Compress(job.segment);
+      }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    bool started;
+};
+
+/**
+ * Store
+ */
+
+Store::Store(const Options &options)
+  : options(options), id(next_store_id++), file_size(kSpillFileSize),
+    resident(0), active_lines(0), start(0), end(0), lines(0), memory(0),
+    index(0), last(0), destroyed(false), first_file(0), disk(0), spill_errors(0) {
+  // at least two segments fit, so that a full one can go while the next fills
+  size_t &segment_size = this->options.segment_size;
+  if (segment_size > options.limit / 2) segment_size = options.limit / 2;
+  if (segment_size < kMinSegmentSize) segment_size = kMinSegmentSize;
+  if (options.disk_limit > 0) {
+    file_size = std::min(file_size, std::max<uint64_t>(options.disk_limit / 4, segment_size));
+  }
+  active.reserve(segment_size);
+  active_lead[0] = active_lead[1] = 0;
+}
+
+Store::~Store() {
+  CloseFiles(true);
+}
+
+std::shared_ptr<Store> Store::Create(const Options &options) {
+  std::shared_ptr<Store> store = std::make_shared<Store>(options);
+  store->account = budget::Open(store);
+  return store;
+}
+
+void Store::Report() {
+  if (!account) return;
+  account->Set(budget::kScrollback, memory + index);
+  // reclaiming leaves the segment appended to and the indexes
+  account->SetFloor(active.size() + index);
+}
+
+void Store::Append(const char *data, size_t len) {
+  if (len == 0) return;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (destroyed) return;
+  last = data[len - 1];
+  while (len > 0) {
+    size_t n = std::min(len, options.segment_size - active.size());
+    size_t newlines = std::count(data, data + n, '\n');
+    active.append(data, n);
+    active_lines += newlines;
+    lines += newlines;
+    memory += n;
+    end += n;
+    data += n;
+    len -= n;
+    if (active.size() >= options.segment_size) Seal();
+  }
+  Evict(options.limit);
+  Report();
+}
+
+void Store::Seal() {
+  std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+  segment->offset = end - active.size();
+  segment->length = active.size();
+  segment->first_line = lines - active_lines;
+  segment->lines = active_lines;
+  segment->lead[0] = active_lead[0];
+  segment->lead[1] = active_lead[1];
+  active_lead[0] = active[active.size() - 2];
+  active_lead[1] = active[active.size() - 1];
+  segment->raw.swap(active);
+  segments.push_back(segment);
+
+  active.reserve(options.segment_size);
+  active_lines = 0;
+  Compressor::Get()->Queue(shared_from_this(), segment);
+}
+
+void Store::Evict(size_t limit) {
+  while (memory > limit && resident < segments.size()) {
+    if (options.directory.empty()) {
+      DropFront();
+      continue;
+    }
+    if (Spill(segments[resident].get())) {
+      resident++;
+      continue;
+    }
+    // the older spilled output goes too, so that what is held stays
+    // contiguous
+    spill_errors++;
+    while (resident > 0) DropFront();
+    DropFront();
+  }
+  while (options.disk_limit > 0 && disk > options.disk_limit && resident > 0) {
+    DropFront();
+  }
+}
+
+// Indexes a segment the compressor has not got to yet, before its raw data
+// is freed.
+void Store::Index(Segment *segment) {
+  if (segment->grams.Built()) return;
+  segment->grams.Build(segment->lead, segment->raw.data(), segment->raw.size());
+  index += segment->grams.Size();
+}
+
+// Packs a segment the compressor has not got to yet.
+void Store::Pack(Segment *segment) {
+  Index(segment);
+  std::string packed;
+  if (compress::Pack(segment->raw.data(), segment->raw.size(), &packed)) {
+    memory -= segment->raw.size();
+    memory += packed.size();
+    segment->packed.swap(packed);
+    std::string().swap(segment->raw);
+    segment->compressed = true;
+  }
+}
+
+bool Store::Spill(Segment *segment) {
+  Index(segment);
+  // packing here keeps the files small when the compressor fell behind
+  if (!segment->compressed && options.compress) Pack(segment);
+
+  const std::string &data = segment->compressed ? segment->packed : segment->raw;
+  File *file = SpillFile(data.size());
+  if (!file) return false;
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = write(file->fd, data.data() + done, data.size() - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      // files only hold whole segments
+      int r = ftruncate(file->fd, file->size);
+      (void)r;
+      return false;
+    }
+    done += n;
+  }
+
+  segment->file = first_file + files.size() - 1;
+  segment->file_offset = file->size;
+  segment->stored = data.size();
+  file->size += data.size();
+  file->segments++;
+  disk += data.size();
+  memory -= data.size();
+  std::string().swap(segment->raw);
+  std::string().swap(segment->packed);
+  return true;
+}
+
+// The newest spill file, or a new one when len would not fit.
+Store::File *Store::SpillFile(size_t len) {
+  if (!files.empty() &&
+      (files.back().size == 0 || files.back().size + len <= file_size)) {
+    return &files.back();
+  }
+  File file;
+  file.path = options.directory + "/node-pty-" + std::to_string(getpid()) + "-" +
+              std::to_string(id) + "-" + std::to_string(first_file + files.size()) +
+              ".scrollback";
+  file.fd = open(file.path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0600);
+  if (file.fd == -1) return NULL;
+  file.size = 0;
+  file.map = NULL;
+  file.mapped = 0;
+  file.segments = 0;
+  files.push_back(file);
+  return &files.back();
+}
+
+void Store::DropFront() {
+  std::shared_ptr<Segment> segment = segments.front();
+  segments.pop_front();
+  segment->dropped = true;
+  if (segment->file >= 0) {
+    resident--;
+    files[segment->file - first_file].segments--;
+    CloseFiles(false);
+  } else {
+    memory -= segment->compressed ? segment->packed.size() : segment->raw.size();
+  }
+  index -= segment->grams.Size();
+  start = segments.empty() ? end - active.size() : segments.front()->offset;
+}
+
+// Removes the oldest spill files without segments, or all of them.
+void Store::CloseFiles(bool all) {
+  while (!files.empty() && (all || files.front().segments == 0)) {
+    File &file = files.front();
+    if (file.map) munmap(file.map, file.mapped);
+    close(file.fd);
+    unlink(file.path.c_str());
+    disk -= file.size;
+    files.pop_front();
+    first_file++;
+  }
+}
+
+void Store::Compress(const std::shared_ptr<Segment> &segment) {
+  // spilling frees the raw data under the lock, so it is indexed and packed
+  // from a copy; segments are indexed before that, the raw data of one that
+  // is not is still there
+  std::string raw;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (segment->dropped || segment->grams.Built()) return;
+    raw = segment->raw;
+  }
+  search::Grams grams;
+  grams.Build(segment->lead, raw.data(), raw.size());
+  std::string packed;
+  bool packs = options.compress && compress::Pack(raw.data(), raw.size(), &packed);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (segment->dropped || segment->grams.Built()) return;
+  segment->grams.Swap(grams);
+  index += segment->grams.Size();
+  if (packs) {
+    memory -= segment->raw.size();
+    memory += packed.size();
+    segment->packed.swap(packed);
+    std::string().swap(segment->raw);
+    segment->compressed = true;
+  }
+  Report();
+}
+
+size_t Store::Reclaim(size_t bytes, bool evict) {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t held = memory;
+  if (evict) {
+    Evict(memory > bytes ? memory - bytes : 0);
+  } else if (options.compress) {
+    for (size_t i = resident; i < segments.size() && held - memory < bytes; i++) {
+      if (!segments[i]->compressed) Pack(segments[i].get());
+    }
+  }
+  Report();
+  return held - memory;
+}
+
+bool Store::Copy(const Segment &segment, size_t from, size_t to, std::string *out) {
+  const char *data;
+  size_t size;
+  if (segment.file >= 0) {
+    File &file = files[segment.file - first_file];
+    if (segment.file_offset + segment.stored > file.mapped) {
+      // the file grew since it was mapped
+      if (file.map) munmap(file.map, file.mapped);
+      void *map = mmap(NULL, file.size, PROT_READ, MAP_SHARED, file.fd, 0);
+      file.map = map == MAP_FAILED ? NULL : (char *)map;
+      file.mapped = file.map ? file.size : 0;
+      if (!file.map) return false;
+    }
+    data = file.map + segment.file_offset;
+    size = segment.stored;
+  } else if (segment.compressed) {
+    data = segment.packed.data();
+    size = segment.packed.size();
+  } else {
+    data = segment.raw.data();
+    size = segment.raw.size();
+  }
+
+  if (!segment.compressed) {
+    out->append(data + from, std::min(to, size) - std::min(from, size));
+    return true;
+  }
+  std::string raw;
+  if (!compress::Unpack(data, size, segment.length, &raw)) return false;
+  out->append(raw, from, to - from);
+  return true;
+}
+
+std::string Store::ReadLocked(uint64_t offset, size_t max, uint64_t *from) {
+  uint64_t pos = std::min(std::max(offset, start), end);
+  *from = pos;
+
+  std::string out;
+  // the last segment starting at or before pos
+  auto it = std::upper_bound(segments.begin(), segments.end(), pos,
+    [](uint64_t p, const std::shared_ptr<Segment> &s) { return p < s->offset; });
+  if (it != segments.begin()) --it;
+  for (; it != segments.end() && out.size() < max; ++it) {
+    const Segment &segment = **it;
+    if (pos >= segment.offset + segment.length) continue;
+    size_t begin = pos - segment.offset;
+    size_t stop = segment.length - begin > max - out.size() ? begin + (max - out.size()) : segment.length;
+    // the read ends before output that cannot be read, rather than leave a
+    // hole in it
+    if (!Copy(segment, begin, stop, &out)) return out;
+    pos = segment.offset + stop;
+  }
+
+  uint64_t active_start = end - active.size();
+  if (out.size() < max && pos < end) {
+    size_t begin = pos - active_start;
+    out.append(active, begin, std::min(active.size() - begin, max - out.size()));
+  }
+  return out;
+}
+
+std::string Store::Read(uint64_t offset, size_t max, uint64_t *from) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (account) account->Viewed();
+  return ReadLocked(offset, max, from);
+}
+
+std::string Store::Tail(size_t bytes, uint64_t *from) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (account) account->Viewed();
+  uint64_t held = end - start;
+  return ReadLocked(end - std::min((uint64_t)bytes, held), SIZE_MAX, from);
+}
+
+// Scans back for the need-th newline, pos is set to the offset after it.
+static bool
+find_newline(const char *data, size_t len, uint64_t offset, size_t *need, uint64_t *pos) {
+  for (size_t i = len; i > 0; i--) {
+    if (data[i - 1] == '\n' && --*need == 0) {
+      *pos = offset + i;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string Store::TailLines(size_t lines, uint64_t *from) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (account) account->Viewed();
+  if (lines == 0 || end == start) {
+    *from = end;
+    return std::string();
+  }
+
+  // the newline before the first line wanted, past the one ending the output
+  size_t need = lines + (last == '\n' ? 1 : 0);
+  uint64_t pos = start;
+  bool found = false;
+  if (active_lines >= need) {
+    found = find_newline(active.data(), active.size(), end - active.size(), &need, &pos);
+  } else {
+    need -= active_lines;
+  }
+  for (auto it = segments.rbegin(); !found && it != segments.rend(); ++it) {
+    const Segment &segment = **it;
+    if (segment.lines < need) {
+      need -= segment.lines;
+      continue;
+    }
+    std::string data;
+    if (!Copy(segment, 0, segment.length, &data)) {
+      // the lines after it are what can be read
+      pos = segment.offset + segment.length;
+      break;
+    }
+    found = find_newline(data.data(), data.size(), segment.offset, &need, &pos);
+  }
+  return ReadLocked(pos, SIZE_MAX, from);
+}
+
+// The offset after the line-th newline, where start_line < line <= lines.
+uint64_t Store::LineStart(uint64_t line) {
+  uint64_t active_line = lines - active_lines;
+  std::string copy;
+  const char *data = active.data();
+  size_t len = active.size();
+  uint64_t offset = end - active.size();
+  uint64_t need = line - active_line;
+  if (line <= active_line) {
+    // the last segment with fewer newlines before it, it holds the newline
+    auto it = std::lower_bound(segments.begin(), segments.end(), line,
+      [](const std::shared_ptr<Segment> &s, uint64_t l) { return s->first_line < l; });
+    --it;
+    // a read from a segment that cannot be read ends right away
+    if (!Copy(**it, 0, (*it)->length, &copy)) return (*it)->offset;
+    data = copy.data();
+    len = copy.size();
+    offset = (*it)->offset;
+    need = line - (*it)->first_line;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == '\n' && --need == 0) return offset + i + 1;
+  }
+  return end;
+}
+
+std::string Store::ReadLines(uint64_t line, uint64_t count, uint64_t *from,
+                             uint64_t *from_line) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (account) account->Viewed();
+  // the first line held may have lost its beginning
+  uint64_t start_line = segments.empty() ? lines - active_lines : segments.front()->first_line;
+  if (line > lines) {
+    *from_line = lines;
+    *from = end;
+    return std::string();
+  }
+  line = std::max(line, start_line);
+  *from_line = line;
+  uint64_t begin = line == start_line ? start : LineStart(line);
+  uint64_t stop = count == 0 ? begin : count > lines - line ? end : LineStart(line + count);
+  return ReadLocked(begin, stop - begin, from);
+}
+
+void Store::Search(const search::Query &query, size_t limit, std::vector<search::Hit> *hits) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (account) account->Viewed();
+  if (end == start) return;
+
+  // segment n is the active one, which is not indexed
+  size_t n = segments.size();
+  auto offset_of = [&](size_t i) { return i < n ? segments[i]->offset : end - active.size(); };
+  auto lines_of = [&](size_t i) { return i < n ? (uint64_t)segments[i]->lines : active_lines; };
+  auto starts_line = [&](size_t i) { return (i < n ? segments[i]->lead : active_lead)[1] == '\n'; };
+
+  // a literal ends in a segment that may hold it, or in the one after when
+  // it goes on from there; a literal longer than a segment may span more
+  // than two. A regex matches the lines around its literal, which windows
+  // are widened to.
+  bool regex = query.Regex();
+  size_t before = regex ? 0 : 1;
+  bool filter = query.Span() <= options.segment_size;
+  std::vector<bool> covered(n + 1, false);
+  for (size_t i = 0; i <= n; i++) {
+    // the bitmaps are apart in memory, so the ones ahead are loaded early
+    if (i + 16 < n) __builtin_prefetch(segments[i + 16].get());
+    if (i + 8 < n) query.Prefetch(segments[i + 8]->grams);
+    bool wanted = i == n ? !active.empty() :
+      !filter || query.MayMatch(i > 0 ? &segments[i - 1]->grams : NULL, segments[i]->grams);
+    if (!wanted) continue;
+    for (size_t j = i >= before ? i - before : 0; j <= i; j++) covered[j] = true;
+  }
+
+  size_t window = std::max<size_t>(2, kSearchWindow / options.segment_size);
+  uint64_t found = 0;  // matches before it were found in the window before
+  for (size_t first = 0; first <= n && hits->size() < limit; first++) {
+    if (!covered[first]) continue;
+    size_t last = first;
+    while (last < n && covered[last + 1]) last++;
+    for (size_t s = first; hits->size() < limit; s += window - before) {
+      size_t e = std::min(last, s + window - 1);
+      size_t from = s;
+      size_t to = e;
+      while (regex && from > 0 && !starts_line(from) && offset_of(s) - offset_of(from) < kSearchWindow) {
+        if (lines_of(--from) > 0) break;
+      }
+      while (regex && to < n && !starts_line(to + 1) && offset_of(to + 1) - offset_of(e) < kSearchWindow) {
+        if (lines_of(++to) > 0) break;
+      }
+      uint64_t stop = to < n ? segments[to]->offset + segments[to]->length : end;
+      uint64_t at;
+      std::string data = ReadLocked(offset_of(from), stop - offset_of(from), &at);
+      uint64_t line = from < n ? segments[from]->first_line : lines - active_lines;
+      query.Find(data, at, line, found, from == 0 || starts_line(from), to == n, limit, hits);
+      if (!hits->empty()) found = hits->back().offset + hits->back().length;
+      if (e == last) break;
+    }
+    first = last;
+  }
+}
+
+void Store::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < segments.size(); i++) segments[i]->dropped = true;
+  segments.clear();
+  resident = 0;
+  CloseFiles(true);
+  active.clear();
+  active_lines = 0;
+  memory = 0;
+  index = 0;
+  start = end;
+  Report();
+}
+
+void Store::Destroy() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < segments.size(); i++) segments[i]->dropped = true;
+  segments.clear();
+  resident = 0;
+  CloseFiles(true);
+  std::string().swap(active);
+  active_lines = 0;
+  memory = 0;
+  index = 0;
+  start = end;
+  destroyed = true;
+  Report();
+}
+
+Stats Store::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  Stats stats;
+  stats.start = start;
+  stats.end = end;
+  stats.start_line = segments.empty() ? lines - active_lines : segments.front()->first_line;
+  stats.end_line = lines;
+  stats.memory = memory;
+  stats.index = index;
+  stats.disk = disk;
+  stats.segments = segments.size() + (active.empty() ? 0 : 1);
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (segments[i]->compressed) stats.compressed++;
+  }
+  stats.spilled = resident;
+  stats.files = files.size();
+  stats.spill_errors = spill_errors;
+  return stats;
+}
+
+/**
+ * Scrollback
+ */
+
+Napi::FunctionReference Scrollback::constructor;
+
+void Scrollback::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function ctor = DefineClass(env, "Scrollback", {
+    InstanceMethod("write", &Scrollback::Write),
+    InstanceMethod("read", &Scrollback::Read),
+    InstanceMethod("tail", &Scrollback::Tail),
+    InstanceMethod("tailLines", &Scrollback::TailLines),
+    InstanceMethod("readLines", &Scrollback::ReadLines),
+    InstanceMethod("search", &Scrollback::Search),
+    InstanceMethod("clear", &Scrollback::Clear),
+    InstanceMethod("destroy", &Scrollback::Destroy),
+    InstanceMethod("markViewed", &Scrollback::MarkViewed),
+    InstanceMethod("stats", &Scrollback::GetStats)
+  });
+  constructor = Napi::Persistent(ctor);
+  constructor.SuppressDestruct();
+
+  exports.Set("Scrollback", ctor);
+}
+
+std::shared_ptr<Store> Scrollback::Unwrap(Napi::Value value) {
+  if (!value.IsObject() || constructor.IsEmpty() ||
+      !value.As<Napi::Object>().InstanceOf(constructor.Value())) {
+    return std::shared_ptr<Store>();
+  }
+  return Napi::ObjectWrap<Scrollback>::Unwrap(value.As<Napi::Object>())->store;
+}
+
+Scrollback::Scrollback(const Napi::CallbackInfo& info)
+  : Napi::ObjectWrap<Scrollback>(info) {
+  Napi::Env env(info.Env());
+
+  if (info.Length() != 1 || !info[0].IsObject()) {
+    Napi::Error::New(env, "Usage: new pty.Scrollback(options)").ThrowAsJavaScriptException();
+    return;
+  }
+  Napi::Object opt = info[0].As<Napi::Object>();
+  Options options;
+  options.segment_size = kSegmentSize;
+  Napi::Value limit = opt.Get("limit");
+  Napi::Value segment_size = opt.Get("segmentSize");
+  if (!limit.IsNumber() || limit.As<Napi::Number>().Int64Value() < 1 ||
+      (segment_size.IsNumber() && segment_size.As<Napi::Number>().Int64Value() < 1)) {
+    Napi::Error::New(env, "The scrollback limit and segment size must be positive.").ThrowAsJavaScriptException();
+    return;
+  }
+  options.limit = limit.As<Napi::Number>().Int64Value();
+  if (segment_size.IsNumber()) {
+    options.segment_size = segment_size.As<Napi::Number>().Int64Value();
+  }
+  Napi::Value compress = opt.Get("compress");
+  options.compress = !compress.IsBoolean() || compress.As<Napi::Boolean>().Value();
+
+  Napi::Value directory = opt.Get("directory");
+  if (directory.IsString()) {
+    options.directory = directory.As<Napi::String>().Utf8Value();
+    if (access(options.directory.c_str(), W_OK | X_OK) == -1) {
+      std::string msg = "Cannot spill scrollback to " + options.directory + ": " + strerror(errno);
+      Napi::Error::New(env, msg).ThrowAsJavaScriptException();
+      return;
+    }
+  }
+  Napi::Value disk_limit = opt.Get("diskLimit");
+  if (disk_limit.IsNumber()) {
+    int64_t bytes = disk_limit.As<Napi::Number>().Int64Value();
+    if (bytes < 1) {
+      Napi::Error::New(env, "The scrollback disk limit must be positive.").ThrowAsJavaScriptException();
+      return;
+    }
+    options.disk_limit = bytes;
+  }
+  store = Store::Create(options);
+}
+
+Napi::Value Scrollback::Write(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: scrollback.write(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    store->Append(buffer.Data(), buffer.Length());
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    store->Append(data.data(), data.size());
+  }
+  return env.Undefined();
+}
+
+static Napi::Value
+result(Napi::Env env, uint64_t offset, const std::string &data) {
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("offset", Napi::Number::New(env, (double)offset));
+  obj.Set("data", Napi::Buffer<char>::Copy(env, data.data(), data.size()));
+  return obj;
+}
+
+// Non-negative integer arguments, SIZE_MAX when absent.
+static bool
+size_arg(const Napi::CallbackInfo& info, size_t i, uint64_t *value) {
+  if (info.Length() <= i || info[i].IsUndefined()) {
+    *value = SIZE_MAX;
+    return true;
+  }
+  if (!info[i].IsNumber()) return false;
+  double n = info[i].As<Napi::Number>().DoubleValue();
+  if (!(n >= 0)) return false;
+  *value = n >= (double)SIZE_MAX ? SIZE_MAX : (uint64_t)n;
+  return true;
+}
+
+Napi::Value Scrollback::Read(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  uint64_t offset, max;
+  if (info.Length() < 1 || info[0].IsUndefined() ||
+      !size_arg(info, 0, &offset) || !size_arg(info, 1, &max)) {
+    Napi::Error::New(env, "Usage: scrollback.read(offset, length)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  uint64_t from;
+  std::string data = store->Read(offset, max, &from);
+  return result(env, from, data);
+}
+
+Napi::Value Scrollback::Tail(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  uint64_t bytes;
+  if (info.Length() != 1 || !size_arg(info, 0, &bytes)) {
+    Napi::Error::New(env, "Usage: scrollback.tail(bytes)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  uint64_t from;
+  std::string data = store->Tail(bytes, &from);
+  return result(env, from, data);
+}
+
+Napi::Value Scrollback::TailLines(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  uint64_t lines;
+  if (info.Length() != 1 || !size_arg(info, 0, &lines)) {
+    Napi::Error::New(env, "Usage: scrollback.tailLines(lines)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  uint64_t from;
+  std::string data = store->TailLines(lines, &from);
+  return result(env, from, data);
+}
+
+Napi::Value Scrollback::ReadLines(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  uint64_t line, count;
+  if (info.Length() < 1 || info[0].IsUndefined() ||
+      !size_arg(info, 0, &line) || !size_arg(info, 1, &count)) {
+    Napi::Error::New(env, "Usage: scrollback.readLines(line, count)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  uint64_t from, from_line;
+  std::string data = store->ReadLines(line, count, &from, &from_line);
+  Napi::Value obj = result(env, from, data);
+  obj.As<Napi::Object>().Set("line", Napi::Number::New(env, (double)from_line));
+  return obj;
+}
+
+Napi::Value Scrollback::Search(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  uint64_t limit;
+  if (info.Length() < 3 || !info[0].IsString() || !info[1].IsBoolean() ||
+      !info[2].IsBoolean() || !size_arg(info, 3, &limit)) {
+    Napi::Error::New(env, "Usage: scrollback.search(query, regex, caseInsensitive, limit)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  search::Query query;
+  std::string error;
+  if (!query.Compile(info[0].As<Napi::String>().Utf8Value(), info[1].As<Napi::Boolean>().Value(),
+                     info[2].As<Napi::Boolean>().Value(), &error)) {
+    Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  std::vector<search::Hit> hits;
+  store->Search(query, limit, &hits);
+
+  Napi::Array matches = Napi::Array::New(env, hits.size());
+  for (size_t i = 0; i < hits.size(); i++) {
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("offset", Napi::Number::New(env, (double)hits[i].offset));
+    obj.Set("length", Napi::Number::New(env, hits[i].length));
+    obj.Set("line", Napi::Number::New(env, (double)hits[i].line));
+    matches.Set(i, obj);
+  }
+  return matches;
+}
+
+Napi::Value Scrollback::Clear(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  store->Clear();
+  return env.Undefined();
+}
+
+Napi::Value Scrollback::Destroy(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  store->Destroy();
+  return env.Undefined();
+}
+
+Napi::Value Scrollback::MarkViewed(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  store->account->Viewed();
+  return env.Undefined();
+}
+
+Napi::Value Scrollback::GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  Stats stats = store->GetStats();
+  Napi::Object obj = Napi::Object::New(env);
+  obj.Set("start", Napi::Number::New(env, (double)stats.start));
+  obj.Set("end", Napi::Number::New(env, (double)stats.end));
+  obj.Set("startLine", Napi::Number::New(env, (double)stats.start_line));
+  obj.Set("endLine", Napi::Number::New(env, (double)stats.end_line));
+  obj.Set("memory", Napi::Number::New(env, stats.memory));
+  obj.Set("index", Napi::Number::New(env, stats.index));
+  obj.Set("disk", Napi::Number::New(env, (double)stats.disk));
+  obj.Set("segments", Napi::Number::New(env, stats.segments));
+  obj.Set("compressed", Napi::Number::New(env, stats.compressed));
+  obj.Set("spilled", Napi::Number::New(env, stats.spilled));
+  obj.Set("files", Napi::Number::New(env, stats.files));
+  obj.Set("spillErrors", Napi::Number::New(env, stats.spill_errors));
+  return obj;
+}
+
+}  // namespace scrollback
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * scrollback.h:
+ *   A bounded native store of terminal output. Output is appended to a raw
+ *   segment, full segments are sealed and compressed on a background thread
+ *   and the oldest segments are dropped once the store holds more than its
+ *   limit, or spilled to append-only files in a directory and read back
+ *   through memory maps. Bytes are addressed by their offset in the whole
+ *   output and lines by the number of newlines before them, both stay valid
+ *   as older output is dropped. Sealed segments are indexed by their
+ *   trigrams for searching, see search.h.
+ */
+
+#ifndef NODE_PTY_SCROLLBACK_H_
+#define NODE_PTY_SCROLLBACK_H_
+
+#include <napi.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "budget.h"
+#include "search.h"
+
+namespace scrollback {
+
+// Output of [offset, offset + length), raw until it was compressed. A
+// spilled segment has no data in memory, it is stored bytes at file_offset
+// of a spill file.
+struct Segment {
+  uint64_t offset;
+  size_t length;
+  uint64_t first_line;  // newlines before it
+  size_t lines;         // newlines in it
+  std::string raw;
+  std::string packed;
+  bool compressed;
+  bool dropped;         // evicted or cleared while being compressed
+  int64_t file;         // the spill file, -1 while in memory
+  uint64_t file_offset;
+  size_t stored;
+  char lead[2];         // the bytes before it
+  search::Grams grams;  // built before the raw data is freed
+
+  Segment() : offset(0), length(0), first_line(0), lines(0), compressed(false),
+              dropped(false), file(-1), file_offset(0), stored(0) {
+    lead[0] = lead[1] = 0;
+  }
+};
+
+struct Options {
+  size_t limit;             // bytes of memory
+  size_t segment_size;
+  bool compress;
+  std::string directory;    // spills to files here when not empty
+  uint64_t disk_limit;      // bytes of spill files, 0 for no limit
+
+  Options() : limit(0), segment_size(0), compress(true), disk_limit(0) {}
+};
+
+struct Stats {
+  uint64_t start;       // offset of the oldest byte held
+  uint64_t end;         // offset after the newest byte
+  uint64_t start_line;  // newlines before start
+  uint64_t end_line;    // newlines before end
+  size_t memory;        // bytes held, compressed or not
+  size_t index;         // bytes of the trigrams of the segments
+  uint64_t disk;        // bytes in spill files
+  size_t segments;
+  size_t compressed;
+  size_t spilled;
+  size_t files;
+  size_t spill_errors;  // segments dropped as they could not be spilled
+
+  Stats() : start(0), end(0), start_line(0), end_line(0), memory(0), index(0), disk(0),
+            segments(0), compressed(0), spilled(0), files(0), spill_errors(0) {}
+};
+
+class Store : public std::enable_shared_from_this<Store>,
+              public budget::Reclaimable {
+  public:
+    // Holds up to limit bytes of memory in segments of segment_size bytes.
+    explicit Store(const Options &options);
+    ~Store();
+    // A store with an account in the memory budget.
+    static std::shared_ptr<Store> Create(const Options &options);
+
+    // Thread-safe, output is appended by hub I/O threads too.
+    void Append(const char *data, size_t len);
+
+    // Output from offset on, at most max bytes. The offset actually read
+    // from is returned in from, later than asked when that was dropped.
+    std::string Read(uint64_t offset, size_t max, uint64_t *from);
+    // The last bytes, or the last lines where a final newline ends the last
+    // line.
+    std::string Tail(size_t bytes, uint64_t *from);
+    std::string TailLines(size_t lines, uint64_t *from);
+    // Count lines from the start of line on, line 0 starts the output. The
+    // line actually read from is returned in from_line.
+    std::string ReadLines(uint64_t line, uint64_t count, uint64_t *from,
+                          uint64_t *from_line);
+    // Appends the matches of query in the output held, oldest first, while
+    // there are fewer than limit hits.
+    void Search(const search::Query &query, size_t limit, std::vector<search::Hit> *hits);
+    void Clear();
+    // Drops all output and removes the spill files, later output is ignored.
+    void Destroy();
+    Stats GetStats();
+
+    // Called by the compressor for a sealed segment, it is indexed too.
+    void Compress(const std::shared_ptr<Segment> &segment);
+    // Called by the memory budget: packs the segments the compressor has not
+    // got to yet, or spills or drops the oldest ones.
+    size_t Reclaim(size_t bytes, bool evict) override;
+
+    // charged with the memory held, reads mark it viewed
+    std::shared_ptr<budget::Account> account;
+
+  private:
+    // An append-only spill file, mapped up to mapped bytes for reads.
+    struct File {
+      std::string path;
+      int fd;
+      uint64_t size;
+      char *map;
+      size_t mapped;
+      size_t segments;  // spilled segments still held in it
+    };
+
+    void Seal();
+    // Spills or drops the oldest segments while more than limit is held.
+    void Evict(size_t limit);
+    void Index(Segment *segment);
+    void Pack(Segment *segment);
+    bool Spill(Segment *segment);
+    File *SpillFile(size_t len);
+    void DropFront();
+    void CloseFiles(bool all);
+    void Report();
+    // Appends [from, to) of the segment to out, relative to its start.
+    // False when its spill file cannot be mapped or it cannot be unpacked.
+    bool Copy(const Segment &segment, size_t from, size_t to, std::string *out);
+    std::string ReadLocked(uint64_t offset, size_t max, uint64_t *from);
+    uint64_t LineStart(uint64_t line);
+
+    Options options;
+    uint64_t id;         // names the spill files
+    uint64_t file_size;  // starts another spill file beyond it
+
+    std::mutex mutex;
+    std::deque<std::shared_ptr<Segment> > segments;  // sealed, oldest first
+    size_t resident;  // index of the oldest segment in memory, the ones
+                      // before it are spilled
+    std::string active;                              // the newest output
+    size_t active_lines;
+    char active_lead[2];                             // the bytes before it
+    uint64_t start;
+    uint64_t end;
+    uint64_t lines;  // newlines before end
+    size_t memory;
+    size_t index;  // bytes of grams, charged to the account but not the limit
+    char last;  // the newest byte
+    bool destroyed;
+
+    std::deque<File> files;  // oldest first
+    int64_t first_file;      // the number of files.front()
+    uint64_t disk;
+    size_t spill_errors;
+};
+
+// The JS handle of a store.
+class Scrollback : public Napi::ObjectWrap<Scrollback> {
+  public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    // The store of a Scrollback object, null for anything else.
+    static std::shared_ptr<Store> Unwrap(Napi::Value value);
+
+    Scrollback(const Napi::CallbackInfo& info);
+
+    std::shared_ptr<Store> store;
+
+  private:
+    static Napi::FunctionReference constructor;
+
+    Napi::Value Write(const Napi::CallbackInfo& info);
+    Napi::Value Read(const Napi::CallbackInfo& info);
+    Napi::Value Tail(const Napi::CallbackInfo& info);
+    Napi::Value TailLines(const Napi::CallbackInfo& info);
+    Napi::Value ReadLines(const Napi::CallbackInfo& info);
+    Napi::Value Search(const Napi::CallbackInfo& info);
+    Napi::Value Clear(const Napi::CallbackInfo& info);
+    Napi::Value Destroy(const Napi::CallbackInfo& info);
+    Napi::Value MarkViewed(const Napi::CallbackInfo& info);
+    Napi::Value GetStats(const Napi::CallbackInfo& info);
+};
+
+}  // namespace scrollback
+
+#endif  // NODE_PTY_SCROLLBACK_H_
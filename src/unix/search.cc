@@ -0,0 +1,286 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * search.cc:
+ *   Trigram bitmaps of scrollback segments and the queries run over them.
+ */
+
+#include "search.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace search {
+
+static inline uint32_t fold(unsigned char c) {
+  return (unsigned)(c - 'A') < 26u ? c + 32 : c;
+}
+
+// Spreads the 24 bits of a trigram over the high bits a bitmap takes.
+static inline uint32_t gram_key(uint32_t gram) {
+  return gram * 0x9E3779B1u;
+}
+
+/**
+ * Grams
+ */
+
+void Grams::Build(const char *lead, const char *data, size_t len) {
+  size_t n = 512;
+  int order = 9;
+  while (n < len / 4) {
+    n <<= 1;
+    order++;
+  }
+  shift = 32 - order;
+  bits.assign(n / 64, 0);
+
+  const unsigned char *p = (const unsigned char *)data;
+  uint32_t gram = fold(lead[0]) << 8 | fold(lead[1]);
+  for (size_t i = 0; i < len; i++) {
+    gram = ((gram << 8) | fold(p[i])) & 0xFFFFFF;
+    uint32_t bit = gram_key(gram) >> shift;
+    bits[bit >> 6] |= (uint64_t)1 << (bit & 63);
+  }
+}
+
+/**
+ * Query
+ */
+
+static void end_run(std::string *run, std::string *best) {
+  if (run->size() > best->size()) *best = *run;
+  run->clear();
+}
+
+// Drops the last character of run, which a quantifier makes optional.
+static void drop_last(std::string *run) {
+  while (!run->empty() && ((unsigned char)run->back() & 0xC0) == 0x80) run->pop_back();
+  if (!run->empty()) run->pop_back();
+}
+
+// The end of what the escape of a letter or digit at source[i - 1] is
+// followed by as part of it: the hex digits of \xHH and \uHHHH, the letter
+// of \cX, the digits of a backreference or octal escape, the braces of
+// \u{...}, \p{...} and the name of \k<...>.
+static size_t escape_end(const std::string &source, size_t i) {
+  char escaped = source[i - 1];
+  size_t n = 0;
+  switch (escaped) {
+    case 'x':
+      while (n < 2 && i + n < source.size() && isxdigit((unsigned char)source[i + n])) n++;
+      return i + n;
+    case 'u':
+    case 'p':
+    case 'P':
+      if (i < source.size() && source[i] == '{') {
+        size_t close = source.find('}', i);
+        return close == std::string::npos ? source.size() : close + 1;
+      }
+      if (escaped != 'u') return i;
+      while (n < 4 && i + n < source.size() && isxdigit((unsigned char)source[i + n])) n++;
+      return i + n;
+    case 'c':
+      return i < source.size() && isalpha((unsigned char)source[i]) ? i + 1 : i;
+    case 'k':
+      if (i < source.size() && source[i] == '<') {
+        size_t close = source.find('>', i);
+        return close == std::string::npos ? source.size() : close + 1;
+      }
+      return i;
+  }
+  if (escaped >= '0' && escaped <= '9') {
+    while (i < source.size() && source[i] >= '0' && source[i] <= '9') i++;
+  }
+  return i;
+}
+
+// The longest run of characters every match of an ECMAScript regex holds,
+// empty when none was found. Groups, classes and escapes of anything but
+// punctuation end runs, an alternation outside of groups leaves none.
+static std::string required_literal(const std::string &source) {
+  std::string best, run;
+  int depth = 0;
+  size_t i = 0;
+  while (i < source.size()) {
+    char c = source[i];
+    if (c == '\\') {
+      if (i + 1 >= source.size()) break;
+      char escaped = source[i + 1];
+      i += 2;
+      if (depth > 0) {
+        if (isalnum((unsigned char)escaped)) i = escape_end(source, i);
+        continue;
+      }
+      if (isalnum((unsigned char)escaped)) {
+        // what the escape stands for is not known here, nor is its payload
+        // part of the run
+        i = escape_end(source, i);
+        end_run(&run, &best);
+      } else {
+        run += escaped;
+      }
+      continue;
+    }
+    if (c == '[') {
+      for (i++; i < source.size() && source[i] != ']'; i++) {
+        if (source[i] == '\\') i++;
+      }
+      i++;
+      if (depth == 0) end_run(&run, &best);
+      continue;
+    }
+    i++;
+    if (depth > 0) {
+      if (c == '(') depth++;
+      if (c == ')') depth--;
+      continue;
+    }
+    switch (c) {
+      case '|':
+        return std::string();
+      case '(':
+        depth++;
+        end_run(&run, &best);
+        break;
+      case '*':
+      case '?':
+        drop_last(&run);
+        end_run(&run, &best);
+        break;
+      case '{':
+        drop_last(&run);
+        end_run(&run, &best);
+        while (i < source.size() && source[i - 1] != '}') i++;
+        break;
+      case '+':
+      case ')':
+      case '.':
+      case '^':
+      case '$':
+        end_run(&run, &best);
+        break;
+      default:
+        run += c;
+    }
+  }
+  end_run(&run, &best);
+  return best;
+}
+
+bool Query::Compile(const std::string &text, bool regex, bool icase, std::string *error) {
+  if (text.empty()) {
+    *error = "The search query must not be empty.";
+    return false;
+  }
+  this->regex = regex;
+  this->icase = icase;
+  if (regex) {
+    std::string message;
+    if (!pattern.Compile(text, icase, &message)) {
+      *error = "Invalid regex: " + message;
+      return false;
+    }
+    literal = required_literal(text);
+  } else {
+    literal = text;
+  }
+
+  if (icase) {
+    for (size_t i = 0; i < literal.size(); i++) literal[i] = fold(literal[i]);
+  }
+  keys.clear();
+  for (size_t i = 2; i < literal.size(); i++) {
+    const unsigned char *p = (const unsigned char *)literal.data() + i - 2;
+    keys.push_back(gram_key(fold(p[0]) << 16 | fold(p[1]) << 8 | fold(p[2])));
+  }
+  return true;
+}
+
+bool Query::MayMatch(const Grams *before, const Grams &grams) const {
+  if (keys.empty() || !grams.Built() || (before && !before->Built())) return true;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (!grams.Has(keys[i]) && !(before && before->Has(keys[i]))) return false;
+  }
+  return true;
+}
+
+void Query::Find(const std::string &data, uint64_t offset, uint64_t line, uint64_t from,
+                 bool first_whole, bool last_whole, size_t limit,
+                 std::vector<Hit> *hits) const {
+  // literals are found in a folded copy, matches keep the offsets
+  std::string folded;
+  const char *hay = data.data();
+  if (icase && !literal.empty()) {
+    folded.resize(data.size());
+    for (size_t i = 0; i < data.size(); i++) folded[i] = fold(data[i]);
+    hay = folded.data();
+  }
+  if (regex) {
+    FindRegex(hay, data, offset, line, from, first_whole, last_whole, limit, hits);
+  } else {
+    FindLiteral(hay, data, offset, line, from, limit, hits);
+  }
+}
+
+void Query::FindLiteral(const char *hay, const std::string &data, uint64_t offset,
+                        uint64_t line, uint64_t from, size_t limit,
+                        std::vector<Hit> *hits) const {
+  size_t pos = from > offset ? std::min<uint64_t>(from - offset, data.size()) : 0;
+  size_t counted = 0;
+  while (hits->size() < limit && pos < data.size()) {
+    const char *p = (const char *)memmem(hay + pos, data.size() - pos, literal.data(), literal.size());
+    if (!p) break;
+    size_t at = p - hay;
+    line += std::count(data.data() + counted, data.data() + at, '\n');
+    counted = at;
+    hits->push_back(Hit(offset + at, literal.size(), line));
+    pos = at + literal.size();
+  }
+}
+
+void Query::FindRegex(const char *hay, const std::string &data, uint64_t offset,
+                      uint64_t line, uint64_t from, bool first_whole, bool last_whole,
+                      size_t limit, std::vector<Hit> *hits) const {
+  const char *base = data.data();
+  size_t size = data.size();
+  size_t pos = 0;
+  if (!first_whole) {
+    const char *newline = (const char *)memchr(base, '\n', size);
+    if (!newline) return;
+    pos = newline - base + 1;
+    line++;
+  }
+  size_t counted = pos;
+  while (hits->size() < limit && pos < size) {
+    // only lines with the literal may match
+    size_t start = pos;
+    if (!literal.empty()) {
+      const char *p = (const char *)memmem(hay + pos, size - pos, literal.data(), literal.size());
+      if (!p) break;
+      start = p - hay;
+      while (start > pos && base[start - 1] != '\n') start--;
+    }
+    const char *newline = (const char *)memchr(base + start, '\n', size - start);
+    if (!newline && !last_whole) break;
+    size_t end = newline ? newline - base : size;
+    line += std::count(base + counted, base + start, '\n');
+    counted = start;
+
+    size_t stop = end > start && base[end - 1] == '\r' ? end - 1 : end;
+    size_t at = 0, length = 0;
+    for (size_t next = 0; hits->size() < limit &&
+         pattern.Search(base + start, stop - start, next, &at, &length);) {
+      // empty matches are skipped as nothing to show
+      next = at + std::max<size_t>(length, 1);
+      if (length == 0 || offset + start + at < from) continue;
+      hits->push_back(Hit(offset + start + at, length, line));
+      if (next > stop - start) break;
+    }
+    pos = end + 1;
+  }
+}
+
+}  // namespace search
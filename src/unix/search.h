@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * search.h:
+ *   Search over the scrollback. Each sealed segment keeps a bitmap of the
+ *   trigrams in it (ASCII case folded), so a search only unpacks and scans
+ *   the segments that may hold the literal of the query, or the literal a
+ *   regex cannot match without. Regexes run on the linear-time matcher of
+ *   expect(), a long line does not take them deep.
+ */
+
+#ifndef NODE_PTY_SEARCH_H_
+#define NODE_PTY_SEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "expect.h"
+
+namespace search {
+
+// The trigrams of a segment hashed into a bitmap of about a bit per 4 bytes
+// of output, which holds 3% of the output in memory.
+class Grams {
+  public:
+    Grams() : shift(0) {}
+
+    // Indexes the trigrams ending in data, lead holds the 2 bytes before it.
+    void Build(const char *lead, const char *data, size_t len);
+    bool Built() const { return !bits.empty(); }
+    // Whether a trigram with the key may be in the segment.
+    bool Has(uint32_t key) const {
+      uint32_t bit = key >> shift;
+      return (bits[bit >> 6] >> (bit & 63)) & 1;
+    }
+    size_t Size() const { return bits.size() * sizeof(uint64_t); }
+    // Starts loading the word of the bit of key.
+    void Prefetch(uint32_t key) const {
+      if (Built()) __builtin_prefetch(&bits[(key >> shift) >> 6]);
+    }
+    void Swap(Grams &other) { bits.swap(other.bits); std::swap(shift, other.shift); }
+
+  private:
+    std::vector<uint64_t> bits;
+    int shift;
+};
+
+struct Hit {
+  uint64_t offset;
+  size_t length;
+  uint64_t line;  // newlines before it
+
+  Hit(uint64_t offset, size_t length, uint64_t line)
+    : offset(offset), length(length), line(line) {}
+};
+
+class Query {
+  public:
+    Query() : regex(false), icase(false) {}
+
+    // False with error set when the query is empty or not a valid regex.
+    // Case is ignored for ASCII letters with icase.
+    bool Compile(const std::string &text, bool regex, bool icase, std::string *error);
+
+    // Whether a segment with grams may hold a match, before holds the grams
+    // of the segment before it for matches across both. Segments not
+    // indexed yet may hold anything.
+    bool MayMatch(const Grams *before, const Grams &grams) const;
+    // Starts loading what MayMatch looks at first of grams.
+    void Prefetch(const Grams &grams) const {
+      if (!keys.empty()) grams.Prefetch(keys[0]);
+    }
+    // The length of the literal filtered on, a match spans at least it.
+    size_t Span() const { return literal.size(); }
+    bool Regex() const { return regex; }
+
+    // Appends the matches in data, the output from offset on with line
+    // newlines before it, that start at from or later while there are fewer
+    // than limit hits. Regexes match within lines, a line cut off at the
+    // start of data is skipped unless first_whole, one cut off at its end
+    // unless last_whole.
+    void Find(const std::string &data, uint64_t offset, uint64_t line, uint64_t from,
+              bool first_whole, bool last_whole, size_t limit,
+              std::vector<Hit> *hits) const;
+
+  private:
+    void FindLiteral(const char *hay, const std::string &data, uint64_t offset,
+                     uint64_t line, uint64_t from, size_t limit,
+                     std::vector<Hit> *hits) const;
+    void FindRegex(const char *hay, const std::string &data, uint64_t offset,
+                   uint64_t line, uint64_t from, bool first_whole, bool last_whole,
+                   size_t limit, std::vector<Hit> *hits) const;
+
+    bool regex;
+    bool icase;
+    std::string literal;  // folded with icase, empty for a regex without one
+    std::vector<uint32_t> keys;  // of the trigrams of the literal
+    expect::Regex pattern;
+};
+
+}  // namespace search
+
+#endif  // NODE_PTY_SEARCH_H_
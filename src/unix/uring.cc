@@ -0,0 +1,238 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * uring.cc:
+ *   A minimal io_uring(7) ring without liburing.
+ *
+ * See:
+ *   man io_uring_setup
+ *   man io_uring_enter
+ *   https://kernel.dk/io_uring.pdf
+ */
+
+#include "uring.h"
+
+#if defined(NODE_PTY_URING)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace uring {
+
+static int
+uring_setup(unsigned entries, struct io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+Ring::Ring()
+  : enters(0), fd(-1), sq_ring(MAP_FAILED), sq_ring_size(0),
+    cq_ring(MAP_FAILED), cq_ring_size(0), sqes((struct io_uring_sqe *)MAP_FAILED),
+    sqes_size(0), tail(0), to_submit(0), failed(0) {}
+
+Ring::~Ring() {
+  if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+  if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+  if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+  // closing the ring cancels requests still in flight
+  if (fd != -1) close(fd);
+}
+
+bool Ring::Init(unsigned entries, std::string *error) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+#if defined(IORING_SETUP_COOP_TASKRUN)
+  // no interrupts to run completions, the ring is only used by its thread
+  params.flags = IORING_SETUP_COOP_TASKRUN;
+#endif
+  fd = uring_setup(entries, &params);
+#if defined(IORING_SETUP_COOP_TASKRUN)
+  if (fd == -1 && errno == EINVAL) {
+    memset(&params, 0, sizeof(params));
+    fd = uring_setup(entries, &params);
+  }
+#endif
+  if (fd == -1) {
+    *error = std::string("io_uring_setup(2) failed: ") + strerror(errno);
+    return false;
+  }
+
+  // Pty reads must be armed by the kernel instead of blocking a worker
+  // thread each, and completions must not be dropped when the hub has more
+  // reads in flight than the completion queue holds.
+  unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_FAST_POLL;
+  if ((params.features & required) != required) {
+    *error = "io_uring lacks fast poll, no-drop or single mmap (kernel < 5.7)";
+    return false;
+  }
+
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (cq_ring_size > sq_ring_size) sq_ring_size = cq_ring_size;
+  cq_ring_size = sq_ring_size;
+
+  sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    *error = std::string("mmap(2) of the io_uring failed: ") + strerror(errno);
+    return false;
+  }
+  cq_ring = sq_ring;
+
+  sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe *)mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    *error = std::string("mmap(2) of the io_uring failed: ") + strerror(errno);
+    return false;
+  }
+
+  char *sq = (char *)sq_ring;
+  sq_head = (unsigned *)(sq + params.sq_off.head);
+  sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  sq_array = (unsigned *)(sq + params.sq_off.array);
+  sq_entries = params.sq_entries;
+
+  char *cq = (char *)cq_ring;
+  cq_head = (unsigned *)(cq + params.cq_off.head);
+  cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  tail = *sq_tail;
+  return true;
+}
+
+struct io_uring_sqe *Ring::Next() {
+  while (!failed && tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+    int r = Enter(0);
+    // the kernel holds completions it has no room for, which must be
+    // reaped before it accepts more requests
+    if (r == -EBUSY || r == -EAGAIN) Stash();
+    else if (r < 0) failed = r;
+  }
+  if (failed) {
+    memset(&spare, 0, sizeof(spare));
+    return &spare;
+  }
+  unsigned index = tail & *sq_mask;
+  struct io_uring_sqe *sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array[index] = index;
+  tail++;
+  to_submit++;
+  return sqe;
+}
+
+void Ring::Stash() {
+  unsigned head = *cq_head;
+  unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != end; head++) {
+    struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+    Completion c = { cqe->user_data, cqe->res, cqe->flags };
+    backlog.push_back(c);
+  }
+  __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+void Ring::Read(int target, uint64_t data, uint16_t group, uint32_t len) {
+  struct io_uring_sqe *sqe = Next();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = target;
+  sqe->off = (uint64_t)-1;  // the current position, ptys are streams
+  sqe->len = len;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = group;
+  sqe->user_data = data;
+}
+
+void Ring::ReadInto(int target, uint64_t data, void *buf, uint32_t len) {
+  struct io_uring_sqe *sqe = Next();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = target;
+  sqe->off = (uint64_t)-1;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->user_data = data;
+}
+
+void Ring::Write(int target, uint64_t data, const void *buf, uint32_t len) {
+  struct io_uring_sqe *sqe = Next();
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = target;
+  sqe->off = (uint64_t)-1;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->user_data = data;
+}
+
+void Ring::Cancel(uint64_t target, uint64_t data) {
+  struct io_uring_sqe *sqe = Next();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = target;
+  sqe->user_data = data;
+}
+
+void Ring::Provide(uint16_t group, void *addr, uint32_t len, uint16_t count,
+                   uint16_t bid, uint64_t data) {
+  struct io_uring_sqe *sqe = Next();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->off = bid;
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = len;
+  sqe->buf_group = group;
+  sqe->user_data = data;
+}
+
+int Ring::Enter(unsigned min_complete) {
+  if (failed) return failed;
+  // completions stashed away are ready already
+  if (!backlog.empty()) min_complete = 0;
+  __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+  for (;;) {
+    enters++;
+    int n = uring_enter(fd, to_submit, min_complete,
+                        min_complete ? IORING_ENTER_GETEVENTS : 0);
+    if (n >= 0) {
+      to_submit -= n;
+      return n;
+    }
+    if (errno == EINTR) continue;
+    // EBUSY/EAGAIN: completions must be reaped first, the caller does that
+    // and enters again with the rest still queued
+    return -errno;
+  }
+}
+
+unsigned Ring::Reap(Completion *out, unsigned max) {
+  unsigned n = 0;
+  size_t stashed = backlog.size() < max ? backlog.size() : max;
+  for (; n < stashed; n++) out[n] = backlog[n];
+  backlog.erase(backlog.begin(), backlog.begin() + stashed);
+  unsigned head = *cq_head;
+  unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  while (head != end && n < max) {
+    struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+    out[n].data = cqe->user_data;
+    out[n].res = cqe->res;
+    out[n].flags = cqe->flags;
+    n++;
+    head++;
+  }
+  __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+}  // namespace uring
+
+#endif  // NODE_PTY_URING
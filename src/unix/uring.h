@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * uring.h:
+ *   A minimal io_uring(7) submission/completion ring over the raw system
+ *   calls, for reading and writing many ptys with one io_uring_enter(2) per
+ *   loop turn. Only available on Linux with io_uring headers of 5.7 or newer
+ *   (NODE_PTY_URING), the kernel may still refuse it at runtime.
+ */
+
+#ifndef NODE_PTY_URING_H_
+#define NODE_PTY_URING_H_
+
+#include <stdint.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// provided buffers and fast poll arrived together in 5.7
+#if defined(IORING_FEAT_FAST_POLL)
+#define NODE_PTY_URING 1
+#endif
+#endif
+#endif
+
+#if defined(NODE_PTY_URING)
+
+#include <string>
+#include <vector>
+
+namespace uring {
+
+struct Completion {
+  uint64_t data;
+  int32_t res;
+  uint32_t flags;
+};
+
+class Ring {
+  public:
+    Ring();
+    ~Ring();
+
+    // Sets up a ring of at least the given number of submission entries.
+    // Fails with a reason when the kernel lacks io_uring or a feature the
+    // hub relies on, callers then fall back to readiness polling.
+    bool Init(unsigned entries, std::string *error);
+
+    // Queues a read of up to len bytes into a buffer the kernel picks from
+    // the provided group once data is available.
+    void Read(int fd, uint64_t data, uint16_t group, uint32_t len);
+    // Queues a read into buf.
+    void ReadInto(int fd, uint64_t data, void *buf, uint32_t len);
+    void Write(int fd, uint64_t data, const void *buf, uint32_t len);
+    // Cancels the request queued with target.
+    void Cancel(uint64_t target, uint64_t data);
+    // Hands count buffers of len bytes starting at addr to the group, with
+    // ids from bid.
+    void Provide(uint16_t group, void *addr, uint32_t len, uint16_t count,
+                 uint16_t bid, uint64_t data);
+
+    // Submits the queued requests and waits for min_complete completions,
+    // returns -errno on failure. Once submitting failed for good, requests
+    // are dropped and it returns that error.
+    int Enter(unsigned min_complete);
+
+    // Moves up to max completions to out.
+    unsigned Reap(Completion *out, unsigned max);
+
+    // The number of io_uring_enter(2) calls made.
+    uint64_t enters;
+
+  private:
+    // The entry of the next request, submitting the queued ones first when
+    // the submission queue is full.
+    struct io_uring_sqe *Next();
+    // Moves the completions in the ring to backlog, making room for more.
+    void Stash();
+
+    int fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    unsigned tail;        // local submission tail
+    unsigned to_submit;   // queued but not submitted yet
+
+    // completions reaped to submit, handed out before those in the ring
+    std::vector<Completion> backlog;
+    int failed;  // -errno once submitting failed for good, else 0
+    struct io_uring_sqe spare;  // takes requests once failed
+};
+
+}  // namespace uring
+
+#endif  // NODE_PTY_URING
+
+#endif  // NODE_PTY_URING_H_
@@ -0,0 +1,299 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * vt.cc:
+ *   The VT500-series escape sequence parser.
+ */
+
+#include "vt.h"
+
+#include <string.h>
+
+namespace vt {
+
+// OSC strings longer than this are cut, they carry titles and paths.
+static const size_t kMaxOsc = 4096;
+static const uint32_t kReplacement = 0xFFFD;
+
+Parser::Parser(Handler *handler) : handler(handler) {
+  Reset();
+}
+
+void Parser::Reset() {
+  state = kGround;
+  code = 0;
+  need = 0;
+  Clear();
+}
+
+void Parser::Clear() {
+  params.count = 0;
+  params.sub = 0;
+  param_started = false;
+  prefix = 0;
+  intermediates[0] = intermediates[1] = intermediates[2] = 0;
+  intermediate_count = 0;
+  ignoring = false;
+}
+
+void Parser::Collect(uint8_t c) {
+  if (intermediate_count < 2) {
+    intermediates[intermediate_count++] = (char)c;
+  } else {
+    ignoring = true;
+  }
+}
+
+void Parser::Param(uint8_t c) {
+  if (c == ';' || c == ':') {
+    if (!param_started) {
+      // an empty parameter before the separator
+      if (params.count < kMaxParams) params.values[params.count++] = 0;
+      else ignoring = true;
+    }
+    param_started = false;
+    if (params.count < kMaxParams) {
+      if (c == ':') params.sub |= 1u << params.count;
+    } else {
+      ignoring = true;
+    }
+    return;
+  }
+  if (!param_started) {
+    if (params.count >= kMaxParams) {
+      ignoring = true;
+      return;
+    }
+    params.values[params.count++] = 0;
+    param_started = true;
+  }
+  uint32_t v = params.values[params.count - 1] * 10u + (c - '0');
+  params.values[params.count - 1] = v > 0xFFFF ? 0xFFFF : (uint16_t)v;
+}
+
+void Parser::Enter(State next) {
+  // exit actions
+  if (state == kOscString) handler->OscDispatch(osc);
+  if (state == kDcsPassthrough) handler->DcsUnhook();
+
+  state = next;
+
+  // entry actions
+  switch (next) {
+    case kEscape:
+    case kCsiEntry:
+    case kDcsEntry:
+      Clear();
+      break;
+    case kOscString:
+      osc.clear();
+      break;
+    default:
+      break;
+  }
+}
+
+void Parser::Utf8(uint8_t c) {
+  if (need > 0) {
+    if ((c & 0xC0) == 0x80) {
+      code = (code << 6) | (c & 0x3F);
+      if (--need == 0) {
+        // overlong forms and surrogates were rejected at the lead byte
+        // where possible, the rest here
+        if (code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) code = kReplacement;
+        handler->Print(code);
+      }
+      return;
+    }
+    // a sequence cut short
+    need = 0;
+    handler->Print(kReplacement);
+    if (c < 0x80) return;  // handled by the caller
+  }
+  if (c >= 0xC2 && c <= 0xDF) {
+    code = c & 0x1F;
+    need = 1;
+  } else if (c >= 0xE0 && c <= 0xEF) {
+    code = c & 0x0F;
+    need = 2;
+  } else if (c >= 0xF0 && c <= 0xF4) {
+    code = c & 0x07;
+    need = 3;
+  } else {
+    handler->Print(kReplacement);
+  }
+}
+
+// Whether all bytes of the word are printable ASCII, 0x20 to 0x7E: none
+// is below 0x20 and none above 0x7E.
+static inline bool
+printable(uint64_t w) {
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t highs = 0x8080808080808080ULL;
+  uint64_t below = (w - ones * 0x20) & ~w & highs;
+  uint64_t above = ((w + ones) | w) & highs;
+  return (below | above) == 0;
+}
+
+size_t Parser::Ground(const char *data, size_t len) {
+  size_t i = 0;
+  while (i + 8 <= len) {
+    uint64_t w;
+    memcpy(&w, data + i, 8);
+    if (!printable(w)) break;
+    i += 8;
+  }
+  while (i < len && (uint8_t)data[i] >= 0x20 && (uint8_t)data[i] < 0x7F) i++;
+  if (i > 0) handler->PrintAscii(data, i);
+  return i;
+}
+
+size_t Parser::Csi(const char *data, size_t len) {
+  Clear();
+  size_t i = 0;
+  if (i < len && data[i] >= 0x3C && data[i] <= 0x3F) prefix = data[i++];
+  for (; i < len; i++) {
+    uint8_t c = (uint8_t)data[i];
+    if (c >= 0x30 && c <= 0x3B && intermediate_count == 0) {
+      Param(c);
+    } else if (c >= 0x20 && c < 0x30) {
+      Collect(c);
+    } else if (c >= 0x40 && c < 0x7F) {
+      if (!ignoring) handler->CsiDispatch(params, prefix, intermediates, c);
+      state = kGround;
+      return i + 1;
+    } else {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+void Parser::Write(const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = (uint8_t)data[i];
+
+    if (need > 0) {
+      // continues the sequence, or cuts it short and starts over
+      Utf8(c);
+      if (c >= 0x80) continue;
+    }
+    if (state == kGround && c >= 0x20 && c < 0x7F) {
+      i += Ground(data + i, len - i) - 1;
+      continue;
+    }
+
+    // anywhere
+    if (c == 0x18 || c == 0x1A) {
+      if (state == kOscString || state == kDcsPassthrough) Enter(kGround);
+      handler->Execute(c);
+      state = kGround;
+      continue;
+    }
+    if (c == 0x1B) {
+      Enter(kEscape);
+      continue;
+    }
+
+    switch (state) {
+      case kGround:
+        if (c < 0x20) handler->Execute(c);
+        else if (c >= 0x80) Utf8(c);
+        // DEL is ignored
+        break;
+
+      case kEscape:
+        if (c < 0x20) handler->Execute(c);
+        else if (c < 0x30) { Collect(c); state = kEscapeIntermediate; }
+        else if (c == '[') {
+          size_t used = Csi(data + i + 1, len - i - 1);
+          if (used > 0) i += used;
+          else Enter(kCsiEntry);
+        }
+        else if (c == ']') Enter(kOscString);
+        else if (c == 'P') Enter(kDcsEntry);
+        else if (c == 'X' || c == '^' || c == '_') Enter(kSosPmApcString);
+        else if (c < 0x7F) { handler->EscDispatch(intermediates, c); state = kGround; }
+        break;
+
+      case kEscapeIntermediate:
+        if (c < 0x20) handler->Execute(c);
+        else if (c < 0x30) Collect(c);
+        else if (c < 0x7F) {
+          if (!ignoring) handler->EscDispatch(intermediates, c);
+          state = kGround;
+        }
+        break;
+
+      case kCsiEntry:
+      case kCsiParam:
+        if (c < 0x20) handler->Execute(c);
+        else if (c < 0x30) { Collect(c); state = kCsiIntermediate; }
+        else if (c <= 0x3B) { Param(c); state = kCsiParam; }
+        else if (c < 0x40) {
+          // a private marker only leads the sequence
+          if (state == kCsiEntry) { prefix = (char)c; state = kCsiParam; }
+          else state = kCsiIgnore;
+        } else if (c < 0x7F) {
+          if (!ignoring) handler->CsiDispatch(params, prefix, intermediates, c);
+          state = kGround;
+        }
+        break;
+
+      case kCsiIntermediate:
+        if (c < 0x20) handler->Execute(c);
+        else if (c < 0x30) Collect(c);
+        else if (c < 0x40) state = kCsiIgnore;
+        else if (c < 0x7F) {
+          if (!ignoring) handler->CsiDispatch(params, prefix, intermediates, c);
+          state = kGround;
+        }
+        break;
+
+      case kCsiIgnore:
+        if (c < 0x20) handler->Execute(c);
+        else if (c >= 0x40 && c < 0x7F) state = kGround;
+        break;
+
+      case kDcsEntry:
+      case kDcsParam:
+        if (c < 0x20) break;
+        if (c < 0x30) { Collect(c); state = kDcsIntermediate; }
+        else if (c <= 0x3B) { Param(c); state = kDcsParam; }
+        else if (c < 0x40) {
+          if (state == kDcsEntry) { prefix = (char)c; state = kDcsParam; }
+          else state = kDcsIgnore;
+        } else if (c < 0x7F) {
+          state = kDcsPassthrough;
+          handler->DcsHook(params, prefix, intermediates, c);
+        }
+        break;
+
+      case kDcsIntermediate:
+        if (c < 0x20) break;
+        if (c < 0x30) Collect(c);
+        else if (c < 0x40) state = kDcsIgnore;
+        else if (c < 0x7F) {
+          state = kDcsPassthrough;
+          handler->DcsHook(params, prefix, intermediates, c);
+        }
+        break;
+
+      case kDcsPassthrough:
+        if (c != 0x7F) handler->DcsPut(c);
+        break;
+
+      case kDcsIgnore:
+      case kSosPmApcString:
+        break;
+
+      case kOscString:
+        // BEL ends the string too, as in xterm
+        if (c == 0x07) Enter(kGround);
+        else if (c >= 0x20 && osc.size() < kMaxOsc) osc.push_back((char)c);
+        break;
+    }
+  }
+}
+
+}  // namespace vt
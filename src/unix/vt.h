@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * vt.h:
+ *   A parser for the escape sequences of VT500-series terminals, after the
+ *   state machine of Paul Williams (https://vt100.net/emu/dec_ansi_parser).
+ *   UTF-8 is decoded in the ground state, other 8-bit input is treated like
+ *   its 7-bit counterpart and C1 controls are not recognized, as in the
+ *   UTF-8 mode of xterm.
+ */
+
+#ifndef NODE_PTY_VT_H_
+#define NODE_PTY_VT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace vt {
+
+static const int kMaxParams = 32;
+
+// The parameters of a control sequence. A parameter left out is 0, sub
+// parameters (separated by colons) follow their parameter with their bit in
+// sub set.
+struct Params {
+  uint16_t values[kMaxParams];
+  int count;
+  uint32_t sub;
+
+  Params() : count(0), sub(0) {}
+  // The i-th value, or def when it is missing or 0.
+  int Get(int i, int def) const {
+    return i < count && values[i] != 0 ? values[i] : def;
+  }
+  bool IsSub(int i) const { return i < count && (sub >> i) & 1; }
+};
+
+// Receives what the parser recognizes.
+class Handler {
+  public:
+    virtual ~Handler() {}
+    // Printable ASCII, in runs.
+    virtual void PrintAscii(const char *data, size_t len) = 0;
+    // Any other printable code point.
+    virtual void Print(uint32_t code) = 0;
+    // C0 controls.
+    virtual void Execute(uint8_t code) = 0;
+    // prefix is the private marker ('?', '>', ...) or 0, intermediates are
+    // up to two bytes.
+    virtual void CsiDispatch(const Params &params, char prefix,
+                             const char *intermediates, uint8_t final) = 0;
+    virtual void EscDispatch(const char *intermediates, uint8_t final) = 0;
+    virtual void OscDispatch(const std::string &data) = 0;
+    // Device control strings, ignored unless overridden.
+    virtual void DcsHook(const Params &, char, const char *, uint8_t) {}
+    virtual void DcsPut(uint8_t) {}
+    virtual void DcsUnhook() {}
+};
+
+class Parser {
+  public:
+    explicit Parser(Handler *handler);
+
+    void Write(const char *data, size_t len);
+    void Reset();
+
+  private:
+    enum State {
+      kGround,
+      kEscape,
+      kEscapeIntermediate,
+      kCsiEntry,
+      kCsiParam,
+      kCsiIntermediate,
+      kCsiIgnore,
+      kDcsEntry,
+      kDcsParam,
+      kDcsIntermediate,
+      kDcsPassthrough,
+      kDcsIgnore,
+      kOscString,
+      kSosPmApcString
+    };
+
+    void Clear();
+    void Collect(uint8_t c);
+    void Param(uint8_t c);
+    void Enter(State next);
+    void Utf8(uint8_t c);
+    // Returns how many bytes from data on were printed as ASCII.
+    size_t Ground(const char *data, size_t len);
+    // Parses and dispatches a whole control sequence after CSI, the common
+    // case, and returns its length. Returns 0 when it does not end in data
+    // or has controls in it, the state machine takes it over then.
+    size_t Csi(const char *data, size_t len);
+
+    Handler *handler;
+    State state;
+
+    Params params;
+    bool param_started;
+    char prefix;
+    char intermediates[3];
+    int intermediate_count;
+    bool ignoring;  // too many intermediates or parameters
+    std::string osc;
+
+    // a UTF-8 sequence being decoded
+    uint32_t code;
+    int need;
+};
+
+}  // namespace vt
+
+#endif  // NODE_PTY_VT_H_
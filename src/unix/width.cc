@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * width.cc:
+ *   The columns of UTF-8 text.
+ */
+
+#include "width.h"
+
+#include <string.h>
+
+#include <string>
+
+namespace width {
+
+static const uint64_t kOnes = 0x0101010101010101ULL;
+static const uint64_t kHighs = 0x8080808080808080ULL;
+
+// The printable bytes of a word of ASCII, 0x20 to 0x7E: setting the high
+// bit first keeps the subtractions from borrowing across bytes.
+static inline int
+printable(uint64_t w) {
+  uint64_t from_space = ((w | kHighs) - kOnes * 0x20) & kHighs;
+  uint64_t not_del = (((w ^ (kOnes * 0x7F)) | kHighs) - kOnes) & kHighs;
+  return __builtin_popcountll(from_space & not_del);
+}
+
+// Decodes the sequence at data[0], false when it is malformed.
+static inline bool
+decode(const uint8_t *data, size_t len, uint32_t *code, size_t *used) {
+  uint8_t lead = data[0];
+  size_t need;
+  uint32_t c;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    need = 1;
+    c = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    need = 2;
+    c = lead & 0x0F;
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    need = 3;
+    c = lead & 0x07;
+  } else {
+    return false;
+  }
+  if (need >= len) return false;
+  for (size_t i = 1; i <= need; i++) {
+    if ((data[i] & 0xC0) != 0x80) return false;
+    c = (c << 6) | (data[i] & 0x3F);
+  }
+  // overlong forms, surrogates and beyond U+10FFFF
+  if ((need == 2 && (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF))) ||
+      (need == 3 && (c < 0x10000 || c > 0x10FFFF))) {
+    return false;
+  }
+  *code = c;
+  *used = need + 1;
+  return true;
+}
+
+size_t Columns(const char *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  size_t columns = 0;
+  size_t i = 0;
+  while (i < len) {
+    // ASCII a word at a time
+    while (i + 8 <= len) {
+      uint64_t w;
+      memcpy(&w, p + i, 8);
+      if (w & kHighs) break;
+      columns += printable(w);
+      i += 8;
+    }
+    for (; i < len && p[i] < 0x80; i++) {
+      columns += p[i] >= 0x20 && p[i] < 0x7F;
+    }
+    while (i < len && p[i] >= 0x80) {
+      uint32_t code;
+      size_t used;
+      if (decode(p + i, len - i, &code, &used)) {
+        columns += CodePoint(code);
+        i += used;
+      } else {
+        columns++;
+        i++;
+      }
+    }
+  }
+  return columns;
+}
+
+static Napi::Value
+GetColumns(const Napi::CallbackInfo& info) {
+  Napi::Env env(info.Env());
+  Napi::HandleScope scope(env);
+
+  if (info.Length() != 1 || !(info[0].IsString() || info[0].IsBuffer())) {
+    Napi::Error::New(env, "Usage: pty.columns(data)").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  size_t columns;
+  if (info[0].IsBuffer()) {
+    Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
+    columns = Columns(buffer.Data(), buffer.Length());
+  } else {
+    std::string data = info[0].As<Napi::String>().Utf8Value();
+    columns = Columns(data.data(), data.size());
+  }
+  return Napi::Number::New(env, (double)columns);
+}
+
+void Init(Napi::Env env, Napi::Object exports) {
+  exports.Set(Napi::String::New(env, "columns"), Napi::Function::New(env, GetColumns));
+  exports.Set(Napi::String::New(env, "unicodeVersion"), Napi::String::New(env,
+    std::to_string(kUnicodeVersion[0]) + "." + std::to_string(kUnicodeVersion[1]) + "." +
+    std::to_string(kUnicodeVersion[2])));
+}
+
+}  // namespace width
@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2019, Microsoft Corporation (MIT License).
+ *
+ * width.h:
+ *   The columns code points take in a terminal, looked up in tables that
+ *   scripts/gen-width-table.js generates from a pinned version of the
+ *   Unicode character database (width_table.cc), so that they do not depend
+ *   on the locale or the libc wcwidth.
+ */
+
+#ifndef NODE_PTY_WIDTH_H_
+#define NODE_PTY_WIDTH_H_
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace width {
+
+// The Unicode version of the tables.
+extern const uint32_t kUnicodeVersion[3];
+// Two stages: a block of stage 2 for the high bits of a code point, holding
+// the widths of its 256 code points in 2 bits each.
+extern const uint8_t kStage1[0x1100];
+extern const uint8_t kStage2[][64];
+
+// 0 for marks, format characters and controls, 2 for wide characters and
+// emoji, 1 otherwise.
+inline int CodePoint(uint32_t c) {
+  if (c < 0x7F) return c >= 0x20 ? 1 : 0;
+  if (c >= 0x110000) return 1;
+  return (kStage2[kStage1[c >> 8]][(c & 0xFF) >> 2] >> ((c & 3) * 2)) & 3;
+}
+
+// The columns of a span of UTF-8 text. Controls take none, malformed bytes
+// one each, as the U+FFFD they are shown as.
+size_t Columns(const char *data, size_t len);
+
+void Init(Napi::Env env, Napi::Object exports);
+
+}  // namespace width
+
+#endif  // NODE_PTY_WIDTH_H_
@@ -8,6 +8,7 @@ import * as assert from 'assert';
 import * as cp from 'child_process';
 import * as path from 'path';
 import { pollUntil } from './testUtils.test';
+import { termiosFlags } from './index';
 
 const FIXTURES_PATH = path.normalize(path.join(__dirname, '..', 'fixtures', 'utf8-character.txt'));
 
@@ -32,6 +33,47 @@ if (process.platform !== 'win32') {
       });
     });
 
+    describe('termios', () => {
+      it('should not translate newlines in raw mode', (done) => {
+        const term = new UnixTerminal('/bin/bash', ['-c', 'printf "a\\nb"'], { termios: 'raw' });
+        let buffer = '';
+        term.on('data', (data) => buffer += data);
+        term.on('exit', () => {
+          assert.equal(buffer, 'a\nb');
+          done();
+        });
+      });
+      it('should get and set the attributes at runtime', () => {
+        const term = new UnixTerminal('/bin/bash', [], {});
+        const lflag = term.getTermios().lflag;
+        assert.ok(lflag & termiosFlags.ECHO);
+        term.setTermios({ lflag: lflag & ~termiosFlags.ECHO });
+        assert.equal(term.getTermios().lflag & termiosFlags.ECHO, 0);
+        term.setTermios('default');
+        assert.equal(term.getTermios().lflag, lflag);
+        term.kill();
+      });
+      it('should apply termios on open', () => {
+        const term = UnixTerminal.open({ termios: 'raw' });
+        assert.equal(term.getTermios().oflag & termiosFlags.OPOST, 0);
+        term.slave.destroy();
+        term.master.destroy();
+      });
+    });
+
+    describe('spawn errors', () => {
+      it('should throw a structured error when the file does not exist', () => {
+        assert.throws(() => new UnixTerminal('/nonexistent/file', []), (err: any) => {
+          return err.code === 'ENOENT' && err.errno === -2 && err.syscall === 'execvp' && err.path === '/nonexistent/file';
+        });
+      });
+      it('should throw a structured error when the cwd does not exist', () => {
+        assert.throws(() => new UnixTerminal('/bin/bash', [], { cwd: '/nonexistent/cwd' }), (err: any) => {
+          return err.code === 'ENOENT' && err.syscall === 'chdir' && err.path === '/nonexistent/cwd';
+        });
+      });
+    });
+
     describe('PtyForkEncodingOption', () => {
       it('should default to utf8', (done) => {
         const term = new UnixTerminal('/bin/bash', [ '-c', `cat "${FIXTURES_PATH}"` ]);
@@ -105,6 +147,75 @@ if (process.platform !== 'win32') {
         term.master.write('master\n');
       });
     });
+    describe('throttle', () => {
+      it('should pause a flooding terminal until its rate drops', (done) => {
+        const term = new UnixTerminal('/bin/sh', ['-c', 'yes'], { throttle: { bytesPerSecond: 100000, pause: true, halfLife: 50 } });
+        const states: boolean[] = [];
+        const listener = term.onThrottle(e => {
+          states.push(e.throttled);
+          if (!e.throttled) {
+            assert.deepEqual(states, [true, false]);
+            listener.dispose();
+            term.kill();
+            done();
+          }
+        });
+      });
+      it('should meter decoded output in bytes', async () => {
+        const term = new UnixTerminal('/bin/sh', ['-c', 'i=0; while [ $i -lt 500 ]; do printf "\\303\\251"; i=$((i+1)); done'], { throttle: { bytesPerSecond: 1e9 } });
+        const throttle = (term as any)._throttle;
+        const record = throttle.record;
+        let bytes = 0;
+        throttle.record = (n: number) => {
+          bytes += n;
+          record.call(throttle, n);
+        };
+        await pollUntil(() => bytes === 1000, 2000, 10);
+        assert.equal(bytes, 1000);
+        term.kill();
+      });
+    });
+    describe('events', () => {
+      it('should pick titles, bells, directories and clipboard requests out of the output', (done) => {
+        const term = new UnixTerminal('/bin/sh', ['-c', 'printf "\\033]0;one\\007a\\007\\033]7;file://host/tmp/a%%20b\\007\\033]52;c;aGk=\\007"'], {});
+        const seen: string[] = [];
+        term.onTitleChange(title => seen.push(`title ${title}`));
+        term.onBell(() => seen.push('bell'));
+        term.onCwdChange(e => seen.push(`cwd ${e.host} ${e.path}`));
+        term.onClipboard(e => seen.push(`clipboard ${e.selection} ${e.data}`));
+        term.onExit(() => {
+          assert.deepEqual(seen, ['title one', 'bell', 'cwd host /tmp/a b', 'clipboard c hi']);
+          done();
+        });
+      });
+    });
+    describe('pty pool', () => {
+      afterEach(() => UnixTerminal.configurePool({ size: 0 }));
+
+      it('should serve spawns from the pool and refill it', async () => {
+        UnixTerminal.configurePool({ size: 2 });
+        await pollUntil(() => UnixTerminal.poolStats.available === 2, 1000, 10);
+        const before = UnixTerminal.poolStats;
+        const term = new UnixTerminal('/bin/bash', [], {});
+        assert.equal(UnixTerminal.poolStats.hits, before.hits + 1);
+        assert.equal(UnixTerminal.poolStats.misses, before.misses);
+        await pollUntil(() => UnixTerminal.poolStats.available === 2, 1000, 10);
+        term.kill();
+      });
+      it('should apply the spawn size to pooled ptys', (done) => {
+        UnixTerminal.configurePool({ size: 1, cols: 80, rows: 24 });
+        pollUntil(() => UnixTerminal.poolStats.available === 1, 1000, 10).then(() => {
+          const term = new UnixTerminal('/bin/bash', ['-c', 'stty size'], { cols: 100, rows: 30 });
+          let buffer = '';
+          term.on('data', (data) => buffer += data);
+          term.on('exit', () => {
+            assert.equal(buffer.trim(), '30 100');
+            done();
+          });
+        });
+      });
+    });
+
     describe('signals in parent and child', () => {
       it('SIGINT - custom in parent and child', done => {
         // this test is cumbersome - we have to run it in a sub process to
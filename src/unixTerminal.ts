@@ -5,11 +5,19 @@
  */
 import * as net from 'net';
 import { Terminal, DEFAULT_COLS, DEFAULT_ROWS } from './terminal';
-import { IProcessEnv, IPtyForkOptions, IPtyOpenOptions } from './interfaces';
+import { IProcessEnv, IPtyForkOptions, IPtyOpenOptions, IPtyPoolOptions, IPtyPoolStats, IMemoryBudgetOptions, IMemoryBudgetStats, ITermios, TermiosOption, IOutputSince, ICwdChangeEvent, IClipboardEvent, ICommandEvent, ILine, ILink, ExpectPattern, IExpectOptions, IExpectMatch, ISearchOptions, ISearchMatch } from './interfaces';
 import { ArgvOrCommandLine } from './types';
 import { assign } from './utils';
-
-let pty: IUnixNative;
+import { Scrollback } from './scrollback';
+import { Screen } from './screen';
+import { PlainText } from './plainText';
+import { LineFramer, linesMode } from './lineFramer';
+import { LinkDetector } from './linkDetector';
+import { ExpectMatcher } from './expectMatcher';
+import { TerminalEvents } from './terminalEvents';
+import { EventEmitter2, IEvent } from './eventEmitter2';
+
+export let pty: IUnixNative;
 try {
   pty = require(`../bin/${process.platform}-${process.arch}/pty.node`);
 } catch (outerError) {
@@ -24,7 +32,76 @@ try {
 
 const DEFAULT_FILE = 'sh';
 const DEFAULT_NAME = 'xterm';
-const DESTROY_SOCKET_TIMEOUT_MS = 200;
+export const DESTROY_SOCKET_TIMEOUT_MS = 200;
+
+export interface IUnixFork {
+  process: IUnixProcess;
+  file: string;
+  name: string;
+  cols: number;
+  rows: number;
+  encoding: string | null;
+}
+
+/**
+ * Resolves the spawn options the way every unix terminal does and forks the
+ * process on a new pty.
+ */
+export function forkPty(file: string | undefined, args: ArgvOrCommandLine | undefined, opt: IPtyForkOptions | undefined, onexit: (code: number, signal: number) => void): IUnixFork {
+  if (typeof args === 'string') {
+    throw new Error('args as a string is not supported on unix.');
+  }
+
+  // Initialize arguments
+  args = args || [];
+  file = file || DEFAULT_FILE;
+  opt = opt || {};
+  opt.env = opt.env || process.env;
+
+  const cols = opt.cols || DEFAULT_COLS;
+  const rows = opt.rows || DEFAULT_ROWS;
+  const uid = opt.uid || -1;
+  const gid = opt.gid || -1;
+  const env = assign({}, opt.env);
+
+  if (opt.env === process.env) {
+    sanitizeEnv(env);
+  }
+
+  const cwd = opt.cwd || process.cwd();
+  env.PWD = cwd;
+  const name = opt.name || env.TERM || DEFAULT_NAME;
+  env.TERM = name;
+  const parsedEnv = parseEnv(env);
+
+  const encoding = (opt.encoding === undefined ? 'utf8' : opt.encoding);
+
+  // fork
+  const term = pty.fork(file, args, parsedEnv, cwd, cols, rows, uid, gid, (encoding === 'utf8'), opt.termios, onexit);
+
+  return { process: term, file, name, cols, rows, encoding };
+}
+
+function parseEnv(env: IProcessEnv): string[] {
+  return Object.keys(env).map(key => key + '=' + env[key]);
+}
+
+function sanitizeEnv(env: IProcessEnv): void {
+  // Make sure we didn't start our server from inside tmux.
+  delete env['TMUX'];
+  delete env['TMUX_PANE'];
+
+  // Make sure we didn't start our server from inside screen.
+  // http://web.mit.edu/gnu/doc/html/screen_20.html
+  delete env['STY'];
+  delete env['WINDOW'];
+
+  // Delete some variables that might confuse our terminal.
+  delete env['WINDOWID'];
+  delete env['TERMCAP'];
+  delete env['COLUMNS'];
+  delete env['LINES'];
+}
 
 export class UnixTerminal extends Terminal {
   protected _fd: number;
@@ -40,40 +117,62 @@ export class UnixTerminal extends Terminal {
   private _emittedClose: boolean;
   private _master: net.Socket;
   private _slave: net.Socket;
+  private _scrollback: Scrollback | undefined;
+  private _screen: Screen | undefined;
+  private _plainText: PlainText | undefined;
+  private _lines: LineFramer | undefined;
+  private _links: LinkDetector | undefined;
+  private _seq: number = 0;
+  private _events: TerminalEvents | undefined;
+  private _expect: ExpectMatcher | undefined;
 
   public get master(): net.Socket { return this._master; }
   public get slave(): net.Socket { return this._slave; }
+  public get scrollback(): Scrollback | undefined { return this._scrollback; }
+  public get screen(): Screen | undefined { return this._screen; }
+  public get plainText(): PlainText | undefined { return this._plainText; }
 
-  constructor(file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions) {
-    super(opt);
-
-    if (typeof args === 'string') {
-      throw new Error('args as a string is not supported on unix.');
-    }
+  private _onPlainText = new EventEmitter2<string>();
+  public get onPlainText(): IEvent<string> { return this._onPlainText.event; }
+  private _onLines = new EventEmitter2<ILine[]>();
+  public get onLines(): IEvent<ILine[]> { return this._onLines.event; }
+  private _onLinks = new EventEmitter2<ILink[]>();
+  public get onLinks(): IEvent<ILink[]> { return this._onLinks.event; }
 
-    // Initialize arguments
-    args = args || [];
-    file = file || DEFAULT_FILE;
-    opt = opt || {};
-    opt.env = opt.env || process.env;
+  /**
+   * The bytes of output delivered so far, within a data listener including
+   * that data: the sequence number of the next byte.
+   */
+  public get seq(): number { return this._seq; }
 
-    this._cols = opt.cols || DEFAULT_COLS;
-    this._rows = opt.rows || DEFAULT_ROWS;
-    const uid = opt.uid || -1;
-    const gid = opt.gid || -1;
-    const env = assign({}, opt.env);
+  /**
+   * The output delivered from sequence number seq on, from the scrollback.
+   */
+  public readSince(seq: number): IOutputSince {
+    if (!this._scrollback) {
+      throw new Error('readSince needs the scrollback option');
+    }
+    return this._scrollback.readSince(seq, this._seq);
+  }
 
-    if (opt.env === process.env) {
-      this._sanitizeEnv(env);
+  /**
+   * The matches of query in the output held by the scrollback.
+   */
+  public search(query: string, opt?: ISearchOptions): ISearchMatch[] {
+    if (!this._scrollback) {
+      throw new Error('search needs the scrollback option');
     }
+    return this._scrollback.search(query, opt);
+  }
 
-    const cwd = opt.cwd || process.cwd();
-    env.PWD = cwd;
-    const name = opt.name || env.TERM || DEFAULT_NAME;
-    env.TERM = name;
-    const parsedEnv = this._parseEnv(env);
+  public get onTitleChange(): IEvent<string> { return this._scanEvents().onTitleChange; }
+  public get onBell(): IEvent<void> { return this._scanEvents().onBell; }
+  public get onCwdChange(): IEvent<ICwdChangeEvent> { return this._scanEvents().onCwdChange; }
+  public get onClipboard(): IEvent<IClipboardEvent> { return this._scanEvents().onClipboard; }
+  public get onCommand(): IEvent<ICommandEvent> { return this._scanEvents().onCommand; }
 
-    const encoding = (opt.encoding === undefined ? 'utf8' : opt.encoding);
+  constructor(file?: string, args?: ArgvOrCommandLine, opt?: IPtyForkOptions) {
+    super(opt);
 
     const onexit = (code: number, signal: number): void => {
       // XXX Sometimes a data event is emitted after exit. Wait til socket is
@@ -102,14 +201,93 @@ export class UnixTerminal extends Terminal {
       this.emit('exit', code, signal);
     };
 
-    // fork
-    const term = pty.fork(file, args, parsedEnv, cwd, this._cols, this._rows, uid, gid, (encoding === 'utf8'), onexit);
+    let forked: IUnixFork;
+    try {
+      if (opt && opt.scrollback) {
+        this._scrollback = new Scrollback(opt.scrollback);
+      }
+      if (linesMode(opt)) {
+        this._lines = new LineFramer(opt && opt.lines);
+        this._lines.onLines(lines => this._onLines.fire(lines));
+        this._deliverData = false;
+      }
+      if (opt && opt.links) {
+        this._links = new LinkDetector(opt.links, 0);
+        this._links.onLinks(links => this._onLinks.fire(links));
+      }
+
+      forked = forkPty(file, args, opt, onexit);
+    } catch (e) {
+      // stops the idle timer of the line framer, nothing else would
+      if (this._lines) {
+        this._lines.close();
+      }
+      if (this._links) {
+        this._links.close();
+      }
+      if (this._scrollback) {
+        this._scrollback.destroy();
+      }
+      throw e;
+    }
+    const term = forked.process;
+    const encoding = forked.encoding;
+    this._encoding = encoding;
+    this._cols = forked.cols;
+    this._rows = forked.rows;
 
     this._socket = new PipeSocket(term.fd);
     if (encoding !== null) {
       this._socket.setEncoding(encoding);
     }
 
+    // counted before anything sees the data
+    this._socket.on('data', (data: string | Buffer) => {
+      this._seq += typeof data === 'string' ? Buffer.byteLength(data, encoding) : data.length;
+    });
+    if (this._scrollback) {
+      const scrollback = this._scrollback.native;
+      this._scrollback.encoding = encoding;
+      // the store keeps the bytes the pty wrote
+      this._socket.on('data', (data: string | Buffer) => scrollback.write(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data));
+    }
+    if (opt && opt.screen) {
+      this._screen = new Screen(this._cols, this._rows, opt.screen);
+      const screen = this._screen.native;
+      this._socket.on('data', (data: string | Buffer) => screen.write(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data));
+    }
+    if (opt && opt.plainText) {
+      this._plainText = new PlainText(opt.plainText);
+      const plainText = this._plainText.native;
+      this._socket.on('data', (data: string | Buffer) => {
+        const text = plainText.write(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data);
+        if (text) {
+          this._onPlainText.fire(text);
+        }
+      });
+      // the last line ends with the output, before the exit is emitted
+      this._socket.on('close', () => {
+        const text = plainText.close();
+        if (text) {
+          this._onPlainText.fire(text);
+        }
+      });
+    }
+
+    if (this._lines) {
+      const lines = this._lines;
+      this._socket.on('data', (data: string | Buffer) => lines.write(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data));
+      // the last line is delivered with the output, before the exit is
+      // emitted
+      this._socket.on('close', () => lines.close());
+    }
+    if (this._links) {
+      const links = this._links;
+      this._socket.on('data', (data: string | Buffer) => links.write(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data));
+      // a link at the end of the output ends with it
+      this._socket.on('close', () => links.close());
+    }
+
     // setup
     this._socket.on('error', (err: any) => {
       // NOTE: fs.ReadStream gets EAGAIN twice at first:
@@ -147,8 +325,8 @@ export class UnixTerminal extends Terminal {
     this._fd = term.fd;
     this._pty = term.pty;
 
-    this._file = file;
-    this._name = name;
+    this._file = forked.file;
+    this._name = forked.name;
 
     this._readable = true;
     this._writable = true;
@@ -169,6 +347,43 @@ export class UnixTerminal extends Terminal {
     this._socket.write(data);
   }
 
+  /**
+   * Waits for one of the patterns in the output, resolves with the first
+   * match. Matching starts with the first call, from then on the output
+   * since the last match is kept for the next call.
+   */
+  public expect(patterns: ExpectPattern[], opt?: IExpectOptions): Promise<IExpectMatch> {
+    if (!this._expect) {
+      const matcher = this._expect = new ExpectMatcher(this._seq || 0);
+      const encoding = this._encoding;
+      if (this._emittedClose) {
+        matcher.close();
+      } else {
+        this._socket.on('data', (data: string | Buffer) => matcher.write(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data));
+        this.once('close', () => matcher.close());
+      }
+    }
+    return this._expect.expect(patterns, opt);
+  }
+
+  // The output is scanned natively from the first subscription to an event
+  // on, a sequence split across chunks is put together. Positions are
+  // sequence numbers.
+  private _scanEvents(): TerminalEvents {
+    if (!this._events) {
+      const events = this._events = new TerminalEvents();
+      const scanner = new pty.EventScanner(this._seq || 0);
+      const encoding = this._encoding;
+      this._socket.on('data', (data: string | Buffer) => {
+        const found = scanner.scan(typeof data === 'string' && encoding !== 'utf8' ? Buffer.from(data, encoding) : data);
+        for (let i = 0; i < found.length; i++) {
+          events.fire(found[i]);
+        }
+      });
+    }
+    return this._events;
+  }
+
   /**
    * openpty
    */
@@ -189,7 +404,7 @@ export class UnixTerminal extends Terminal {
     const encoding = (opt.encoding === undefined ? 'utf8' : opt.encoding);
 
     // open
-    const term: IUnixOpenProcess = pty.open(cols, rows);
+    const term: IUnixOpenProcess = pty.open(cols, rows, opt.termios);
 
     self._master = new PipeSocket(<number>term.master);
     if (encoding !== null) {
@@ -204,6 +419,7 @@ export class UnixTerminal extends Terminal {
     self._slave.resume();
 
     self._socket = self._master;
+    self._encoding = encoding;
     self._pid = null;
     self._fd = term.master;
     self._pty = term.pty;
@@ -228,8 +444,41 @@ export class UnixTerminal extends Terminal {
     return self;
   }
 
+  /**
+   * Configures the pool of pre-opened ptys that spawn draws from, a size of 0
+   * disables the pool.
+   */
+  public static configurePool(opt: IPtyPoolOptions): void {
+    opt = opt || {};
+    pty.setPoolOptions(opt.size || 0, opt.cols || DEFAULT_COLS, opt.rows || DEFAULT_ROWS);
+  }
+
+  public static get poolStats(): IPtyPoolStats {
+    return pty.getPoolStats();
+  }
+
+  /**
+   * Caps the output buffered natively by all terminals of the process, a
+   * limit of 0 removes the cap.
+   */
+  public static configureMemoryBudget(opt: IMemoryBudgetOptions): void {
+    const limit = opt && opt.limit || 0;
+    if (typeof limit !== 'number' || !(limit >= 0)) {
+      throw new Error('limit must be a non-negative number');
+    }
+    pty.setMemoryBudget(limit);
+  }
+
+  public static get memoryBudgetStats(): IMemoryBudgetStats {
+    return pty.getMemoryBudget();
+  }
+
   public destroy(): void {
     this._close();
+    if (this._scrollback) {
+      // removes its spill files
+      this._scrollback.destroy();
+    }
 
     // Need to close the read stream so node stops reading a dead file
     // descriptor. Then we can safely SIGHUP the shell.
@@ -257,31 +506,32 @@ export class UnixTerminal extends Terminal {
    * TTY
    */
 
+  /**
+   * Gets the terminal attributes of the pty.
+   */
+  public getTermios(): ITermios {
+    return pty.getAttr(this._fd);
+  }
+
+  /**
+   * Sets the terminal attributes of the pty, fields that are not given keep
+   * their current value.
+   */
+  public setTermios(termios: TermiosOption): void {
+    pty.setAttr(this._fd, termios);
+  }
+
   public resize(cols: number, rows: number): void {
     if (cols <= 0 || rows <= 0 || isNaN(cols) || isNaN(rows) || cols === Infinity || rows === Infinity) {
       throw new Error('resizing must be done using positive cols and rows');
     }
     pty.resize(this._fd, cols, rows);
+    if (this._screen) {
+      this._screen.native.resize(cols, rows);
+    }
     this._cols = cols;
     this._rows = rows;
   }
-
-  private _sanitizeEnv(env: IProcessEnv): void {
-    // Make sure we didn't start our server from inside tmux.
-    delete env['TMUX'];
-    delete env['TMUX_PANE'];
-
-    // Make sure we didn't start our server from inside screen.
-    // http://web.mit.edu/gnu/doc/html/screen_20.html
-    delete env['STY'];
-    delete env['WINDOW'];
-
-    // Delete some variables that might confuse our terminal.
-    delete env['WINDOWID'];
-    delete env['TERMCAP'];
-    delete env['COLUMNS'];
-    delete env['LINES'];
-  }
 }
 
 /**
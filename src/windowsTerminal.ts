@@ -183,6 +183,9 @@ export class WindowsTerminal extends Terminal {
     });
   }
 
+  public getTermios(): never { throw new Error('getTermios is not supported on Windows'); }
+  public setTermios(termios: any): never { throw new Error('setTermios is not supported on Windows'); }
+
   public get process(): string { return this._name; }
   public get master(): Socket { throw new Error('master is not supported on Windows'); }
   public get slave(): Socket { throw new Error('slave is not supported on Windows'); }
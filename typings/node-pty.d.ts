@@ -11,80 +11,1298 @@ declare module 'node-pty' {
    * (string). Note that the CommandLine option is only available on Windows and is expected to be
    * escaped properly.
    * @param options The options of the terminal.
+   * @throws When the process could not be started. On Unix the error carries `code` (eg.
+   * `ENOENT`), `errno` (negative, as in the errors of Node itself), `syscall` (the failing stage:
+   * `chdir`, `setgid`, `setuid` or `execvp`) and `path` when applicable.
    * @see CommandLineToArgvW https://msdn.microsoft.com/en-us/library/windows/desktop/bb776391(v=vs.85).aspx
    * @see Parsing C++ Comamnd-Line Arguments https://msdn.microsoft.com/en-us/library/17w5ykft.aspx
    * @see GetCommandLine https://msdn.microsoft.com/en-us/library/windows/desktop/ms683156.aspx
    */
   export function spawn(file: string, args: string[] | string, options: IPtyForkOptions | IWindowsPtyForkOptions): IPty;
 
+  /**
+   * Creates a pool that keeps idle, fully initialized shells per spawn configuration so that
+   * claiming one skips shell startup (rc files, prompt init).
+   * @param options The options of the pool.
+   */
+  export function createShellPool(options?: IShellPoolOptions): IShellPool;
+
+  export interface IShellPoolOptions {
+    /**
+     * The number of idle shells to keep per spawn configuration. Defaults to 1.
+     */
+    size?: number;
+
+    /**
+     * A pattern matched against the buffered output of an idle shell, the shell is considered
+     * initialized once it matches. When unset a shell is initialized once its output settles for
+     * `settleTime`.
+     */
+    promptPattern?: RegExp;
+
+    /**
+     * The time in milliseconds without output after which an idle shell is considered initialized
+     * when `promptPattern` is unset. Defaults to 100.
+     */
+    settleTime?: number;
+
+    /**
+     * The time in milliseconds after which the idle shells of a spawn configuration that was not
+     * claimed meanwhile are killed and not replaced, counted from the last claim or from when a
+     * shell became ready, whichever is later. Defaults to 5 minutes.
+     */
+    idleTimeout?: number;
+  }
+
+  export interface IShellPoolStats {
+    /**
+     * The number of idle shells across all spawn configurations.
+     */
+    idle: number;
+
+    /**
+     * The number of idle shells that are initialized.
+     */
+    ready: number;
+
+    /**
+     * The number of claims served by an idle shell.
+     */
+    hits: number;
+
+    /**
+     * The number of claims that had to spawn a shell.
+     */
+    misses: number;
+  }
+
+  export interface IShellPool {
+    readonly stats: IShellPoolStats;
+
+    /**
+     * Starts keeping idle shells for a spawn configuration without claiming one.
+     */
+    warm(file: string, args: string[] | string, options: IPtyForkOptions | IWindowsPtyForkOptions): void;
+
+    /**
+     * Hands out an idle shell for the spawn configuration, preferring an initialized one, or spawns
+     * one when none is idle. The output the shell produced while idle (eg. the first prompt) is
+     * replayed to the claimant on the next tick and `cols`/`rows` of the options are applied.
+     */
+    claim(file: string, args: string[] | string, options: IPtyForkOptions | IWindowsPtyForkOptions): IPty;
+
+    /**
+     * Kills all idle shells, claimed shells are not affected.
+     */
+    dispose(): void;
+  }
+
+  /**
+   * Keeps a number of ptys opened ahead of time so that spawn only has to fork and exec, this
+   * helps when many terminals are spawned at once. The pool is refilled in the background. This
+   * does nothing on Windows.
+   * @param options The pool options.
+   */
+  export function configurePtyPool(options: IPtyPoolOptions): void;
+
+  /**
+   * Gets the state of the pty pool and how many spawns it served.
+   */
+  export function getPtyPoolStats(): IPtyPoolStats;
+
+  export interface IPtyPoolOptions {
+    /**
+     * The number of ptys to keep ready, 0 (the default) disables the pool.
+     */
+    size?: number;
+
+    /**
+     * The cols the pooled ptys are opened with, spawns using the same size skip a resize.
+     */
+    cols?: number;
+
+    /**
+     * The rows the pooled ptys are opened with, spawns using the same size skip a resize.
+     */
+    rows?: number;
+  }
+
+  export interface IPtyPoolStats {
+    /**
+     * The configured pool size.
+     */
+    size: number;
+
+    /**
+     * The number of ptys currently ready.
+     */
+    available: number;
+
+    /**
+     * The number of spawns served from the pool.
+     */
+    hits: number;
+
+    /**
+     * The number of spawns that found the pool empty and opened a pty themselves.
+     */
+    misses: number;
+  }
+
+  /**
+   * Caps the output all terminals of the process buffer natively: scrollback, input not yet
+   * accepted by the ptys and output not yet delivered to JS. Once more is buffered, the scrollback
+   * of the least recently viewed terminals is compressed and then evicted (or spilled when it has
+   * a `directory`) in the background, and hub terminals are not read while that does not suffice.
+   * Reading a scrollback, writing to a terminal and `markViewed` count as viewing. This does
+   * nothing on Windows.
+   * @param options The budget options.
+   */
+  export function configureMemoryBudget(options: IMemoryBudgetOptions): void;
+
+  /**
+   * Gets what all terminals buffer natively against the memory budget.
+   */
+  export function getMemoryBudgetStats(): IMemoryBudgetStats;
+
+  export interface IMemoryBudgetOptions {
+    /**
+     * The bytes all terminals may buffer, 0 (the default) for no limit. Input not yet accepted by
+     * a pty counts in the stats but not against the limit, as only the pty reading it frees it.
+     * Neither does the `floor` of the stats.
+     */
+    limit?: number;
+  }
+
+  export interface IMemoryBudgetStats {
+    limit: number;
+
+    /**
+     * The bytes buffered in total and by kind.
+     */
+    used: number;
+    scrollback: number;
+    writes: number;
+    output: number;
+
+    /**
+     * The bytes of `used` that reclaiming cannot free and that do not count against the limit:
+     * the segment each scrollback appends to and the search indexes.
+     */
+    floor: number;
+
+    /**
+     * The terminals and scrollbacks charged to the budget.
+     */
+    sessions: number;
+
+    /**
+     * How often the budget was reclaimed from and the bytes that freed.
+     */
+    reclaims: number;
+    reclaimed: number;
+
+    /**
+     * Whether hub terminals are held back as more than the limit is buffered.
+     */
+    backpressure: boolean;
+  }
+
+  /**
+   * Creates a hub that reads the ptys of all terminals it spawns on native I/O threads and
+   * delivers their output in batches, one JS callback per batch instead of a socket per terminal.
+   * UTF-8 output is cut at character boundaries on the I/O threads.
+   * This keeps memory and GC overhead low with thousands of terminals.
+   * @param options The options of the hub.
+   * @throws Will throw on Windows.
+   */
+  export function createPtyHub(options?: IPtyHubOptions): IPtyHub;
+
+  /**
+   * Decodes a snapshot of `IScreen.snapshot`, for instance where a client reconnects and restores
+   * the screen from it instead of replaying output. Nothing native is needed to decode.
+   * @param data The snapshot.
+   * @throws When the data is not a snapshot or of a newer format.
+   */
+  export function decodeScreenSnapshot(data: Uint8Array): IScreenSnapshot;
+
+  export interface IPtyHubOptions {
+    /**
+     * How the I/O thread reads and writes the ptys. `'poll'` (the default) waits for readiness with
+     * epoll, kqueue or poll and reads each ready pty. `'io_uring'` keeps a read queued on every pty
+     * from a shared pool of buffers and submits reads and writes of all ptys with one system call
+     * per loop turn. It needs Linux 5.7 and falls back to `'poll'` when io_uring is unavailable,
+     * check `stats.backend` for the backend in use.
+     */
+    backend?: 'poll' | 'io_uring';
+
+    /**
+     * The number of I/O threads (shards), each reads the ptys assigned to it on its own core and
+     * hands its batches to JS separately. Defaults to 1.
+     */
+    threads?: number;
+
+    /**
+     * How spawned terminals are assigned to shards: `'round-robin'` (the default),
+     * `'least-loaded'` (the shard with the fewest terminals) or a function returning the shard
+     * index for the spawn arguments, eg. to keep the terminals of a tenant together.
+     */
+    assign?: 'round-robin' | 'least-loaded' | ((file: string, args: string[], options: IPtyForkOptions) => number);
+
+    /**
+     * How a shard shares reading between terminals with output pending. Each loop turn serves
+     * every ready terminal once, a terminal that still has output after its share is read again
+     * after the others. `'round-robin'` (the default) reads up to `quantum` bytes per turn,
+     * `'drr'` (deficit round-robin) reads whole chunks and takes what a terminal read over its
+     * quantum off its next turn. The `'io_uring'` backend reads at most one buffer per terminal
+     * per turn regardless.
+     */
+    scheduler?: 'round-robin' | 'drr';
+
+    /**
+     * The bytes a terminal may read per loop turn, defaults to 65536.
+     */
+    quantum?: number;
+
+    /**
+     * How many milliseconds the output of a terminal of each priority is left to collect before it
+     * is read, so that it takes fewer reads and batches. Defaults to 0 for `interactive` and
+     * `normal` terminals and 5 for `batch` ones. Ignored by the `'io_uring'` backend.
+     */
+    coalesce?: { interactive?: number, normal?: number, batch?: number };
+  }
+
+  export interface IHubPtyForkOptions extends IPtyForkOptions {
+    /**
+     * How urgently the hub reads the terminal: `'interactive'` terminals are read first each loop
+     * turn, `'batch'` terminals last and after their coalescing window. When JS falls behind on
+     * the output of a shard, `'batch'` terminals are no longer read and then `'normal'` ones, so
+     * their programs block on a full pty while interactive terminals keep being served. Defaults
+     * to `'normal'`. The `'io_uring'` backend keeps a read queued on every terminal and does not
+     * prioritize.
+     */
+    priority?: 'interactive' | 'normal' | 'batch';
+  }
+
+  export interface IPtyHub {
+    readonly stats: IPtyHubStats;
+
+    /**
+     * Forks a process as a pseudoterminal that is read by the hub.
+     * @param file The file to launch.
+     * @param args The file's arguments as argv.
+     * @param options The options of the terminal.
+     */
+    spawn(file: string, args: string[], options: IHubPtyForkOptions): IHubPty;
+
+    /**
+     * Stops the I/O thread of the hub, its terminals stop receiving data.
+     */
+    close(): void;
+  }
+
+  export interface IPtyHubStats {
+    /**
+     * The backend in use: `'io_uring'`, `'epoll'`, `'kqueue'` or `'poll'`.
+     */
+    backend: string;
+
+    /**
+     * The number of ptys read by the hub.
+     */
+    sessions: number;
+
+    /**
+     * The number of system calls made for pty I/O, including waiting and changing what is polled.
+     */
+    syscalls: number;
+
+    /**
+     * The number of read(2) calls that returned data, and the bytes they returned.
+     */
+    reads: number;
+    bytesRead: number;
+
+    /**
+     * The number of write(2) calls that wrote input, and the bytes they wrote.
+     */
+    writes: number;
+    bytesWritten: number;
+
+    /**
+     * The number of times the I/O thread woke up.
+     */
+    wakeups: number;
+
+    /**
+     * The number of batches delivered to JS.
+     */
+    batches: number;
+
+    /**
+     * The number of times a terminal used up its share of a turn with output left to read.
+     */
+    deferred: number;
+
+    /**
+     * The number of times a terminal was not read because JS fell behind (see `priority`).
+     */
+    throttled: number;
+
+    /**
+     * The terminals, bytes read and batches of each shard.
+     */
+    shards: { sessions: number, bytesRead: number, batches: number }[];
+  }
+
+  /**
+   * A pseudoterminal of a pty hub. Output is delivered by the hub, so there is no socket and
+   * `onData` receives a `Buffer` when the `encoding` option is `null`.
+   */
+  export interface IHubPty {
+    readonly pid: number;
+    readonly cols: number;
+    readonly rows: number;
+    readonly process: string;
+
+    /**
+     * The store of the output when the terminal was spawned with `scrollback`.
+     */
+    readonly scrollback: IScrollback | undefined;
+
+    /**
+     * The screen model when the terminal was spawned with `screen`, fed by the hub as it reads.
+     */
+    readonly screen: IScreen | undefined;
+
+    /**
+     * The plain text channel when the terminal was spawned with `plainText`, fed by the hub as it
+     * reads.
+     */
+    readonly plainText: IPlainText | undefined;
+
+    /**
+     * The sequence number of the output: the bytes delivered to `onData` so far, within a data
+     * listener including that data. A client keeps the `seq` of the last data it got. In lines
+     * mode, the bytes framed into the lines delivered to `onLines` so far.
+     */
+    readonly seq: number;
+    readonly onData: IEvent<string | Buffer>;
+    readonly onExit: IEvent<{ exitCode: number, signal?: number }>;
+    readonly onThrottle: IEvent<IThrottleEvent>;
+
+    /**
+     * Fired when the program sets the window title (OSC 0 or 2). The hub scans the output for
+     * these events natively as it reads it, they follow the data they were in.
+     */
+    readonly onTitleChange: IEvent<string>;
+
+    /**
+     * Fired when the program rings the bell (BEL outside of an escape sequence).
+     */
+    readonly onBell: IEvent<void>;
+
+    /**
+     * Fired when the shell reports its working directory (OSC 7).
+     */
+    readonly onCwdChange: IEvent<ICwdChangeEvent>;
+
+    /**
+     * Fired when the program sets or queries the clipboard (OSC 52). Acting on it is up to the
+     * listener.
+     */
+    readonly onClipboard: IEvent<IClipboardEvent>;
+
+    /**
+     * Fired when a command run by a shell with shell integration finishes (OSC 133 or 633 marks
+     * around the prompt, command line and output). The positions are sequence numbers, see `seq`,
+     * so the output of a command can be read back from the scrollback.
+     */
+    readonly onCommand: IEvent<ICommandEvent>;
+
+    /**
+     * Fired with the plain text of complete lines, when the terminal was spawned with `plainText`
+     * without a file.
+     */
+    readonly onPlainText: IEvent<string>;
+
+    /**
+     * Fired with the complete lines of the output when the terminal was spawned with
+     * `mode: 'lines'`, framed by the hub as it reads. `onData` is not fired then.
+     */
+    readonly onLines: IEvent<ILine[]>;
+
+    /**
+     * Fired with the links in the output when the terminal was spawned with `links`, found by the
+     * hub as it reads. A link is delivered once the word it is in ends, with or after the data it
+     * was in.
+     */
+    readonly onLinks: IEvent<ILink[]>;
+
+    /**
+     * What the read scheduler of the hub gave this terminal: the bytes read, the turns it was
+     * read in, the turns it used up its share in, and the total and longest time in microseconds
+     * it had output pending before it was read.
+     */
+    readonly fairness: { bytesRead: number, turns: number, deferred: number, waitUs: number, maxWaitUs: number };
+
+    /**
+     * The bytes this terminal holds against the memory budget by kind, and the milliseconds since
+     * it was last viewed.
+     */
+    readonly memoryUsage: { scrollback: number, writes: number, output: number, total: number, idleMs: number };
+
+    /**
+     * Marks the terminal as looked at, the memory budget reclaims from the least recently viewed
+     * terminals first.
+     */
+    markViewed(): void;
+
+    /**
+     * The output delivered after sequence number `seq`, for a client that reconnects after missing
+     * some. The scrollback is the retention window, see `IOutputSince.tooOld`.
+     * @throws When the terminal has no scrollback, seq is ahead of the output or output spilled to a
+     * file could not be read back.
+     */
+    readSince(seq: number): IOutputSince;
+
+    /**
+     * The matches of `query` in the output held by the scrollback, see `IScrollback.search`.
+     * @throws When the terminal has no scrollback or the regex is invalid.
+     */
+    search(query: string, options?: ISearchOptions): ISearchMatch[];
+
+    on(event: 'data', listener: (data: string | Buffer) => void): void;
+    on(event: 'exit', listener: (exitCode: number, signal?: number) => void): void;
+    resize(columns: number, rows: number): void;
+    write(data: string | Buffer): void;
+
+    /**
+     * Waits for one of the patterns in the output and resolves with the first match, the pattern
+     * whose match ends first, the first listed on a tie. The hub finds the literals of all
+     * patterns together as it reads, across reads, and the automaton of a pattern list is shared
+     * by the terminals that expect it. The output since the last match (a few KB) is kept, so
+     * text that arrived before the call still matches; a match uses up the output up to its end.
+     * Only one call may wait at a time.
+     * @throws (rejects) When no pattern matched within `timeout`, or the terminal closed first.
+     */
+    expect(patterns: ExpectPattern[], options?: IExpectOptions): Promise<IExpectMatch>;
+    getTermios(): ITermios;
+    setTermios(termios: 'default' | 'raw' | ITermios): void;
+
+    /**
+     * Stops reading the pty until `resume` is called, the program blocks once the pty buffer is
+     * full. A terminal throttled with `pause` stays paused until its rate is back under the limits.
+     */
+    pause(): void;
+    resume(): void;
+    kill(signal?: string): void;
+
+    /**
+     * Stops reading and closes the pty, then sends SIGHUP to the process.
+     */
+    destroy(): void;
+  }
+
   export interface IBasePtyForkOptions {
 
     /**
-     * Name of the terminal to be set in environment ($TERM variable).
+     * Name of the terminal to be set in environment ($TERM variable).
+     */
+    name?: string;
+
+    /**
+     * Number of intial cols of the pty.
+     */
+    cols?: number;
+
+    /**
+     * Number of initial rows of the pty.
+     */
+    rows?: number;
+
+    /**
+     * Working directory to be set for the child program.
+     */
+    cwd?: string;
+
+    /**
+     * Environment to be set for the child program.
+     */
+    env?: { [key: string]: string };
+
+    /**
+     * String encoding of the underlying pty.
+     * If set, incoming data will be decoded to strings and outgoing strings to bytes applying this encoding.
+     * If unset, incoming data will be delivered as raw bytes (Buffer type).
+     * By default 'utf8' is assumed, to unset it explicitly set it to `null`.
+     */
+    encoding?: string | null;
+
+    /**
+     * (EXPERIMENTAL)
+     * Whether to enable flow control handling (false by default). If enabled a message of `flowControlPause`
+     * will pause the socket and thus blocking the child program execution due to buffer back pressure.
+     * A message of `flowControlResume` will resume the socket into flow mode.
+     * For performance reasons only a single message as a whole will match (no message part matching).
+     * If flow control is enabled the `flowControlPause` and `flowControlResume` messages are not forwarded to
+     * the underlying pseudoterminal.
+     */
+    handleFlowControl?: boolean;
+
+    /**
+     * (EXPERIMENTAL)
+     * The string that should pause the pty when `handleFlowControl` is true. Default is XOFF ('\x13').
+     */
+    flowControlPause?: string;
+
+    /**
+     * (EXPERIMENTAL)
+     * The string that should resume the pty when `handleFlowControl` is true. Default is XON ('\x11').
+     */
+    flowControlResume?: string;
+
+    /**
+     * Watches the output rate of the terminal and fires `onThrottle` when it goes over either limit
+     * and again once it is back under both.
+     */
+    throttle?: IThrottleOptions;
+  }
+
+  export interface IThrottleOptions {
+    /**
+     * The output rate limit in bytes per second, counted before the output is decoded so every backend
+     * meters the same unit.
+     */
+    bytesPerSecond?: number;
+
+    /**
+     * The limit of data events per second.
+     */
+    eventsPerSecond?: number;
+
+    /**
+     * Whether to stop reading the pty while the terminal is over the limits, the program then
+     * blocks once the pty buffer is full. Defaults to false.
+     */
+    pause?: boolean;
+
+    /**
+     * The rates are moving averages that weigh output half as much after this many milliseconds.
+     * Defaults to 1000.
+     */
+    halfLife?: number;
+  }
+
+  export interface IThrottleEvent {
+    /**
+     * Whether the terminal went over the limits or is back under them.
+     */
+    throttled: boolean;
+    bytesPerSecond: number;
+    eventsPerSecond: number;
+  }
+
+  export interface IPtyForkOptions extends IBasePtyForkOptions {
+    /**
+     * Security warning: use this option with great caution, as opened file descriptors
+     * with higher privileges might leak to the child program.
+     */
+    uid?: number;
+    gid?: number;
+
+    /**
+     * The terminal attributes of the pty. `'default'` is the cooked mode node-pty always used,
+     * `'raw'` disables input/output processing, echo and signal characters so bytes pass the line
+     * discipline unchanged (no NL to CRNL translation), which suits non-interactive jobs streaming
+     * large outputs. An object overrides the given fields of the default attributes.
+     */
+    termios?: 'default' | 'raw' | ITermios;
+
+    /**
+     * Keeps the output of the terminal in a native store, see `IPty.scrollback`.
+     */
+    scrollback?: IScrollbackOptions;
+
+    /**
+     * Parses the output of the terminal into a native screen model, see `IPty.screen`.
+     */
+    screen?: IScreenOptions;
+
+    /**
+     * Strips the output of the terminal to plain text natively, for logs, see `IPty.plainText`.
+     */
+    plainText?: IPlainTextOptions;
+
+    /**
+     * `'lines'` delivers the output as complete lines to `onLines` instead of `onData` and `'data'`
+     * listeners, for log capture, defaults to `'data'`.
+     */
+    mode?: 'data' | 'lines';
+
+    /**
+     * How output is framed into lines in lines mode.
+     */
+    lines?: ILinesOptions;
+
+    /**
+     * Finds URLs and file paths in the output natively, see `IPty.onLinks`.
+     */
+    links?: ILinkOptions;
+  }
+
+  export interface ILinesOptions {
+    /**
+     * The longest line in bytes, longer ones are cut into several, defaults to 16384.
+     */
+    maxLength?: number;
+
+    /**
+     * A line that does not end is delivered as partial once the output was idle for this long,
+     * checked every `idleMs` milliseconds. Defaults to 1000, 0 waits for lines to end.
+     */
+    idleMs?: number;
+  }
+
+  /**
+   * A line of output. A line written over after a carriage return keeps what was written last,
+   * so a progress bar leaves its last state. Escape sequences are kept, the text is UTF-8 and has
+   * no line ending.
+   */
+  export interface ILine {
+    text: string;
+
+    /**
+     * When the line was framed, in milliseconds since the epoch.
+     */
+    time: number;
+
+    /**
+     * The line did not end: the output was idle or the terminal closed. What follows it starts a
+     * new line.
+     */
+    partial: boolean;
+  }
+
+  export interface ILinkOptions {
+    /**
+     * Whether to find URLs, a scheme followed by `://`. Defaults to true.
+     */
+    urls?: boolean;
+
+    /**
+     * Whether to find file paths: ones that start with `/`, `./`, `../` or `~/`, and others with
+     * a file extension or a `:line` or `:line:column` after them, of which a file name without a
+     * directory needs both. Defaults to true.
+     */
+    paths?: boolean;
+  }
+
+  /**
+   * A URL or file path in the output. Escape sequences within it (colors) are left out of the
+   * text but not the offsets.
+   */
+  export interface ILink {
+    type: 'url' | 'path';
+
+    /**
+     * The link as it is in the output, with the `:line:column` of a path.
+     */
+    text: string;
+
+    /**
+     * The sequence numbers of the first byte of the link and the byte after it, which are offsets
+     * in the scrollback.
+     */
+    start: number;
+    end: number;
+
+    /**
+     * The line and column given after a path, if any.
+     */
+    line?: number;
+    column?: number;
+  }
+
+  /**
+   * A pattern to expect: a literal, which may go on with a regex that must match right after it,
+   * e.g. `{ literal: 'Downloaded ', regex: /\d+ files/ }`. The regex is matched natively in
+   * ECMAScript syntax against up to 1 KB of the output read so far after the literal, only its
+   * `i` flag is supported. It runs in time linear in the output, so backreferences, lookarounds
+   * and named groups are not supported, and `i` only folds ASCII letters. Literals are 1 KB long
+   * at most.
+   */
+  export type ExpectPattern = string | { literal: string, regex?: RegExp };
+
+  export interface IExpectOptions {
+    /**
+     * Rejects when no pattern matched within this many milliseconds, waits forever by default.
+     */
+    timeout?: number;
+
+    /**
+     * Matches the literals ignoring ASCII case.
+     */
+    caseInsensitive?: boolean;
+  }
+
+  export interface ISearchOptions {
+    /**
+     * Whether the query is a regex in ECMAScript syntax, which matches within lines (without
+     * their `\r\n`). Lines longer than a scrollback segment may be missed. It runs in time linear
+     * in the output, with the syntax of `ExpectPattern` regexes. Defaults to false.
+     */
+    regex?: boolean;
+
+    /**
+     * Whether to ignore the case of ASCII letters. Defaults to false.
+     */
+    caseInsensitive?: boolean;
+
+    /**
+     * The matches returned at most, the oldest ones. Defaults to 1000.
+     */
+    limit?: number;
+  }
+
+  export interface ISearchMatch {
+    /**
+     * The byte offset of the match in the output and its length in bytes, see
+     * `IScrollback.read`.
+     */
+    offset: number;
+    length: number;
+
+    /**
+     * The line of the match, the newlines before it, see `IScrollback.readLines`.
+     */
+    line: number;
+  }
+
+  export interface IExpectMatch {
+    /**
+     * The index of the pattern that matched.
+     */
+    index: number;
+
+    /**
+     * The text of the match, the literal and what its regex matched. Run the regex on it again
+     * for its groups.
+     */
+    text: string;
+
+    /**
+     * The sequence numbers of the match, see `IHubPty.seq`.
+     */
+    start: number;
+    end: number;
+  }
+
+  export interface IPlainTextOptions {
+    /**
+     * A file to append the text to, created when it does not exist. Without it the text is
+     * delivered to `onPlainText`. The file is written by a thread of its own, see
+     * `IPlainTextStats.pending`.
+     */
+    file?: string;
+  }
+
+  export interface IPlainTextStats {
+    /**
+     * The lines ended so far.
+     */
+    lines: number;
+
+    /**
+     * The bytes of text delivered or written to the file.
+     */
+    bytes: number;
+
+    /**
+     * The bytes of text not yet written to the file. Once the terminal closed, the file is
+     * complete when this is 0. More than 16MB waiting for the disk fails the file with
+     * `ENOBUFS`.
+     */
+    pending: number;
+
+    /**
+     * The error code of the first failed write to the file, e.g. `ENOSPC`. Nothing is written
+     * after it.
+     */
+    error: string | null;
+  }
+
+  /**
+   * The plain text of the output of a terminal. Escape sequences (CSI, OSC, DCS and the like) are
+   * removed and a line overwritten after a carriage return or backspace keeps what was written
+   * last, as the terminal showed it, so a progress bar leaves its last state. A line is delivered
+   * once it ends, the last one when the terminal closes. The text is UTF-8.
+   */
+  export interface IPlainText {
+    readonly file: string | undefined;
+    readonly stats: IPlainTextStats;
+  }
+
+  export interface IScreenOptions {
+    /**
+     * The lines that scrolled off the top of the screen to keep, defaults to 1000.
+     */
+    scrollback?: number;
+  }
+
+  export interface IScreenState {
+    cols: number;
+    rows: number;
+
+    /**
+     * The cursor position, zero-based.
+     */
+    cursorX: number;
+    cursorY: number;
+    cursorVisible: boolean;
+
+    /**
+     * Whether the alternate screen (of full screen programs) is shown.
+     */
+    alternate: boolean;
+
+    /**
+     * Whether the program asked for application cursor keys and bracketed paste.
+     */
+    applicationCursor: boolean;
+    bracketedPaste: boolean;
+
+    /**
+     * The lines held in the scrollback.
+     */
+    scrollback: number;
+
+    /**
+     * The lines that ever scrolled off the top of the main screen, the lines that scrolled
+     * between two states are the difference.
+     */
+    saved: number;
+
+    /**
+     * Grows with every write that changes the screen, the cursor or the modes.
+     */
+    version: number;
+
+    /**
+     * The window title the program set.
      */
-    name?: string;
+    title: string;
+  }
 
+  export interface IScreenChanges extends IScreenState {
     /**
-     * Number of intial cols of the pty.
+     * The version the changes are since.
      */
-    cols?: number;
+    since: number;
 
     /**
-     * Number of initial rows of the pty.
+     * The rows changed, top to bottom.
      */
-    rows?: number;
+    lines: IScreenLineChange[];
 
     /**
-     * Working directory to be set for the child program.
+     * The bounding box of the changed cells, right and bottom exclusive; null when no cells
+     * changed.
      */
-    cwd?: string;
+    rect: { left: number, top: number, right: number, bottom: number } | null;
+  }
+
+  export interface IScreenLineChange {
+    y: number;
 
     /**
-     * Environment to be set for the child program.
+     * The columns [left, right) that changed. Whole rows are given when a row changed more than
+     * once since the version asked for, or moved.
      */
-    env?: { [key: string]: string };
+    left: number;
+    right: number;
 
     /**
-     * String encoding of the underlying pty.
-     * If set, incoming data will be decoded to strings and outgoing strings to bytes applying this encoding.
-     * If unset, incoming data will be delivered as raw bytes (Buffer type).
-     * By default 'utf8' is assumed, to unset it explicitly set it to `null`.
+     * Whether the line continues on the next row.
      */
-    encoding?: string | null;
+    wrapped: boolean;
 
     /**
-     * (EXPERIMENTAL)
-     * Whether to enable flow control handling (false by default). If enabled a message of `flowControlPause`
-     * will pause the socket and thus blocking the child program execution due to buffer back pressure.
-     * A message of `flowControlResume` will resume the socket into flow mode.
-     * For performance reasons only a single message as a whole will match (no message part matching).
-     * If flow control is enabled the `flowControlPause` and `flowControlResume` messages are not forwarded to
-     * the underlying pseudoterminal.
+     * The characters of columns left to right, with their combining marks; ' ' for a blank cell
+     * and '' for the column a wide character covers.
      */
-    handleFlowControl?: boolean;
+    chars: string[];
 
     /**
-     * (EXPERIMENTAL)
-     * The string that should pause the pty when `handleFlowControl` is true. Default is XOFF ('\x13').
+     * Runs of columns [start, end) with the same attributes. Colors are as in `IScreenCell`,
+     * flags has bits for bold (1), dim (2), italic (4), underline (8), blink (16), inverse (32),
+     * hidden (64) and strikethrough (128).
      */
-    flowControlPause?: string;
+    runs: { start: number, end: number, fg: number, bg: number, flags: number }[];
+  }
+
+  /**
+   * A line of a snapshot, cut after its last character. Characters, runs and colors are as in
+   * `IScreenLineChange`.
+   */
+  export interface IScreenLine {
+    wrapped: boolean;
+    chars: string[];
+    runs: { start: number, end: number, fg: number, bg: number, flags: number }[];
+  }
+
+  export interface IScreenSnapshot {
+    cols: number;
+    rows: number;
+    cursorX: number;
+    cursorY: number;
+    cursorVisible: boolean;
+    alternate: boolean;
+    applicationCursor: boolean;
+    bracketedPaste: boolean;
 
     /**
-     * (EXPERIMENTAL)
-     * The string that should resume the pty when `handleFlowControl` is true. Default is XON ('\x11').
+     * The modes of the terminal that output to come depends on: auto wrap (DECAWM), origin mode
+     * (DECOM), insert mode (IRM), new line mode (LNM) and whether the cursor wraps before the next
+     * character.
      */
-    flowControlResume?: string;
+    autowrap: boolean;
+    origin: boolean;
+    insert: boolean;
+    newline: boolean;
+    wrapPending: boolean;
+
+    /**
+     * The scroll region, rows top to bottom inclusive.
+     */
+    scrollTop: number;
+    scrollBottom: number;
+
+    /**
+     * The attributes characters are written with.
+     */
+    attributes: { fg: number, bg: number, flags: number };
+    version: number;
+    saved: number;
+    title: string;
+
+    /**
+     * The newest lines of the scrollback, oldest first.
+     */
+    scrollback: IScreenLine[];
+
+    /**
+     * The rows of the screen shown.
+     */
+    lines: IScreenLine[];
   }
 
-  export interface IPtyForkOptions extends IBasePtyForkOptions {
+  export interface IScreenCell {
     /**
-     * Security warning: use this option with great caution, as opened file descriptors
-     * with higher privileges might leak to the child program.
+     * The character in the cell with its combining marks, '' for a blank cell or the second
+     * column of a wide character.
      */
-    uid?: number;
-    gid?: number;
+    chars: string;
+
+    /**
+     * 2 for a wide character, 0 for the column it covers, 1 otherwise.
+     */
+    width: number;
+
+    /**
+     * Colors are -1 for the default color, 0 to 255 for the palette and 0x1000000 + 0xRRGGBB for
+     * direct colors.
+     */
+    fg: number;
+    bg: number;
+    bold: boolean;
+    dim: boolean;
+    italic: boolean;
+    underline: boolean;
+    blink: boolean;
+    inverse: boolean;
+    hidden: boolean;
+    strikethrough: boolean;
+  }
+
+  /**
+   * A headless model of what a terminal shows. Output is parsed natively, VT500 compatible, as it
+   * is read; there is no per-byte work in JS. Rows count from the top of the screen, the
+   * scrollback has negative rows (-1 is its newest line). Lines are not reflowed on resize.
+   */
+  export interface IScreen {
+    readonly state: IScreenState;
+
+    /**
+     * The rows of the screen joined by newlines.
+     */
+    readonly text: string;
+
+    /**
+     * The text of rows [start, end) without trailing blanks, the rows of the screen by default.
+     */
+    lines(start?: number, end?: number): string[];
+
+    /**
+     * The text of a row, '' when there is no such row.
+     */
+    line(row: number): string;
+
+    /**
+     * The cell at a column and row, null when there is none.
+     */
+    cell(x: number, y: number): IScreenCell | null;
+
+    /**
+     * The rows of the screen that changed after a version, for renderers that send row deltas
+     * rather than output. Pass `changes.version` as `since` next time, 0 gives all rows.
+     */
+    changes(since: number): IScreenChanges;
+
+    /**
+     * A compact binary snapshot of the screen shown: its cells run-length encoded, the cursor, the
+     * modes and the newest lines of the scrollback, to restore a client with one message. Decode it
+     * with `decodeScreenSnapshot`.
+     * @param scrollback The scrollback lines to include, 100 by default.
+     */
+    snapshot(scrollback?: number): Buffer;
+
+    /**
+     * Resets the screen as if the terminal was reset.
+     */
+    reset(): void;
+  }
+
+  export interface IScrollbackOptions {
+    /**
+     * The memory the store may hold in bytes, the oldest output is dropped beyond it. Defaults to
+     * 8MB.
+     */
+    limit?: number;
+
+    /**
+     * The bytes of output that are compressed and dropped together, defaults to 65536.
+     */
+    segmentSize?: number;
+
+    /**
+     * Whether full segments are compressed (LZ4) on a background thread, which typically holds
+     * 3-10x more output in the same memory. Defaults to true.
+     */
+    compress?: boolean;
+
+    /**
+     * A directory to spill output to instead of dropping it beyond `limit`. Spilled segments are
+     * appended to files in it and read back through memory maps, so the full output stays
+     * available while the memory held stays bounded. The files are removed when the terminal is
+     * destroyed.
+     */
+    directory?: string;
+
+    /**
+     * The bytes the spill files may take, the oldest output is dropped beyond it. Defaults to no
+     * limit.
+     */
+    diskLimit?: number;
+  }
+
+  export interface IScrollbackStats {
+    /**
+     * The offset and line of the oldest output held, and the offset and line after the newest.
+     */
+    start: number;
+    end: number;
+    startLine: number;
+    endLine: number;
+
+    /**
+     * The bytes held in memory and in spill files.
+     */
+    memory: number;
+    disk: number;
+
+    /**
+     * The bytes of the search index in memory, about 3% of the output indexed. It is charged to
+     * the memory budget but not to `limit`.
+     */
+    index: number;
+    segments: number;
+    compressed: number;
+    spilled: number;
+    files: number;
+
+    /**
+     * Segments that were dropped as they could not be written to the spill directory.
+     */
+    spillErrors: number;
+  }
+
+  export interface ICwdChangeEvent {
+    /**
+     * The directory, percent-decoded from the `file://` URL the shell sent.
+     */
+    path: string;
+
+    /**
+     * The host in the URL, empty when there was none.
+     */
+    host: string;
+  }
+
+  export interface IClipboardEvent {
+    /**
+     * The selections to set or query, e.g. `c` for the clipboard and `p` for the primary selection.
+     */
+    selection: string;
+
+    /**
+     * The text to copy, decoded from base64, or null when the program asks for the clipboard.
+     */
+    data: string | null;
+  }
+
+  export interface ICommandEvent {
+    /**
+     * Where the prompt started (mark A), -1 when the shell did not mark it.
+     */
+    promptStart: number;
+
+    /**
+     * Where the command line started, after the prompt (mark B), -1 when not marked.
+     */
+    commandStart: number;
+
+    /**
+     * The output of the command, from after the command line (mark C) to the end mark (D).
+     */
+    outputStart: number;
+    outputEnd: number;
+
+    /**
+     * The exit status the shell reported, null when it reported none.
+     */
+    exitCode: number | null;
+
+    /**
+     * The milliseconds from the command being executed to it finishing, as the output was read.
+     */
+    duration: number;
+  }
+
+  export interface IOutputSince {
+    /**
+     * Whether output from the sequence number asked for was dropped from the scrollback already,
+     * the client has to resync from a screen snapshot or the scrollback then.
+     */
+    tooOld: boolean;
+
+    /**
+     * The sequence numbers of the data and after it; offset is the oldest output held when too old.
+     */
+    offset: number;
+    end: number;
+
+    /**
+     * The output missed, empty when too old.
+     */
+    data: string | Buffer;
+  }
+
+  /**
+   * A bounded native store of the output of a terminal. Output is addressed by its byte offset
+   * since the terminal started; reading output that was dropped already starts at the oldest
+   * output held. Output is returned as a string in the encoding of the terminal, or a Buffer when
+   * the encoding is `null`.
+   */
+  export interface IScrollback {
+    /**
+     * The offset of the oldest output held and the offset after the newest.
+     */
+    readonly start: number;
+    readonly end: number;
+    readonly stats: IScrollbackStats;
+
+    /**
+     * The last output, up to the given number of bytes.
+     */
+    tail(bytes: number): string | Buffer;
+
+    /**
+     * The last lines of output, including an unterminated last line.
+     */
+    tailLines(lines: number): string | Buffer;
+
+    /**
+     * The output from offset on, at most length bytes, and the offset it actually starts at. It ends
+     * early before output spilled to a file that could not be read back.
+     */
+    read(offset: number, length?: number): { offset: number, data: string | Buffer };
+
+    /**
+     * The output from the start of a line on, at most count lines. Line 0 starts the output, the
+     * line and offset it actually starts at are returned too; the oldest line held may have lost
+     * its beginning.
+     */
+    readLines(line: number, count?: number): { offset: number, line: number, data: string | Buffer };
+
+    /**
+     * The matches of `query` in the output held, oldest first. Every segment keeps a bitmap of
+     * its trigrams, so only the segments that may hold the query, or the literal a regex cannot
+     * match without, are unpacked and scanned; output spilled to files stays indexed in memory.
+     * The raw output is searched, escape sequences included.
+     * @throws When the regex is invalid.
+     */
+    search(query: string, options?: ISearchOptions): ISearchMatch[];
+
+    /**
+     * Drops all output held, offsets continue after it.
+     */
+    clear(): void;
+
+    /**
+     * Marks the output as looked at like reading it does, see `configureMemoryBudget`.
+     */
+    markViewed(): void;
+  }
+
+  /**
+   * Terminal attributes, see termios(3). Flag values are platform specific, use `termiosFlags` to
+   * compose them.
+   */
+  export interface ITermios {
+    iflag?: number;
+    oflag?: number;
+    cflag?: number;
+    lflag?: number;
+    ispeed?: number;
+    ospeed?: number;
+
+    /**
+     * Control characters by name, eg. `{ VINTR: 3 }`.
+     */
+    cc?: { [name: string]: number };
   }
 
+  /**
+   * The termios flag values of the platform by name (eg. `ICANON`). Empty on Windows.
+   */
+  export const termiosFlags: { [name: string]: number };
+
+  /**
+   * The Unicode version the column widths of `columns` and the screen model follow, '' on Windows.
+   */
+  export const unicodeVersion: string;
+
+  /**
+   * The columns text takes in a terminal, counted natively with tables generated from the Unicode
+   * character database rather than the locale dependent `wcwidth`: East Asian wide and fullwidth
+   * characters and emoji take 2 columns, combining marks, format characters and controls none,
+   * ambiguous width characters 1. Escape sequences are not skipped.
+   * @param data The text, a Buffer is taken as UTF-8 and malformed bytes take a column each.
+   * @throws Will throw on Windows.
+   */
+  export function columns(data: string | Buffer): number;
+
   export interface IWindowsPtyForkOptions extends IBasePtyForkOptions {
     /**
      * Whether to use the ConPTY system on Windows. When this is not set, ConPTY will be used when
@@ -126,6 +1344,94 @@ declare module 'node-pty' {
      */
     readonly process: string;
 
+    /**
+     * The store of the output when the terminal was spawned with the `scrollback` option. This is
+     * not supported on Windows.
+     */
+    readonly scrollback?: IScrollback;
+
+    /**
+     * The screen model of the terminal when it was spawned with the `screen` option. This is not
+     * supported on Windows.
+     */
+    readonly screen?: IScreen;
+
+    /**
+     * The sequence number of the output, see `IHubPty.seq`. This is not supported on Windows.
+     */
+    readonly seq?: number;
+
+    /**
+     * The plain text channel when the terminal was spawned with the `plainText` option. This is
+     * not supported on Windows.
+     */
+    readonly plainText?: IPlainText;
+
+    /**
+     * Fired with the plain text of complete lines, see `IHubPty.onPlainText`. This is not
+     * supported on Windows.
+     */
+    readonly onPlainText?: IEvent<string>;
+
+    /**
+     * Fired with the complete lines of the output in lines mode, see `IHubPty.onLines`. This is
+     * not supported on Windows.
+     */
+    readonly onLines?: IEvent<ILine[]>;
+
+    /**
+     * Fired with the links in the output, see `IHubPty.onLinks`. This is not supported on
+     * Windows.
+     */
+    readonly onLinks?: IEvent<ILink[]>;
+
+    /**
+     * The output delivered after sequence number `seq`, see `IHubPty.readSince`. This is not
+     * supported on Windows.
+     */
+    readSince?(seq: number): IOutputSince;
+
+    /**
+     * The matches of `query` in the scrollback, see `IScrollback.search`. This is not supported
+     * on Windows.
+     */
+    search?(query: string, options?: ISearchOptions): ISearchMatch[];
+
+    /**
+     * Waits for one of the patterns in the output, see `IHubPty.expect`. Matching starts with the
+     * first call. This is not supported on Windows.
+     */
+    expect?(patterns: ExpectPattern[], options?: IExpectOptions): Promise<IExpectMatch>;
+
+    /**
+     * Fired when the program sets the window title, see `IHubPty.onTitleChange`. The output is
+     * scanned from the first subscription to one of these events on. This is not supported on
+     * Windows.
+     */
+    readonly onTitleChange?: IEvent<string>;
+
+    /**
+     * Fired when the program rings the bell. This is not supported on Windows.
+     */
+    readonly onBell?: IEvent<void>;
+
+    /**
+     * Fired when the shell reports its working directory (OSC 7). This is not supported on Windows.
+     */
+    readonly onCwdChange?: IEvent<ICwdChangeEvent>;
+
+    /**
+     * Fired when the program sets or queries the clipboard (OSC 52). This is not supported on
+     * Windows.
+     */
+    readonly onClipboard?: IEvent<IClipboardEvent>;
+
+    /**
+     * Fired when a command run by a shell with shell integration finishes, see
+     * `IHubPty.onCommand`. This is not supported on Windows.
+     */
+    readonly onCommand?: IEvent<ICommandEvent>;
+
     /**
      * (EXPERIMENTAL)
      * Whether to handle flow control. Useful to disable/re-enable flow control during runtime.
@@ -135,7 +1441,7 @@ declare module 'node-pty' {
 
     /**
      * Adds an event listener for when a data event fires. This happens when data is returned from
-     * the pty.
+     * the pty, except in lines mode (see `IPtyForkOptions.mode`).
      * @returns an `IDisposable` to stop listening.
      */
     readonly onData: IEvent<string>;
@@ -147,7 +1453,15 @@ declare module 'node-pty' {
     readonly onExit: IEvent<{ exitCode: number, signal?: number }>;
 
     /**
-     * Adds a listener to the data event, fired when data is returned from the pty.
+     * Adds an event listener for when the output rate goes over the limits of the `throttle`
+     * option and when it is back under them.
+     * @returns an `IDisposable` to stop listening.
+     */
+    readonly onThrottle: IEvent<IThrottleEvent>;
+
+    /**
+     * Adds a listener to the data event, fired when data is returned from the pty, except in lines
+     * mode as `onData`.
      * @param event The name of the event.
      * @param listener The callback function.
      * @deprecated Use IPty.onData
@@ -176,6 +1490,20 @@ declare module 'node-pty' {
      */
     write(data: string): void;
 
+    /**
+     * Gets the terminal attributes of the pty.
+     * @throws Will throw on Windows.
+     */
+    getTermios(): ITermios;
+
+    /**
+     * Sets the terminal attributes of the pty at runtime, fields that are not given keep their
+     * current value.
+     * @param termios A preset (`'default'` or `'raw'`) or the attributes to change.
+     * @throws Will throw on Windows.
+     */
+    setTermios(termios: 'default' | 'raw' | ITermios): void;
+
     /**
      * Kills the pty.
      * @param signal The signal to use, defaults to SIGHUP. This parameter is not supported on